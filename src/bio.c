@@ -61,18 +61,41 @@
 #include "server.h"
 #include "bio.h"
 
-static pthread_t bio_threads[BIO_NUM_OPS];
-static pthread_mutex_t bio_mutex[BIO_NUM_OPS];
-static pthread_cond_t bio_newjob_cond[BIO_NUM_OPS];
-static pthread_cond_t bio_step_cond[BIO_NUM_OPS];
-static list *bio_jobs[BIO_NUM_OPS];
+#ifdef HAVE_NUMA
+#include <numa.h>
+#endif
+
+/* Every thread is a "worker" serving a single job queue. The first
+ * BIO_NUM_OPS workers serve the job type with the same index. When
+ * numa-lazyfree-workers is enabled, one more BIO_LAZY_FREE worker per NUMA
+ * node follows them: objects are routed to the worker of the node their
+ * memory lives on, and that worker runs on the node's CPUs, so freeing
+ * touches socket-local memory and does not serialize all the sockets behind
+ * a single thread. */
+#define BIO_MAX_WORKERS (BIO_NUM_OPS+BIO_LAZY_FREE_MAX_NODES)
+
+static pthread_t bio_threads[BIO_MAX_WORKERS];
+static pthread_mutex_t bio_mutex[BIO_MAX_WORKERS];
+static pthread_cond_t bio_newjob_cond[BIO_MAX_WORKERS];
+static pthread_cond_t bio_step_cond[BIO_MAX_WORKERS];
+static list *bio_jobs[BIO_MAX_WORKERS];
 /* The following array is used to hold the number of pending jobs for every
  * OP type. This allows us to export the bioPendingJobsOfType() API that is
  * useful when the main thread wants to perform some operation that may involve
  * objects shared with the background thread. The main thread will just wait
  * that there are no longer jobs of this type to be executed before performing
  * the sensible operation. This data is also useful for reporting. */
-static unsigned long long bio_pending[BIO_NUM_OPS];
+static unsigned long long bio_pending[BIO_MAX_WORKERS];
+
+/* Number of workers actually spawned, and how many of them are per node
+ * lazyfree workers. Both are set by bioInit() and never change later. */
+static int bio_num_workers = BIO_NUM_OPS;
+static int bio_lazyfree_nodes = 0;
+
+/* Processed jobs and time spent processing them, per worker. Protected by
+ * the worker mutex like bio_pending. */
+static unsigned long long bio_processed[BIO_MAX_WORKERS];
+static unsigned long long bio_busy_usec[BIO_MAX_WORKERS];
 
 /* This structure represents a background Job. It is only used locally to this
  * file as the API does not expose the internals at all. */
@@ -86,6 +109,52 @@ struct bio_job {
 
 void *bioProcessBackgroundJobs(void *arg);
 
+/* Return the job type served by the specified worker. */
+static int bioWorkerType(int worker) {
+    return worker < BIO_NUM_OPS ? worker : BIO_LAZY_FREE;
+}
+
+/* Return the number of per node lazyfree workers to spawn, zero if the
+ * feature is disabled or NUMA is not available. */
+static int bioLazyFreeNodesToSpawn(void) {
+#ifdef HAVE_NUMA
+    if (!server.numa_lazyfree_workers || numa_available() < 0) return 0;
+    int nodes = numa_max_node()+1;
+    if (nodes > BIO_LAZY_FREE_MAX_NODES) nodes = BIO_LAZY_FREE_MAX_NODES;
+    return nodes;
+#else
+    return 0;
+#endif
+}
+
+/* Bind the calling lazyfree worker to the CPUs of 'node'. Memory only nodes
+ * (CXL expanders) have no CPUs: their objects are freed by the CPUs of the
+ * nearest node that has some. */
+static void bioBindLazyFreeWorker(int node) {
+#ifdef HAVE_NUMA
+    struct bitmask *cpus = numa_allocate_cpumask();
+    int target = -1, best = INT_MAX;
+
+    for (int n = 0; n <= numa_max_node(); n++) {
+        if (numa_node_to_cpus(n,cpus) != 0 || numa_bitmask_weight(cpus) == 0)
+            continue;
+        int dist = numa_distance(node,n);
+        if (n == node) dist = -1;
+        if (dist < best) {
+            best = dist;
+            target = n;
+        }
+    }
+    numa_free_cpumask(cpus);
+    if (target == -1 || numa_run_on_node(target) != 0) {
+        serverLog(LL_WARNING,
+            "Warning: can't bind the lazyfree worker of NUMA node %d", node);
+    }
+#else
+    UNUSED(node);
+#endif
+}
+
 /* Make sure we have enough stack to perform all the things we do in the
  * main thread. */
 #define REDIS_THREAD_STACK_SIZE (1024*1024*4)
@@ -97,13 +166,18 @@ void bioInit(void) {
     size_t stacksize;
     int j;
 
+    bio_lazyfree_nodes = bioLazyFreeNodesToSpawn();
+    bio_num_workers = BIO_NUM_OPS + bio_lazyfree_nodes;
+
     /* Initialization of state vars and objects */
-    for (j = 0; j < BIO_NUM_OPS; j++) {
+    for (j = 0; j < bio_num_workers; j++) {
         pthread_mutex_init(&bio_mutex[j],NULL);
         pthread_cond_init(&bio_newjob_cond[j],NULL);
         pthread_cond_init(&bio_step_cond[j],NULL);
         bio_jobs[j] = listCreate();
         bio_pending[j] = 0;
+        bio_processed[j] = 0;
+        bio_busy_usec[j] = 0;
     }
 
     /* Set the stack size as by default it may be small in some system */
@@ -114,9 +188,9 @@ void bioInit(void) {
     pthread_attr_setstacksize(&attr, stacksize);
 
     /* Ready to spawn our threads. We use the single argument the thread
-     * function accepts in order to pass the job ID the thread is
+     * function accepts in order to pass the worker ID the thread is
      * responsible of. */
-    for (j = 0; j < BIO_NUM_OPS; j++) {
+    for (j = 0; j < bio_num_workers; j++) {
         void *arg = (void*)(unsigned long) j;
         if (pthread_create(&thread,&attr,bioProcessBackgroundJobs,arg) != 0) {
             serverLog(LL_WARNING,"Fatal: Can't initialize Background Jobs.");
@@ -124,32 +198,54 @@ void bioInit(void) {
         }
         bio_threads[j] = thread;
     }
+    if (bio_lazyfree_nodes)
+        serverLog(LL_NOTICE,"Started %d per NUMA node lazyfree workers",
+            bio_lazyfree_nodes);
 }
 
-void bioSubmitJob(int type, struct bio_job *job) {
+void bioSubmitJob(int worker, struct bio_job *job) {
     job->time = time(NULL);
-    pthread_mutex_lock(&bio_mutex[type]);
-    listAddNodeTail(bio_jobs[type],job);
-    bio_pending[type]++;
-    pthread_cond_signal(&bio_newjob_cond[type]);
-    pthread_mutex_unlock(&bio_mutex[type]);
+    pthread_mutex_lock(&bio_mutex[worker]);
+    listAddNodeTail(bio_jobs[worker],job);
+    bio_pending[worker]++;
+    pthread_cond_signal(&bio_newjob_cond[worker]);
+    pthread_mutex_unlock(&bio_mutex[worker]);
 }
 
-void bioCreateLazyFreeJob(lazy_free_fn free_fn, int arg_count, ...) {
-    va_list valist;
+static struct bio_job *bioCreateLazyFreeJobV(lazy_free_fn free_fn, int arg_count, va_list valist) {
     /* Allocate memory for the job structure and all required
      * arguments */
     struct bio_job *job = zmalloc(sizeof(*job) + sizeof(void *) * (arg_count));
     job->free_fn = free_fn;
 
-    va_start(valist, arg_count);
     for (int i = 0; i < arg_count; i++) {
         job->free_args[i] = va_arg(valist, void *);
     }
+    return job;
+}
+
+void bioCreateLazyFreeJob(lazy_free_fn free_fn, int arg_count, ...) {
+    va_list valist;
+    va_start(valist, arg_count);
+    struct bio_job *job = bioCreateLazyFreeJobV(free_fn, arg_count, valist);
     va_end(valist);
     bioSubmitJob(BIO_LAZY_FREE, job);
 }
 
+/* Like bioCreateLazyFreeJob(), but the job is processed by the lazyfree
+ * worker of the NUMA node 'node', the node the memory to free lives on.
+ * Falls back to the shared lazyfree worker when there is no such worker. */
+void bioCreateLazyFreeJobOnNode(int node, lazy_free_fn free_fn, int arg_count, ...) {
+    va_list valist;
+    va_start(valist, arg_count);
+    struct bio_job *job = bioCreateLazyFreeJobV(free_fn, arg_count, valist);
+    va_end(valist);
+
+    int worker = BIO_LAZY_FREE;
+    if (node >= 0 && node < bio_lazyfree_nodes) worker = BIO_NUM_OPS + node;
+    bioSubmitJob(worker, job);
+}
+
 void bioCreateCloseJob(int fd) {
     struct bio_job *job = zmalloc(sizeof(*job));
     job->fd = fd;
@@ -166,17 +262,18 @@ void bioCreateFsyncJob(int fd) {
 
 void *bioProcessBackgroundJobs(void *arg) {
     struct bio_job *job;
-    unsigned long type = (unsigned long) arg;
+    unsigned long worker = (unsigned long) arg;
     sigset_t sigset;
 
-    /* Check that the type is within the right interval. */
-    if (type >= BIO_NUM_OPS) {
+    /* Check that the worker is within the right interval. */
+    if (worker >= (unsigned long) bio_num_workers) {
         serverLog(LL_WARNING,
-            "Warning: bio thread started with wrong type %lu",type);
+            "Warning: bio thread started with wrong worker %lu",worker);
         return NULL;
     }
+    int type = bioWorkerType(worker);
 
-    switch (type) {
+    switch (worker) {
     case BIO_CLOSE_FILE:
         redis_set_thread_title("bio_close_file");
         break;
@@ -186,13 +283,24 @@ void *bioProcessBackgroundJobs(void *arg) {
     case BIO_LAZY_FREE:
         redis_set_thread_title("bio_lazy_free");
         break;
+    default: {
+        char title[32];
+        snprintf(title,sizeof(title),"bio_lazyfree_%d",
+            (int)(worker-BIO_NUM_OPS) % BIO_LAZY_FREE_MAX_NODES);
+        redis_set_thread_title(title);
+        break;
+    }
     }
 
-    redisSetCpuAffinity(server.bio_cpulist);
+    /* An explicit bio_cpulist wins over the per node binding. */
+    if (worker >= BIO_NUM_OPS && !server.bio_cpulist)
+        bioBindLazyFreeWorker(worker-BIO_NUM_OPS);
+    else
+        redisSetCpuAffinity(server.bio_cpulist);
 
     makeThreadKillable();
 
-    pthread_mutex_lock(&bio_mutex[type]);
+    pthread_mutex_lock(&bio_mutex[worker]);
     /* Block SIGALRM so we are sure that only the main thread will
      * receive the watchdog signal. */
     sigemptyset(&sigset);
@@ -205,16 +313,17 @@ void *bioProcessBackgroundJobs(void *arg) {
         listNode *ln;
 
         /* The loop always starts with the lock hold. */
-        if (listLength(bio_jobs[type]) == 0) {
-            pthread_cond_wait(&bio_newjob_cond[type],&bio_mutex[type]);
+        if (listLength(bio_jobs[worker]) == 0) {
+            pthread_cond_wait(&bio_newjob_cond[worker],&bio_mutex[worker]);
             continue;
         }
         /* Pop the job from the queue. */
-        ln = listFirst(bio_jobs[type]);
+        ln = listFirst(bio_jobs[worker]);
         job = ln->value;
         /* It is now possible to unlock the background system as we know have
          * a stand alone job structure to process.*/
-        pthread_mutex_unlock(&bio_mutex[type]);
+        pthread_mutex_unlock(&bio_mutex[worker]);
+        long long start = ustime();
 
         /* Process the job accordingly to its type. */
         if (type == BIO_CLOSE_FILE) {
@@ -243,24 +352,37 @@ void *bioProcessBackgroundJobs(void *arg) {
             serverPanic("Wrong job type in bioProcessBackgroundJobs().");
         }
         zfree(job);
+        long long elapsed = ustime() - start;
 
         /* Lock again before reiterating the loop, if there are no longer
          * jobs to process we'll block again in pthread_cond_wait(). */
-        pthread_mutex_lock(&bio_mutex[type]);
-        listDelNode(bio_jobs[type],ln);
-        bio_pending[type]--;
+        pthread_mutex_lock(&bio_mutex[worker]);
+        listDelNode(bio_jobs[worker],ln);
+        bio_pending[worker]--;
+        bio_processed[worker]++;
+        bio_busy_usec[worker] += elapsed;
 
         /* Unblock threads blocked on bioWaitStepOfType() if any. */
-        pthread_cond_broadcast(&bio_step_cond[type]);
+        pthread_cond_broadcast(&bio_step_cond[worker]);
     }
 }
 
-/* Return the number of pending jobs of the specified type. */
-unsigned long long bioPendingJobsOfType(int type) {
+static unsigned long long bioPendingJobsOfWorker(int worker) {
     unsigned long long val;
-    pthread_mutex_lock(&bio_mutex[type]);
-    val = bio_pending[type];
-    pthread_mutex_unlock(&bio_mutex[type]);
+    pthread_mutex_lock(&bio_mutex[worker]);
+    val = bio_pending[worker];
+    pthread_mutex_unlock(&bio_mutex[worker]);
+    return val;
+}
+
+/* Return the number of pending jobs of the specified type, summing the
+ * queues of all the workers serving it. */
+unsigned long long bioPendingJobsOfType(int type) {
+    unsigned long long val = bioPendingJobsOfWorker(type);
+    if (type == BIO_LAZY_FREE) {
+        for (int j = BIO_NUM_OPS; j < bio_num_workers; j++)
+            val += bioPendingJobsOfWorker(j);
+    }
     return val;
 }
 
@@ -275,15 +397,39 @@ unsigned long long bioPendingJobsOfType(int type) {
  * a bio.c thread to do more work in a blocking way.
  */
 unsigned long long bioWaitStepOfType(int type) {
-    unsigned long long val;
-    pthread_mutex_lock(&bio_mutex[type]);
-    val = bio_pending[type];
-    if (val != 0) {
-        pthread_cond_wait(&bio_step_cond[type],&bio_mutex[type]);
-        val = bio_pending[type];
+    /* With per node lazyfree workers, wait for the first worker of the
+     * type that has pending jobs. */
+    int worker = type;
+    for (int j = 0; j < bio_num_workers; j++) {
+        if (bioWorkerType(j) == type && bioPendingJobsOfWorker(j)) {
+            worker = j;
+            break;
+        }
     }
-    pthread_mutex_unlock(&bio_mutex[type]);
-    return val;
+
+    pthread_mutex_lock(&bio_mutex[worker]);
+    if (bio_pending[worker] != 0)
+        pthread_cond_wait(&bio_step_cond[worker],&bio_mutex[worker]);
+    pthread_mutex_unlock(&bio_mutex[worker]);
+    return bioPendingJobsOfType(type);
+}
+
+/* Return the number of per NUMA node lazyfree workers, zero when disabled. */
+int bioLazyFreeNodeWorkers(void) {
+    return bio_lazyfree_nodes;
+}
+
+/* Fill 'stats' with the queue depth and the work done by the lazyfree worker
+ * of the NUMA node 'node'. Returns C_ERR if there is no such worker. */
+int bioGetLazyFreeNodeStats(int node, bioWorkerStats *stats) {
+    if (node < 0 || node >= bio_lazyfree_nodes) return C_ERR;
+    int worker = BIO_NUM_OPS + node;
+    pthread_mutex_lock(&bio_mutex[worker]);
+    stats->pending = bio_pending[worker];
+    stats->processed = bio_processed[worker];
+    stats->busy_usec = bio_busy_usec[worker];
+    pthread_mutex_unlock(&bio_mutex[worker]);
+    return C_OK;
 }
 
 /* Kill the running bio threads in an unclean way. This function should be
@@ -293,16 +439,16 @@ unsigned long long bioWaitStepOfType(int type) {
 void bioKillThreads(void) {
     int err, j;
 
-    for (j = 0; j < BIO_NUM_OPS; j++) {
+    for (j = 0; j < bio_num_workers; j++) {
         if (bio_threads[j] == pthread_self()) continue;
         if (bio_threads[j] && pthread_cancel(bio_threads[j]) == 0) {
             if ((err = pthread_join(bio_threads[j],NULL)) != 0) {
                 serverLog(LL_WARNING,
-                    "Bio thread for job type #%d can not be joined: %s",
+                    "Bio thread for worker #%d can not be joined: %s",
                         j, strerror(err));
             } else {
                 serverLog(LL_WARNING,
-                    "Bio thread for job type #%d terminated",j);
+                    "Bio thread for worker #%d terminated",j);
             }
         }
     }
@@ -32,6 +32,13 @@
 
 typedef void lazy_free_fn(void *args[]);
 
+/* Work done by a background worker, see bioGetLazyFreeNodeStats(). */
+typedef struct bioWorkerStats {
+    unsigned long long pending;     /* Jobs waiting in the queue. */
+    unsigned long long processed;   /* Jobs processed so far. */
+    unsigned long long busy_usec;   /* Time spent processing them. */
+} bioWorkerStats;
+
 /* Exported API */
 void bioInit(void);
 unsigned long long bioPendingJobsOfType(int type);
@@ -41,6 +48,9 @@ void bioKillThreads(void);
 void bioCreateCloseJob(int fd);
 void bioCreateFsyncJob(int fd);
 void bioCreateLazyFreeJob(lazy_free_fn free_fn, int arg_count, ...);
+void bioCreateLazyFreeJobOnNode(int node, lazy_free_fn free_fn, int arg_count, ...);
+int bioLazyFreeNodeWorkers(void);
+int bioGetLazyFreeNodeStats(int node, bioWorkerStats *stats);
 
 /* Background job opcodes */
 #define BIO_CLOSE_FILE    0 /* Deferred close(2) syscall. */
@@ -48,4 +58,7 @@ void bioCreateLazyFreeJob(lazy_free_fn free_fn, int arg_count, ...);
 #define BIO_LAZY_FREE     2 /* Deferred objects freeing. */
 #define BIO_NUM_OPS       3
 
+/* Max number of per NUMA node lazyfree workers. */
+#define BIO_LAZY_FREE_MAX_NODES 16
+
 #endif
@@ -30,18 +30,44 @@
 
 #include "server.h"
 
+#ifdef HAVE_X86_SIMD_DISPATCH
+#include <immintrin.h>
+#endif
+
 /* -----------------------------------------------------------------------------
  * Helpers and low level bit functions.
  * -------------------------------------------------------------------------- */
 
-/* Count number of bits set in the binary array pointed by 's' and long
- * 'count' bytes. The implementation of this function is required to
- * work with an input string length up to 512 MB or more (server.proto_max_bulk_len) */
-long long redisPopcount(void *s, long count) {
+/* The hot loops of BITCOUNT, BITPOS and BITOP have a portable implementation
+ * plus, on x86-64, AVX2 / AVX-512 versions compiled with per function target
+ * attributes. The best kernel the CPU supports is selected the first time
+ * it is needed, so the same binary runs everywhere. Kernels only handle
+ * whole blocks: the callers finish the last bytes, and the vector kernels
+ * hand what is shorter than a vector block to the word sized code. */
+typedef long long (*popcountKernel)(const unsigned char *p, long count);
+typedef unsigned long (*bitposSkipKernel)(const unsigned char *p,
+                                          unsigned long count, int bit);
+typedef unsigned long (*bitopKernel)(int op, unsigned char *res,
+                                     unsigned char **src, unsigned long numkeys,
+                                     unsigned long j, unsigned long len);
+
+static popcountKernel popcountImpl = NULL;
+static bitposSkipKernel bitposSkipImpl = NULL;
+static bitopKernel bitopImpl = NULL;
+static const char *bitopsKernelName = NULL;
+
+#define BITOP_AND   0
+#define BITOP_OR    1
+#define BITOP_XOR   2
+#define BITOP_NOT   3
+
+static const unsigned char bitsinbyte[256] = {0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4,1,2,2,3,2,3,3,4,2,3,3,4,3,4,4,5,1,2,2,3,2,3,3,4,2,3,3,4,3,4,4,5,2,3,3,4,3,4,4,5,3,4,4,5,4,5,5,6,1,2,2,3,2,3,3,4,2,3,3,4,3,4,4,5,2,3,3,4,3,4,4,5,3,4,4,5,4,5,5,6,2,3,3,4,3,4,4,5,3,4,4,5,4,5,5,6,3,4,4,5,4,5,5,6,4,5,5,6,5,6,6,7,1,2,2,3,2,3,3,4,2,3,3,4,3,4,4,5,2,3,3,4,3,4,4,5,3,4,4,5,4,5,5,6,2,3,3,4,3,4,4,5,3,4,4,5,4,5,5,6,3,4,4,5,4,5,5,6,4,5,5,6,5,6,6,7,2,3,3,4,3,4,4,5,3,4,4,5,4,5,5,6,3,4,4,5,4,5,5,6,4,5,5,6,5,6,6,7,3,4,4,5,4,5,5,6,4,5,5,6,5,6,6,7,4,5,5,6,5,6,6,7,5,6,6,7,6,7,7,8};
+
+/* Portable popcount: table lookup up to 32 bit alignment, then the classic
+ * SWAR bit trick 28 bytes at a time. */
+static long long popcountGeneric(const unsigned char *p, long count) {
     long long bits = 0;
-    unsigned char *p = s;
-    uint32_t *p4;
-    static const unsigned char bitsinbyte[256] = {0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4,1,2,2,3,2,3,3,4,2,3,3,4,3,4,4,5,1,2,2,3,2,3,3,4,2,3,3,4,3,4,4,5,2,3,3,4,3,4,4,5,3,4,4,5,4,5,5,6,1,2,2,3,2,3,3,4,2,3,3,4,3,4,4,5,2,3,3,4,3,4,4,5,3,4,4,5,4,5,5,6,2,3,3,4,3,4,4,5,3,4,4,5,4,5,5,6,3,4,4,5,4,5,5,6,4,5,5,6,5,6,6,7,1,2,2,3,2,3,3,4,2,3,3,4,3,4,4,5,2,3,3,4,3,4,4,5,3,4,4,5,4,5,5,6,2,3,3,4,3,4,4,5,3,4,4,5,4,5,5,6,3,4,4,5,4,5,5,6,4,5,5,6,5,6,6,7,2,3,3,4,3,4,4,5,3,4,4,5,4,5,5,6,3,4,4,5,4,5,5,6,4,5,5,6,5,6,6,7,3,4,4,5,4,5,5,6,4,5,5,6,5,6,6,7,4,5,5,6,5,6,6,7,5,6,6,7,6,7,7,8};
+    const uint32_t *p4;
 
     /* Count initial bytes not aligned to 32 bit. */
     while((unsigned long)p & 3 && count) {
@@ -50,7 +76,7 @@ long long redisPopcount(void *s, long count) {
     }
 
     /* Count bits 28 bytes at a time */
-    p4 = (uint32_t*)p;
+    p4 = (const uint32_t*)p;
     while(count>=28) {
         uint32_t aux1, aux2, aux3, aux4, aux5, aux6, aux7;
 
@@ -86,11 +112,346 @@ long long redisPopcount(void *s, long count) {
                     ((aux7 + (aux7 >> 4)) & 0x0F0F0F0F))* 0x01010101) >> 24;
     }
     /* Count the remaining bytes. */
-    p = (unsigned char*)p4;
+    p = (const unsigned char*)p4;
     while(count--) bits += bitsinbyte[*p++];
     return bits;
 }
 
+/* The word at a time loop of redisBitpos() is the portable BITPOS code, so
+ * the generic kernel skips nothing. */
+static unsigned long bitposSkipGeneric(const unsigned char *p,
+                                       unsigned long count, int bit) {
+    UNUSED(p);
+    UNUSED(count);
+    UNUSED(bit);
+    return 0;
+}
+
+/* Portable BITOP of the bytes from 'j' to 'len' (that all the sources have)
+ * four words at a time. Returns the offset of the first byte not processed.
+ * On ARM we skip it since it will result in GCC compiling the code using
+ * multiple-words load/store operations that are not supported even in
+ * ARM >= v6, the caller goes byte by byte. */
+static unsigned long bitopGeneric(int op, unsigned char *res,
+                                  unsigned char **src, unsigned long numkeys,
+                                  unsigned long j, unsigned long len) {
+#ifdef USE_ALIGNED_ACCESS
+    UNUSED(op);
+    UNUSED(res);
+    UNUSED(src);
+    UNUSED(numkeys);
+    UNUSED(len);
+    return j;
+#else
+    unsigned long i;
+
+    /* Note: sds pointer is always aligned to 8 byte boundary. */
+    for (; len-j >= sizeof(unsigned long)*4; j += sizeof(unsigned long)*4) {
+        unsigned long *lres = (unsigned long*) (res+j);
+        unsigned long *l = (unsigned long*) (src[0]+j);
+
+        lres[0] = l[0];
+        lres[1] = l[1];
+        lres[2] = l[2];
+        lres[3] = l[3];
+        for (i = 1; i < numkeys; i++) {
+            l = (unsigned long*) (src[i]+j);
+            if (op == BITOP_AND) {
+                lres[0] &= l[0];
+                lres[1] &= l[1];
+                lres[2] &= l[2];
+                lres[3] &= l[3];
+            } else if (op == BITOP_OR) {
+                lres[0] |= l[0];
+                lres[1] |= l[1];
+                lres[2] |= l[2];
+                lres[3] |= l[3];
+            } else {
+                lres[0] ^= l[0];
+                lres[1] ^= l[1];
+                lres[2] ^= l[2];
+                lres[3] ^= l[3];
+            }
+        }
+        if (op == BITOP_NOT) {
+            lres[0] = ~lres[0];
+            lres[1] = ~lres[1];
+            lres[2] = ~lres[2];
+            lres[3] = ~lres[3];
+        }
+    }
+    return j;
+#endif
+}
+
+#ifdef HAVE_X86_SIMD_DISPATCH
+/* POPCNT instruction on four independent 64 bit accumulators, so that the
+ * three cycles latency of popcnt is hidden. Also used for the tails of the
+ * vector kernels. */
+__attribute__((target("popcnt")))
+static long long popcountPopcnt(const unsigned char *p, long count) {
+    uint64_t a = 0, b = 0, c = 0, d = 0, w[4];
+
+    while (count >= 32) {
+        memcpy(w,p,sizeof(w));
+        a += __builtin_popcountll(w[0]);
+        b += __builtin_popcountll(w[1]);
+        c += __builtin_popcountll(w[2]);
+        d += __builtin_popcountll(w[3]);
+        p += 32;
+        count -= 32;
+    }
+    while (count >= 8) {
+        memcpy(w,p,sizeof(w[0]));
+        a += __builtin_popcountll(w[0]);
+        p += 8;
+        count -= 8;
+    }
+    while (count--) b += __builtin_popcount(*p++);
+    return a+b+c+d;
+}
+
+/* AVX2 popcount using the nibble lookup table trick: VPSHUFB counts the bits
+ * of every nibble, the per byte counts of 8 vectors are summed (at most 64,
+ * so no byte overflows) and then folded into 64 bit lanes with VPSADBW. */
+__attribute__((target("avx2,popcnt")))
+static long long popcountAVX2(const unsigned char *p, long count) {
+    const __m256i lookup = _mm256_setr_epi8(
+        0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4,
+        0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4);
+    const __m256i low = _mm256_set1_epi8(0x0f);
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i acc = _mm256_setzero_si256();
+
+    while (count >= 256) {
+        __m256i local = _mm256_setzero_si256();
+        for (int i = 0; i < 8; i++) {
+            __m256i v = _mm256_loadu_si256((const __m256i*)(p+i*32));
+            __m256i lo = _mm256_and_si256(v,low);
+            __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v,4),low);
+            local = _mm256_add_epi8(local,_mm256_shuffle_epi8(lookup,lo));
+            local = _mm256_add_epi8(local,_mm256_shuffle_epi8(lookup,hi));
+        }
+        acc = _mm256_add_epi64(acc,_mm256_sad_epu8(local,zero));
+        p += 256;
+        count -= 256;
+    }
+    return (long long)_mm256_extract_epi64(acc,0) +
+           _mm256_extract_epi64(acc,1) +
+           _mm256_extract_epi64(acc,2) +
+           _mm256_extract_epi64(acc,3) +
+           popcountPopcnt(p,count);
+}
+
+/* AVX-512 VPOPCNTQ: one instruction per 64 bytes, four vectors in flight. */
+__attribute__((target("avx512f,avx512vpopcntdq,popcnt")))
+static long long popcountAVX512(const unsigned char *p, long count) {
+    __m512i a = _mm512_setzero_si512(), b = _mm512_setzero_si512();
+    __m512i c = _mm512_setzero_si512(), d = _mm512_setzero_si512();
+
+    while (count >= 256) {
+        a = _mm512_add_epi64(a,_mm512_popcnt_epi64(_mm512_loadu_si512(p)));
+        b = _mm512_add_epi64(b,_mm512_popcnt_epi64(_mm512_loadu_si512(p+64)));
+        c = _mm512_add_epi64(c,_mm512_popcnt_epi64(_mm512_loadu_si512(p+128)));
+        d = _mm512_add_epi64(d,_mm512_popcnt_epi64(_mm512_loadu_si512(p+192)));
+        p += 256;
+        count -= 256;
+    }
+    while (count >= 64) {
+        a = _mm512_add_epi64(a,_mm512_popcnt_epi64(_mm512_loadu_si512(p)));
+        p += 64;
+        count -= 64;
+    }
+    a = _mm512_add_epi64(_mm512_add_epi64(a,b),_mm512_add_epi64(c,d));
+    return _mm512_reduce_add_epi64(a) + popcountPopcnt(p,count);
+}
+
+/* Skip 32 byte blocks that are all zero (looking for a one) or all ones
+ * (looking for a zero). Returns the number of bytes skipped; the block
+ * holding the first interesting bit is left to the caller. */
+__attribute__((target("avx2")))
+static unsigned long bitposSkipAVX2(const unsigned char *p,
+                                    unsigned long count, int bit) {
+    const __m256i skip = bit ? _mm256_setzero_si256() : _mm256_set1_epi8(-1);
+    unsigned long j = 0;
+
+    while (count-j >= 128) {
+        __m256i x = _mm256_or_si256(
+            _mm256_or_si256(
+                _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(p+j)),skip),
+                _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(p+j+32)),skip)),
+            _mm256_or_si256(
+                _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(p+j+64)),skip),
+                _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(p+j+96)),skip)));
+        if (!_mm256_testz_si256(x,x)) break;
+        j += 128;
+    }
+    while (count-j >= 32) {
+        __m256i x = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(p+j)),skip);
+        if (!_mm256_testz_si256(x,x)) break;
+        j += 32;
+    }
+    return j;
+}
+
+__attribute__((target("avx512f")))
+static unsigned long bitposSkipAVX512(const unsigned char *p,
+                                      unsigned long count, int bit) {
+    const __m512i skip = bit ? _mm512_setzero_si512() : _mm512_set1_epi64(-1);
+    unsigned long j = 0;
+
+    while (count-j >= 256) {
+        __m512i x = _mm512_or_si512(
+            _mm512_or_si512(_mm512_xor_si512(_mm512_loadu_si512(p+j),skip),
+                            _mm512_xor_si512(_mm512_loadu_si512(p+j+64),skip)),
+            _mm512_or_si512(_mm512_xor_si512(_mm512_loadu_si512(p+j+128),skip),
+                            _mm512_xor_si512(_mm512_loadu_si512(p+j+192),skip)));
+        if (_mm512_test_epi64_mask(x,x)) break;
+        j += 256;
+    }
+    while (count-j >= 64) {
+        __m512i x = _mm512_xor_si512(_mm512_loadu_si512(p+j),skip);
+        if (_mm512_test_epi64_mask(x,x)) break;
+        j += 64;
+    }
+    return j;
+}
+
+/* Vector BITOP, same contract as bitopGeneric(). Every block of four vectors
+ * is loaded from the first source, combined with the same block of the other
+ * sources and stored once, so the destination is written a single time
+ * whatever the number of keys. */
+__attribute__((target("avx2")))
+static unsigned long bitopAVX2(int op, unsigned char *res,
+                               unsigned char **src, unsigned long numkeys,
+                               unsigned long j, unsigned long len) {
+    unsigned long i;
+
+    for (; len-j >= 128; j += 128) {
+        __m256i r0 = _mm256_loadu_si256((const __m256i*)(src[0]+j));
+        __m256i r1 = _mm256_loadu_si256((const __m256i*)(src[0]+j+32));
+        __m256i r2 = _mm256_loadu_si256((const __m256i*)(src[0]+j+64));
+        __m256i r3 = _mm256_loadu_si256((const __m256i*)(src[0]+j+96));
+
+        for (i = 1; i < numkeys; i++) {
+            const __m256i *s = (const __m256i*)(src[i]+j);
+            __m256i s0 = _mm256_loadu_si256(s);
+            __m256i s1 = _mm256_loadu_si256(s+1);
+            __m256i s2 = _mm256_loadu_si256(s+2);
+            __m256i s3 = _mm256_loadu_si256(s+3);
+            if (op == BITOP_AND) {
+                r0 = _mm256_and_si256(r0,s0); r1 = _mm256_and_si256(r1,s1);
+                r2 = _mm256_and_si256(r2,s2); r3 = _mm256_and_si256(r3,s3);
+            } else if (op == BITOP_OR) {
+                r0 = _mm256_or_si256(r0,s0); r1 = _mm256_or_si256(r1,s1);
+                r2 = _mm256_or_si256(r2,s2); r3 = _mm256_or_si256(r3,s3);
+            } else {
+                r0 = _mm256_xor_si256(r0,s0); r1 = _mm256_xor_si256(r1,s1);
+                r2 = _mm256_xor_si256(r2,s2); r3 = _mm256_xor_si256(r3,s3);
+            }
+        }
+        if (op == BITOP_NOT) {
+            const __m256i ones = _mm256_set1_epi8(-1);
+            r0 = _mm256_xor_si256(r0,ones); r1 = _mm256_xor_si256(r1,ones);
+            r2 = _mm256_xor_si256(r2,ones); r3 = _mm256_xor_si256(r3,ones);
+        }
+        _mm256_storeu_si256((__m256i*)(res+j),r0);
+        _mm256_storeu_si256((__m256i*)(res+j+32),r1);
+        _mm256_storeu_si256((__m256i*)(res+j+64),r2);
+        _mm256_storeu_si256((__m256i*)(res+j+96),r3);
+    }
+    return bitopGeneric(op,res,src,numkeys,j,len);
+}
+
+__attribute__((target("avx512f")))
+static unsigned long bitopAVX512(int op, unsigned char *res,
+                                 unsigned char **src, unsigned long numkeys,
+                                 unsigned long j, unsigned long len) {
+    unsigned long i;
+
+    for (; len-j >= 256; j += 256) {
+        __m512i r0 = _mm512_loadu_si512(src[0]+j);
+        __m512i r1 = _mm512_loadu_si512(src[0]+j+64);
+        __m512i r2 = _mm512_loadu_si512(src[0]+j+128);
+        __m512i r3 = _mm512_loadu_si512(src[0]+j+192);
+
+        for (i = 1; i < numkeys; i++) {
+            const unsigned char *s = src[i]+j;
+            __m512i s0 = _mm512_loadu_si512(s);
+            __m512i s1 = _mm512_loadu_si512(s+64);
+            __m512i s2 = _mm512_loadu_si512(s+128);
+            __m512i s3 = _mm512_loadu_si512(s+192);
+            if (op == BITOP_AND) {
+                r0 = _mm512_and_si512(r0,s0); r1 = _mm512_and_si512(r1,s1);
+                r2 = _mm512_and_si512(r2,s2); r3 = _mm512_and_si512(r3,s3);
+            } else if (op == BITOP_OR) {
+                r0 = _mm512_or_si512(r0,s0); r1 = _mm512_or_si512(r1,s1);
+                r2 = _mm512_or_si512(r2,s2); r3 = _mm512_or_si512(r3,s3);
+            } else {
+                r0 = _mm512_xor_si512(r0,s0); r1 = _mm512_xor_si512(r1,s1);
+                r2 = _mm512_xor_si512(r2,s2); r3 = _mm512_xor_si512(r3,s3);
+            }
+        }
+        if (op == BITOP_NOT) {
+            const __m512i ones = _mm512_set1_epi64(-1);
+            r0 = _mm512_xor_si512(r0,ones); r1 = _mm512_xor_si512(r1,ones);
+            r2 = _mm512_xor_si512(r2,ones); r3 = _mm512_xor_si512(r3,ones);
+        }
+        _mm512_storeu_si512(res+j,r0);
+        _mm512_storeu_si512(res+j+64,r1);
+        _mm512_storeu_si512(res+j+128,r2);
+        _mm512_storeu_si512(res+j+192,r3);
+    }
+    return bitopGeneric(op,res,src,numkeys,j,len);
+}
+#endif /* HAVE_X86_SIMD_DISPATCH */
+
+/* Select the kernels for the running CPU. Called lazily: racing callers
+ * (module threads) just compute and store the same pointers. */
+static void bitopsSelectKernels(void) {
+    popcountKernel popcount = popcountGeneric;
+    bitposSkipKernel bitpos = bitposSkipGeneric;
+    bitopKernel bitop = bitopGeneric;
+    const char *name = "generic";
+
+#ifdef HAVE_X86_SIMD_DISPATCH
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("popcnt")) {
+        popcount = popcountPopcnt;
+        name = "popcnt";
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) {
+        popcount = popcountAVX2;
+        bitpos = bitposSkipAVX2;
+        bitop = bitopAVX2;
+        name = "avx2";
+    }
+    if (__builtin_cpu_supports("avx512f")) {
+        bitpos = bitposSkipAVX512;
+        bitop = bitopAVX512;
+        name = "avx512";
+        if (__builtin_cpu_supports("avx512vpopcntdq") &&
+            __builtin_cpu_supports("popcnt"))
+        {
+            popcount = popcountAVX512;
+        }
+    }
+#endif
+
+    bitopsKernelName = name;
+    bitopImpl = bitop;
+    bitposSkipImpl = bitpos;
+    popcountImpl = popcount;
+}
+
+/* Count number of bits set in the binary array pointed by 's' and long
+ * 'count' bytes. The implementation of this function is required to
+ * work with an input string length up to 512 MB or more (server.proto_max_bulk_len) */
+long long redisPopcount(void *s, long count) {
+    if (popcountImpl == NULL) bitopsSelectKernels();
+    return popcountImpl(s,count);
+}
+
 /* Return the position of the first bit set to one (if 'bit' is 1) or
  * zero (if 'bit' is 0) in the bitmap starting at 's' and long 'count' bytes.
  *
@@ -129,6 +490,16 @@ long long redisBitpos(void *s, unsigned long count, int bit) {
         pos += 8;
     }
 
+    /* Skip whole vector blocks when a SIMD kernel is available. What it
+     * skips is a multiple of the word size, so 'c' stays aligned. */
+    if (!found) {
+        if (bitposSkipImpl == NULL) bitopsSelectKernels();
+        j = bitposSkipImpl(c,count,bit);
+        c += j;
+        count -= j;
+        pos += (long long)j*8;
+    }
+
     /* Skip bits with full word step. */
     l = (unsigned long*) c;
     if (!found) {
@@ -395,11 +766,6 @@ void printBits(unsigned char *p, unsigned long count) {
  * Bits related string commands: GETBIT, SETBIT, BITCOUNT, BITOP.
  * -------------------------------------------------------------------------- */
 
-#define BITOP_AND   0
-#define BITOP_OR    1
-#define BITOP_XOR   2
-#define BITOP_NOT   3
-
 #define BITFIELDOP_GET 0
 #define BITFIELDOP_SET 1
 #define BITFIELDOP_INCRBY 2
@@ -663,73 +1029,13 @@ void bitopCommand(client *c) {
         unsigned long i;
 
         /* Fast path: as far as we have data for all the input bitmaps we
-         * can take a fast path that performs much better than the
-         * vanilla algorithm. On ARM we skip the fast path since it will
-         * result in GCC compiling the code using multiple-words load/store
-         * operations that are not supported even in ARM >= v6. */
+         * can take a fast path (a vector kernel where the CPU has one)
+         * that performs much better than the vanilla algorithm. */
         j = 0;
-        #ifndef USE_ALIGNED_ACCESS
-        if (minlen >= sizeof(unsigned long)*4 && numkeys <= 16) {
-            unsigned long *lp[16];
-            unsigned long *lres = (unsigned long*) res;
-
-            /* Note: sds pointer is always aligned to 8 byte boundary. */
-            memcpy(lp,src,sizeof(unsigned long*)*numkeys);
-            memcpy(res,src[0],minlen);
-
-            /* Different branches per different operations for speed (sorry). */
-            if (op == BITOP_AND) {
-                while(minlen >= sizeof(unsigned long)*4) {
-                    for (i = 1; i < numkeys; i++) {
-                        lres[0] &= lp[i][0];
-                        lres[1] &= lp[i][1];
-                        lres[2] &= lp[i][2];
-                        lres[3] &= lp[i][3];
-                        lp[i]+=4;
-                    }
-                    lres+=4;
-                    j += sizeof(unsigned long)*4;
-                    minlen -= sizeof(unsigned long)*4;
-                }
-            } else if (op == BITOP_OR) {
-                while(minlen >= sizeof(unsigned long)*4) {
-                    for (i = 1; i < numkeys; i++) {
-                        lres[0] |= lp[i][0];
-                        lres[1] |= lp[i][1];
-                        lres[2] |= lp[i][2];
-                        lres[3] |= lp[i][3];
-                        lp[i]+=4;
-                    }
-                    lres+=4;
-                    j += sizeof(unsigned long)*4;
-                    minlen -= sizeof(unsigned long)*4;
-                }
-            } else if (op == BITOP_XOR) {
-                while(minlen >= sizeof(unsigned long)*4) {
-                    for (i = 1; i < numkeys; i++) {
-                        lres[0] ^= lp[i][0];
-                        lres[1] ^= lp[i][1];
-                        lres[2] ^= lp[i][2];
-                        lres[3] ^= lp[i][3];
-                        lp[i]+=4;
-                    }
-                    lres+=4;
-                    j += sizeof(unsigned long)*4;
-                    minlen -= sizeof(unsigned long)*4;
-                }
-            } else if (op == BITOP_NOT) {
-                while(minlen >= sizeof(unsigned long)*4) {
-                    lres[0] = ~lres[0];
-                    lres[1] = ~lres[1];
-                    lres[2] = ~lres[2];
-                    lres[3] = ~lres[3];
-                    lres+=4;
-                    j += sizeof(unsigned long)*4;
-                    minlen -= sizeof(unsigned long)*4;
-                }
-            }
+        if (minlen) {
+            if (bitopImpl == NULL) bitopsSelectKernels();
+            j = bitopImpl(op,res,src,numkeys,0,minlen);
         }
-        #endif
 
         /* j is set to the next byte to process by the previous loop. */
         for (; j < maxlen; j++) {
@@ -1164,3 +1470,190 @@ void bitfieldCommand(client *c) {
 void bitfieldroCommand(client *c) {
     bitfieldGeneric(c, BITFIELD_FLAG_READONLY);
 }
+
+#ifdef REDIS_TEST
+/* Finish in plain C what the selected BITOP kernel left, like bitopCommand()
+ * does, for equal length sources. */
+static void bitopTestRun(int op, unsigned char *res, unsigned char **src,
+                         unsigned long numkeys, unsigned long len) {
+    unsigned long j = bitopImpl(op,res,src,numkeys,0,len), i;
+
+    for (; j < len; j++) {
+        unsigned char output = src[0][j];
+        for (i = 1; i < numkeys; i++) {
+            if (op == BITOP_AND) output &= src[i][j];
+            else if (op == BITOP_OR) output |= src[i][j];
+            else output ^= src[i][j];
+        }
+        res[j] = (op == BITOP_NOT) ? ~output : output;
+    }
+}
+
+static void bitopsTestRandom(unsigned char *p, size_t len) {
+    for (size_t j = 0; j < len; j++) p[j] = rand();
+}
+
+/* ./redis-server test bitops [--accurate]
+ *
+ * Checks every kernel the CPU supports against the portable code, then
+ * reports BITCOUNT, BITPOS and BITOP (two keys) throughput for bitmaps
+ * from 1KB to 8MB, or to 512MB with --accurate. */
+int bitopsTest(int argc, char **argv, int accurate) {
+#ifdef HAVE_X86_SIMD_DISPATCH
+    /* Same conditions as bitopsSelectKernels(): AVX-512F alone enables the
+     * BITPOS and BITOP kernels, and popcount stays on the best narrower
+     * kernel unless VPOPCNTDQ is there too. */
+    __builtin_cpu_init();
+    int has_popcnt = __builtin_cpu_supports("popcnt");
+    int has_avx2 = __builtin_cpu_supports("avx2") && has_popcnt;
+    int has_avx512f = __builtin_cpu_supports("avx512f");
+    int has_vpopcntdq = has_avx512f && has_popcnt &&
+                        __builtin_cpu_supports("avx512vpopcntdq");
+    popcountKernel popcount512f = has_avx2 ? popcountAVX2 :
+                                  has_popcnt ? popcountPopcnt : popcountGeneric;
+#endif
+    struct {
+        const char *name;
+        popcountKernel popcount;
+        bitposSkipKernel bitpos;
+        bitopKernel bitop;
+        int supported;
+    } kernels[] = {
+        {"generic", popcountGeneric, bitposSkipGeneric, bitopGeneric, 1},
+#ifdef HAVE_X86_SIMD_DISPATCH
+        {"popcnt", popcountPopcnt, bitposSkipGeneric, bitopGeneric, has_popcnt},
+        {"avx2", popcountAVX2, bitposSkipAVX2, bitopAVX2, has_avx2},
+        {"avx512f", popcount512f, bitposSkipAVX512, bitopAVX512, has_avx512f},
+        {"avx512", popcountAVX512, bitposSkipAVX512, bitopAVX512, has_vpopcntdq},
+#endif
+    };
+    int numkernels = sizeof(kernels)/sizeof(kernels[0]);
+    size_t maxsize = accurate ? (size_t)512*1024*1024 : (size_t)8*1024*1024;
+    size_t checksize = 4096+64;
+    unsigned char *a, *b, *res, *ref, *src[20];
+    int k, i, errors = 0;
+    UNUSED(argc);
+    UNUSED(argv);
+
+    bitopsSelectKernels();
+    printf("bitops: selected kernels: %s\n", bitopsKernelName);
+
+    a = zmalloc(maxsize);
+    b = zmalloc(maxsize);
+    res = zmalloc(maxsize);
+    ref = zmalloc(checksize);
+    for (i = 0; i < 20; i++) {
+        src[i] = zmalloc(checksize);
+        bitopsTestRandom(src[i],checksize);
+    }
+
+    for (k = 0; k < numkernels; k++) {
+        if (!kernels[k].supported) continue;
+        popcountImpl = kernels[k].popcount;
+        bitposSkipImpl = kernels[k].bitpos;
+        bitopImpl = kernels[k].bitop;
+
+        for (i = 0; i < 2000; i++) {
+            unsigned long off = rand() % 64, len = rand() % 4096;
+            unsigned long numkeys = 1 + rand() % 20, j, bit = rand() & 1;
+            int op = rand() % 4;
+            unsigned char *p = src[0]+off;
+
+            /* BITCOUNT from an unaligned start. */
+            if (popcountImpl(p,len) != popcountGeneric(p,len)) {
+                printf("bitops %s: popcount mismatch, len %lu\n",
+                    kernels[k].name, len);
+                errors++;
+            }
+
+            /* BITPOS over a long run of skippable bytes ending with a
+             * random byte at a random place. */
+            memset(a,bit ? 0 : 0xff,len+64);
+            if (len) a[off+rand()%len] = rand();
+            bitposSkipImpl = bitposSkipGeneric;
+            long long expected = redisBitpos(a+off,len,bit);
+            bitposSkipImpl = kernels[k].bitpos;
+            if (redisBitpos(a+off,len,bit) != expected) {
+                printf("bitops %s: bitpos mismatch, len %lu bit %lu\n",
+                    kernels[k].name, len, bit);
+                errors++;
+            }
+
+            /* BITOP with any number of keys, NOT only takes one. */
+            if (op == BITOP_NOT) numkeys = 1;
+            bitopTestRun(op,res,src,numkeys,len);
+            for (j = 0; j < len; j++) {
+                unsigned char output = src[0][j];
+                for (unsigned long n = 1; n < numkeys; n++) {
+                    if (op == BITOP_AND) output &= src[n][j];
+                    else if (op == BITOP_OR) output |= src[n][j];
+                    else output ^= src[n][j];
+                }
+                ref[j] = (op == BITOP_NOT) ? ~output : output;
+            }
+            if (len && memcmp(res,ref,len)) {
+                printf("bitops %s: bitop %d mismatch, %lu keys len %lu\n",
+                    kernels[k].name, op, numkeys, len);
+                errors++;
+            }
+        }
+    }
+
+    /* Throughput. BITPOS scans zeros up to a single bit set at the end. */
+    bitopsTestRandom(a,maxsize);
+    bitopsTestRandom(b,maxsize);
+    for (size_t size = 1024; size <= maxsize; size *= 2) {
+        unsigned char *bench[2] = {a, b};
+        long iterations = (256*1024*1024) / size;
+        if (iterations < 1) iterations = 1;
+
+        for (k = 0; k < numkernels; k++) {
+            long long start, popcount_us, bitpos_us, bitop_us, sink = 0;
+            long iter;
+
+            if (!kernels[k].supported) continue;
+            popcountImpl = kernels[k].popcount;
+            bitposSkipImpl = kernels[k].bitpos;
+            bitopImpl = kernels[k].bitop;
+
+            start = ustime();
+            for (iter = 0; iter < iterations; iter++)
+                sink += redisPopcount(a,size);
+            popcount_us = ustime()-start;
+
+            start = ustime();
+            for (iter = 0; iter < iterations; iter++)
+                bitopTestRun(BITOP_AND,res,bench,2,size);
+            bitop_us = ustime()-start;
+
+            memset(res,0,size);
+            res[size-1] = 1;
+            start = ustime();
+            for (iter = 0; iter < iterations; iter++)
+                sink += redisBitpos(res,size,1);
+            bitpos_us = ustime()-start;
+
+#define BITOPS_MBS(us) ((double)size*iterations/1024/1024/((us) ? (us) : 1)*1000000)
+            printf("bitops %-7s %7zuKB: BITCOUNT %9.1f MB/s, "
+                   "BITPOS %9.1f MB/s, BITOP AND %9.1f MB/s (%lld)\n",
+                kernels[k].name, size/1024, BITOPS_MBS(popcount_us),
+                BITOPS_MBS(bitpos_us), BITOPS_MBS(bitop_us), sink);
+#undef BITOPS_MBS
+        }
+    }
+
+    for (i = 0; i < 20; i++) zfree(src[i]);
+    zfree(a);
+    zfree(b);
+    zfree(res);
+    zfree(ref);
+    bitopsSelectKernels();
+
+    if (errors) {
+        printf("bitops: %d mismatches\n", errors);
+        return 1;
+    }
+    printf("bitops: all kernels agree\n");
+    return 0;
+}
+#endif
@@ -30,6 +30,12 @@
 
 #include "server.h"
 #include "cluster.h"
+#include "numa_bw_monitor.h"
+#include "numa_cold_tier.h"
+#include "numa_rdb_loader.h"
+#include "numa_reply_pool.h"
+#include "numa_quicklist_pool.h"
+#include "evict.h"
 
 #include <fcntl.h>
 #include <sys/stat.h>
@@ -576,6 +582,20 @@ void loadServerConfigFromString(char *config) {
             server.client_obuf_limits[class].hard_limit_bytes = hard;
             server.client_obuf_limits[class].soft_limit_bytes = soft;
             server.client_obuf_limits[class].soft_limit_seconds = soft_seconds;
+        } else if (!strcasecmp(argv[0],"maxmemory-node") && argc == 3) {
+            char *eptr;
+            long node = strtol(argv[1],&eptr,10);
+            int memerr = 0;
+            long long bytes = memtoll(argv[2],&memerr);
+
+            if (eptr == argv[1] || eptr[0] != '\0' ||
+                node < 0 || node >= NUMA_ACCT_MAX_NODES) {
+                err = "Invalid NUMA node for maxmemory-node"; goto loaderr;
+            }
+            if (memerr || bytes < 0) {
+                err = "Invalid memory size for maxmemory-node"; goto loaderr;
+            }
+            server.maxmemory_node[node] = bytes;
         } else if (!strcasecmp(argv[0],"oom-score-adj-values") && argc == 1 + CONFIG_OOM_COUNT) {
             if (updateOOMScoreAdjValues(&argv[1], &err, 0) == C_ERR) goto loaderr;
         } else if (!strcasecmp(argv[0],"notify-keyspace-events") && argc == 2) {
@@ -840,6 +860,34 @@ void configSetCommand(client *c) {
             server.client_obuf_limits[class].soft_limit_seconds = soft_seconds;
         }
         sdsfreesplitres(v,vlen);
+    } config_set_special_field("maxmemory-node") {
+        int vlen, j;
+        sds *v = sdssplitlen(o->ptr,sdslen(o->ptr)," ",1,&vlen);
+
+        /* <node> <bytes> 成对出现，整串校验通过后才替换全部预算 */
+        if (vlen % 2) {
+            sdsfreesplitres(v,vlen);
+            goto badfmt;
+        }
+        size_t budgets[NUMA_ACCT_MAX_NODES] = {0};
+        for (j = 0; j < vlen; j += 2) {
+            char *eptr;
+            long node = strtol(v[j],&eptr,10);
+            long long bytes = memtoll(v[j+1],&err);
+
+            /* 空串（多余空格产生）不能当作节点 0 或 0 字节 */
+            if (eptr == v[j] || eptr[0] != '\0' || node < 0 ||
+                node >= NUMA_ACCT_MAX_NODES || sdslen(v[j+1]) == 0 ||
+                err || bytes < 0)
+            {
+                sdsfreesplitres(v,vlen);
+                goto badfmt;
+            }
+            budgets[node] = bytes;
+        }
+        memcpy(server.maxmemory_node,budgets,sizeof(server.maxmemory_node));
+        sdsfreesplitres(v,vlen);
+        performEvictions();
     } config_set_special_field("oom-score-adj-values") {
         int vlen;
         int success = 1;
@@ -991,6 +1039,20 @@ void configGetCommand(client *c) {
         sdsfree(buf);
         matches++;
     }
+    if (stringmatch(pattern,"maxmemory-node",1)) {
+        sds buf = sdsempty();
+        int j;
+
+        for (j = 0; j < NUMA_ACCT_MAX_NODES; j++) {
+            if (!server.maxmemory_node[j]) continue;
+            if (sdslen(buf)) buf = sdscatlen(buf," ",1);
+            buf = sdscatprintf(buf,"%d %zu",j,server.maxmemory_node[j]);
+        }
+        addReplyBulkCString(c,"maxmemory-node");
+        addReplyBulkCString(c,buf);
+        sdsfree(buf);
+        matches++;
+    }
     if (stringmatch(pattern,"unixsocketperm",1)) {
         char buf[32];
         snprintf(buf,sizeof(buf),"%lo",(unsigned long) server.unixsocketperm);
@@ -1500,6 +1562,23 @@ void rewriteConfigClientoutputbufferlimitOption(struct rewriteConfigState *state
     }
 }
 
+/* Rewrite the maxmemory-node option: one line per node with a budget. */
+void rewriteConfigMaxmemoryNodeOption(struct rewriteConfigState *state) {
+    int j;
+    char *option = "maxmemory-node";
+
+    for (j = 0; j < NUMA_ACCT_MAX_NODES; j++) {
+        char mem[64];
+        if (!server.maxmemory_node[j]) continue;
+        rewriteConfigFormatMemory(mem,sizeof(mem),server.maxmemory_node[j]);
+        rewriteConfigRewriteLine(state,option,
+            sdscatprintf(sdsempty(),"%s %d %s",option,j,mem),1);
+    }
+
+    /* Mark as processed in case no budget is set. */
+    rewriteConfigMarkAsProcessed(state,option);
+}
+
 /* Rewrite the oom-score-adj-values option. */
 void rewriteConfigOOMScoreAdjValuesOption(struct rewriteConfigState *state) {
     int force = 0;
@@ -1701,6 +1780,7 @@ int rewriteConfig(char *path, int force_all) {
     rewriteConfigStringOption(state,"cluster-config-file",server.cluster_configfile,CONFIG_DEFAULT_CLUSTER_CONFIG_FILE);
     rewriteConfigNotifykeyspaceeventsOption(state);
     rewriteConfigClientoutputbufferlimitOption(state);
+    rewriteConfigMaxmemoryNodeOption(state);
     rewriteConfigOOMScoreAdjValuesOption(state);
 
     /* Rewrite Sentinel config if in Sentinel mode. */
@@ -2263,6 +2343,61 @@ static int updateMaxmemory(long long val, long long prev, const char **err) {
     return 1;
 }
 
+static int updateNumaLatencyProbeInterval(long long val, long long prev, const char **err) {
+    UNUSED(prev);
+    UNUSED(err);
+    numa_lat_probe_set_interval((uint32_t)val);
+    return 1;
+}
+
+static int updateDictBackgroundResize(long long val, long long prev, const char **err) {
+    UNUSED(val);
+    UNUSED(prev);
+    UNUSED(err);
+    updateDictBackgroundHooks();
+    return 1;
+}
+
+static int updateNumaReplyPoolBlocks(long long val, long long prev, const char **err) {
+    UNUSED(val);
+    UNUSED(prev);
+    UNUSED(err);
+    numaReplyPoolTrim();
+    return 1;
+}
+
+static int updateNumaQuicklistPoolNodes(long long val, long long prev, const char **err) {
+    UNUSED(val);
+    UNUSED(prev);
+    UNUSED(err);
+    numaQuicklistPoolTrim();
+    return 1;
+}
+
+static int isValidNumaNodeCapacity(char *val, const char **err) {
+    return numaApplyNodeCapacitySpec(val, 0, err);
+}
+
+static int updateNumaNodeCapacity(char *val, char *prev, const char **err) {
+    UNUSED(prev);
+    return numaApplyNodeCapacitySpec(val, 1, err);
+}
+
+static int isValidNumaBwSampleInterval(long long val, const char **err) {
+    if (val != 0 && val < NUMA_BW_HF_MIN_INTERVAL_MS) {
+        *err = "numa-bw-sample-interval must be 0 or between 10 and 100";
+        return 0;
+    }
+    return 1;
+}
+
+static int updateNumaBwSampleInterval(long long val, long long prev, const char **err) {
+    UNUSED(prev);
+    UNUSED(err);
+    numa_bw_sampler_set_interval((uint32_t)val);
+    return 1;
+}
+
 static int updateGoodSlaves(long long val, long long prev, const char **err) {
     UNUSED(val);
     UNUSED(prev);
@@ -2441,6 +2576,15 @@ standardConfig configs[] = {
     createBoolConfig("cluster-allow-replica-migration", NULL, MODIFIABLE_CONFIG, server.cluster_allow_replica_migration, 1, NULL, NULL),
     createBoolConfig("replica-announced", NULL, MODIFIABLE_CONFIG, server.replica_announced, 1, NULL, NULL),
     createBoolConfig("lua-enable-deprecated-api", NULL, IMMUTABLE_CONFIG, server.lua_enable_deprecated_api, 0, NULL, NULL),
+    createBoolConfig("numa-cold-compress", NULL, MODIFIABLE_CONFIG, server.numa_cold_compress, 0, NULL, NULL),
+    createBoolConfig("numa-io-threads", NULL, IMMUTABLE_CONFIG, server.numa_io_threads, 0, NULL, NULL),
+    createBoolConfig("numa-lazyfree-workers", NULL, IMMUTABLE_CONFIG, server.numa_lazyfree_workers, 0, NULL, NULL),
+    createBoolConfig("numa-rdb-placement", NULL, MODIFIABLE_CONFIG, server.numa_rdb_placement, 0, NULL, NULL),
+    createBoolConfig("numa-bgsave-per-node", NULL, MODIFIABLE_CONFIG, server.numa_bgsave_per_node, 0, NULL, NULL),
+    createBoolConfig("keyspace-bucketed-dict", NULL, IMMUTABLE_CONFIG, server.keyspace_bucketed_dict, 0, NULL, NULL),
+    createBoolConfig("repl-backlog-shared-output", NULL, MODIFIABLE_CONFIG, server.repl_backlog_shared_output, 0, NULL, NULL),
+    createBoolConfig("client-argv-cache", NULL, MODIFIABLE_CONFIG, server.client_argv_cache, 0, NULL, NULL),
+    createBoolConfig("numa-rdb-hot-first", NULL, MODIFIABLE_CONFIG, server.numa_rdb_hot_first, 0, NULL, NULL),
 
     /* String Configs */
     createStringConfig("aclfile", NULL, IMMUTABLE_CONFIG, ALLOW_EMPTY_STRING, server.acl_filename, "", NULL, NULL),
@@ -2460,6 +2604,7 @@ standardConfig configs[] = {
     createStringConfig("proc-title-template", NULL, MODIFIABLE_CONFIG, ALLOW_EMPTY_STRING, server.proc_title_template, CONFIG_DEFAULT_PROC_TITLE_TEMPLATE, isValidProcTitleTemplate, updateProcTitleTemplate),
     #ifdef HAVE_NUMA
     createStringConfig("numa-migrate-config", NULL, IMMUTABLE_CONFIG, EMPTY_STRING_IS_NULL, server.numa_migrate_config_file, NULL, NULL, NULL),
+    createStringConfig("numa-node-capacity", NULL, MODIFIABLE_CONFIG, EMPTY_STRING_IS_NULL, server.numa_node_capacity, NULL, isValidNumaNodeCapacity, updateNumaNodeCapacity),
     #endif
 
     /* SDS Configs */
@@ -2481,6 +2626,7 @@ standardConfig configs[] = {
     createIntConfig("databases", NULL, IMMUTABLE_CONFIG, 1, INT_MAX, server.dbnum, 16, INTEGER_CONFIG, NULL, NULL),
     createIntConfig("port", NULL, MODIFIABLE_CONFIG, 0, 65535, server.port, 6379, INTEGER_CONFIG, NULL, updatePort), /* TCP port. */
     createIntConfig("io-threads", NULL, IMMUTABLE_CONFIG, 1, 128, server.io_threads_num, 1, INTEGER_CONFIG, NULL, NULL), /* Single threaded by default */
+    createIntConfig("parallel-ops-threads", NULL, MODIFIABLE_CONFIG, 1, PARALLEL_MAX_THREADS, server.parallel_ops_threads, 1, INTEGER_CONFIG, NULL, NULL), /* Disabled by default */
     createIntConfig("auto-aof-rewrite-percentage", NULL, MODIFIABLE_CONFIG, 0, INT_MAX, server.aof_rewrite_perc, 100, INTEGER_CONFIG, NULL, NULL),
     createIntConfig("cluster-replica-validity-factor", "cluster-slave-validity-factor", MODIFIABLE_CONFIG, 0, INT_MAX, server.cluster_slave_validity_factor, 10, INTEGER_CONFIG, NULL, NULL), /* Slave max data age factor. */
     createIntConfig("list-max-ziplist-size", NULL, MODIFIABLE_CONFIG, INT_MIN, INT_MAX, server.list_max_ziplist_size, -2, INTEGER_CONFIG, NULL, NULL),
@@ -2501,6 +2647,15 @@ standardConfig configs[] = {
     createIntConfig("numa-demote-pressure-weight", NULL, MODIFIABLE_CONFIG, 0, 100, server.numa_demote_pressure_weight, 30, INTEGER_CONFIG, NULL, NULL),
     createIntConfig("numa-demote-bandwidth-weight", NULL, MODIFIABLE_CONFIG, 0, 100, server.numa_demote_bandwidth_weight, 30, INTEGER_CONFIG, NULL, NULL),
     createIntConfig("numa-demote-prefer-closer", NULL, MODIFIABLE_CONFIG, 0, 1, server.numa_demote_prefer_closer, 1, INTEGER_CONFIG, NULL, NULL),
+    createIntConfig("numa-latency-probe-interval", NULL, MODIFIABLE_CONFIG, 0, 60000, server.numa_latency_probe_interval, NUMA_LAT_PROBE_DEFAULT_INTERVAL_MS, INTEGER_CONFIG, NULL, updateNumaLatencyProbeInterval),
+    createIntConfig("numa-bw-sample-interval", NULL, MODIFIABLE_CONFIG, 0, NUMA_BW_HF_MAX_INTERVAL_MS, server.numa_bw_sample_interval, NUMA_BW_HF_DEFAULT_INTERVAL_MS, INTEGER_CONFIG, isValidNumaBwSampleInterval, updateNumaBwSampleInterval),
+    createIntConfig("pipeline-prefetch-batch", NULL, MODIFIABLE_CONFIG, 0, PROTO_PREFETCH_MAX_BATCH, server.pipeline_prefetch_batch, 0, INTEGER_CONFIG, NULL, NULL),
+    createIntConfig("numa-repl-backlog-node", NULL, MODIFIABLE_CONFIG, -1, NUMA_ACCT_MAX_NODES-1, server.numa_repl_backlog_node, -1, INTEGER_CONFIG, NULL, NULL),
+    createIntConfig("numa-keyspace-shards", NULL, IMMUTABLE_CONFIG, 0, NUMA_ACCT_MAX_NODES, server.numa_keyspace_shards, 0, INTEGER_CONFIG, NULL, NULL),
+    createIntConfig("keyspace-embedded-key-max-len", NULL, IMMUTABLE_CONFIG, 0, 255, server.keyspace_embedded_key_max_len, 0, INTEGER_CONFIG, NULL, NULL),
+    createIntConfig("numa-reply-pool-blocks", NULL, MODIFIABLE_CONFIG, 0, NUMA_REPLY_POOL_MAX_BLOCKS, server.numa_reply_pool_blocks, 0, INTEGER_CONFIG, NULL, updateNumaReplyPoolBlocks),
+    createIntConfig("numa-quicklist-pool-nodes", NULL, MODIFIABLE_CONFIG, 0, NUMA_QUICKLIST_POOL_MAX_NODES, server.numa_quicklist_pool_nodes, 0, INTEGER_CONFIG, NULL, updateNumaQuicklistPoolNodes),
+    createIntConfig("numa-rdb-load-threads", NULL, MODIFIABLE_CONFIG, 0, NUMA_RDB_LOADER_MAX_THREADS, server.numa_rdb_load_threads, 0, INTEGER_CONFIG, NULL, NULL),
     createIntConfig("replica-priority", "slave-priority", MODIFIABLE_CONFIG, 0, INT_MAX, server.slave_priority, 100, INTEGER_CONFIG, NULL, NULL),
     createIntConfig("repl-diskless-sync-delay", NULL, MODIFIABLE_CONFIG, 0, INT_MAX, server.repl_diskless_sync_delay, 5, INTEGER_CONFIG, NULL, NULL),
     createIntConfig("maxmemory-samples", NULL, MODIFIABLE_CONFIG, 1, INT_MAX, server.maxmemory_samples, 5, INTEGER_CONFIG, NULL, NULL),
@@ -2542,13 +2697,19 @@ standardConfig configs[] = {
     createULongLongConfig("maxmemory", NULL, MODIFIABLE_CONFIG, 0, ULLONG_MAX, server.maxmemory, 0, MEMORY_CONFIG, NULL, updateMaxmemory),
 
     /* Size_t configs */
-    createSizeTConfig("hash-max-ziplist-entries", NULL, MODIFIABLE_CONFIG, 0, LONG_MAX, server.hash_max_ziplist_entries, 512, INTEGER_CONFIG, NULL, NULL),
+    createSizeTConfig("hash-max-listpack-entries", "hash-max-ziplist-entries", MODIFIABLE_CONFIG, 0, LONG_MAX, server.hash_max_listpack_entries, 512, INTEGER_CONFIG, NULL, NULL),
     createSizeTConfig("set-max-intset-entries", NULL, MODIFIABLE_CONFIG, 0, LONG_MAX, server.set_max_intset_entries, 512, INTEGER_CONFIG, NULL, NULL),
-    createSizeTConfig("zset-max-ziplist-entries", NULL, MODIFIABLE_CONFIG, 0, LONG_MAX, server.zset_max_ziplist_entries, 128, INTEGER_CONFIG, NULL, NULL),
+    createSizeTConfig("zset-max-listpack-entries", "zset-max-ziplist-entries", MODIFIABLE_CONFIG, 0, LONG_MAX, server.zset_max_listpack_entries, 128, INTEGER_CONFIG, NULL, NULL),
+    createSizeTConfig("numa-cold-compress-min-size", NULL, MODIFIABLE_CONFIG, 64, UINT32_MAX, server.numa_cold_compress_min_size, NUMA_COLD_DEFAULT_MIN_SIZE, MEMORY_CONFIG, NULL, NULL),
+    createSizeTConfig("numa-latency-probe-buffer", NULL, IMMUTABLE_CONFIG, NUMA_LAT_PROBE_MIN_BUFFER, LONG_MAX, server.numa_latency_probe_buffer, NUMA_LAT_PROBE_DEFAULT_BUFFER, MEMORY_CONFIG, NULL, NULL),
+    createSizeTConfig("dict-background-resize-threshold", NULL, MODIFIABLE_CONFIG, 0, LLONG_MAX, server.dict_background_resize_threshold, 0, MEMORY_CONFIG, NULL, updateDictBackgroundResize),
     createSizeTConfig("active-defrag-ignore-bytes", NULL, MODIFIABLE_CONFIG, 1, LLONG_MAX, server.active_defrag_ignore_bytes, 100<<20, MEMORY_CONFIG, NULL, NULL), /* Default: don't defrag if frag overhead is below 100mb */
-    createSizeTConfig("hash-max-ziplist-value", NULL, MODIFIABLE_CONFIG, 0, LONG_MAX, server.hash_max_ziplist_value, 64, MEMORY_CONFIG, NULL, NULL),
+    createSizeTConfig("hash-max-listpack-value", "hash-max-ziplist-value", MODIFIABLE_CONFIG, 0, LONG_MAX, server.hash_max_listpack_value, 64, MEMORY_CONFIG, NULL, NULL),
     createSizeTConfig("stream-node-max-bytes", NULL, MODIFIABLE_CONFIG, 0, LONG_MAX, server.stream_node_max_bytes, 4096, MEMORY_CONFIG, NULL, NULL),
-    createSizeTConfig("zset-max-ziplist-value", NULL, MODIFIABLE_CONFIG, 0, LONG_MAX, server.zset_max_ziplist_value, 64, MEMORY_CONFIG, NULL, NULL),
+    createSizeTConfig("zset-max-listpack-value", "zset-max-ziplist-value", MODIFIABLE_CONFIG, 0, LONG_MAX, server.zset_max_listpack_value, 64, MEMORY_CONFIG, NULL, NULL),
+    createSizeTConfig("parallel-sort-min-elements", NULL, MODIFIABLE_CONFIG, 2, LONG_MAX, server.parallel_sort_min_elements, 100000, INTEGER_CONFIG, NULL, NULL),
+    createSizeTConfig("parallel-zset-min-elements", NULL, MODIFIABLE_CONFIG, 1, LONG_MAX, server.parallel_zset_min_elements, 100000, INTEGER_CONFIG, NULL, NULL),
+    createSizeTConfig("zset-btree-min-entries", NULL, MODIFIABLE_CONFIG, 0, LONG_MAX, server.zset_btree_min_entries, 1024, INTEGER_CONFIG, NULL, NULL),
     createSizeTConfig("hll-sparse-max-bytes", NULL, MODIFIABLE_CONFIG, 0, LONG_MAX, server.hll_sparse_max_bytes, 3000, MEMORY_CONFIG, NULL, NULL),
     createSizeTConfig("tracking-table-max-keys", NULL, MODIFIABLE_CONFIG, 0, LONG_MAX, server.tracking_table_max_keys, 1000000, INTEGER_CONFIG, NULL, NULL), /* Default: 1 million keys max. */
     createSizeTConfig("client-query-buffer-limit", NULL, MODIFIABLE_CONFIG, 1024*1024, LONG_MAX, server.client_max_querybuf_len, 1024*1024*1024, MEMORY_CONFIG, NULL, NULL), /* Default: 1GB max query buffer. */
@@ -116,6 +116,12 @@
 #define unlikely(x) (x)
 #endif
 
+#if __GNUC__ >= 4
+#define redis_prefetch(addr) __builtin_prefetch(addr)
+#else
+#define redis_prefetch(addr) ((void)(addr))
+#endif
+
 /* Define rdb_fsync_range to sync_file_range() on Linux, otherwise we use
  * the plain fsync() call. */
 #if (defined(__linux__) && defined(SYNC_FILE_RANGE_WAIT_BEFORE))
@@ -220,6 +226,15 @@ void setproctitle(const char *fmt, ...);
 #endif
 #endif
 
+/* Test for x86-64 SIMD kernels selected at runtime (see bitops.c): we need
+ * per function target attributes and __builtin_cpu_supports() knowing about
+ * AVX-512 VPOPCNTDQ, that is GCC >= 8 or clang >= 8. */
+#if defined(__x86_64__) && !defined(NO_SIMD_DISPATCH) && \
+    ((defined(__clang__) && __clang_major__ >= 8) || \
+     (!defined(__clang__) && defined(__GNUC__) && __GNUC__ >= 8))
+#define HAVE_X86_SIMD_DISPATCH 1
+#endif
+
 /* Make sure we can test for ARM just checking for __arm__, since sometimes
  * __arm is defined but __arm__ is not. */
 #if defined(__arm) && !defined(__arm__)
@@ -53,6 +53,44 @@ struct dbBackup {
 
 int keyIsExpired(redisDb *db, robj *key);
 
+/* Fill 'nodes' with the NUMA node of each keyspace shard: the nodes that
+ * have CPUs, in turn. Memory only nodes (CXL expanders) get no shard, the
+ * hash tables being the most accessed part of the keyspace. The shards are
+ * left unbound (-1) if NUMA is not available. */
+static void dbShardNodes(int *nodes, int nshards) {
+    int count = 0;
+    int cpu_nodes[NUMA_ACCT_MAX_NODES];
+
+#ifdef HAVE_NUMA
+    if (numa_available() >= 0) {
+        struct bitmask *cpus = numa_allocate_cpumask();
+        for (int n = 0; n <= numa_max_node() && count < NUMA_ACCT_MAX_NODES; n++) {
+            if (numa_node_to_cpus(n,cpus) == 0 && numa_bitmask_weight(cpus) > 0)
+                cpu_nodes[count++] = n;
+        }
+        numa_free_cpumask(cpus);
+    }
+#endif
+    for (int j = 0; j < nshards; j++)
+        nodes[j] = count ? cpu_nodes[j % count] : -1;
+}
+
+/* Create the main or the expires dict of a DB: with keyspace-bucketed-dict
+ * the entries are stored inline in cache line buckets, and with
+ * numa-keyspace-shards the keys are partitioned by hash into sub-dicts each
+ * allocated on a NUMA node, see dict.c. The main dict and the expires dict
+ * use the same partitioning, so a key and its expire live on the same node. */
+dict *dbCreateDict(dictType *type) {
+    if (server.numa_keyspace_shards > 0) {
+        int nodes[NUMA_ACCT_MAX_NODES];
+        dbShardNodes(nodes,server.numa_keyspace_shards);
+        return dictCreateSharded(type,NULL,server.numa_keyspace_shards,nodes,
+                                 server.keyspace_bucketed_dict);
+    }
+    if (server.keyspace_bucketed_dict) return dictCreateBucketed(type,NULL);
+    return dictCreate(type,NULL);
+}
+
 /* Update LFU when an object is accessed.
  * Firstly, decrement the counter if the decrement time is reached.
  * Then logarithmically increment the counter, and update the access time. */
@@ -81,8 +119,11 @@ robj *lookupKey(redisDb *db, robj *key, int flags) {
             }
         }
 
-        /* NUMA Composite LRU 热度追踪：记录每次键访问 */
 #ifdef HAVE_NUMA
+        /* 冷层压缩值：解压并提升回本地节点，调用方总是看到原始编码 */
+        if (val->encoding == OBJ_ENCODING_NUMA_COLD) numaColdPromote(val);
+
+        /* NUMA Composite LRU 热度追踪：记录每次键访问 */
         {
             numa_strategy_t *clru = numa_strategy_slot_get(1);
             if (clru && clru->enabled) {
@@ -207,7 +248,8 @@ robj *lookupKeyWriteOrReply(client *c, robj *key, robj *reply) {
  *
  * The program is aborted if the key already exists. */
 void dbAdd(redisDb *db, robj *key, robj *val) {
-    sds copy = sdsdup(key->ptr);
+    /* Short keys are copied into the entry by the dict itself. */
+    sds copy = dictEmbedsKey(db->dict,key->ptr) ? key->ptr : sdsdup(key->ptr);
     int retval = dictAdd(db->dict, copy, val);
 
     serverAssertWithInfo(NULL,key,retval == DICT_OK);
@@ -225,7 +267,8 @@ void dbAdd(redisDb *db, robj *key, robj *val) {
  *
  * The function returns 1 if the key was added to the database, taking
  * ownership of the SDS string, otherwise 0 is returned, and is up to the
- * caller to free the SDS string. */
+ * caller to free the SDS string. Keys the dict embeds in their entry (see
+ * dictEmbedsKey()) are copied, and remain owned by the caller either way. */
 int dbAddRDBLoad(redisDb *db, sds key, robj *val) {
     int retval = dictAdd(db->dict, key, val);
     if (retval != DICT_OK) return 0;
@@ -491,8 +534,8 @@ dbBackup *backupDb(void) {
     backup->dbarray = zmalloc(sizeof(redisDb)*server.dbnum);
     for (int i=0; i<server.dbnum; i++) {
         backup->dbarray[i] = server.db[i];
-        server.db[i].dict = dictCreate(&dbDictType,NULL);
-        server.db[i].expires = dictCreate(&dbExpiresDictType,NULL);
+        server.db[i].dict = dbCreateDict(&dbDictType);
+        server.db[i].expires = dbCreateDict(&dbExpiresDictType);
     }
 
     /* Backup cluster slots to keys map if enable cluster. */
@@ -815,7 +858,7 @@ void scanCallback(void *privdata, const dictEntry *de) {
     } else if (o->type == OBJ_ZSET) {
         sds sdskey = dictGetKey(de);
         key = createStringObject(sdskey,sdslen(sdskey));
-        val = createStringObjectFromLongDouble(*(double*)dictGetVal(de),0);
+        val = createStringObjectFromLongDouble(dictGetDoubleVal(de),0);
     } else {
         serverPanic("Type not handled in SCAN callback.");
     }
@@ -909,7 +952,7 @@ void scanGenericCommand(client *c, robj *o, unsigned long cursor) {
 
     /* Step 2: Iterate the collection.
      *
-     * Note that if the object is encoded with a ziplist, intset, or any other
+     * Note that if the object is encoded with a listpack, intset, or any other
      * representation that is not a hash table, we are sure that it is also
      * composed of a small number of elements. So to avoid taking state we
      * just return everything inside the object in a single call, setting the
@@ -956,17 +999,17 @@ void scanGenericCommand(client *c, robj *o, unsigned long cursor) {
             listAddNodeTail(keys,createStringObjectFromLongLong(ll));
         cursor = 0;
     } else if (o->type == OBJ_HASH || o->type == OBJ_ZSET) {
-        unsigned char *p = ziplistIndex(o->ptr,0);
+        unsigned char *p = lpFirst(o->ptr);
         unsigned char *vstr;
         unsigned int vlen;
         long long vll;
 
         while(p) {
-            ziplistGet(p,&vstr,&vlen,&vll);
+            vstr = lpGetValue(p,&vlen,&vll);
             listAddNodeTail(keys,
                 (vstr != NULL) ? createStringObject((char*)vstr,vlen) :
                                  createStringObjectFromLongLong(vll));
-            p = ziplistNext(o->ptr,p);
+            p = lpNext(o->ptr,p);
         }
         cursor = 0;
     } else {
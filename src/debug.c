@@ -134,6 +134,15 @@ void mixStringObjectDigest(unsigned char *digest, robj *o) {
  * will continue mixing this object digest to anything that was already
  * present. */
 void xorObjectDigest(redisDb *db, robj *keyobj, unsigned char *digest, robj *o) {
+#ifdef HAVE_NUMA
+    /* 冷层压缩值按解压后的内容计算摘要，不改变其存放位置 */
+    if (o->encoding == OBJ_ENCODING_NUMA_COLD) {
+        robj *decoded = numaColdDecodedCopy(o);
+        xorObjectDigest(db,keyobj,digest,decoded);
+        decrRefCount(decoded);
+        return;
+    }
+#endif
     uint32_t aux = htonl(o->type);
     mixDigest(digest,&aux,sizeof(aux));
     long long expiretime = getExpire(db,keyobj);
@@ -162,7 +171,7 @@ void xorObjectDigest(redisDb *db, robj *keyobj, unsigned char *digest, robj *o)
     } else if (o->type == OBJ_ZSET) {
         unsigned char eledigest[20];
 
-        if (o->encoding == OBJ_ENCODING_ZIPLIST) {
+        if (o->encoding == OBJ_ENCODING_LISTPACK) {
             unsigned char *zl = o->ptr;
             unsigned char *eptr, *sptr;
             unsigned char *vstr;
@@ -170,13 +179,13 @@ void xorObjectDigest(redisDb *db, robj *keyobj, unsigned char *digest, robj *o)
             long long vll;
             double score;
 
-            eptr = ziplistIndex(zl,0);
+            eptr = lpSeek(zl,0);
             serverAssert(eptr != NULL);
-            sptr = ziplistNext(zl,eptr);
+            sptr = lpNext(zl,eptr);
             serverAssert(sptr != NULL);
 
             while (eptr != NULL) {
-                serverAssert(ziplistGet(eptr,&vstr,&vlen,&vll));
+                vstr = lpGetValue(eptr,&vlen,&vll);
                 score = zzlGetScore(sptr);
 
                 memset(eledigest,0,20);
@@ -199,9 +208,9 @@ void xorObjectDigest(redisDb *db, robj *keyobj, unsigned char *digest, robj *o)
 
             while((de = dictNext(di)) != NULL) {
                 sds sdsele = dictGetKey(de);
-                double *score = dictGetVal(de);
+                double score = dictGetDoubleVal(de);
 
-                snprintf(buf,sizeof(buf),"%.17g",*score);
+                snprintf(buf,sizeof(buf),"%.17g",score);
                 memset(eledigest,0,20);
                 mixDigest(eledigest,sdsele,sdslen(sdsele));
                 mixDigest(eledigest,buf,strlen(buf));
@@ -407,9 +416,13 @@ void debugCommand(client *c) {
 "LOG <message>",
 "    Write <message> to the server log.",
 "HTSTATS <dbid>",
-"    Return hash table statistics of the specified Redis database.",
+"    Return hash table statistics of the specified Redis database. With",
+"    numa-keyspace-shards > 1 the stats are reported per shard, each under a",
+"    'Shard <j> (node <n>):' header.",
 "HTSTATS-KEY <key>",
 "    Like HTSTATS but for the hash table stored at <key>'s value.",
+"LISTPACK <key>",
+"    Show low level info about the listpack encoding of <key>.",
 "LOADAOF",
 "    Flush the AOF buffers on disk and reload the AOF in memory.",
 "LUA-ALWAYS-REPLICATE-COMMANDS <0|1>",
@@ -606,12 +619,24 @@ NULL
             remaining -= used;
         }
 
+        size_t serlen;
+#ifdef HAVE_NUMA
+        if (val->encoding == OBJ_ENCODING_NUMA_COLD) {
+            robj *decoded = numaColdDecodedCopy(val);
+            serlen = rdbSavedObjectLen(decoded, c->argv[2]);
+            decrRefCount(decoded);
+            snprintf(extra, sizeof(extra), " cold_blob_size:%zu",
+                numaColdBlobSize(val));
+        } else
+#endif
+        serlen = rdbSavedObjectLen(val, c->argv[2]);
+
         addReplyStatusFormat(c,
             "Value at:%p refcount:%d "
             "encoding:%s serializedlength:%zu "
             "lru:%d lru_seconds_idle:%llu%s",
             (void*)val, val->refcount,
-            strenc, rdbSavedObjectLen(val, c->argv[2]),
+            strenc, serlen,
             val->lru, estimateObjectIdleTime(val)/1000, extra);
     } else if (!strcasecmp(c->argv[1]->ptr,"sdslen") && c->argc == 3) {
         dictEntry *de;
@@ -633,7 +658,8 @@ NULL
                 "val_sds_len:%lld, val_sds_avail:%lld, val_zmalloc: %lld",
                 (long long) sdslen(key),
                 (long long) sdsavail(key),
-                (long long) sdsZmallocSize(key),
+                (long long) (dictEmbedsKey(c->db->dict,key) ?
+                    zmalloc_size(de)-sizeof(dictEntry) : sdsZmallocSize(key)),
                 (long long) sdslen(val->ptr),
                 (long long) sdsavail(val->ptr),
                 (long long) getStringObjectSdsUsedMemory(val));
@@ -650,6 +676,18 @@ NULL
             ziplistRepr(o->ptr);
             addReplyStatus(c,"Ziplist structure printed on stdout");
         }
+    } else if (!strcasecmp(c->argv[1]->ptr,"listpack") && c->argc == 3) {
+        robj *o;
+
+        if ((o = objectCommandLookupOrReply(c,c->argv[2],shared.nokeyerr))
+                == NULL) return;
+
+        if (o->encoding != OBJ_ENCODING_LISTPACK) {
+            addReplyError(c,"Not a listpack encoded object.");
+        } else {
+            lpRepr(o->ptr);
+            addReplyStatus(c,"Listpack structure printed on stdout");
+        }
     } else if (!strcasecmp(c->argv[1]->ptr,"populate") &&
                c->argc >= 3 && c->argc <= 5) {
         long keys, j;
@@ -976,8 +1014,13 @@ void serverLogObjectDebugInfo(const robj *o) {
         serverLog(LL_WARNING,"Hash size: %d", (int) hashTypeLength(o));
     } else if (o->type == OBJ_ZSET) {
         serverLog(LL_WARNING,"Sorted set size: %d", (int) zsetLength(o));
-        if (o->encoding == OBJ_ENCODING_SKIPLIST)
-            serverLog(LL_WARNING,"Skiplist level: %d", (int) ((const zset*)o->ptr)->zsl->level);
+        if (o->encoding == OBJ_ENCODING_SKIPLIST) {
+            const zset *zs = o->ptr;
+            if (zs->zsl)
+                serverLog(LL_WARNING,"Skiplist level: %d", (int) zs->zsl->level);
+            else
+                serverLog(LL_WARNING,"B+tree leaves: %lu", zs->zbt->leaves);
+        }
     } else if (o->type == OBJ_STREAM) {
         serverLog(LL_WARNING,"Stream size: %d", (int) streamLength(o));
     }
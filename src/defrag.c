@@ -46,6 +46,7 @@ int je_get_defrag_hint(void* ptr);
 
 /* forward declarations*/
 void defragDictBucketCallback(void *privdata, dictEntry **bucketref);
+void defragDbDictBucketCallback(void *privdata, dictEntry **bucketref);
 dictEntry* replaceSatelliteDictKeyPtrAndOrDefragDictEntry(dict *d, sds oldkey, sds newkey, uint64_t hash, long *defragged);
 
 /* Defrag helper for generic allocations.
@@ -120,7 +121,8 @@ robj *activeDefragStringOb(robj* ob, long *defragged) {
                 ret->ptr = (void*)((intptr_t)ret + ofs);
                 (*defragged)++;
             }
-        } else if (ob->encoding!=OBJ_ENCODING_INT) {
+        } else if (ob->encoding!=OBJ_ENCODING_INT &&
+                   ob->encoding!=OBJ_ENCODING_NUMA_COLD) {
             serverPanic("Unknown string encoding");
         }
     }
@@ -195,13 +197,12 @@ void zslUpdateNode(zskiplist *zsl, zskiplistNode *oldnode, zskiplistNode *newnod
 }
 
 /* Defrag helper for sorted set.
- * Update the robj pointer, defrag the skiplist struct and return the new score
- * reference. We may not access oldele pointer (not even the pointer stored in
- * the skiplist), as it was already freed. Newele may be null, in which case we
- * only need to defrag the skiplist, but not update the obj pointer.
- * When return value is non-NULL, it is the score reference that must be updated
- * in the dict record. */
-double *zslDefrag(zskiplist *zsl, double score, sds oldele, sds newele) {
+ * Update the robj pointer, defrag the skiplist struct and return 1 if the
+ * skiplist node was moved. We may not access oldele pointer (not even the
+ * pointer stored in the skiplist), as it was already freed. Newele may be null,
+ * in which case we only need to defrag the skiplist, but not update the obj
+ * pointer. */
+long zslDefrag(zskiplist *zsl, double score, sds oldele, sds newele) {
     zskiplistNode *update[ZSKIPLIST_MAXLEVEL], *x, *newx;
     int i;
     sds ele = newele? newele: oldele;
@@ -231,25 +232,25 @@ double *zslDefrag(zskiplist *zsl, double score, sds oldele, sds newele) {
     newx = activeDefragAlloc(x);
     if (newx) {
         zslUpdateNode(zsl, x, newx, update);
-        return &newx->score;
+        return 1;
     }
-    return NULL;
+    return 0;
 }
 
 /* Defrag helper for sorted set.
- * Defrag a single dict entry key name, and corresponding skiplist struct */
+ * Defrag a single dict entry key name, and corresponding skiplist struct.
+ * B+tree nodes hold many elements, they are defragged by defragZsetSkiplist,
+ * here we only update the element pointer. */
 long activeDefragZsetEntry(zset *zs, dictEntry *de) {
     sds newsds;
-    double* newscore;
     long defragged = 0;
     sds sdsele = dictGetKey(de);
     if ((newsds = activeDefragSds(sdsele)))
         defragged++, de->key = newsds;
-    newscore = zslDefrag(zs->zsl, *(double*)dictGetVal(de), sdsele, newsds);
-    if (newscore) {
-        dictSetVal(zs->dict, de, newscore);
-        defragged++;
-    }
+    if (zs->zsl)
+        defragged += zslDefrag(zs->zsl, dictGetDoubleVal(de), sdsele, newsds);
+    else if (newsds)
+        zbtReplaceEle(zs->zbt, dictGetDoubleVal(de), sdsele, newsds);
     return defragged;
 }
 
@@ -386,6 +387,13 @@ long activeDefragSdsListAndDict(list *l, dict *d, int dict_val_type) {
  * NOTE: this is very ugly code, but it let's us avoid the complication of
  * doing a scan on another dict. */
 dictEntry* replaceSatelliteDictKeyPtrAndOrDefragDictEntry(dict *d, sds oldkey, sds newkey, uint64_t hash, long *defragged) {
+    /* Bucketed dicts store entries inline, there is no entry allocation
+     * to move: only the key pointer needs to be replaced. */
+    if (dictIsBucketed(d)) {
+        dictEntry *de = dictFindEntryByPtrAndHash(d, oldkey, hash);
+        if (de && newkey) de->key = newkey;
+        return de;
+    }
     dictEntry **deref = dictFindEntryRefByPtrAndHash(d, oldkey, hash);
     if (deref) {
         dictEntry *de = *deref;
@@ -565,16 +573,23 @@ long defragZsetSkiplist(redisDb *db, dictEntry *kde) {
     zset *zs = (zset*)ob->ptr;
     zset *newzs;
     zskiplist *newzsl;
+    zbtree *newzbt;
     dict *newdict;
     dictEntry *de;
     struct zskiplistNode *newheader;
     serverAssert(ob->type == OBJ_ZSET && ob->encoding == OBJ_ENCODING_SKIPLIST);
     if ((newzs = activeDefragAlloc(zs)))
         defragged++, ob->ptr = zs = newzs;
-    if ((newzsl = activeDefragAlloc(zs->zsl)))
-        defragged++, zs->zsl = newzsl;
-    if ((newheader = activeDefragAlloc(zs->zsl->header)))
-        defragged++, zs->zsl->header = newheader;
+    if (zs->zsl) {
+        if ((newzsl = activeDefragAlloc(zs->zsl)))
+            defragged++, zs->zsl = newzsl;
+        if ((newheader = activeDefragAlloc(zs->zsl->header)))
+            defragged++, zs->zsl->header = newheader;
+    } else {
+        if ((newzbt = activeDefragAlloc(zs->zbt)))
+            defragged++, zs->zbt = newzbt;
+        defragged += zbtDefragNodes(zs->zbt, activeDefragAlloc);
+    }
     if (dictSize(zs->dict) > server.active_defrag_max_scan_fields)
         defragLater(db, kde);
     else {
@@ -819,8 +834,9 @@ long defragKey(redisDb *db, dictEntry *de) {
     long defragged = 0;
     sds newsds;
 
-    /* Try to defrag the key name. */
-    newsds = activeDefragSds(keysds);
+    /* Try to defrag the key name, unless it is embedded in the entry and
+     * moves with it, see defragDbDictBucketCallback(). */
+    newsds = dictEmbedsKey(db->dict,keysds) ? NULL : activeDefragSds(keysds);
     if (newsds)
         defragged++, de->key = newsds;
     if (dictSize(db->expires)) {
@@ -840,6 +856,8 @@ long defragKey(redisDb *db, dictEntry *de) {
 
     if (ob->type == OBJ_STRING) {
         /* Already handled in activeDefragStringOb. */
+    } else if (ob->encoding == OBJ_ENCODING_NUMA_COLD) {
+        /* 冷层压缩块按节点放置，不参与碎片整理 */
     } else if (ob->type == OBJ_LIST) {
         if (ob->encoding == OBJ_ENCODING_QUICKLIST) {
             defragged += defragQuicklist(db, de);
@@ -860,7 +878,7 @@ long defragKey(redisDb *db, dictEntry *de) {
             serverPanic("Unknown set encoding");
         }
     } else if (ob->type == OBJ_ZSET) {
-        if (ob->encoding == OBJ_ENCODING_ZIPLIST) {
+        if (ob->encoding == OBJ_ENCODING_LISTPACK) {
             if ((newzl = activeDefragAlloc(ob->ptr)))
                 defragged++, ob->ptr = newzl;
         } else if (ob->encoding == OBJ_ENCODING_SKIPLIST) {
@@ -869,7 +887,7 @@ long defragKey(redisDb *db, dictEntry *de) {
             serverPanic("Unknown sorted set encoding");
         }
     } else if (ob->type == OBJ_HASH) {
-        if (ob->encoding == OBJ_ENCODING_ZIPLIST) {
+        if (ob->encoding == OBJ_ENCODING_LISTPACK) {
             if ((newzl = activeDefragAlloc(ob->ptr)))
                 defragged++, ob->ptr = newzl;
         } else if (ob->encoding == OBJ_ENCODING_HT) {
@@ -911,6 +929,31 @@ void defragDictBucketCallback(void *privdata, dictEntry **bucketref) {
     }
 }
 
+/* Defrag callback for the buckets of a db main dict. Moving an entry with an
+ * embedded key moves the key too, so the expires dict, that shares the key
+ * pointer, is updated as well. */
+void defragDbDictBucketCallback(void *privdata, dictEntry **bucketref) {
+    redisDb *db = privdata;
+    while(*bucketref) {
+        dictEntry *de = *bucketref, *newde;
+        sds key = dictGetKey(de);
+        int embedded = dictEmbedsKey(db->dict,key);
+        size_t offset = (char*)key - (char*)de;
+        if ((newde = activeDefragAlloc(de))) {
+            *bucketref = newde;
+            if (embedded) {
+                newde->key = (char*)newde + offset;
+                if (dictSize(db->expires)) {
+                    long defragged = 0;
+                    uint64_t hash = dictGetHash(db->dict, newde->key);
+                    replaceSatelliteDictKeyPtrAndOrDefragDictEntry(db->expires, key, newde->key, hash, &defragged);
+                }
+            }
+        }
+        bucketref = &(*bucketref)->next;
+    }
+}
+
 /* Utility function to get the fragmentation ratio from jemalloc.
  * It is critical to do that by comparing only heap maps that belong to
  * jemalloc, and skip ones the jemalloc keeps as spare. Since we use this
@@ -1170,7 +1213,7 @@ void activeDefragCycle(void) {
                 break; /* this will exit the function and we'll continue on the next cycle */
             }
 
-            cursor = dictScan(db->dict, cursor, defragScanCallback, defragDictBucketCallback, db);
+            cursor = dictScan(db->dict, cursor, defragScanCallback, defragDbDictBucketCallback, db);
 
             /* Once in 16 scan iterations, 512 pointer reallocations. or 64 keys
              * (if we have a lot of pointers in one hash bucket or rehasing),
@@ -3,7 +3,9 @@
  * This file implements in memory hash tables with insert/del/replace/find/
  * get-random-element operations. Hash tables will auto resize if needed
  * tables of power of two in size are used, collisions are handled by
- * chaining. See the source code for more information... :)
+ * chaining. Dicts created with dictCreateBucketed() store their entries
+ * inline in cache line sized buckets instead. See the source code for more
+ * information... :)
  *
  * Copyright (c) 2006-2012, Salvatore Sanfilippo <antirez at gmail dot com>
  * All rights reserved.
@@ -42,6 +44,7 @@
 #include <stdarg.h>
 #include <limits.h>
 #include <sys/time.h>
+#include <pthread.h>
 
 #include "dict.h"
 #include "zmalloc.h"
@@ -62,8 +65,10 @@ static unsigned int dict_force_resize_ratio = 5;
 
 static int _dictExpandIfNeeded(dict *ht);
 static unsigned long _dictNextPower(unsigned long size);
+static unsigned long _dictTableSize(dict *d, unsigned long size);
 static long _dictKeyIndex(dict *ht, const void *key, uint64_t hash, dictEntry **existing);
 static int _dictInit(dict *ht, dictType *type, void *privDataPtr);
+long long timeInMilliseconds(void);
 
 /* -------------------------- hash functions -------------------------------- */
 
@@ -91,6 +96,652 @@ uint64_t dictGenCaseHashFunction(const unsigned char *buf, int len) {
     return siphash_nocase(buf,len,dict_hash_function_seed);
 }
 
+/* ----------------------------- Bucketed tables ---------------------------- */
+
+/* The table of a dict created with dictCreateBucketed() is not an array of
+ * chains of individually allocated dictEntry structures, but an array of
+ * cache line sized buckets, each holding DICT_BUCKET_SLOTS entries inline
+ * (key and value only) and one tag byte per entry taken from the high bits
+ * of its hash. A lookup compares the tags of a whole bucket at once and only
+ * touches the keys whose tag matches; a hit costs the bucket, the key and
+ * the value instead of also an entry allocation. When a bucket is full,
+ * further entries go to overflow buckets chained from it. The buckets are
+ * still selected by the low bits of the hash in a power of two table, so
+ * incremental rehashing and the dictScan() cursor work as for chains.
+ *
+ * The dictEntry pointers handed out point inside the buckets: their 'next'
+ * field must not be used. An entry stays at the same address until it is
+ * deleted or its bucket is rehashed, so callers that keep entries across
+ * calls that may rehash must pause rehashing. Deleting leaves a hole that
+ * the next insertion in the chain reuses, so other entries never move;
+ * overflow buckets are released as soon as they are empty. */
+
+#define DICT_BUCKET_SLOTS 3
+#define DICT_BUCKET_FULL ((1<<DICT_BUCKET_SLOTS)-1)
+#define DICT_BUCKET_FILL 2      /* Entries per bucket on average before growing. */
+#define DICT_BUCKET_ALIGN 64
+
+/* Same layout as the first two fields of dictEntry. */
+typedef struct dictBucketEntry {
+    void *key;
+    union {
+        void *val;
+        uint64_t u64;
+        int64_t s64;
+        double d;
+    } v;
+} dictBucketEntry;
+
+typedef struct dictBucket {
+    uint8_t tag[DICT_BUCKET_SLOTS]; /* High byte of the hash of each entry. */
+    uint8_t used;                   /* Bitmap of the occupied slots. */
+    uint32_t unused;
+    dictBucketEntry entry[DICT_BUCKET_SLOTS];
+    struct dictBucket *next;        /* Overflow bucket. */
+} dictBucket;
+
+#define dictBucketTag(hash) ((uint8_t)((hash) >> 56))
+#define dictBuckets(ht) ((dictBucket*)(ht)->table)
+#define dictBucketEntryAt(b,j) ((dictEntry*)&(b)->entry[j])
+
+static inline int _dictCtz(unsigned int x) {
+#if defined(__GNUC__)
+    return __builtin_ctz(x);
+#else
+    int n = 0;
+    while (!(x & 1)) x >>= 1, n++;
+    return n;
+#endif
+}
+
+/* Allocate 'n' zeroed buckets aligned to a cache line. The distance from the
+ * start of the allocation is stored in the byte before the first bucket. */
+static dictBucket *_dictBucketsAlloc(unsigned long n, int try) {
+    size_t bytes = n*sizeof(dictBucket)+DICT_BUCKET_ALIGN;
+    unsigned char *raw = try ? ztrycalloc(bytes) : zcalloc(bytes);
+    if (raw == NULL) return NULL;
+    size_t shift = DICT_BUCKET_ALIGN - ((uintptr_t)raw & (DICT_BUCKET_ALIGN-1));
+    raw[shift-1] = (unsigned char)shift;
+    return (dictBucket*)(raw+shift);
+}
+
+static void _dictBucketsFree(dictBucket *b) {
+    if (b == NULL) return;
+    unsigned char *p = (unsigned char*)b;
+    zfree(p-p[-1]);
+}
+
+/* Bitmap of the occupied slots of 'b' whose tag is 'tag'. The tags are
+ * compared together as the bytes of one word (SWAR). A false positive is
+ * possible above a matching byte, which is harmless as the caller compares
+ * the keys anyway. */
+static inline unsigned int _dictBucketMatch(const dictBucket *b, uint8_t tag) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    uint32_t word, x, m;
+    memcpy(&word,b->tag,sizeof(word));
+    x = word ^ (0x01010101U * tag);
+    m = (x - 0x01010101U) & ~x & 0x80808080U;
+    return (((m >> 7) & 1) | ((m >> 14) & 2) | ((m >> 21) & 4)) & b->used;
+#else
+    unsigned int match = 0;
+    for (int j = 0; j < DICT_BUCKET_SLOTS; j++)
+        if (b->tag[j] == tag) match |= 1<<j;
+    return match & b->used;
+#endif
+}
+
+/* Move '*bp' / '*slot' forward to the first occupied slot at or after it in
+ * the bucket chain. '*bp' is set to NULL if there is none. */
+static void _dictBucketSeek(dictBucket **bp, int *slot) {
+    dictBucket *b = *bp;
+    int j = *slot;
+
+    while (b) {
+        unsigned int rest = b->used & ~((1U<<j)-1);
+        if (rest) {
+            *bp = b;
+            *slot = _dictCtz(rest);
+            return;
+        }
+        b = b->next;
+        j = 0;
+    }
+    *bp = NULL;
+}
+
+static unsigned long _dictBucketChainLen(const dictBucket *b) {
+    static const uint8_t popcount[DICT_BUCKET_FULL+1] = {0,1,1,2,1,2,2,3};
+    unsigned long len = 0;
+    for (; b; b = b->next) len += popcount[b->used];
+    return len;
+}
+
+static dictEntry *_dictBucketFind(dict *d, dictht *ht, uint64_t hash, const void *key) {
+    dictBucket *b = dictBuckets(ht) + (hash & ht->sizemask);
+    uint8_t tag = dictBucketTag(hash);
+
+    do {
+        unsigned int match = _dictBucketMatch(b,tag);
+        while (match) {
+            int j = _dictCtz(match);
+            void *k = b->entry[j].key;
+            if (key == k || dictCompareKeys(d, key, k))
+                return dictBucketEntryAt(b,j);
+            match &= match-1;
+        }
+        b = b->next;
+    } while(b);
+    return NULL;
+}
+
+/* Take a free slot for 'hash' in 'ht', allocating an overflow bucket if its
+ * chain is full. The key and value are left to the caller. */
+static dictEntry *_dictBucketInsert(dict *d, dictht *ht, uint64_t hash) {
+    dictBucket *b = dictBuckets(ht) + (hash & ht->sizemask);
+
+    while (b->used == DICT_BUCKET_FULL) {
+        if (b->next == NULL) {
+            b->next = zcalloc(sizeof(dictBucket));
+            d->overflow_buckets++;
+        }
+        b = b->next;
+    }
+    int j = _dictCtz(~b->used & DICT_BUCKET_FULL);
+    b->used |= 1<<j;
+    b->tag[j] = dictBucketTag(hash);
+    b->entry[j].v.u64 = 0;
+    ht->used++;
+    return dictBucketEntryAt(b,j);
+}
+
+/* Remove 'key' from 'ht'. With 'nofree' the key and value are not released
+ * and a heap copy of the entry is returned, as its slot is reused. */
+static dictEntry *_dictBucketDelete(dict *d, dictht *ht, uint64_t hash, const void *key, int nofree) {
+    dictBucket *b = dictBuckets(ht) + (hash & ht->sizemask), *prev = NULL;
+    uint8_t tag = dictBucketTag(hash);
+
+    do {
+        unsigned int match = _dictBucketMatch(b,tag);
+        while (match) {
+            int j = _dictCtz(match);
+            dictEntry *he = dictBucketEntryAt(b,j);
+            if (key == he->key || dictCompareKeys(d, key, he->key)) {
+                if (nofree) {
+                    dictEntry *copy = zmalloc(sizeof(*copy));
+                    copy->key = he->key;
+                    memcpy(&copy->v,&b->entry[j].v,sizeof(copy->v));
+                    copy->next = NULL;
+                    he = copy;
+                } else {
+                    dictFreeKey(d, he);
+                    dictFreeVal(d, he);
+                }
+                b->used &= ~(1<<j);
+                ht->used--;
+                if (b->used == 0 && prev) {
+                    prev->next = b->next;
+                    zfree(b);
+                    d->overflow_buckets--;
+                }
+                return he;
+            }
+            match &= match-1;
+        }
+        prev = b;
+        b = b->next;
+    } while(b);
+    return NULL;
+}
+
+/* Release the entries and the overflow buckets of a table. */
+static void _dictBucketsClear(dict *d, dictht *ht, void(callback)(void *)) {
+    unsigned long i;
+
+    for (i = 0; i < ht->size && ht->used > 0; i++) {
+        dictBucket *head = dictBuckets(ht)+i, *b = head, *next;
+
+        if (callback && (i & 65535) == 0) callback(d->privdata);
+        do {
+            next = b->next;
+            for (unsigned int used = b->used; used; used &= used-1) {
+                dictEntry *he = dictBucketEntryAt(b,_dictCtz(used));
+                dictFreeKey(d, he);
+                dictFreeVal(d, he);
+                ht->used--;
+            }
+            if (b != head) {
+                zfree(b);
+                d->overflow_buckets--;
+            }
+            b = next;
+        } while(b);
+    }
+    _dictBucketsFree(dictBuckets(ht));
+}
+
+/* Move the entries of bucket 'idx' of ht[0] to ht[1]. */
+static void _dictBucketRehash(dict *d, unsigned long idx) {
+    dictBucket *head = dictBuckets(&d->ht[0])+idx, *b = head, *next;
+
+    do {
+        next = b->next;
+        for (unsigned int used = b->used; used; used &= used-1) {
+            int j = _dictCtz(used);
+            dictEntry *de = _dictBucketInsert(d,&d->ht[1],
+                                              dictHashKey(d,b->entry[j].key));
+            de->key = b->entry[j].key;
+            memcpy(&de->v,&b->entry[j].v,sizeof(de->v));
+            d->ht[0].used--;
+        }
+        if (b != head) {
+            zfree(b);
+            d->overflow_buckets--;
+        }
+        b = next;
+    } while(b);
+    memset(head,0,sizeof(*head));
+}
+
+/* Call 'fn' for every entry of a bucket chain. The position of the next
+ * entry is taken before calling 'fn', so that it may delete the entry. */
+static void _dictBucketEmit(dictBucket *b, dictScanFunction *fn, void *privdata) {
+    int j = 0;
+
+    _dictBucketSeek(&b,&j);
+    while (b) {
+        dictEntry *de = dictBucketEntryAt(b,j);
+        j++;
+        _dictBucketSeek(&b,&j);
+        fn(privdata,de);
+    }
+}
+
+/* ------------------------------ Sharded dicts ----------------------------- */
+
+/* A dict created with dictCreateSharded() holds no table itself: its keys are
+ * partitioned by hash among independent sub-dicts (shards), each with its
+ * own tables and incremental rehashing, so growing one shard never touches
+ * the memory of the others. The tables and entries of a shard are allocated
+ * on the NUMA node it is bound to. The public API dispatches to the shard
+ * owning the key hash; ht[0].used of the parent counts the keys of all the
+ * shards, so that dictSize() stays a field access.
+ *
+ * dictScan() cursors of a sharded dict carry the index of the shard being
+ * scanned in their top byte and the cursor inside that shard in the other
+ * bits, so the scan guarantees hold shard after shard. */
+
+#define DICT_MAX_SHARDS 255
+#define DICT_SHARD_CURSOR_SHIFT (sizeof(unsigned long)*8-8)
+#define DICT_SHARD_CURSOR_MASK ((1UL<<DICT_SHARD_CURSOR_SHIFT)-1)
+#define DICT_NODE_UNCHANGED -2
+
+/* The shard is picked with the 16 hash bits below the bucket tag (the top
+ * byte). The bucket index inside a shard uses the low bits, so the two only
+ * overlap for shard tables of 2^40 buckets or more. */
+#define DICT_SHARD_HASH_SHIFT 40
+static inline dict *_dictShard(dict *d, uint64_t hash) {
+    return d->shards[(uint32_t)((hash >> DICT_SHARD_HASH_SHIFT) & 0xffff) % d->nshards];
+}
+
+/* Bind the allocations of the calling thread to 'node' while operating on
+ * a shard. Returns the previous binding, to pass to _dictUnbindNode(). */
+static inline int _dictBindNode(int node) {
+#ifdef HAVE_NUMA
+    if (node >= 0) return numa_set_thread_alloc_node(node);
+#else
+    DICT_NOTUSED(node);
+#endif
+    return DICT_NODE_UNCHANGED;
+}
+
+static inline void _dictUnbindNode(int old) {
+#ifdef HAVE_NUMA
+    if (old != DICT_NODE_UNCHANGED) numa_set_thread_alloc_node(old);
+#else
+    DICT_NOTUSED(old);
+#endif
+}
+
+/* Create a dict partitioned into 'nshards' shards, shard j being allocated
+ * on NUMA node nodes[j] (no binding if 'nodes' is NULL or nodes[j] is -1).
+ * If 'bucketed' is true the shards use cache line buckets. */
+dict *dictCreateSharded(dictType *type, void *privDataPtr, int nshards, const int *nodes, int bucketed) {
+    assert(nshards > 0 && nshards <= DICT_MAX_SHARDS);
+    dict *d = dictCreate(type,privDataPtr);
+
+    d->bucketed = bucketed;
+    d->nshards = nshards;
+    d->shards = zmalloc(sizeof(dict*)*nshards);
+    for (int j = 0; j < nshards; j++) {
+        int node = nodes ? nodes[j] : -1;
+        int old = _dictBindNode(node);
+        dict *s = dictCreate(type,privDataPtr);
+        _dictUnbindNode(old);
+        s->bucketed = bucketed;
+        s->node = node;
+        d->shards[j] = s;
+    }
+    return d;
+}
+
+unsigned long dictShardsSlots(dict *d) {
+    unsigned long slots = 0;
+
+    for (int j = 0; j < d->nshards; j++) slots += dictSlots(d->shards[j]);
+    return slots;
+}
+
+/* Called by dictPauseRehashing() / dictResumeRehashing(): pausing a sharded
+ * dict pauses every shard. */
+void dictShardsPauseRehashing(dict *d, int delta) {
+    for (int j = 0; j < d->nshards; j++) d->shards[j]->pauserehash += delta;
+}
+
+/* Return true if the dict, or one of its shards, is rehashing. */
+int dictRehashPending(dict *d) {
+    if (!d->shards) return dictIsRehashing(d);
+    for (int j = 0; j < d->nshards; j++)
+        if (dictIsRehashing(d->shards[j])) return 1;
+    return 0;
+}
+
+/* Size every shard for its part of 'size' elements. */
+static int _dictShardsExpand(dict *d, unsigned long size, int* malloc_failed) {
+    unsigned long per_shard = size/d->nshards + 1;
+    int retval = DICT_ERR;
+
+    if (malloc_failed) *malloc_failed = 0;
+    for (int j = 0; j < d->nshards; j++) {
+        dict *s = d->shards[j];
+        int failed = 0;
+        int old = _dictBindNode(s->node);
+
+        if (malloc_failed) {
+            if (dictTryExpand(s,per_shard) == DICT_ERR) failed = 1;
+            else retval = DICT_OK;
+        } else if (dictExpand(s,per_shard) == DICT_OK) {
+            retval = DICT_OK;
+        }
+        _dictUnbindNode(old);
+        if (failed) {
+            *malloc_failed = 1;
+            return DICT_ERR;
+        }
+    }
+    return retval;
+}
+
+static int _dictShardsResize(dict *d) {
+    int retval = DICT_ERR;
+
+    for (int j = 0; j < d->nshards; j++) {
+        dict *s = d->shards[j];
+        int old = _dictBindNode(s->node);
+        if (dictResize(s) == DICT_OK) retval = DICT_OK;
+        _dictUnbindNode(old);
+    }
+    return retval;
+}
+
+/* N steps of incremental rehashing in every rehashing shard. Shards with
+ * rehashing paused (a safe iterator or a scan of that shard only) are
+ * skipped, and don't count as having more to rehash. */
+static int _dictShardsRehash(dict *d, int n) {
+    int more = 0;
+
+    for (int j = 0; j < d->nshards; j++) {
+        dict *s = d->shards[j];
+        if (!dictIsRehashing(s) || s->pauserehash > 0) continue;
+        int old = _dictBindNode(s->node);
+        more |= dictRehash(s,n);
+        _dictUnbindNode(old);
+    }
+    return more;
+}
+
+static void _dictShardsEmpty(dict *d, void(callback)(void*)) {
+    for (int j = 0; j < d->nshards; j++) dictEmpty(d->shards[j],callback);
+    d->ht[0].used = 0;
+}
+
+static void _dictShardsRelease(dict *d) {
+    for (int j = 0; j < d->nshards; j++) dictRelease(d->shards[j]);
+    zfree(d->shards);
+    zfree(d);
+}
+
+/* Iterate the shards one after the other, each with its own iterator of
+ * the same kind. */
+static dictEntry *_dictShardsNext(dictIterator *iter) {
+    dict *d = iter->d;
+
+    while (1) {
+        if (iter->shard_iter == NULL) {
+            if (++iter->index >= d->nshards) return NULL;
+            dict *s = d->shards[iter->index];
+            iter->shard_iter = iter->safe ? dictGetSafeIterator(s) :
+                                            dictGetIterator(s);
+        }
+        dictEntry *de = dictNext(iter->shard_iter);
+        if (de) return de;
+        dictReleaseIterator(iter->shard_iter);
+        iter->shard_iter = NULL;
+    }
+}
+
+/* Pick a shard with a probability proportional to its size. */
+static dict *_dictShardsPick(dict *d) {
+    unsigned long r = randomULong() % dictSize(d);
+
+    for (int j = 0; j < d->nshards; j++) {
+        dict *s = d->shards[j];
+        if (r < dictSize(s)) return s;
+        r -= dictSize(s);
+    }
+    return d->shards[d->nshards-1];
+}
+
+static unsigned long _dictShardsScan(dict *d, unsigned long v,
+                                     dictScanFunction *fn,
+                                     dictScanBucketFunction* bucketfn,
+                                     void *privdata)
+{
+    unsigned long j = v >> DICT_SHARD_CURSOR_SHIFT;
+
+    v &= DICT_SHARD_CURSOR_MASK;
+    for (; j < d->nshards; j++, v = 0) {
+        dict *s = d->shards[j];
+        if (dictSize(s) == 0) continue;
+        v = dictScan(s,v,fn,bucketfn,privdata);
+        if (v) return (j << DICT_SHARD_CURSOR_SHIFT) | v;
+        /* Done with this shard: continue with the next one in the
+         * next call, unless it was the last one. */
+        return (j+1 < d->nshards) ? (j+1) << DICT_SHARD_CURSOR_SHIFT : 0;
+    }
+    return 0;
+}
+
+/* ------------------------- Background resizing ---------------------------- */
+
+/* Growing a dict with hundreds of millions of keys allocates and zeroes a
+ * table of several GB, and completing the rehash frees the old one: both
+ * would stall the thread using the dict. With dictSetBackgroundHooks(),
+ * when _dictExpandIfNeeded() decides to grow a table of at least min_bytes,
+ * the new table is allocated (on the node of the dict) by a background job
+ * instead, while the dict keeps using the old table: the next insertion
+ * that finds the job done starts the incremental rehashing to it. The table
+ * left empty by a completed rehash is freed by a background job as well.
+ * Moving the entries is still done incrementally by the thread owning the
+ * dict, as before.
+ *
+ * The job and the dict only share the dictAsyncTable, protected by its
+ * mutex. The dict may be released or emptied, or explicitly resized, while
+ * the job is pending: then the job is cancelled and frees what it
+ * allocated itself. */
+
+#define DICT_ASYNC_PENDING 0
+#define DICT_ASYNC_DONE 1
+#define DICT_ASYNC_CANCELLED 2
+
+typedef struct dictAsyncTable {
+    pthread_mutex_t lock;
+    int state;
+    int bucketed;
+    int node;
+    unsigned long size;
+    dictEntry **table;  /* NULL after DICT_ASYNC_DONE if allocation failed. */
+} dictAsyncTable;
+
+static dictBackgroundHooks *dict_bg_hooks = NULL;
+
+void dictSetBackgroundHooks(dictBackgroundHooks *hooks) {
+    dict_bg_hooks = hooks;
+}
+
+static void _dictReportLatency(const char *event, long long start) {
+    if (dict_bg_hooks && dict_bg_hooks->latency)
+        dict_bg_hooks->latency(event, timeInMilliseconds()-start);
+}
+
+static size_t _dictTableBytes(int bucketed, unsigned long size) {
+    return size * (bucketed ? sizeof(dictBucket) : sizeof(dictEntry*));
+}
+
+static int _dictUseBackground(size_t bytes) {
+    return dict_bg_hooks && dict_bg_hooks->submit &&
+           dict_bg_hooks->min_bytes && bytes >= dict_bg_hooks->min_bytes;
+}
+
+/* The allocation to free for a table. */
+static void *_dictTableAllocation(int bucketed, dictEntry **table) {
+    if (table == NULL || !bucketed) return table;
+    unsigned char *p = (unsigned char*)table;
+    return p-p[-1];
+}
+
+static void _dictFreeAllocationJob(void *args[]) {
+    zfree(args[0]);
+}
+
+static void _dictAsyncTableAllocJob(void *args[]) {
+    dictAsyncTable *at = args[0];
+    int old = _dictBindNode(at->node);
+    dictEntry **table;
+
+    /* Zero the table explicitly even if the allocator returned zeroed
+     * pages, so that they are also faulted in here rather than by the
+     * rehashing steps. */
+    if (at->bucketed)
+        table = (dictEntry**)_dictBucketsAlloc(at->size, 1);
+    else
+        table = ztrymalloc(_dictTableBytes(0, at->size));
+    if (table) memset(table, 0, _dictTableBytes(at->bucketed, at->size));
+    _dictUnbindNode(old);
+
+    pthread_mutex_lock(&at->lock);
+    if (at->state == DICT_ASYNC_CANCELLED) {
+        pthread_mutex_unlock(&at->lock);
+        zfree(_dictTableAllocation(at->bucketed, table));
+        pthread_mutex_destroy(&at->lock);
+        zfree(at);
+        return;
+    }
+    at->table = table;
+    at->state = DICT_ASYNC_DONE;
+    pthread_mutex_unlock(&at->lock);
+}
+
+/* Start allocating a table for 'size' elements in the background. Returns
+ * DICT_ERR if the table is too small for that to be worth it. */
+static int _dictAsyncTableRequest(dict *d, unsigned long size) {
+    unsigned long realsize = _dictTableSize(d, size);
+    dictAsyncTable *at;
+
+    if (realsize == d->ht[0].size ||
+        realsize > SIZE_MAX / _dictTableBytes(d->bucketed, 1) ||
+        !_dictUseBackground(_dictTableBytes(d->bucketed, realsize)))
+        return DICT_ERR;
+
+    at = zmalloc(sizeof(*at));
+    pthread_mutex_init(&at->lock, NULL);
+    at->state = DICT_ASYNC_PENDING;
+    at->bucketed = d->bucketed;
+    at->node = d->node;
+    at->size = realsize;
+    at->table = NULL;
+    d->async_table = at;
+    dict_bg_hooks->submit(d->node, _dictAsyncTableAllocJob, at);
+    return DICT_OK;
+}
+
+/* Drop the pending background table of 'd', if any. */
+static void _dictAsyncTableCancel(dict *d) {
+    dictAsyncTable *at = d->async_table;
+
+    if (at == NULL) return;
+    d->async_table = NULL;
+    pthread_mutex_lock(&at->lock);
+    if (at->state == DICT_ASYNC_PENDING) {
+        /* The job frees everything when done. */
+        at->state = DICT_ASYNC_CANCELLED;
+        pthread_mutex_unlock(&at->lock);
+        return;
+    }
+    pthread_mutex_unlock(&at->lock);
+    zfree(_dictTableAllocation(at->bucketed, at->table));
+    pthread_mutex_destroy(&at->lock);
+    zfree(at);
+}
+
+/* Start rehashing to the background table of 'd' if it is ready. If its
+ * allocation failed, expand synchronously instead. Like a synchronous
+ * expand, this waits while resizing is forbidden, or avoided (there is a fork
+ * child) and the table isn't over the forced resize ratio. */
+static int _dictAsyncTableInstall(dict *d) {
+    dictAsyncTable *at = d->async_table;
+    int state;
+
+    pthread_mutex_lock(&at->lock);
+    state = at->state;
+    pthread_mutex_unlock(&at->lock);
+    if (state == DICT_ASYNC_PENDING) return DICT_OK;
+    if (dict_can_resize != DICT_RESIZE_ENABLE) {
+        unsigned long capacity = d->ht[0].size;
+        if (d->bucketed) capacity *= DICT_BUCKET_FILL;
+        if (dict_can_resize == DICT_RESIZE_FORBID ||
+            d->ht[0].used / capacity <= dict_force_resize_ratio)
+            return DICT_OK;
+    }
+
+    d->async_table = NULL;
+    if (at->table == NULL) {
+        pthread_mutex_destroy(&at->lock);
+        zfree(at);
+        return dictExpand(d, d->ht[0].used + 1);
+    }
+    d->ht[1].table = at->table;
+    d->ht[1].size = at->size;
+    d->ht[1].sizemask = at->size-1;
+    d->ht[1].used = 0;
+    d->rehashidx = 0;
+    pthread_mutex_destroy(&at->lock);
+    zfree(at);
+    return DICT_OK;
+}
+
+/* Free a table left empty by rehashing, in the background if it is big. */
+static void _dictFreeTable(dict *d, dictht *ht) {
+    void *alloc = _dictTableAllocation(d->bucketed, ht->table);
+
+    if (alloc && _dictUseBackground(_dictTableBytes(d->bucketed, ht->size))) {
+        dict_bg_hooks->submit(d->node, _dictFreeAllocationJob, alloc);
+        return;
+    }
+    long long start = timeInMilliseconds();
+    zfree(alloc);
+    _dictReportLatency("dict-table-free", start);
+}
+
 /* ----------------------------- API implementation ------------------------- */
 
 /* Reset a hash table already initialized with ht_init().
@@ -103,6 +754,12 @@ static void _dictReset(dictht *ht)
     ht->used = 0;
 }
 
+/* Release the key of a chained entry, unless it is embedded in the entry
+ * allocation and goes away with it. */
+static void _dictFreeEntryKey(dict *d, dictEntry *he) {
+    if (!dictEmbedsKey(d, he->key)) dictFreeKey(d, he);
+}
+
 /* Create a new hash table */
 dict *dictCreate(dictType *type,
         void *privDataPtr)
@@ -113,6 +770,14 @@ dict *dictCreate(dictType *type,
     return d;
 }
 
+/* Create a new hash table with cache line buckets, see "Bucketed tables". */
+dict *dictCreateBucketed(dictType *type, void *privDataPtr) {
+    dict *d = dictCreate(type,privDataPtr);
+
+    d->bucketed = 1;
+    return d;
+}
+
 /* Initialize the hash table */
 int _dictInit(dict *d, dictType *type,
         void *privDataPtr)
@@ -123,6 +788,12 @@ int _dictInit(dict *d, dictType *type,
     d->privdata = privDataPtr;
     d->rehashidx = -1;
     d->pauserehash = 0;
+    d->bucketed = 0;
+    d->nshards = 0;
+    d->node = -1;
+    d->overflow_buckets = 0;
+    d->shards = NULL;
+    d->async_table = NULL;
     return DICT_OK;
 }
 
@@ -132,6 +803,7 @@ int dictResize(dict *d)
 {
     unsigned long minimal;
 
+    if (d->shards) return _dictShardsResize(d);
     if (dict_can_resize != DICT_RESIZE_ENABLE || dictIsRehashing(d)) return DICT_ERR;
     minimal = d->ht[0].used;
     if (minimal < DICT_HT_INITIAL_SIZE)
@@ -144,6 +816,7 @@ int dictResize(dict *d)
  * Returns DICT_OK if expand was performed, and DICT_ERR if skipped. */
 int _dictExpand(dict *d, unsigned long size, int* malloc_failed)
 {
+    if (d->shards) return _dictShardsExpand(d, size, malloc_failed);
     if (malloc_failed) *malloc_failed = 0;
 
     /* the size is invalid if it is smaller than the number of
@@ -152,25 +825,38 @@ int _dictExpand(dict *d, unsigned long size, int* malloc_failed)
         return DICT_ERR;
 
     dictht n; /* the new hash table */
-    unsigned long realsize = _dictNextPower(size);
+    unsigned long realsize = _dictTableSize(d, size);
+    size_t unit = d->bucketed ? sizeof(dictBucket) : sizeof(dictEntry*);
 
     /* Detect overflows */
-    if (realsize < size || realsize * sizeof(dictEntry*) < realsize)
+    if ((!d->bucketed && realsize < size) || realsize > SIZE_MAX / unit)
         return DICT_ERR;
 
     /* Rehashing to the same table size is not useful. */
     if (realsize == d->ht[0].size) return DICT_ERR;
 
+    /* An explicit resize supersedes a table pending in the background. */
+    _dictAsyncTableCancel(d);
+
     /* Allocate the new hash table and initialize all pointers to NULL */
+    long long start = timeInMilliseconds();
     n.size = realsize;
     n.sizemask = realsize-1;
-    if (malloc_failed) {
+    if (d->bucketed) {
+        n.table = (dictEntry**)_dictBucketsAlloc(realsize, malloc_failed != NULL);
+        if (malloc_failed) {
+            *malloc_failed = n.table == NULL;
+            if (*malloc_failed)
+                return DICT_ERR;
+        }
+    } else if (malloc_failed) {
         n.table = ztrycalloc(realsize*sizeof(dictEntry*));
         *malloc_failed = n.table == NULL;
         if (*malloc_failed)
             return DICT_ERR;
     } else
         n.table = zcalloc(realsize*sizeof(dictEntry*));
+    _dictReportLatency("dict-expand", start);
 
     n.used = 0;
 
@@ -209,6 +895,8 @@ int dictTryExpand(dict *d, unsigned long size) {
  * will visit at max N*10 empty buckets in total, otherwise the amount of
  * work it does would be unbound and the function may block for a long time. */
 int dictRehash(dict *d, int n) {
+    if (d->shards) return _dictShardsRehash(d,n);
+
     int empty_visits = n*10; /* Max number of empty buckets to visit. */
     unsigned long s0 = d->ht[0].size;
     unsigned long s1 = d->ht[1].size;
@@ -226,6 +914,18 @@ int dictRehash(dict *d, int n) {
         /* Note that rehashidx can't overflow as we are sure there are more
          * elements because ht[0].used != 0 */
         assert(d->ht[0].size > (unsigned long)d->rehashidx);
+        if (d->bucketed) {
+            /* Same as below, a bucket chain at a time. */
+            dictBucket *b = dictBuckets(&d->ht[0])+d->rehashidx;
+            while(b->used == 0 && b->next == NULL) {
+                d->rehashidx++;
+                b++;
+                if (--empty_visits == 0) return 1;
+            }
+            _dictBucketRehash(d, d->rehashidx);
+            d->rehashidx++;
+            continue;
+        }
         while(d->ht[0].table[d->rehashidx] == NULL) {
             d->rehashidx++;
             if (--empty_visits == 0) return 1;
@@ -250,7 +950,7 @@ int dictRehash(dict *d, int n) {
 
     /* Check if we already rehashed the whole table... */
     if (d->ht[0].used == 0) {
-        zfree(d->ht[0].table);
+        _dictFreeTable(d, &d->ht[0]);
         d->ht[0] = d->ht[1];
         _dictReset(&d->ht[1]);
         d->rehashidx = -1;
@@ -324,7 +1024,7 @@ int dictAdd(dict *d, void *key, void *val)
  *
  * If key was added, the hash entry is returned to be manipulated by the caller.
  */
-dictEntry *dictAddRaw(dict *d, void *key, dictEntry **existing)
+static dictEntry *_dictAddRaw(dict *d, void *key, uint64_t h, dictEntry **existing)
 {
     long index;
     dictEntry *entry;
@@ -332,9 +1032,26 @@ dictEntry *dictAddRaw(dict *d, void *key, dictEntry **existing)
 
     if (dictIsRehashing(d)) _dictRehashStep(d);
 
+    if (d->bucketed) {
+        if (existing) *existing = NULL;
+        if (_dictExpandIfNeeded(d) == DICT_ERR) return NULL;
+        for (int table = 0; table <= 1; table++) {
+            entry = _dictBucketFind(d, &d->ht[table], h, key);
+            if (entry) {
+                if (existing) *existing = entry;
+                return NULL;
+            }
+            if (!dictIsRehashing(d)) break;
+        }
+        ht = dictIsRehashing(d) ? &d->ht[1] : &d->ht[0];
+        entry = _dictBucketInsert(d, ht, h);
+        dictSetKey(d, entry, key);
+        return entry;
+    }
+
     /* Get the index of the new element, or -1 if
      * the element already exists. */
-    if ((index = _dictKeyIndex(d, key, dictHashKey(d,key), existing)) == -1)
+    if ((index = _dictKeyIndex(d, key, h, existing)) == -1)
         return NULL;
 
     /* Allocate the memory and store the new entry.
@@ -342,16 +1059,35 @@ dictEntry *dictAddRaw(dict *d, void *key, dictEntry **existing)
      * system it is more likely that recently added entries are accessed
      * more frequently. */
     ht = dictIsRehashing(d) ? &d->ht[1] : &d->ht[0];
-    entry = zmalloc(sizeof(*entry));
+    size_t embedlen = d->type->keyEmbedLen ? d->type->keyEmbedLen(key) : 0;
+    entry = zmalloc(sizeof(*entry)+embedlen);
     entry->next = ht->table[index];
     ht->table[index] = entry;
     ht->used++;
 
     /* Set the hash entry fields. */
-    dictSetKey(d, entry, key);
+    if (embedlen)
+        entry->key = d->type->keyEmbed(entry+1, key);
+    else
+        dictSetKey(d, entry, key);
     return entry;
 }
 
+dictEntry *dictAddRaw(dict *d, void *key, dictEntry **existing)
+{
+    uint64_t h = dictHashKey(d,key);
+
+    if (d->shards) {
+        dict *s = _dictShard(d,h);
+        int old = _dictBindNode(s->node);
+        dictEntry *entry = _dictAddRaw(s,key,h,existing);
+        _dictUnbindNode(old);
+        if (entry) d->ht[0].used++;
+        return entry;
+    }
+    return _dictAddRaw(d,key,h,existing);
+}
+
 /* Add or Overwrite:
  * Add an element, discarding the old value if the key already exists.
  * Return 1 if the key was added from scratch, 0 if there was already an
@@ -396,17 +1132,22 @@ dictEntry *dictAddOrFind(dict *d, void *key) {
 /* Search and remove an element. This is an helper function for
  * dictDelete() and dictUnlink(), please check the top comment
  * of those functions. */
-static dictEntry *dictGenericDelete(dict *d, const void *key, int nofree) {
-    uint64_t h, idx;
+static dictEntry *_dictGenericDelete(dict *d, const void *key, uint64_t h, int nofree) {
+    uint64_t idx;
     dictEntry *he, *prevHe;
     int table;
 
     if (d->ht[0].used == 0 && d->ht[1].used == 0) return NULL;
 
     if (dictIsRehashing(d)) _dictRehashStep(d);
-    h = dictHashKey(d, key);
 
     for (table = 0; table <= 1; table++) {
+        if (d->bucketed) {
+            he = _dictBucketDelete(d, &d->ht[table], h, key, nofree);
+            if (he) return he;
+            if (!dictIsRehashing(d)) break;
+            continue;
+        }
         idx = h & d->ht[table].sizemask;
         he = d->ht[table].table[idx];
         prevHe = NULL;
@@ -418,7 +1159,7 @@ static dictEntry *dictGenericDelete(dict *d, const void *key, int nofree) {
                 else
                     d->ht[table].table[idx] = he->next;
                 if (!nofree) {
-                    dictFreeKey(d, he);
+                    _dictFreeEntryKey(d, he);
                     dictFreeVal(d, he);
                     zfree(he);
                 }
@@ -433,6 +1174,22 @@ static dictEntry *dictGenericDelete(dict *d, const void *key, int nofree) {
     return NULL; /* not found */
 }
 
+static dictEntry *dictGenericDelete(dict *d, const void *key, int nofree) {
+    uint64_t h;
+
+    if (dictSize(d) == 0) return NULL;
+    h = dictHashKey(d, key);
+    if (d->shards) {
+        dict *s = _dictShard(d,h);
+        int old = _dictBindNode(s->node);
+        dictEntry *he = _dictGenericDelete(s,key,h,nofree);
+        _dictUnbindNode(old);
+        if (he) d->ht[0].used--;
+        return he;
+    }
+    return _dictGenericDelete(d,key,h,nofree);
+}
+
 /* Remove an element, returning DICT_OK on success or DICT_ERR if the
  * element was not found. */
 int dictDelete(dict *ht, const void *key) {
@@ -460,6 +1217,7 @@ int dictDelete(dict *ht, const void *key) {
  * // Do something with entry
  * dictFreeUnlinkedEntry(entry); // <- This does not need to lookup again.
  */
+/* With bucketed dicts the returned entry is a copy, as its slot is reused. */
 dictEntry *dictUnlink(dict *ht, const void *key) {
     return dictGenericDelete(ht,key,1);
 }
@@ -468,7 +1226,7 @@ dictEntry *dictUnlink(dict *ht, const void *key) {
  * to dictUnlink(). It's safe to call this function with 'he' = NULL. */
 void dictFreeUnlinkedEntry(dict *d, dictEntry *he) {
     if (he == NULL) return;
-    dictFreeKey(d, he);
+    _dictFreeEntryKey(d, he);
     dictFreeVal(d, he);
     zfree(he);
 }
@@ -477,6 +1235,12 @@ void dictFreeUnlinkedEntry(dict *d, dictEntry *he) {
 int _dictClear(dict *d, dictht *ht, void(callback)(void *)) {
     unsigned long i;
 
+    if (d->bucketed) {
+        _dictBucketsClear(d,ht,callback);
+        _dictReset(ht);
+        return DICT_OK;
+    }
+
     /* Free all the elements */
     for (i = 0; i < ht->size && ht->used > 0; i++) {
         dictEntry *he, *nextHe;
@@ -486,7 +1250,7 @@ int _dictClear(dict *d, dictht *ht, void(callback)(void *)) {
         if ((he = ht->table[i]) == NULL) continue;
         while(he) {
             nextHe = he->next;
-            dictFreeKey(d, he);
+            _dictFreeEntryKey(d, he);
             dictFreeVal(d, he);
             zfree(he);
             ht->used--;
@@ -503,20 +1267,30 @@ int _dictClear(dict *d, dictht *ht, void(callback)(void *)) {
 /* Clear & Release the hash table */
 void dictRelease(dict *d)
 {
+    if (d->shards) {
+        _dictShardsRelease(d);
+        return;
+    }
+    _dictAsyncTableCancel(d);
     _dictClear(d,&d->ht[0],NULL);
     _dictClear(d,&d->ht[1],NULL);
     zfree(d);
 }
 
-dictEntry *dictFind(dict *d, const void *key)
+static dictEntry *_dictFind(dict *d, const void *key, uint64_t h)
 {
     dictEntry *he;
-    uint64_t h, idx, table;
+    uint64_t idx, table;
 
     if (dictSize(d) == 0) return NULL; /* dict is empty */
     if (dictIsRehashing(d)) _dictRehashStep(d);
-    h = dictHashKey(d, key);
     for (table = 0; table <= 1; table++) {
+        if (d->bucketed) {
+            he = _dictBucketFind(d, &d->ht[table], h, key);
+            if (he) return he;
+            if (!dictIsRehashing(d)) return NULL;
+            continue;
+        }
         idx = h & d->ht[table].sizemask;
         he = d->ht[table].table[idx];
         while(he) {
@@ -529,6 +1303,22 @@ dictEntry *dictFind(dict *d, const void *key)
     return NULL;
 }
 
+dictEntry *dictFind(dict *d, const void *key)
+{
+    uint64_t h;
+
+    if (dictSize(d) == 0) return NULL; /* dict is empty */
+    h = dictHashKey(d, key);
+    if (d->shards) {
+        dict *s = _dictShard(d,h);
+        int old = _dictBindNode(s->node);
+        dictEntry *he = _dictFind(s,key,h);
+        _dictUnbindNode(old);
+        return he;
+    }
+    return _dictFind(d,key,h);
+}
+
 void *dictFetchValue(dict *d, const void *key) {
     dictEntry *he;
 
@@ -584,6 +1374,9 @@ dictIterator *dictGetIterator(dict *d)
     iter->safe = 0;
     iter->entry = NULL;
     iter->nextEntry = NULL;
+    iter->bucket = NULL;
+    iter->slot = 0;
+    iter->shard_iter = NULL;
     return iter;
 }
 
@@ -594,8 +1387,50 @@ dictIterator *dictGetSafeIterator(dict *d) {
     return i;
 }
 
+/* dictNext() for bucketed dicts: iter->bucket and iter->slot are the
+ * position of the entry to return next, found before returning the current
+ * one since the user may delete it. */
+static dictEntry *_dictBucketNext(dictIterator *iter) {
+    dictht *ht = &iter->d->ht[iter->table];
+
+    while (iter->bucket == NULL) {
+        iter->index++;
+        if (iter->index >= (long) ht->size) {
+            if (dictIsRehashing(iter->d) && iter->table == 0) {
+                iter->table++;
+                iter->index = 0;
+                ht = &iter->d->ht[1];
+            } else {
+                return NULL;
+            }
+        }
+        dictBucket *b = dictBuckets(ht)+iter->index;
+        iter->slot = 0;
+        _dictBucketSeek(&b,&iter->slot);
+        iter->bucket = b;
+    }
+
+    dictBucket *b = iter->bucket;
+    iter->entry = dictBucketEntryAt(b,iter->slot);
+    iter->slot++;
+    _dictBucketSeek(&b,&iter->slot);
+    iter->bucket = b;
+    return iter->entry;
+}
+
 dictEntry *dictNext(dictIterator *iter)
 {
+    if (iter->d->shards) return _dictShardsNext(iter);
+    if (iter->d->bucketed) {
+        if (iter->index == -1 && iter->table == 0 && iter->bucket == NULL) {
+            if (iter->safe)
+                dictPauseRehashing(iter->d);
+            else
+                iter->fingerprint = dictFingerprint(iter->d);
+        }
+        return _dictBucketNext(iter);
+    }
+
     while (1) {
         if (iter->entry == NULL) {
             dictht *ht = &iter->d->ht[iter->table];
@@ -631,7 +1466,9 @@ dictEntry *dictNext(dictIterator *iter)
 
 void dictReleaseIterator(dictIterator *iter)
 {
-    if (!(iter->index == -1 && iter->table == 0)) {
+    if (iter->d->shards) {
+        if (iter->shard_iter) dictReleaseIterator(iter->shard_iter);
+    } else if (!(iter->index == -1 && iter->table == 0)) {
         if (iter->safe)
             dictResumeRehashing(iter->d);
         else
@@ -649,7 +1486,32 @@ dictEntry *dictGetRandomKey(dict *d)
     int listlen, listele;
 
     if (dictSize(d) == 0) return NULL;
+    if (d->shards) return dictGetRandomKey(_dictShardsPick(d));
     if (dictIsRehashing(d)) _dictRehashStep(d);
+    if (d->bucketed) {
+        dictBucket *b;
+        unsigned long len;
+        int j = 0;
+
+        /* Same as below, with bucket chains. */
+        do {
+            if (dictIsRehashing(d)) {
+                h = d->rehashidx + (randomULong() % (dictSlots(d) - d->rehashidx));
+                b = (h >= d->ht[0].size) ? dictBuckets(&d->ht[1])+(h - d->ht[0].size) :
+                                           dictBuckets(&d->ht[0])+h;
+            } else {
+                h = randomULong() & d->ht[0].sizemask;
+                b = dictBuckets(&d->ht[0])+h;
+            }
+        } while((len = _dictBucketChainLen(b)) == 0);
+        listele = random() % len;
+        _dictBucketSeek(&b,&j);
+        while(listele--) {
+            j++;
+            _dictBucketSeek(&b,&j);
+        }
+        return dictBucketEntryAt(b,j);
+    }
     if (dictIsRehashing(d)) {
         do {
             /* We are sure there are no elements in indexes from 0
@@ -709,6 +1571,12 @@ unsigned int dictGetSomeKeys(dict *d, dictEntry **des, unsigned int count) {
     unsigned long stored = 0, maxsizemask;
     unsigned long maxsteps;
 
+    /* Sample a shard chosen with a probability proportional to its size. */
+    if (d->shards) {
+        if (dictSize(d) == 0) return 0;
+        return dictGetSomeKeys(_dictShardsPick(d),des,count);
+    }
+
     if (dictSize(d) < count) count = dictSize(d);
     maxsteps = count*10;
 
@@ -744,6 +1612,31 @@ unsigned int dictGetSomeKeys(dict *d, dictEntry **des, unsigned int count) {
                     continue;
             }
             if (i >= d->ht[j].size) continue; /* Out of range for this table. */
+            if (d->bucketed) {
+                dictBucket *b = dictBuckets(&d->ht[j])+i;
+                int slot = 0;
+
+                /* Same as below, with bucket chains. */
+                _dictBucketSeek(&b,&slot);
+                if (b == NULL) {
+                    emptylen++;
+                    if (emptylen >= 5 && emptylen > count) {
+                        i = randomULong() & maxsizemask;
+                        emptylen = 0;
+                    }
+                    continue;
+                }
+                emptylen = 0;
+                while (b) {
+                    *des = dictBucketEntryAt(b,slot);
+                    des++;
+                    stored++;
+                    if (stored == count) return stored;
+                    slot++;
+                    _dictBucketSeek(&b,&slot);
+                }
+                continue;
+            }
             dictEntry *he = d->ht[j].table[i];
 
             /* Count contiguous empty buckets, and jump to other
@@ -891,6 +1784,9 @@ static unsigned long rev(unsigned long v) {
  *    we are sure we don't miss keys moving during rehashing.
  * 3) The reverse cursor is somewhat hard to understand at first, but this
  *    comment is supposed to help.
+ *
+ * With bucketed dicts 'bucketfn' is not called: the entries are stored in
+ * the buckets and there are no entry allocations to reference.
  */
 unsigned long dictScan(dict *d,
                        unsigned long v,
@@ -903,6 +1799,7 @@ unsigned long dictScan(dict *d,
     unsigned long m0, m1;
 
     if (dictSize(d) == 0) return 0;
+    if (d->shards) return _dictShardsScan(d,v,fn,bucketfn,privdata);
 
     /* This is needed in case the scan callback tries to do dictFind or alike. */
     dictPauseRehashing(d);
@@ -912,12 +1809,16 @@ unsigned long dictScan(dict *d,
         m0 = t0->sizemask;
 
         /* Emit entries at cursor */
-        if (bucketfn) bucketfn(privdata, &t0->table[v & m0]);
-        de = t0->table[v & m0];
-        while (de) {
-            next = de->next;
-            fn(privdata, de);
-            de = next;
+        if (d->bucketed) {
+            _dictBucketEmit(dictBuckets(t0)+(v & m0), fn, privdata);
+        } else {
+            if (bucketfn) bucketfn(privdata, &t0->table[v & m0]);
+            de = t0->table[v & m0];
+            while (de) {
+                next = de->next;
+                fn(privdata, de);
+                de = next;
+            }
         }
 
         /* Set unmasked bits so incrementing the reversed cursor
@@ -943,24 +1844,32 @@ unsigned long dictScan(dict *d,
         m1 = t1->sizemask;
 
         /* Emit entries at cursor */
-        if (bucketfn) bucketfn(privdata, &t0->table[v & m0]);
-        de = t0->table[v & m0];
-        while (de) {
-            next = de->next;
-            fn(privdata, de);
-            de = next;
+        if (d->bucketed) {
+            _dictBucketEmit(dictBuckets(t0)+(v & m0), fn, privdata);
+        } else {
+            if (bucketfn) bucketfn(privdata, &t0->table[v & m0]);
+            de = t0->table[v & m0];
+            while (de) {
+                next = de->next;
+                fn(privdata, de);
+                de = next;
+            }
         }
 
         /* Iterate over indices in larger table that are the expansion
          * of the index pointed to by the cursor in the smaller table */
         do {
             /* Emit entries at cursor */
-            if (bucketfn) bucketfn(privdata, &t1->table[v & m1]);
-            de = t1->table[v & m1];
-            while (de) {
-                next = de->next;
-                fn(privdata, de);
-                de = next;
+            if (d->bucketed) {
+                _dictBucketEmit(dictBuckets(t1)+(v & m1), fn, privdata);
+            } else {
+                if (bucketfn) bucketfn(privdata, &t1->table[v & m1]);
+                de = t1->table[v & m1];
+                while (de) {
+                    next = de->next;
+                    fn(privdata, de);
+                    de = next;
+                }
             }
 
             /* Increment the reverse cursor not covered by the smaller mask.*/
@@ -978,6 +1887,83 @@ unsigned long dictScan(dict *d,
     return v;
 }
 
+/* Call 'fn' for every entry of bucket 'idx' (masked to the table size) of
+ * both tables when rehashing, with rehashing paused. 'fn' may delete the
+ * entry it gets. This is a lower level dictScan() step for callers that walk
+ * the buckets with their own cursor: with a sharded dict, consecutive values
+ * of 'idx' visit the shards in turn. Returns the number of buckets visited. */
+int dictBucketForEach(dict *d, unsigned long idx, dictScanFunction *fn, void *privdata) {
+    int visited = 0;
+
+    if (d->shards)
+        return dictBucketForEach(d->shards[idx % d->nshards],
+                                 idx / d->nshards, fn, privdata);
+
+    dictPauseRehashing(d);
+    for (int table = 0; table < 2; table++) {
+        dictht *ht = &d->ht[table];
+
+        if (table == 1 && !dictIsRehashing(d)) break;
+        visited++;
+        if (ht->size == 0) continue;
+        if (d->bucketed) {
+            _dictBucketEmit(dictBuckets(ht)+(idx & ht->sizemask), fn, privdata);
+        } else {
+            dictEntry *de = ht->table[idx & ht->sizemask], *next;
+            while (de) {
+                next = de->next;
+                fn(privdata, de);
+                de = next;
+            }
+        }
+    }
+    dictResumeRehashing(d);
+    return visited;
+}
+
+/* Lookups split in steps, so that the caller can prefetch the buckets of
+ * many keys before touching any of them: dictGetBucket() returns the
+ * address of the bucket 'hash' maps to (NULL for an empty table), and
+ * dictBucketCandidate() the first entry in it that may hold the key, without
+ * comparing keys. */
+void *dictGetBucket(dict *d, uint64_t hash) {
+    if (d->shards) d = _dictShard(d,hash);
+
+    dictht *ht = &d->ht[0];
+    uint64_t idx;
+
+    if (ht->size == 0) return NULL;
+    idx = hash & ht->sizemask;
+    /* Buckets below rehashidx were already moved to the new table. */
+    if (dictIsRehashing(d) && (long)idx < d->rehashidx) {
+        ht = &d->ht[1];
+        idx = hash & ht->sizemask;
+    }
+    if (d->bucketed) return dictBuckets(ht)+idx;
+    return &ht->table[idx];
+}
+
+dictEntry *dictBucketCandidate(dict *d, void *bucket, uint64_t hash) {
+    if (bucket == NULL) return NULL;
+    if (!d->bucketed) return *(dictEntry**)bucket;
+
+    dictBucket *b = bucket;
+    unsigned int match = _dictBucketMatch(b,dictBucketTag(hash));
+    return match ? dictBucketEntryAt(b,_dictCtz(match)) : NULL;
+}
+
+/* Memory used by the tables and entries, not counting keys and values. */
+size_t dictMemUsage(dict *d) {
+    if (d->shards) {
+        size_t mem = 0;
+        for (int j = 0; j < d->nshards; j++) mem += dictMemUsage(d->shards[j]);
+        return mem;
+    }
+    if (d->bucketed)
+        return (dictSlots(d)+d->overflow_buckets)*sizeof(dictBucket);
+    return dictSize(d)*sizeof(dictEntry) + dictSlots(d)*sizeof(dictEntry*);
+}
+
 /* ------------------------- private functions ------------------------------ */
 
 /* Because we may need to allocate huge memory chunk at once when dict
@@ -985,6 +1971,10 @@ unsigned long dictScan(dict *d,
  * type has expandAllowed member function. */
 static int dictTypeExpandAllowed(dict *d) {
     if (d->type->expandAllowed == NULL) return 1;
+    if (d->bucketed)
+        return d->type->expandAllowed(
+                    _dictTableSize(d, d->ht[0].used + 1) * sizeof(dictBucket),
+                    (double)d->ht[0].used / (d->ht[0].size * DICT_BUCKET_FILL));
     return d->type->expandAllowed(
                     _dictNextPower(d->ht[0].used + 1) * sizeof(dictEntry*),
                     (double)d->ht[0].used / d->ht[0].size);
@@ -996,6 +1986,10 @@ static int _dictExpandIfNeeded(dict *d)
     /* Incremental rehashing already in progress. Return. */
     if (dictIsRehashing(d)) return DICT_OK;
 
+    /* A bigger table is being allocated in the background: keep using the
+     * current one until it is ready. */
+    if (d->async_table) return _dictAsyncTableInstall(d);
+
     /* If the hash table is empty expand it to the initial size. */
     if (d->ht[0].size == 0) return dictExpand(d, DICT_HT_INITIAL_SIZE);
 
@@ -1005,11 +1999,15 @@ static int _dictExpandIfNeeded(dict *d)
      * the number of buckets. */
     if (!dictTypeExpandAllowed(d))
         return DICT_OK;
+    unsigned long capacity = d->ht[0].size;
+    if (d->bucketed) capacity *= DICT_BUCKET_FILL;
     if ((dict_can_resize == DICT_RESIZE_ENABLE &&
-         d->ht[0].used >= d->ht[0].size) ||
+         d->ht[0].used >= capacity) ||
         (dict_can_resize != DICT_RESIZE_FORBID &&
-         d->ht[0].used / d->ht[0].size > dict_force_resize_ratio))
+         d->ht[0].used / capacity > dict_force_resize_ratio))
     {
+        if (_dictAsyncTableRequest(d, d->ht[0].used + 1) == DICT_OK)
+            return DICT_OK;
         return dictExpand(d, d->ht[0].used + 1);
     }
     return DICT_OK;
@@ -1028,6 +2026,13 @@ static unsigned long _dictNextPower(unsigned long size)
     }
 }
 
+/* Number of buckets of a table for 'size' elements. */
+static unsigned long _dictTableSize(dict *d, unsigned long size) {
+    if (d->bucketed)
+        return _dictNextPower(size/DICT_BUCKET_FILL + (size % DICT_BUCKET_FILL != 0));
+    return _dictNextPower(size);
+}
+
 /* Returns the index of a free slot that can be populated with
  * a hash entry for the given 'key'.
  * If the key already exists, -1 is returned
@@ -1061,6 +2066,11 @@ static long _dictKeyIndex(dict *d, const void *key, uint64_t hash, dictEntry **e
 }
 
 void dictEmpty(dict *d, void(callback)(void*)) {
+    if (d->shards) {
+        _dictShardsEmpty(d,callback);
+        return;
+    }
+    _dictAsyncTableCancel(d);
     _dictClear(d,&d->ht[0],callback);
     _dictClear(d,&d->ht[1],callback);
     d->rehashidx = -1;
@@ -1084,6 +2094,8 @@ dictEntry **dictFindEntryRefByPtrAndHash(dict *d, const void *oldptr, uint64_t h
     dictEntry *he, **heref;
     unsigned long idx, table;
 
+    assert(!d->bucketed); /* No entry references, see dictFindEntryByPtrAndHash(). */
+    if (d->shards) return dictFindEntryRefByPtrAndHash(_dictShard(d,hash),oldptr,hash);
     if (dictSize(d) == 0) return NULL; /* dict is empty */
     for (table = 0; table <= 1; table++) {
         idx = hash & d->ht[table].sizemask;
@@ -1100,12 +2112,39 @@ dictEntry **dictFindEntryRefByPtrAndHash(dict *d, const void *oldptr, uint64_t h
     return NULL;
 }
 
+/* Like dictFindEntryRefByPtrAndHash(), but returns the entry itself, which
+ * also works with bucketed dicts. */
+dictEntry *dictFindEntryByPtrAndHash(dict *d, const void *oldptr, uint64_t hash) {
+    unsigned long table;
+
+    if (d->shards) return dictFindEntryByPtrAndHash(_dictShard(d,hash),oldptr,hash);
+    if (!d->bucketed) {
+        dictEntry **deref = dictFindEntryRefByPtrAndHash(d, oldptr, hash);
+        return deref ? *deref : NULL;
+    }
+    if (dictSize(d) == 0) return NULL; /* dict is empty */
+    for (table = 0; table <= 1; table++) {
+        dictBucket *b = dictBuckets(&d->ht[table]) + (hash & d->ht[table].sizemask);
+        do {
+            unsigned int match = _dictBucketMatch(b,dictBucketTag(hash));
+            while (match) {
+                int j = _dictCtz(match);
+                if (oldptr == b->entry[j].key) return dictBucketEntryAt(b,j);
+                match &= match-1;
+            }
+            b = b->next;
+        } while(b);
+        if (!dictIsRehashing(d)) return NULL;
+    }
+    return NULL;
+}
+
 /* ------------------------------- Debugging ---------------------------------*/
 
 #define DICT_STATS_VECTLEN 50
-size_t _dictGetStatsHt(char *buf, size_t bufsize, dictht *ht, int tableid) {
+size_t _dictGetStatsHt(char *buf, size_t bufsize, dict *d, dictht *ht, int tableid) {
     unsigned long i, slots = 0, chainlen, maxchainlen = 0;
-    unsigned long totchainlen = 0;
+    unsigned long totchainlen = 0, overflow = 0;
     unsigned long clvector[DICT_STATS_VECTLEN];
     size_t l = 0;
 
@@ -1121,6 +2160,21 @@ size_t _dictGetStatsHt(char *buf, size_t bufsize, dictht *ht, int tableid) {
     for (i = 0; i < ht->size; i++) {
         dictEntry *he;
 
+        if (d->bucketed) {
+            /* Chains are bucket chains, their length counts entries. */
+            dictBucket *b = dictBuckets(ht)+i;
+            chainlen = _dictBucketChainLen(b);
+            while ((b = b->next)) overflow++;
+            if (chainlen == 0) {
+                clvector[0]++;
+                continue;
+            }
+            slots++;
+            clvector[(chainlen < DICT_STATS_VECTLEN) ? chainlen : (DICT_STATS_VECTLEN-1)]++;
+            if (chainlen > maxchainlen) maxchainlen = chainlen;
+            totchainlen += chainlen;
+            continue;
+        }
         if (ht->table[i] == NULL) {
             clvector[0]++;
             continue;
@@ -1146,11 +2200,18 @@ size_t _dictGetStatsHt(char *buf, size_t bufsize, dictht *ht, int tableid) {
         " different slots: %lu\n"
         " max chain length: %lu\n"
         " avg chain length (counted): %.02f\n"
-        " avg chain length (computed): %.02f\n"
-        " Chain length distribution:\n",
+        " avg chain length (computed): %.02f\n",
         tableid, (tableid == 0) ? "main hash table" : "rehashing target",
         ht->size, ht->used, slots, maxchainlen,
         (float)totchainlen/slots, (float)ht->used/slots);
+    if (d->bucketed && l < bufsize) {
+        l += snprintf(buf+l,bufsize-l,
+            " entries per bucket: %d\n"
+            " overflow buckets: %lu\n",
+            DICT_BUCKET_SLOTS, overflow);
+    }
+    if (l < bufsize)
+        l += snprintf(buf+l,bufsize-l," Chain length distribution:\n");
 
     for (i = 0; i < DICT_STATS_VECTLEN-1; i++) {
         if (clvector[i] == 0) continue;
@@ -1171,11 +2232,32 @@ void dictGetStats(char *buf, size_t bufsize, dict *d) {
     char *orig_buf = buf;
     size_t orig_bufsize = bufsize;
 
-    l = _dictGetStatsHt(buf,bufsize,&d->ht[0],0);
+    /* A single shard prints exactly like an unsharded dict. With more shards
+     * every shard's stats follow a "Shard <j> (node <n>):" header. */
+    if (d->shards && d->nshards == 1) {
+        dictGetStats(buf,bufsize,d->shards[0]);
+        return;
+    }
+    if (d->shards) {
+        for (int j = 0; j < d->nshards && bufsize > 1; j++) {
+            l = snprintf(buf,bufsize,"Shard %d (node %d):\n",j,d->shards[j]->node);
+            if (l >= bufsize) break;
+            buf += l;
+            bufsize -= l;
+            dictGetStats(buf,bufsize,d->shards[j]);
+            l = strlen(buf);
+            buf += l;
+            bufsize -= l;
+        }
+        if (orig_bufsize) orig_buf[orig_bufsize-1] = '\0';
+        return;
+    }
+
+    l = _dictGetStatsHt(buf,bufsize,d,&d->ht[0],0);
     buf += l;
     bufsize -= l;
     if (dictIsRehashing(d) && bufsize > 0) {
-        _dictGetStatsHt(buf,bufsize,&d->ht[1],1);
+        _dictGetStatsHt(buf,bufsize,d,&d->ht[1],1);
     }
     /* Make sure there is a NULL term at the end. */
     if (orig_bufsize) orig_buf[orig_bufsize-1] = '\0';
@@ -1318,6 +2400,44 @@ int dictTest(int argc, char **argv, int accurate) {
     }
     end_benchmark("Removing and adding");
     dictRelease(dict);
+
+    /* Sharded dict: the keys must spread evenly over the shards, and a shard
+     * with rehashing paused must be left alone by dictRehash(). */
+    int nshards = 4;
+    dict = dictCreateSharded(&BenchmarkDictType,NULL,nshards,NULL,0);
+    start_benchmark();
+    for (j = 0; j < count; j++) {
+        int retval = dictAdd(dict,stringFromLongLong(j),(void*)j);
+        assert(retval == DICT_OK);
+    }
+    end_benchmark("Inserting (sharded)");
+    assert((long)dictSize(dict) == count);
+    for (j = 0; j < nshards; j++) {
+        long used = (long)dictSize(dict->shards[j]);
+        printf("Shard %ld: %ld keys\n", j, used);
+        assert(used > count/nshards*8/10 && used < count/nshards*12/10);
+    }
+    while (dictRehashPending(dict)) dictRehashMilliseconds(dict,100);
+
+    struct dict *s = dict->shards[0];
+    assert(dictExpand(s,dictSlots(s)*4) == DICT_OK);
+    assert(dictIsRehashing(s));
+    long rehashidx = s->rehashidx;
+    dictPauseRehashing(s);
+    assert(dictRehash(dict,100) == 0);
+    assert(s->rehashidx == rehashidx);
+    dictResumeRehashing(s);
+    while (dictRehashPending(dict)) dictRehashMilliseconds(dict,100);
+    assert(!dictIsRehashing(s));
+
+    for (j = 0; j < count; j++) {
+        char *key = stringFromLongLong(j);
+        assert(dictFind(dict,key) != NULL);
+        assert(dictDelete(dict,key) == DICT_OK);
+        zfree(key);
+    }
+    assert(dictSize(dict) == 0);
+    dictRelease(dict);
     return 0;
 }
 #endif
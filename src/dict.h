@@ -66,6 +66,14 @@ typedef struct dictType {
     void (*keyDestructor)(void *privdata, void *key);
     void (*valDestructor)(void *privdata, void *obj);
     int (*expandAllowed)(size_t moreMem, double usedRatio);
+    /* Optional: store a copy of small keys in the entry allocation itself.
+     * keyEmbedLen() returns the bytes the copy of 'key' needs, or 0 if the
+     * key should be stored as usual, and keyEmbed() writes the copy to
+     * 'buf' and returns it. Embedded keys are owned by the entry: the key
+     * passed to dictAdd() remains the caller's, and keyDestructor is not
+     * called for them. Bucketed dicts never embed keys. */
+    size_t (*keyEmbedLen)(const void *key);
+    void *(*keyEmbed)(void *buf, const void *key);
 } dictType;
 
 /* This is our hash table structure. Every dictionary has two of this as we
@@ -83,6 +91,12 @@ typedef struct dict {
     dictht ht[2];
     long rehashidx; /* rehashing not in progress if rehashidx == -1 */
     int16_t pauserehash; /* If >0 rehashing is paused (<0 indicates coding error) */
+    uint8_t bucketed; /* Entries stored inline in cache line buckets. */
+    uint8_t nshards; /* Number of sub-dicts the keys are partitioned into. */
+    int node; /* NUMA node of the tables and entries, -1 if not bound. */
+    uint32_t overflow_buckets; /* Overflow buckets allocated, if bucketed. */
+    struct dict **shards; /* Sub-dicts, NULL if the dict is not sharded. */
+    struct dictAsyncTable *async_table; /* Table allocated in background. */
 } dict;
 
 /* If safe is set to 1 this is a safe iterator, that means, you can call
@@ -94,6 +108,9 @@ typedef struct dictIterator {
     long index;
     int table, safe;
     dictEntry *entry, *nextEntry;
+    void *bucket; /* Bucket and next slot to visit, if bucketed. */
+    int slot;
+    struct dictIterator *shard_iter; /* Iterator of the current shard. */
     /* unsafe iterator fingerprint for misuse detection. */
     unsigned long long fingerprint;
 } dictIterator;
@@ -101,6 +118,19 @@ typedef struct dictIterator {
 typedef void (dictScanFunction)(void *privdata, const dictEntry *de);
 typedef void (dictScanBucketFunction)(void *privdata, dictEntry **bucketref);
 
+/* Hooks moving the expensive parts of resizing big tables out of the
+ * thread using the dict, see dictSetBackgroundHooks(). */
+typedef struct dictBackgroundHooks {
+    /* Tables of at least this many bytes (0 = none) are allocated and
+     * zeroed, and freed after rehashing, by a job passed to submit(). */
+    size_t min_bytes;
+    /* Run fn(args) in a background thread, preferably one on 'node'
+     * (-1 if the dict is not bound to a node). args[0] is 'arg'. */
+    void (*submit)(int node, void (*fn)(void *args[]), void *arg);
+    /* Report the duration of a resize phase done by the caller thread. */
+    void (*latency)(const char *event, long long ms);
+} dictBackgroundHooks;
+
 /* This is the initial size of every hash table */
 #define DICT_HT_INITIAL_SIZE     4
 
@@ -147,11 +177,21 @@ typedef void (dictScanBucketFunction)(void *privdata, dictEntry **bucketref);
 #define dictGetSignedIntegerVal(he) ((he)->v.s64)
 #define dictGetUnsignedIntegerVal(he) ((he)->v.u64)
 #define dictGetDoubleVal(he) ((he)->v.d)
-#define dictSlots(d) ((d)->ht[0].size+(d)->ht[1].size)
+#define dictSlots(d) ((d)->shards ? dictShardsSlots(d) : (d)->ht[0].size+(d)->ht[1].size)
 #define dictSize(d) ((d)->ht[0].used+(d)->ht[1].used)
 #define dictIsRehashing(d) ((d)->rehashidx != -1)
-#define dictPauseRehashing(d) (d)->pauserehash++
-#define dictResumeRehashing(d) (d)->pauserehash--
+#define dictIsBucketed(d) ((d)->bucketed)
+#define dictIsSharded(d) ((d)->shards != NULL)
+#define dictEmbedsKey(d, key) \
+    ((d)->type->keyEmbedLen && !(d)->bucketed && (d)->type->keyEmbedLen(key))
+#define dictPauseRehashing(d) do { \
+    (d)->pauserehash++; \
+    if ((d)->shards) dictShardsPauseRehashing(d,1); \
+} while(0)
+#define dictResumeRehashing(d) do { \
+    (d)->pauserehash--; \
+    if ((d)->shards) dictShardsPauseRehashing(d,-1); \
+} while(0)
 
 /* If our unsigned long type can store a 64 bit number, use a 64 bit PRNG. */
 #if ULONG_MAX >= 0xffffffffffffffff
@@ -168,6 +208,12 @@ typedef enum {
 
 /* API */
 dict *dictCreate(dictType *type, void *privDataPtr);
+dict *dictCreateBucketed(dictType *type, void *privDataPtr);
+dict *dictCreateSharded(dictType *type, void *privDataPtr, int nshards, const int *nodes, int bucketed);
+unsigned long dictShardsSlots(dict *d);
+void dictShardsPauseRehashing(dict *d, int delta);
+int dictRehashPending(dict *d);
+void dictSetBackgroundHooks(dictBackgroundHooks *hooks);
 int dictExpand(dict *d, unsigned long size);
 int dictTryExpand(dict *d, unsigned long size);
 int dictAdd(dict *d, void *key, void *val);
@@ -198,8 +244,13 @@ int dictRehashMilliseconds(dict *d, int ms);
 void dictSetHashFunctionSeed(uint8_t *seed);
 uint8_t *dictGetHashFunctionSeed(void);
 unsigned long dictScan(dict *d, unsigned long v, dictScanFunction *fn, dictScanBucketFunction *bucketfn, void *privdata);
+int dictBucketForEach(dict *d, unsigned long idx, dictScanFunction *fn, void *privdata);
+void *dictGetBucket(dict *d, uint64_t hash);
+dictEntry *dictBucketCandidate(dict *d, void *bucket, uint64_t hash);
+size_t dictMemUsage(dict *d);
 uint64_t dictGetHash(dict *d, const void *key);
 dictEntry **dictFindEntryRefByPtrAndHash(dict *d, const void *oldptr, uint64_t hash);
+dictEntry *dictFindEntryByPtrAndHash(dict *d, const void *oldptr, uint64_t hash);
 
 /* Hash table types */
 extern dictType dictTypeHeapStringCopyKey;
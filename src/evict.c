@@ -36,6 +36,10 @@
 #include "evict.h"
 #include <math.h>
 
+#ifdef HAVE_NUMA
+#include "numa_pool.h"
+#endif
+
 /* ----------------------------------------------------------------------------
  * Data structures
  * --------------------------------------------------------------------------*/
@@ -481,6 +485,191 @@ static unsigned long evictionTimeLimitUs() {
     return ULONG_MAX;   /* No limit to eviction time */
 }
 
+/* Delete 'key' from 'db' as an eviction: propagate the DEL, fire the
+ * keyspace event and update stats. Returns the amount of memory freed by
+ * db*Delete() alone.
+ *
+ * It is possible that actually the memory needed to propagate the DEL in
+ * AOF and replication link is greater than the one we are freeing removing
+ * the key, but we can't account for that otherwise we would never exit the
+ * eviction loop.
+ *
+ * Same for CSC invalidation messages generated by signalModifiedKey.
+ *
+ * AOF and Output buffer memory will be freed eventually so we only care
+ * about memory used by the key space. */
+static long long evictKey(redisDb *db, sds key) {
+    mstime_t eviction_latency;
+    long long delta;
+    robj *keyobj = createStringObject(key,sdslen(key));
+
+    propagateExpire(db,keyobj,server.lazyfree_lazy_eviction);
+    delta = (long long) zmalloc_used_memory();
+    latencyStartMonitor(eviction_latency);
+    if (server.lazyfree_lazy_eviction)
+        dbAsyncDelete(db,keyobj);
+    else
+        dbSyncDelete(db,keyobj);
+    latencyEndMonitor(eviction_latency);
+    latencyAddSampleIfNeeded("eviction-del",eviction_latency);
+    delta -= (long long) zmalloc_used_memory();
+    server.stat_evictedkeys++;
+    signalModifiedKey(NULL,db,keyobj);
+    notifyKeyspaceEvent(NOTIFY_EVICTED, "evicted",
+        keyobj, db->id);
+    decrRefCount(keyobj);
+    return delta;
+}
+
+/* ========== 节点预算（maxmemory-node）========== */
+
+/* 是否有节点配置了预算 */
+int evictionNodeBudgetsActive(void) {
+#ifdef HAVE_NUMA
+    int num_nodes = numa_pool_num_nodes();
+    for (int i = 0; i < num_nodes && i < NUMA_ACCT_MAX_NODES; i++)
+        if (server.maxmemory_node[i]) return 1;
+#endif
+    return 0;
+}
+
+#ifdef HAVE_NUMA
+/* 连续采样不到可处理 key 的次数上限，超过后放弃该节点本轮处理 */
+#define NODE_EVICTION_MAX_MISSES 8
+
+/* 从各 DB 采样，选出值对象位于 node 上的最佳候选，评分方式与
+ * evictionPoolPopulate() 一致（分值越高越优先）。random 与 noeviction
+ * 策略取第一个命中的 key。找到返回 1。 */
+static int nodeEvictionSampleKey(int node, int *dbid, sds *bestkey) {
+    static unsigned int next_db = 0;
+    dictEntry *samples[server.maxmemory_samples];
+    unsigned long long best_idle = 0;
+    int volatile_only = !(server.maxmemory_policy & MAXMEMORY_FLAG_ALLKEYS) &&
+                        server.maxmemory_policy != MAXMEMORY_NO_EVICTION;
+    int found = 0;
+
+    next_db++;
+    for (int i = 0; i < server.dbnum; i++) {
+        int j = (next_db + i) % server.dbnum;
+        redisDb *db = server.db+j;
+        dict *d = volatile_only ? db->expires : db->dict;
+        if (dictSize(d) == 0) continue;
+
+        int count = dictGetSomeKeys(d,samples,server.maxmemory_samples);
+        for (int k = 0; k < count; k++) {
+            sds key = dictGetKey(samples[k]);
+            robj *o = volatile_only ? dictFetchValue(db->dict,key) :
+                                      dictGetVal(samples[k]);
+            unsigned long long idle;
+
+            if (!o || numaGetObjectNode(o) != node) continue;
+
+            if (server.maxmemory_policy & MAXMEMORY_FLAG_LRU) {
+                idle = estimateObjectIdleTime(o);
+            } else if (server.maxmemory_policy & MAXMEMORY_FLAG_LFU) {
+                idle = 255-LFUDecrAndReturn(o);
+            } else if (server.maxmemory_policy == MAXMEMORY_VOLATILE_TTL) {
+                idle = ULLONG_MAX - (long)dictGetVal(samples[k]);
+            } else {
+                *dbid = j;
+                *bestkey = key;
+                return 1;
+            }
+
+            if (!found || idle > best_idle) {
+                best_idle = idle;
+                *dbid = j;
+                *bestkey = key;
+                found = 1;
+            }
+        }
+    }
+    return found;
+}
+
+/* 按节点预算降级/淘汰。超出预算的节点把冷 key 降级到下一层（更慢的
+ * 节点）；降级成功即算进度，即使该节点的记账还没下降。只有没有可用下层
+ * （最后一层或下层预算已满）时才淘汰；key 迁移失败时保留数据，换一个 key。
+ * 与 performEvictions() 相同，lazyfree 淘汰交给后台释放的内存按对象大小
+ * 计入进度，避免在后台线程释放完之前过量淘汰。
+ *
+ * 返回 EVICT_OK；超出时间预算时返回 EVICT_RUNNING（由 evictionTimeProc
+ * 继续）；noeviction 策略下仍有节点超出预算时返回 EVICT_FAIL。 */
+static int performNodeEvictions(monotime *timer, unsigned long time_limit_us) {
+    int num_nodes = numa_pool_num_nodes();
+    int keys_done = 0;
+    int result = EVICT_OK;
+
+    for (int node = 0; node < num_nodes && node < NUMA_ACCT_MAX_NODES; node++) {
+        size_t budget = server.maxmemory_node[node];
+        size_t used = numa_get_node_used_memory(node);
+        size_t tofree, freed = 0;
+        int misses = 0;
+
+        if (!budget || used <= budget) continue;
+        tofree = used - budget;
+        while (freed < tofree && misses < NODE_EVICTION_MAX_MISSES) {
+            int dbid;
+            sds key;
+
+            if (!nodeEvictionSampleKey(node,&dbid,&key)) {
+                misses++;
+                continue;
+            }
+
+            redisDb *db = server.db+dbid;
+            robj *val = dictFetchValue(db->dict,key);
+            size_t before = numa_get_node_used_memory(node);
+            int target = -1;
+            numa_demote_result_t res = NUMA_DEMOTE_NO_NODE;
+
+            if (server.numa_demote_enabled)
+                res = numaDemoteKeyFromNode(db,key,val,node,&target);
+            if (res == NUMA_DEMOTE_OK) {
+                /* key 已在下层，绝不能再淘汰 */
+                size_t after = numa_get_node_used_memory(node);
+                if (after < before) freed += before-after;
+                misses = 0;
+            } else if (res != NUMA_DEMOTE_NO_NODE) {
+                /* 迁移失败：保留数据，换一个 key */
+                misses++;
+                continue;
+            } else if (server.maxmemory_policy == MAXMEMORY_NO_EVICTION) {
+                /* 没有下层，又不允许淘汰 */
+                misses++;
+                continue;
+            } else {
+                size_t lazysize = server.lazyfree_lazy_eviction ?
+                    objectComputeSize(val,OBJ_COMPUTE_SIZE_DEF_SAMPLES) : 0;
+                evictKey(db,key);
+                size_t after = numa_get_node_used_memory(node);
+                freed += lazysize ? lazysize : (after < before ? before-after : 0);
+                misses = 0;
+            }
+
+            if (++keys_done % 16 == 0) {
+                if (listLength(server.slaves)) flushSlavesOutputBuffers();
+                /* 后台线程可能已经释放完，提前检查是否已回到预算内 */
+                if (server.lazyfree_lazy_eviction &&
+                    numa_get_node_used_memory(node) <= budget) break;
+                if (elapsedUs(*timer) > time_limit_us) {
+                    if (!isEvictionProcRunning) {
+                        isEvictionProcRunning = 1;
+                        aeCreateTimeEvent(server.el, 0,
+                                evictionTimeProc, NULL, NULL);
+                    }
+                    return EVICT_RUNNING;
+                }
+            }
+        }
+        if (server.maxmemory_policy == MAXMEMORY_NO_EVICTION &&
+            numa_get_node_used_memory(node) > budget)
+            result = EVICT_FAIL;
+    }
+    return result;
+}
+#endif /* HAVE_NUMA */
+
 /* Check that memory usage is within the current "maxmemory" limit.  If over
  * "maxmemory", attempt to free memory by evicting data (if it's safe to do so).
  *
@@ -511,11 +700,20 @@ int performEvictions(void) {
     int keys_freed = 0;
     size_t mem_reported, mem_tofree;
     long long mem_freed; /* May be negative */
-    mstime_t latency, eviction_latency;
-    long long delta;
+    mstime_t latency;
     int slaves = listLength(server.slaves);
     int result = EVICT_FAIL;
 
+#ifdef HAVE_NUMA
+    /* 先满足各节点预算（降级优先），再检查全局 maxmemory */
+    if (evictionNodeBudgetsActive()) {
+        monotime nodeTimer;
+        elapsedStart(&nodeTimer);
+        int node_result = performNodeEvictions(&nodeTimer,evictionTimeLimitUs());
+        if (node_result != EVICT_OK) return node_result;
+    }
+#endif
+
     if (getMaxmemoryState(&mem_reported,NULL,&mem_tofree,NULL) == C_OK)
         return EVICT_OK;
 
@@ -585,45 +783,8 @@ int performEvictions(void) {
                      * a ghost and we need to try the next element. */
                     if (de) {
                         bestkey = dictGetKey(de);
-                        robj *val = dictGetVal(de);
-                        
-                        /* === NUMA 降级尝试 === */
-#ifdef HAVE_NUMA
-                        if (server.numa_demote_enabled && val != NULL) {
-                            int target_node = -1;
-                            numa_demote_result_t demote_result = evictionTryNumaDemote(
-                                &server.db[bestdbid], bestkey, val, &target_node);
-                            
-                            if (demote_result == NUMA_DEMOTE_OK) {
-                                /* 降级成功，释放本地内存但保留对象 */
-                                pool[k].current_node = target_node;
-                                pool[k].numa_migrated++;
-                                
-                                size_t obj_size = objectComputeSize(val, 0);
-                                mem_freed += obj_size;
-                                keys_freed++;
-                                
-                                serverLog(LL_VERBOSE,
-                                    "[Eviction] NUMA demote succeeded: %s -> node %d, size=%zu",
-                                    bestkey, target_node, obj_size);
-                                
-                                /* 清空池条目，继续下一轮 */
-                                if (pool[k].key != pool[k].cached)
-                                    sdsfree(pool[k].key);
-                                pool[k].key = NULL;
-                                pool[k].idle = 0;
-                                bestkey = NULL;
-                                continue; /* 继续处理下一个候选者 */
-                            }
-                            
-                            if (demote_result == NUMA_DEMOTE_NO_NODE) {
-                                serverLog(LL_DEBUG,
-                                    "[Eviction] No NUMA node available, proceed to evict");
-                            }
-                        }
-#endif /* HAVE_NUMA */
-                        
-                        /* 进入真正淘汰流程 */
+                        /* 降级只转移内存、不减少 used_memory，对全局 maxmemory
+                         * 无帮助；分层降级由 maxmemory-node 节点预算处理 */
                         break;
                     } else {
                         /* Ghost... Iterate again. */
@@ -655,34 +816,7 @@ int performEvictions(void) {
 
         /* Finally remove the selected key. */
         if (bestkey) {
-            db = server.db+bestdbid;
-            robj *keyobj = createStringObject(bestkey,sdslen(bestkey));
-            propagateExpire(db,keyobj,server.lazyfree_lazy_eviction);
-            /* We compute the amount of memory freed by db*Delete() alone.
-             * It is possible that actually the memory needed to propagate
-             * the DEL in AOF and replication link is greater than the one
-             * we are freeing removing the key, but we can't account for
-             * that otherwise we would never exit the loop.
-             *
-             * Same for CSC invalidation messages generated by signalModifiedKey.
-             *
-             * AOF and Output buffer memory will be freed eventually so
-             * we only care about memory used by the key space. */
-            delta = (long long) zmalloc_used_memory();
-            latencyStartMonitor(eviction_latency);
-            if (server.lazyfree_lazy_eviction)
-                dbAsyncDelete(db,keyobj);
-            else
-                dbSyncDelete(db,keyobj);
-            latencyEndMonitor(eviction_latency);
-            latencyAddSampleIfNeeded("eviction-del",eviction_latency);
-            delta -= (long long) zmalloc_used_memory();
-            mem_freed += delta;
-            server.stat_evictedkeys++;
-            signalModifiedKey(NULL,db,keyobj);
-            notifyKeyspaceEvent(NOTIFY_EVICTED, "evicted",
-                keyobj, db->id);
-            decrRefCount(keyobj);
+            mem_freed += evictKey(server.db+bestdbid,bestkey);
             keys_freed++;
 
             if (keys_freed % 16 == 0) {
@@ -47,7 +47,7 @@ typedef struct {
     double node_pressure_threshold; /* 节点压力阈值 (默认 0.9) */
     
     /* === 距离优先配置 === */
-    int distance_weight;        /* 距离权重 (默认 40, 范围 0-100) */
+    int distance_weight;        /* 距离(实测延迟)权重 (默认 40, 范围 0-100) */
     int pressure_weight;        /* 压力权重 (默认 30, 范围 0-100) */
     int bandwidth_weight;       /* 带宽权重 (默认 30, 范围 0-100) */
     double bw_saturation_threshold; /* 带宽饱和排除阈值 (默认 0.95) */
@@ -83,8 +83,8 @@ numa_demote_result_t evictionTryNumaDemote(void *db, char *key, void *val, int *
 /*
  * numaFindBestDemoteNode - 找到最佳降级目标节点
  *
- * 选择策略: 距离优先 + 压力感知
- * 使用加权评分综合距离和压力因素
+ * 选择策略: 延迟优先 + 压力感知 + 带宽感知
+ * 延迟取自延迟探针实测值，无数据时回退到 numa_distance()
  *
  * @object_size: 对象大小
  * @current_node: 当前节点
@@ -93,20 +93,47 @@ numa_demote_result_t evictionTryNumaDemote(void *db, char *key, void *val, int *
  */
 int numaFindBestDemoteNode(size_t object_size, int current_node);
 
+/*
+ * numaDemoteKeyFromNode - 将位于 current_node 的 key 降级到下一层
+ *
+ * 不受最小降级大小限制，供 maxmemory-node 节点预算淘汰使用。
+ * 返回值同 evictionTryNumaDemote()
+ */
+numa_demote_result_t numaDemoteKeyFromNode(void *db, char *key, void *val,
+                                           int current_node, int *target_node);
+
+/*
+ * numaGetObjectNode - 获取值对象主体所在的 NUMA 节点
+ *
+ * 返回值: 节点 ID, -1 表示未知
+ */
+int numaGetObjectNode(void *val);
+
 /*
  * numaGetNodePressure - 获取节点内存压力
  *
+ * 由分配器每节点记账与节点容量计算，无系统调用；容量未知时返回 0。
  * 返回值: 0.0 ~ 1.0, 越大表示压力越高
  */
 double numaGetNodePressure(int node_id);
 
 /*
- * numaGetNodeFreeMemory - 获取节点空闲内存
+ * numaGetNodeFreeMemory - 获取节点剩余可用内存
  *
- * 返回值: 空闲内存字节数
+ * 返回值: 容量减去本进程已用字节数，容量未知时为 SIZE_MAX
  */
 size_t numaGetNodeFreeMemory(int node_id);
 
+/*
+ * numaApplyNodeCapacitySpec - 解析并应用 numa-node-capacity 配置
+ *
+ * @spec:  "节点:容量" 列表，NULL 表示全部使用探测值
+ * @apply: 0 仅校验，1 校验并应用
+ *
+ * 返回值: 1 成功, 0 格式错误（*err 为错误信息）
+ */
+int numaApplyNodeCapacitySpec(const char *spec, int apply, const char **err);
+
 /*
  * evictionDemoteConfigDefaults - 获取默认降级配置
  */
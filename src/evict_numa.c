@@ -4,10 +4,10 @@
  * 优先将冷数据迁移到其他NUMA节点而非直接淘汰。
  *
  * 核心特性：
- * - 距离优先节点选择（优先选择更近的节点）
+ * - 延迟优先节点选择（探针实测延迟，无数据时回退 numa_distance）
  * - 压力感知（避免迁移到高压节点）
  * - 带宽感知（避免迁移到带宽饱和节点）
- * - 加权评分决策（距离40% + 压力30% + 带宽30%）
+ * - 加权评分决策（延迟40% + 压力30% + 带宽30%）
  *
  * Copyright (c) 2024, Redis-CXL Project
  */
@@ -21,6 +21,7 @@
 #include "numa_key_migrate.h"
 #include "numa_bw_monitor.h"
 #include <numa.h>
+#include <sched.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -38,11 +39,6 @@ static numa_demote_config_t g_demote_config = {
     .prefer_closer_node = 1
 };
 
-/* 节点压力缓存（避免频繁读取sysfs） */
-static double g_node_pressure_cache[MAX_NUMA_NODES];
-static long long g_pressure_cache_time[MAX_NUMA_NODES];
-#define PRESSURE_CACHE_TTL_MS 1000  /* 缓存有效期1秒 */
-
 /* ========== 配置接口 ========== */
 
 void evictionDemoteConfigDefaults(numa_demote_config_t *config) {
@@ -73,94 +69,90 @@ void evictionGetDemoteConfig(numa_demote_config_t *config) {
 /*
  * numaGetNodePressure - 获取节点内存压力
  *
- * 从 /sys/devices/system/node/nodeX/meminfo 读取
+ * 由分配器的每节点记账计算：本进程在该节点上的已用字节数 / 节点容量。
+ * 不涉及系统调用，可在分配路径上直接调用。容量未知（容器内 sysfs
+ * 不可见且未配置 numa-node-capacity）时无从判断，返回 0 而非满压力。
  * 返回值: 0.0 ~ 1.0, 越大表示压力越高
  */
 double numaGetNodePressure(int node_id) {
-    int max_node = numa_max_node();
-    if (node_id < 0 || node_id > max_node) {
+    if (node_id < 0 || node_id >= numa_pool_num_nodes()) {
         return 1.0; /* 无效节点返回满压力 */
     }
-    
-    /* 检查缓存 */
-    long long now = server.mstime;
-    if (g_pressure_cache_time[node_id] > 0 &&
-        (now - g_pressure_cache_time[node_id]) < PRESSURE_CACHE_TTL_MS) {
-        return g_node_pressure_cache[node_id];
-    }
-    
-    /* 读取 sysfs */
-    char path[128];
-    snprintf(path, sizeof(path),
-             "/sys/devices/system/node/node%d/meminfo", node_id);
-    
-    FILE *fp = fopen(path, "r");
-    if (!fp) {
-        g_node_pressure_cache[node_id] = 1.0;
-        g_pressure_cache_time[node_id] = now;
-        return 1.0;
-    }
-    
-    unsigned long mem_total = 0, mem_free = 0;
-    char line[256];
-    while (fgets(line, sizeof(line), fp)) {
-        if (strstr(line, "MemTotal")) {
-            /* 格式: Node X MemTotal: XXXX kB */
-            char *colon = strchr(line, ':');
-            if (colon) {
-                mem_total = strtoul(colon + 1, NULL, 10);
-            }
-        } else if (strstr(line, "MemFree")) {
-            char *colon = strchr(line, ':');
-            if (colon) {
-                mem_free = strtoul(colon + 1, NULL, 10);
-            }
-        }
-    }
-    fclose(fp);
-    
-    double pressure = 1.0;
-    if (mem_total > 0) {
-        pressure = 1.0 - ((double)mem_free / (double)mem_total);
-    }
-    
-    /* 更新缓存 */
-    g_node_pressure_cache[node_id] = pressure;
-    g_pressure_cache_time[node_id] = now;
-    
-    return pressure;
+
+    size_t capacity = numa_get_node_capacity(node_id);
+    if (capacity == 0) return 0.0;
+
+    size_t used = numa_get_node_used_memory(node_id);
+    if (used >= capacity) return 1.0;
+    return (double)used / (double)capacity;
 }
 
 /*
- * numaGetNodeFreeMemory - 获取节点空闲内存（KB）
+ * numaGetNodeFreeMemory - 获取节点剩余可用内存（字节）
+ *
+ * 容量减去本进程在该节点上的已用字节数；容量未知时返回 SIZE_MAX，
+ * 与 numaGetNodePressure() 的"未知即不限制"保持一致。
  */
 size_t numaGetNodeFreeMemory(int node_id) {
-    int max_node = numa_max_node();
-    if (node_id < 0 || node_id > max_node) {
+    if (node_id < 0 || node_id >= numa_pool_num_nodes()) {
         return 0;
     }
-    
-    char path[128];
-    snprintf(path, sizeof(path),
-             "/sys/devices/system/node/node%d/meminfo", node_id);
-    
-    FILE *fp = fopen(path, "r");
-    if (!fp) return 0;
-    
-    unsigned long mem_free = 0;
-    char line[256];
-    while (fgets(line, sizeof(line), fp)) {
-        if (strstr(line, "MemFree")) {
-            char *colon = strchr(line, ':');
-            if (colon) {
-                mem_free = strtoul(colon + 1, NULL, 10);
+
+    size_t capacity = numa_get_node_capacity(node_id);
+    if (capacity == 0) return SIZE_MAX;
+
+    size_t used = numa_get_node_used_memory(node_id);
+    return (used >= capacity) ? 0 : capacity - used;
+}
+
+/*
+ * numaApplyNodeCapacitySpec - 解析并应用 numa-node-capacity 配置
+ *
+ * 格式为空格或逗号分隔的 "节点:容量" 列表，例如 "0:64gb 1:256gb"；
+ * 未列出的节点使用探测到的物理容量。apply 为 0 时只做校验。
+ */
+int numaApplyNodeCapacitySpec(const char *spec, int apply, const char **err) {
+    size_t capacity[NUMA_ACCT_MAX_NODES] = {0};
+    int num_nodes = numa_pool_num_nodes();
+
+    if (spec) {
+        int count = 0;
+        sds *items = sdssplitargs(spec, &count);
+        if (!items) {
+            *err = "Unbalanced quotes in numa-node-capacity";
+            return 0;
+        }
+        for (int i = 0; i < count; i++) {
+            /* 同时接受逗号分隔 */
+            int subcount = 0;
+            sds *pairs = sdssplitlen(items[i], sdslen(items[i]), ",", 1, &subcount);
+            for (int j = 0; j < subcount; j++) {
+                if (sdslen(pairs[j]) == 0) continue;
+                char *colon = strchr(pairs[j], ':');
+                char *endptr;
+                int memerr = 0;
+                long node = colon ? strtol(pairs[j], &endptr, 10) : -1;
+                long long bytes = colon ? memtoll(colon + 1, &memerr) : -1;
+                if (!colon || endptr != colon || node < 0 || node >= NUMA_ACCT_MAX_NODES ||
+                    memerr || bytes < 0)
+                {
+                    *err = "numa-node-capacity expects '<node>:<bytes>' pairs";
+                    sdsfreesplitres(pairs, subcount);
+                    sdsfreesplitres(items, count);
+                    return 0;
+                }
+                capacity[node] = (size_t)bytes;
             }
-            break;
+            sdsfreesplitres(pairs, subcount);
         }
+        sdsfreesplitres(items, count);
     }
-    fclose(fp);
-    
-    return (size_t)mem_free * 1024; /* 转换为字节 */
+
+    if (apply) {
+        for (int i = 0; i < num_nodes && i < NUMA_ACCT_MAX_NODES; i++)
+            numa_set_node_capacity(i, capacity[i]);
+    }
+    return 1;
 }
 
 /* ========== 节点选择算法 ========== */
@@ -168,17 +160,25 @@ size_t numaGetNodeFreeMemory(int node_id) {
 /*
  * numaFindBestDemoteNode - 找到最佳降级目标节点
  *
- * 选择策略: 距离优先 + 压力感知 + 带宽感知
- * 使用加权评分综合距离、压力和带宽因素
+ * 选择策略: 延迟优先 + 压力感知 + 带宽感知
+ * 使用加权评分综合延迟、压力和带宽因素。延迟取自访问方（主线程所在
+ * CPU 节点）到候选内存节点的实测相对延迟，见 numa_lat_get_relative()。
+ *
+ * 分层约束：只考虑不比当前节点更快的节点（降级只往下层走），且配置了
+ * maxmemory-node 的节点必须还能容纳该对象。
  */
 int numaFindBestDemoteNode(size_t object_size, int current_node) {
     int num_nodes = numa_pool_num_nodes();
     if (num_nodes <= 1) return -1; /* 单节点无需降级 */
+
+    int cpu = sched_getcpu();
+    int cpu_node = (cpu >= 0) ? numa_node_of_cpu(cpu) : current_node;
+    if (cpu_node < 0) cpu_node = current_node;
     
     /* 候选节点结构 */
     typedef struct {
         int node_id;
-        int distance;      /* NUMA 距离 (越小越近) */
+        double latency;    /* 相对访存延迟 (本地=1.0, 越小越近) */
         double pressure;   /* 内存压力 (0~1) */
         size_t free_mem;   /* 空闲内存 */
         double bw_usage;   /* 带宽利用率 (0~1) */
@@ -187,10 +187,24 @@ int numaFindBestDemoteNode(size_t object_size, int current_node) {
     
     node_candidate_t candidates[MAX_NUMA_NODES];
     int candidate_count = 0;
+    double current_latency = (current_node >= 0) ?
+        numa_lat_get_relative(cpu_node, current_node) : 0.0;
     
     /* 收集所有候选节点信息 */
     for (int i = 0; i < num_nodes; i++) {
         if (i == current_node) continue; /* 跳过当前节点 */
+
+        /* 不往更快的层级"降级" */
+        if (numa_lat_get_relative(cpu_node, i) < current_latency) continue;
+
+        /* 节点预算剩余空间不足 */
+        if (i < NUMA_ACCT_MAX_NODES && server.maxmemory_node[i] &&
+            numa_get_node_used_memory(i) + object_size > server.maxmemory_node[i])
+        {
+            serverLog(LL_DEBUG,
+                "[NUMA Demote] Node %d skipped: maxmemory-node budget full", i);
+            continue;
+        }
         
         double pressure = numaGetNodePressure(i);
         size_t free_mem = numaGetNodeFreeMemory(i);
@@ -221,11 +235,11 @@ int numaFindBestDemoteNode(size_t object_size, int current_node) {
             continue;
         }
         
-        /* 获取 NUMA 距离 */
-        int dist = numa_distance(current_node, i);
+        /* 获取相对访存延迟（探针实测，无数据时为 SLIT 距离比） */
+        double latency = numa_lat_get_relative(cpu_node, i);
         
         candidates[candidate_count].node_id = i;
-        candidates[candidate_count].distance = dist;
+        candidates[candidate_count].latency = latency;
         candidates[candidate_count].pressure = pressure;
         candidates[candidate_count].free_mem = free_mem;
         candidates[candidate_count].bw_usage = bw_usage;
@@ -239,17 +253,17 @@ int numaFindBestDemoteNode(size_t object_size, int current_node) {
     
     /* === 评分计算 === */
     /*
-     * 综合评分 = 距离归一化 * distance_weight + 压力归一化 * pressure_weight + 带宽归一化 * bandwidth_weight
+     * 综合评分 = 延迟归一化 * distance_weight + 压力归一化 * pressure_weight + 带宽归一化 * bandwidth_weight
      * 评分越低越优先选择
      */
     
-    /* 找最大距离、最大压力和最大带宽用于归一化 */
-    int max_distance = 0;
+    /* 找最大延迟、最大压力和最大带宽用于归一化 */
+    double max_latency = 0.0;
     double max_pressure = 0.0;
     double max_bw_usage = 0.0;
     for (int i = 0; i < candidate_count; i++) {
-        if (candidates[i].distance > max_distance) {
-            max_distance = candidates[i].distance;
+        if (candidates[i].latency > max_latency) {
+            max_latency = candidates[i].latency;
         }
         if (candidates[i].pressure > max_pressure) {
             max_pressure = candidates[i].pressure;
@@ -260,13 +274,13 @@ int numaFindBestDemoteNode(size_t object_size, int current_node) {
     }
     
     /* 避免除零 */
-    if (max_distance == 0) max_distance = 1;
+    if (max_latency <= 0.0) max_latency = 1.0;
     if (max_pressure < 0.01) max_pressure = 1.0;
     if (max_bw_usage < 0.01) max_bw_usage = 1.0;
     
     /* 计算每个候选节点的综合评分 */
     for (int i = 0; i < candidate_count; i++) {
-        double dist_norm = (double)candidates[i].distance / (double)max_distance;
+        double dist_norm = candidates[i].latency / max_latency;
         double pres_norm = candidates[i].pressure / max_pressure;
         double bw_norm = candidates[i].bw_usage / max_bw_usage;
             
@@ -292,9 +306,9 @@ int numaFindBestDemoteNode(size_t object_size, int current_node) {
         }
     
         serverLog(LL_DEBUG,
-            "[NUMA Demote] Node %d: dist=%d(%.2f), pressure=%.2f(%.2f), bw=%.2f(%.2f), score=%.3f",
+            "[NUMA Demote] Node %d: latency=%.2f(%.2f), pressure=%.2f(%.2f), bw=%.2f(%.2f), score=%.3f",
             candidates[i].node_id,
-            candidates[i].distance, dist_norm,
+            candidates[i].latency, dist_norm,
             candidates[i].pressure, pres_norm,
             candidates[i].bw_usage, bw_norm,
             candidates[i].score);
@@ -311,9 +325,9 @@ int numaFindBestDemoteNode(size_t object_size, int current_node) {
     }
     
     serverLog(LL_VERBOSE,
-        "[NUMA Demote] Selected node %d: distance=%d, pressure=%.2f, bw=%.2f, score=%.3f",
+        "[NUMA Demote] Selected node %d: latency=%.2f, pressure=%.2f, bw=%.2f, score=%.3f",
         candidates[best_idx].node_id,
-        candidates[best_idx].distance,
+        candidates[best_idx].latency,
         candidates[best_idx].pressure,
         candidates[best_idx].bw_usage,
         candidates[best_idx].score);
@@ -337,41 +351,57 @@ numa_demote_result_t evictionTryNumaDemote(void *db, char *key, void *val, int *
     if (!server.numa_demote_enabled) {
         return NUMA_DEMOTE_SKIP;
     }
-    
+    if (!db || !key || !val || !target_node) {
+        return NUMA_DEMOTE_SKIP;
+    }
+
+    /* 太小不值得迁移 */
+    if (objectComputeSize((robj *)val, 0) < server.numa_demote_min_size) {
+        return NUMA_DEMOTE_SKIP;
+    }
+
+    int current_node = numaGetObjectNode(val);
+    if (current_node < 0) {
+        current_node = numa_pool_get_node();
+    }
+    return numaDemoteKeyFromNode(db, key, val, current_node, target_node);
+}
+
+/*
+ * numaDemoteKeyFromNode - 将位于 current_node 的 key 降级到下一层
+ *
+ * 供节点预算淘汰直接调用：预算是硬上限，因此不受 numa-demote-min-size
+ * 限制。返回值同 evictionTryNumaDemote()。
+ */
+numa_demote_result_t numaDemoteKeyFromNode(void *db, char *key, void *val,
+                                           int current_node, int *target_node) {
     redisDb *rdb = (redisDb *)db;
     robj *val_obj = (robj *)val;
-    
+
     if (!rdb || !key || !val_obj || !target_node) {
         return NUMA_DEMOTE_SKIP;
     }
-    
+    *target_node = -1;
+
     /* 获取对象大小 */
     size_t obj_size = objectComputeSize(val_obj, 0);
-    if (obj_size < server.numa_demote_min_size) {
-        return NUMA_DEMOTE_SKIP; /* 太小不值得迁移 */
-    }
-    
-    /* 获取当前 NUMA 节点 */
-    int current_node = -1;
-    if (val_obj->ptr) {
-        current_node = numa_get_node_id(val_obj->ptr);
-    }
-    if (current_node < 0) {
-        current_node = numa_pool_get_node();
-    }
-    
+
     /* 找最佳目标节点 */
     int best_node = numaFindBestDemoteNode(obj_size, current_node);
     if (best_node < 0) {
-        *target_node = -1;
         return NUMA_DEMOTE_NO_NODE;
     }
     
-    /* 执行迁移 */
-    robj keyobj;
-    initStaticStringObject(keyobj, key);
-    
-    int result = numa_migrate_single_key(rdb, &keyobj, best_node);
+    /* 冷层压缩优先；不符合条件或收益不足时回退到普通迁移 */
+    int result;
+    if (server.numa_cold_compress && numaColdEligible(val_obj) &&
+        numaColdCompress(val_obj, best_node) == C_OK) {
+        result = NUMA_KEY_MIGRATE_OK;
+    } else {
+        robj keyobj;
+        initStaticStringObject(keyobj, key);
+        result = numa_migrate_single_key(rdb, &keyobj, best_node);
+    }
     
     if (result == NUMA_KEY_MIGRATE_OK) {
         *target_node = best_node;
@@ -396,6 +426,24 @@ numa_demote_result_t evictionTryNumaDemote(void *db, char *key, void *val, int *
     return NUMA_DEMOTE_FAILED;
 }
 
+/*
+ * numaGetObjectNode - 值对象主体所在的 NUMA 节点
+ *
+ * INT/EMBSTR 编码的字符串数据就在 robj 内，取 robj 的节点；其余编码
+ * 取 ptr 指向的主体结构（sds、ziplist、dict 等）的节点。
+ */
+int numaGetObjectNode(void *val) {
+    robj *o = (robj *)val;
+    if (!o) return -1;
+    if (o->type == OBJ_STRING &&
+        (o->encoding == OBJ_ENCODING_INT || o->encoding == OBJ_ENCODING_EMBSTR))
+        return numa_get_node_id(o);
+    /* RAW 字符串的 ptr 指向 sds 头之后，分配起点要用 sdsAllocPtr() 取 */
+    if (o->type == OBJ_STRING && o->encoding == OBJ_ENCODING_RAW)
+        return numa_get_node_id(sdsAllocPtr(o->ptr));
+    return o->ptr ? numa_get_node_id(o->ptr) : numa_get_node_id(o);
+}
+
 /*
  * numaGetNodeBandwidthUsage - 获取节点带宽利用率
  *
@@ -431,6 +479,11 @@ size_t numaGetNodeFreeMemory(int node_id) {
     return 0;
 }
 
+int numaApplyNodeCapacitySpec(const char *spec, int apply, const char **err) {
+    (void)spec; (void)apply; (void)err;
+    return 1;
+}
+
 int numaFindBestDemoteNode(size_t object_size, int current_node) {
     (void)object_size;
     (void)current_node;
@@ -443,6 +496,18 @@ numa_demote_result_t evictionTryNumaDemote(void *db, char *key, void *val, int *
     return NUMA_DEMOTE_SKIP;
 }
 
+numa_demote_result_t numaDemoteKeyFromNode(void *db, char *key, void *val,
+                                           int current_node, int *target_node) {
+    (void)db; (void)key; (void)val; (void)current_node;
+    if (target_node) *target_node = -1;
+    return NUMA_DEMOTE_SKIP;
+}
+
+int numaGetObjectNode(void *val) {
+    (void)val;
+    return -1;
+}
+
 double numaGetNodeBandwidthUsage(int node_id) {
     (void)node_id;
     return -1.0;
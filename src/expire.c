@@ -64,6 +64,30 @@ int activeExpireCycleTryExpire(redisDb *db, dictEntry *de, long long now) {
     }
 }
 
+/* State of the bucket walk of activeExpireCycle(). */
+typedef struct expireScanData {
+    redisDb *db;
+    long long now;
+    unsigned long sampled;
+    unsigned long expired;
+    long long ttl_sum;
+    int ttl_samples;
+} expireScanData;
+
+void expireScanCallback(void *privdata, const dictEntry *const_de) {
+    expireScanData *data = privdata;
+    dictEntry *de = (dictEntry *)const_de;
+    long long ttl = dictGetSignedIntegerVal(de)-data->now;
+
+    if (activeExpireCycleTryExpire(data->db,de,data->now)) data->expired++;
+    if (ttl > 0) {
+        /* We want the average TTL of keys yet not expired. */
+        data->ttl_sum += ttl;
+        data->ttl_samples++;
+    }
+    data->sampled++;
+}
+
 /* Try to expire a few timed out keys. The algorithm used is adaptive and
  * will use few CPU cycles if there are few expiring keys, otherwise
  * it will get more aggressive to avoid that too much memory is used by
@@ -219,17 +243,12 @@ void activeExpireCycle(int type) {
 
             /* The main collection cycle. Sample random keys among keys
              * with an expire set, checking for expired ones. */
-            expired = 0;
-            sampled = 0;
-            ttl_sum = 0;
-            ttl_samples = 0;
-
             if (num > config_keys_per_loop)
                 num = config_keys_per_loop;
 
-            /* Here we access the low level representation of the hash table
-             * for speed concerns: this makes this code coupled with dict.c,
-             * but it hardly changed in ten years.
+            /* Here we walk the buckets of the hash table with our own
+             * cursor, one dictBucketForEach() call per bucket, which works
+             * with chained, bucketed and sharded tables.
              *
              * Note that certain places of the hash table may be empty,
              * so we want also a stop condition about the number of
@@ -239,37 +258,17 @@ void activeExpireCycle(int type) {
              * than keys in the same time. */
             long max_buckets = num*20;
             long checked_buckets = 0;
+            expireScanData data = { db, now, 0, 0, 0, 0 };
 
-            while (sampled < num && checked_buckets < max_buckets) {
-                for (int table = 0; table < 2; table++) {
-                    if (table == 1 && !dictIsRehashing(db->expires)) break;
-
-                    unsigned long idx = db->expires_cursor;
-                    idx &= db->expires->ht[table].sizemask;
-                    dictEntry *de = db->expires->ht[table].table[idx];
-                    long long ttl;
-
-                    /* Scan the current bucket of the current table. */
-                    checked_buckets++;
-                    while(de) {
-                        /* Get the next entry now since this entry may get
-                         * deleted. */
-                        dictEntry *e = de;
-                        de = de->next;
-
-                        ttl = dictGetSignedIntegerVal(e)-now;
-                        if (activeExpireCycleTryExpire(db,e,now)) expired++;
-                        if (ttl > 0) {
-                            /* We want the average TTL of keys yet
-                             * not expired. */
-                            ttl_sum += ttl;
-                            ttl_samples++;
-                        }
-                        sampled++;
-                    }
-                }
+            while (data.sampled < num && checked_buckets < max_buckets) {
+                checked_buckets += dictBucketForEach(db->expires,
+                    db->expires_cursor,expireScanCallback,&data);
                 db->expires_cursor++;
             }
+            expired = data.expired;
+            sampled = data.sampled;
+            ttl_sum = data.ttl_sum;
+            ttl_samples = data.ttl_samples;
             total_expired += expired;
             total_sampled += sampled;
 
@@ -34,6 +34,10 @@
 #include <stdint.h>
 #include <math.h>
 
+#ifdef HAVE_X86_SIMD_DISPATCH
+#include <immintrin.h>
+#endif
+
 /* The Redis HyperLogLog implementation is based on the following ideas:
  *
  * * The use of a 64 bit hash function as proposed in [1], in order to estimate
@@ -515,62 +519,204 @@ int hllDenseAdd(uint8_t *registers, unsigned char *ele, size_t elesize) {
     return hllDenseSet(registers,index,count);
 }
 
-/* Compute the register histogram in the dense representation. */
-void hllDenseRegHisto(uint8_t *registers, int* reghisto) {
+/* Unpack and pack the dense registers to and from an array of HLL_REGISTERS
+ * bytes, one register per byte. PFCOUNT and PFMERGE work on the unpacked
+ * form, where the max merge and the histogram are plain byte operations.
+ *
+ * With the default 16384 registers of 6 bits each, every 3 bytes hold
+ * exactly 4 registers: the scalar code handles 16 registers (12 bytes) per
+ * iteration, the AVX2 code 32 registers (24 bytes) per iteration, placing 3
+ * bytes in every 32 bit lane with VPSHUFB and moving the registers to byte
+ * boundaries with shifts. The vector loads and stores touch 4 bytes after
+ * the block, so the last 24 bytes are always left to the scalar code.
+ *
+ * PFDEBUG SIMD can force the scalar code, in order to compare the two. */
+static int hll_use_simd = -1; /* -1: not yet detected. */
+
+static int hllUseSimd(void) {
+    if (hll_use_simd == -1) {
+#ifdef HAVE_X86_SIMD_DISPATCH
+        __builtin_cpu_init();
+        hll_use_simd = __builtin_cpu_supports("avx2") != 0;
+#else
+        hll_use_simd = 0;
+#endif
+    }
+    return hll_use_simd;
+}
+
+/* Unpack 'blocks' groups of 12 bytes into 16 registers each. */
+static void hllDenseUnpackScalar(uint8_t *dst, uint8_t *r, int blocks) {
+    while (blocks--) {
+        dst[0] = r[0] & 63;
+        dst[1] = (r[0] >> 6 | r[1] << 2) & 63;
+        dst[2] = (r[1] >> 4 | r[2] << 4) & 63;
+        dst[3] = (r[2] >> 2) & 63;
+        dst[4] = r[3] & 63;
+        dst[5] = (r[3] >> 6 | r[4] << 2) & 63;
+        dst[6] = (r[4] >> 4 | r[5] << 4) & 63;
+        dst[7] = (r[5] >> 2) & 63;
+        dst[8] = r[6] & 63;
+        dst[9] = (r[6] >> 6 | r[7] << 2) & 63;
+        dst[10] = (r[7] >> 4 | r[8] << 4) & 63;
+        dst[11] = (r[8] >> 2) & 63;
+        dst[12] = r[9] & 63;
+        dst[13] = (r[9] >> 6 | r[10] << 2) & 63;
+        dst[14] = (r[10] >> 4 | r[11] << 4) & 63;
+        dst[15] = (r[11] >> 2) & 63;
+        dst += 16;
+        r += 12;
+    }
+}
+
+/* Pack 'blocks' groups of 16 registers (each <= 63) into 12 bytes each. */
+static void hllDensePackScalar(uint8_t *r, uint8_t *src, int blocks) {
+    while (blocks--) {
+        for (int j = 0; j < 4; j++) {
+            r[0] = src[0] | src[1] << 6;
+            r[1] = src[1] >> 2 | src[2] << 4;
+            r[2] = src[2] >> 4 | src[3] << 2;
+            r += 3;
+            src += 4;
+        }
+    }
+}
+
+#ifdef HAVE_X86_SIMD_DISPATCH
+#define HLL_AVX2_BLOCKS (HLL_REGISTERS/32-1)
+
+/* Registers 32*i ... 32*i+31 as one byte each. */
+__attribute__((target("avx2")))
+static inline __m256i hllDenseUnpack32(const uint8_t *r) {
+    const __m256i shuffle = _mm256_setr_epi8(
+        0,1,2,-1,3,4,5,-1,6,7,8,-1,9,10,11,-1,
+        0,1,2,-1,3,4,5,-1,6,7,8,-1,9,10,11,-1);
+    __m256i v = _mm256_inserti128_si256(
+        _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)r)),
+        _mm_loadu_si128((const __m128i*)(r+12)),1);
+    v = _mm256_shuffle_epi8(v,shuffle);
+    return _mm256_or_si256(
+        _mm256_or_si256(
+            _mm256_and_si256(v,_mm256_set1_epi32(0x3f)),
+            _mm256_and_si256(_mm256_slli_epi32(v,2),_mm256_set1_epi32(0x3f00))),
+        _mm256_or_si256(
+            _mm256_and_si256(_mm256_slli_epi32(v,4),_mm256_set1_epi32(0x3f0000)),
+            _mm256_and_si256(_mm256_slli_epi32(v,6),_mm256_set1_epi32(0x3f000000))));
+}
+
+__attribute__((target("avx2")))
+static void hllDenseUnpackAVX2(uint8_t *dst, uint8_t *registers) {
+    for (int j = 0; j < HLL_AVX2_BLOCKS; j++)
+        _mm256_storeu_si256((__m256i*)(dst+j*32),
+                            hllDenseUnpack32(registers+j*24));
+    hllDenseUnpackScalar(dst+HLL_AVX2_BLOCKS*32,
+                         registers+HLL_AVX2_BLOCKS*24,2);
+}
+
+__attribute__((target("avx2")))
+static void hllDenseMaxAVX2(uint8_t *max, uint8_t *registers) {
+    uint8_t tail[32];
+
+    for (int j = 0; j < HLL_AVX2_BLOCKS; j++) {
+        __m256i *m = (__m256i*)(max+j*32);
+        _mm256_storeu_si256(m,_mm256_max_epu8(_mm256_loadu_si256(m),
+                            hllDenseUnpack32(registers+j*24)));
+    }
+    hllDenseUnpackScalar(tail,registers+HLL_AVX2_BLOCKS*24,2);
+    for (int j = 0; j < 32; j++) {
+        uint8_t *m = max+HLL_AVX2_BLOCKS*32+j;
+        if (tail[j] > *m) *m = tail[j];
+    }
+}
+
+__attribute__((target("avx2")))
+static void hllDensePackAVX2(uint8_t *registers, uint8_t *src) {
+    const __m256i shuffle = _mm256_setr_epi8(
+        0,1,2,4,5,6,8,9,10,12,13,14,-1,-1,-1,-1,
+        0,1,2,4,5,6,8,9,10,12,13,14,-1,-1,-1,-1);
+
+    for (int j = 0; j < HLL_AVX2_BLOCKS; j++) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(src+j*32));
+        uint8_t *r = registers+j*24;
+
+        v = _mm256_or_si256(
+            _mm256_or_si256(
+                _mm256_and_si256(v,_mm256_set1_epi32(0x3f)),
+                _mm256_and_si256(_mm256_srli_epi32(v,2),_mm256_set1_epi32(0xfc0))),
+            _mm256_or_si256(
+                _mm256_and_si256(_mm256_srli_epi32(v,4),_mm256_set1_epi32(0x3f000)),
+                _mm256_and_si256(_mm256_srli_epi32(v,6),_mm256_set1_epi32(0xfc0000))));
+        v = _mm256_shuffle_epi8(v,shuffle);
+        /* The 4 garbage bytes of each store are rewritten right after. */
+        _mm_storeu_si128((__m128i*)r,_mm256_castsi256_si128(v));
+        _mm_storeu_si128((__m128i*)(r+12),_mm256_extracti128_si256(v,1));
+    }
+    hllDensePackScalar(registers+HLL_AVX2_BLOCKS*24,
+                       src+HLL_AVX2_BLOCKS*32,2);
+}
+#endif /* HAVE_X86_SIMD_DISPATCH */
+
+/* Unpack all the dense registers into 'dst', HLL_REGISTERS bytes. */
+void hllDenseUnpack(uint8_t *dst, uint8_t *registers) {
     int j;
 
-    /* Redis default is to use 16384 registers 6 bits each. The code works
-     * with other values by modifying the defines, but for our target value
-     * we take a faster path with unrolled loops. */
     if (HLL_REGISTERS == 16384 && HLL_BITS == 6) {
-        uint8_t *r = registers;
-        unsigned long r0, r1, r2, r3, r4, r5, r6, r7, r8, r9,
-                      r10, r11, r12, r13, r14, r15;
-        for (j = 0; j < 1024; j++) {
-            /* Handle 16 registers per iteration. */
-            r0 = r[0] & 63;
-            r1 = (r[0] >> 6 | r[1] << 2) & 63;
-            r2 = (r[1] >> 4 | r[2] << 4) & 63;
-            r3 = (r[2] >> 2) & 63;
-            r4 = r[3] & 63;
-            r5 = (r[3] >> 6 | r[4] << 2) & 63;
-            r6 = (r[4] >> 4 | r[5] << 4) & 63;
-            r7 = (r[5] >> 2) & 63;
-            r8 = r[6] & 63;
-            r9 = (r[6] >> 6 | r[7] << 2) & 63;
-            r10 = (r[7] >> 4 | r[8] << 4) & 63;
-            r11 = (r[8] >> 2) & 63;
-            r12 = r[9] & 63;
-            r13 = (r[9] >> 6 | r[10] << 2) & 63;
-            r14 = (r[10] >> 4 | r[11] << 4) & 63;
-            r15 = (r[11] >> 2) & 63;
-
-            reghisto[r0]++;
-            reghisto[r1]++;
-            reghisto[r2]++;
-            reghisto[r3]++;
-            reghisto[r4]++;
-            reghisto[r5]++;
-            reghisto[r6]++;
-            reghisto[r7]++;
-            reghisto[r8]++;
-            reghisto[r9]++;
-            reghisto[r10]++;
-            reghisto[r11]++;
-            reghisto[r12]++;
-            reghisto[r13]++;
-            reghisto[r14]++;
-            reghisto[r15]++;
-
-            r += 12;
+#ifdef HAVE_X86_SIMD_DISPATCH
+        if (hllUseSimd()) {
+            hllDenseUnpackAVX2(dst,registers);
+            return;
         }
+#endif
+        hllDenseUnpackScalar(dst,registers,HLL_REGISTERS/16);
     } else {
-        for(j = 0; j < HLL_REGISTERS; j++) {
-            unsigned long reg;
-            HLL_DENSE_GET_REGISTER(reg,registers,j);
-            reghisto[reg]++;
+        for (j = 0; j < HLL_REGISTERS; j++)
+            HLL_DENSE_GET_REGISTER(dst[j],registers,j);
+    }
+}
+
+/* Set the dense registers to the HLL_REGISTERS bytes at 'src'. */
+void hllDensePack(uint8_t *registers, uint8_t *src) {
+    int j;
+
+    if (HLL_REGISTERS == 16384 && HLL_BITS == 6) {
+#ifdef HAVE_X86_SIMD_DISPATCH
+        if (hllUseSimd()) {
+            hllDensePackAVX2(registers,src);
+            return;
         }
+#endif
+        hllDensePackScalar(registers,src,HLL_REGISTERS/16);
+    } else {
+        for (j = 0; j < HLL_REGISTERS; j++)
+            HLL_DENSE_SET_REGISTER(registers,j,src[j]);
+    }
+}
+
+/* Set max[i] = MAX(max[i],register[i]) for all the dense registers. */
+void hllDenseMax(uint8_t *max, uint8_t *registers) {
+    uint8_t regs[HLL_REGISTERS];
+    int j;
+
+#ifdef HAVE_X86_SIMD_DISPATCH
+    if (HLL_REGISTERS == 16384 && HLL_BITS == 6 && hllUseSimd()) {
+        hllDenseMaxAVX2(max,registers);
+        return;
     }
+#endif
+    /* A branch free loop over bytes the compiler can vectorize. */
+    hllDenseUnpack(regs,registers);
+    for (j = 0; j < HLL_REGISTERS; j++)
+        max[j] = regs[j] > max[j] ? regs[j] : max[j];
+}
+
+void hllRawRegHisto(uint8_t *registers, int* reghisto);
+
+/* Compute the register histogram in the dense representation. */
+void hllDenseRegHisto(uint8_t *registers, int* reghisto) {
+    uint8_t regs[HLL_REGISTERS];
+
+    hllDenseUnpack(regs,registers);
+    hllRawRegHisto(regs,reghisto);
 }
 
 /* ================== Sparse representation implementation  ================= */
@@ -966,28 +1112,35 @@ void hllSparseRegHisto(uint8_t *sparse, int sparselen, int *invalid, int* reghis
  * computation, which is representation-specific, while all the rest is common. */
 
 /* Implements the register histogram calculation for uint8_t data type
- * which is only used internally as speedup for PFCOUNT with multiple keys. */
+ * which is used as speedup for PFCOUNT with multiple keys, and by the dense
+ * histogram after unpacking the registers.
+ *
+ * Most registers share a few values, so the increments go to four separate
+ * histograms: consecutive increments of the same counter would otherwise
+ * wait for each other's store. */
 void hllRawRegHisto(uint8_t *registers, int* reghisto) {
     uint64_t *word = (uint64_t*) registers;
     uint8_t *bytes;
-    int j;
+    int j, h[4][64] = {{0}};
 
     for (j = 0; j < HLL_REGISTERS/8; j++) {
         if (*word == 0) {
-            reghisto[0] += 8;
+            h[0][0] += 8;
         } else {
             bytes = (uint8_t*) word;
-            reghisto[bytes[0]]++;
-            reghisto[bytes[1]]++;
-            reghisto[bytes[2]]++;
-            reghisto[bytes[3]]++;
-            reghisto[bytes[4]]++;
-            reghisto[bytes[5]]++;
-            reghisto[bytes[6]]++;
-            reghisto[bytes[7]]++;
+            h[0][bytes[0]]++;
+            h[1][bytes[1]]++;
+            h[2][bytes[2]]++;
+            h[3][bytes[3]]++;
+            h[0][bytes[4]]++;
+            h[1][bytes[5]]++;
+            h[2][bytes[6]]++;
+            h[3][bytes[7]]++;
         }
         word++;
     }
+    for (j = 0; j < 64; j++)
+        reghisto[j] += h[0][j] + h[1][j] + h[2][j] + h[3][j];
 }
 
 /* Helper function sigma as defined in
@@ -1095,12 +1248,7 @@ int hllMerge(uint8_t *max, robj *hll) {
     int i;
 
     if (hdr->encoding == HLL_DENSE) {
-        uint8_t val;
-
-        for (i = 0; i < HLL_REGISTERS; i++) {
-            HLL_DENSE_GET_REGISTER(val,hdr->registers,i);
-            if (val > max[i]) max[i] = val;
-        }
+        hllDenseMax(max,hdr->registers);
     } else {
         uint8_t *p = hll->ptr, *end = p + sdslen(hll->ptr);
         long runlen, regval;
@@ -1396,13 +1544,19 @@ void pfmergeCommand(client *c) {
     }
 
     /* Write the resulting HLL to the destination HLL registers and
-     * invalidate the cached value. */
-    for (j = 0; j < HLL_REGISTERS; j++) {
-        if (max[j] == 0) continue;
-        hdr = o->ptr;
-        switch(hdr->encoding) {
-        case HLL_DENSE: hllDenseSet(hdr->registers,j,max[j]); break;
-        case HLL_SPARSE: hllSparseSet(o,j,max[j]); break;
+     * invalidate the cached value. The destination is one of the merged
+     * HLLs, so a dense destination can just be overwritten. */
+    hdr = o->ptr;
+    if (hdr->encoding == HLL_DENSE) {
+        hllDensePack(hdr->registers,max);
+    } else {
+        for (j = 0; j < HLL_REGISTERS; j++) {
+            if (max[j] == 0) continue;
+            hdr = o->ptr;
+            switch(hdr->encoding) {
+            case HLL_DENSE: hllDenseSet(hdr->registers,j,max[j]); break;
+            case HLL_SPARSE: hllSparseSet(o,j,max[j]); break;
+            }
         }
     }
     hdr = o->ptr; /* o->ptr may be different now, as a side effect of
@@ -1455,6 +1609,29 @@ void pfselftestCommand(client *c) {
                 goto cleanup;
             }
         }
+
+        /* Unpacking and packing all the registers at once must agree with
+         * the macros, with the vector and the scalar code. */
+        int simd = hllUseSimd();
+        for (int mode = simd; mode >= 0; mode--) {
+            uint8_t unpacked[HLL_REGISTERS];
+            sds packed = sdsnewlen(NULL,HLL_DENSE_SIZE);
+
+            hll_use_simd = mode;
+            hllDenseUnpack(unpacked,hdr->registers);
+            hllDensePack(((struct hllhdr*)packed)->registers,bytecounters);
+            int ok = memcmp(unpacked,bytecounters,HLL_REGISTERS) == 0 &&
+                     memcmp(packed,bitcounters,HLL_DENSE_SIZE) == 0;
+            sdsfree(packed);
+            if (!ok) {
+                hll_use_simd = simd;
+                addReplyErrorFormat(c,
+                    "TESTFAILED Dense registers %s code mismatch",
+                    mode ? "SIMD" : "scalar");
+                goto cleanup;
+            }
+        }
+        hll_use_simd = simd;
     }
 
     /* Test 2: approximation error.
@@ -1533,6 +1710,26 @@ void pfdebugCommand(client *c) {
     robj *o;
     int j;
 
+    /* PFDEBUG SIMD <yes|no>
+     * Use (if the CPU has it) or not the vector code for the dense
+     * registers, in order to compare it with the scalar code. */
+    if (!strcasecmp(cmd,"simd")) {
+        char *arg;
+        if (c->argc != 3) goto arityerr;
+        arg = c->argv[2]->ptr;
+        if (!strcasecmp(arg,"yes")) {
+            hll_use_simd = -1;
+            hllUseSimd();
+        } else if (!strcasecmp(arg,"no")) {
+            hll_use_simd = 0;
+        } else {
+            addReplyError(c,"PFDEBUG SIMD argument must be yes or no");
+            return;
+        }
+        addReply(c,hll_use_simd ? shared.cone : shared.czero);
+        return;
+    }
+
     o = lookupKeyWrite(c->db,c->argv[2]);
     if (o == NULL) {
         addReplyError(c,"The specified key does not exist");
@@ -94,7 +94,7 @@ size_t lazyfreeGetFreeEffort(robj *key, robj *obj) {
         return dictSize(ht);
     } else if (obj->type == OBJ_ZSET && obj->encoding == OBJ_ENCODING_SKIPLIST){
         zset *zs = obj->ptr;
-        return zs->zsl->length;
+        return zsetIndexLength(zs);
     } else if (obj->type == OBJ_HASH && obj->encoding == OBJ_ENCODING_HT) {
         dict *ht = obj->ptr;
         return dictSize(ht);
@@ -172,10 +172,12 @@ int dbAsyncDelete(redisDb *db, robj *key) {
          * of parts of the Redis core may call incrRefCount() to protect
          * objects, and then call dbDelete(). In this case we'll fall
          * through and reach the dictFreeUnlinkedEntry() call, that will be
-         * equivalent to just calling decrRefCount(). */
+         * equivalent to just calling decrRefCount().
+         * The job is routed to the lazyfree worker of the NUMA node the
+         * value lives on, when per node workers are enabled. */
         if (free_effort > LAZYFREE_THRESHOLD && val->refcount == 1) {
             atomicIncr(lazyfree_objects,1);
-            bioCreateLazyFreeJob(lazyfreeFreeObject,1, val);
+            bioCreateLazyFreeJobOnNode(numaGetObjectNode(val),lazyfreeFreeObject,1,val);
             dictSetVal(db->dict,de,NULL);
         }
     }
@@ -196,7 +198,7 @@ void freeObjAsync(robj *key, robj *obj) {
     size_t free_effort = lazyfreeGetFreeEffort(key,obj);
     if (free_effort > LAZYFREE_THRESHOLD && obj->refcount == 1) {
         atomicIncr(lazyfree_objects,1);
-        bioCreateLazyFreeJob(lazyfreeFreeObject,1,obj);
+        bioCreateLazyFreeJobOnNode(numaGetObjectNode(obj),lazyfreeFreeObject,1,obj);
     } else {
         decrRefCount(obj);
     }
@@ -207,8 +209,8 @@ void freeObjAsync(robj *key, robj *obj) {
  * lazy freeing. */
 void emptyDbAsync(redisDb *db) {
     dict *oldht1 = db->dict, *oldht2 = db->expires;
-    db->dict = dictCreate(&dbDictType,NULL);
-    db->expires = dictCreate(&dbExpiresDictType,NULL);
+    db->dict = dbCreateDict(&dbDictType);
+    db->expires = dbCreateDict(&dbExpiresDictType);
     atomicIncr(lazyfree_objects,dictSize(oldht1));
     bioCreateLazyFreeJob(lazyfreeFreeDatabase,2,oldht1,oldht2);
 }
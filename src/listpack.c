@@ -40,6 +40,10 @@
 #include <string.h>
 #include <stdio.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include "listpack.h"
 #include "listpack_malloc.h"
 #include "redisassert.h"
@@ -51,6 +55,7 @@
 #define LP_MAX_ENTRY_BACKLEN 34359738367ULL
 #define LP_ENCODING_INT 0
 #define LP_ENCODING_STRING 1
+#define LISTPACK_MAX_SAFETY_SIZE (1<<30) /* Same as ZIPLIST_MAX_SAFETY_SIZE. */
 
 #define LP_ENCODING_7BIT_UINT 0
 #define LP_ENCODING_7BIT_UINT_MASK 0x80
@@ -249,6 +254,16 @@ unsigned char* lpShrinkToFit(unsigned char *lp) {
     }
 }
 
+/* Check if a listpack of the given size can grow by 'add' more bytes
+ * without exceeding the limit we impose on collections (1GB), see
+ * ziplistSafeToAdd(). */
+int lpSafeToAdd(unsigned char *lp, size_t add) {
+    size_t len = lp ? lpGetTotalBytes(lp) : 0;
+    if (len + add > LISTPACK_MAX_SAFETY_SIZE)
+        return 0;
+    return 1;
+}
+
 /* Given an element 'ele' of size 'size', determine if the element can be
  * represented inside the listpack encoded as integer, and returns
  * LP_ENCODING_INT if so. Otherwise returns LP_ENCODING_STR if no integer
@@ -547,34 +562,46 @@ uint32_t lpLength(unsigned char *lp) {
  * Similarly, there is no error returned since the listpack normally can be
  * assumed to be valid, so that would be a very high API cost. However a function
  * in order to check the integrity of the listpack at load time is provided,
- * check lpIsValid(). */
-unsigned char *lpGet(unsigned char *p, int64_t *count, unsigned char *intbuf) {
+ * check lpIsValid().
+ *
+ * If 'entry_size' is not NULL, it is set to the total length of the element,
+ * backlen included, so that the caller can skip to the next element. */
+static inline unsigned char *lpGetWithSize(unsigned char *p, int64_t *count, unsigned char *intbuf, uint64_t *entry_size) {
     int64_t val;
     uint64_t uval, negstart, negmax;
+    uint64_t size;
 
     assert(p); /* assertion for valgrind (avoid NPD) */
     if (LP_ENCODING_IS_7BIT_UINT(p[0])) {
         negstart = UINT64_MAX; /* 7 bit ints are always positive. */
         negmax = 0;
         uval = p[0] & 0x7f;
+        size = 1;
     } else if (LP_ENCODING_IS_6BIT_STR(p[0])) {
         *count = LP_ENCODING_6BIT_STR_LEN(p);
+        if (entry_size) {
+            size = 1+*count;
+            *entry_size = size+lpEncodeBacklen(NULL,size);
+        }
         return p+1;
     } else if (LP_ENCODING_IS_13BIT_INT(p[0])) {
         uval = ((p[0]&0x1f)<<8) | p[1];
         negstart = (uint64_t)1<<12;
         negmax = 8191;
+        size = 2;
     } else if (LP_ENCODING_IS_16BIT_INT(p[0])) {
         uval = (uint64_t)p[1] |
                (uint64_t)p[2]<<8;
         negstart = (uint64_t)1<<15;
         negmax = UINT16_MAX;
+        size = 3;
     } else if (LP_ENCODING_IS_24BIT_INT(p[0])) {
         uval = (uint64_t)p[1] |
                (uint64_t)p[2]<<8 |
                (uint64_t)p[3]<<16;
         negstart = (uint64_t)1<<23;
         negmax = UINT32_MAX>>8;
+        size = 4;
     } else if (LP_ENCODING_IS_32BIT_INT(p[0])) {
         uval = (uint64_t)p[1] |
                (uint64_t)p[2]<<8 |
@@ -582,6 +609,7 @@ unsigned char *lpGet(unsigned char *p, int64_t *count, unsigned char *intbuf) {
                (uint64_t)p[4]<<24;
         negstart = (uint64_t)1<<31;
         negmax = UINT32_MAX;
+        size = 5;
     } else if (LP_ENCODING_IS_64BIT_INT(p[0])) {
         uval = (uint64_t)p[1] |
                (uint64_t)p[2]<<8 |
@@ -593,17 +621,28 @@ unsigned char *lpGet(unsigned char *p, int64_t *count, unsigned char *intbuf) {
                (uint64_t)p[8]<<56;
         negstart = (uint64_t)1<<63;
         negmax = UINT64_MAX;
+        size = 9;
     } else if (LP_ENCODING_IS_12BIT_STR(p[0])) {
         *count = LP_ENCODING_12BIT_STR_LEN(p);
+        if (entry_size) {
+            size = 2+*count;
+            *entry_size = size+lpEncodeBacklen(NULL,size);
+        }
         return p+2;
     } else if (LP_ENCODING_IS_32BIT_STR(p[0])) {
         *count = LP_ENCODING_32BIT_STR_LEN(p);
+        if (entry_size) {
+            size = 5+(uint64_t)*count;
+            *entry_size = size+lpEncodeBacklen(NULL,size);
+        }
         return p+5;
     } else {
         uval = 12345678900000000ULL + p[0];
         negstart = UINT64_MAX;
         negmax = 0;
+        size = 1;
     }
+    if (entry_size) *entry_size = size+lpEncodeBacklen(NULL,size);
 
     /* We reach this code path only for integer encodings.
      * Convert the unsigned value to the signed one using two's complement
@@ -629,6 +668,27 @@ unsigned char *lpGet(unsigned char *p, int64_t *count, unsigned char *intbuf) {
     }
 }
 
+unsigned char *lpGet(unsigned char *p, int64_t *count, unsigned char *intbuf) {
+    return lpGetWithSize(p,count,intbuf,NULL);
+}
+
+/* Like lpGet(), but without the 'intbuf' form: string elements are returned
+ * with their length in 'slen', while for integer elements NULL is returned
+ * and the value is stored in 'lval'. This is the same interface as
+ * ziplistGet(), to make code working with both formats look alike. */
+unsigned char *lpGetValue(unsigned char *p, unsigned int *slen, long long *lval) {
+    unsigned char *vstr;
+    int64_t ele_len;
+
+    vstr = lpGet(p,&ele_len,NULL);
+    if (vstr) {
+        *slen = ele_len;
+    } else {
+        *lval = ele_len;
+    }
+    return vstr;
+}
+
 /* Insert, delete or replace the specified element 'ele' of length 'len' at
  * the specified position 'p', with 'p' being a listpack element pointer
  * obtained with lpFirst(), lpLast(), lpNext(), lpPrev() or lpSeek().
@@ -810,6 +870,81 @@ unsigned char *lpDelete(unsigned char *lp, unsigned char *p, unsigned char **new
     return lpInsert(lp,NULL,0,p,LP_REPLACE,newp);
 }
 
+/* Insert the specified element 'ele' of length 'size' at the head of the
+ * listpack. Return value is the same as lpInsert(). */
+unsigned char *lpPrepend(unsigned char *lp, unsigned char *ele, uint32_t size) {
+    unsigned char *p = lpFirst(lp);
+    if (!p) return lpAppend(lp,ele,size);
+    return lpInsert(lp,ele,size,p,LP_BEFORE,NULL);
+}
+
+/* Replace the element pointed by '*p' with 'ele' of length 'size'. On return
+ * '*p' points to the new element. Return value is the same as lpInsert(). */
+unsigned char *lpReplace(unsigned char *lp, unsigned char **p, unsigned char *ele, uint32_t size) {
+    return lpInsert(lp,ele,size,*p,LP_REPLACE,p);
+}
+
+/* Delete 'num' consecutive elements starting at the one pointed by '*p',
+ * or all the elements up to the end of the listpack if there are fewer.
+ * On return '*p' points to the element that followed the deleted ones, or
+ * is set to NULL if they were the last ones. */
+unsigned char *lpDeleteRangeWithEntry(unsigned char *lp, unsigned char **p, unsigned long num) {
+    size_t bytes = lpBytes(lp);
+    unsigned long deleted = 0;
+    unsigned char *eofptr = lp + bytes - 1;
+    unsigned char *first, *tail;
+
+    if (num == 0) return lp; /* Nothing to delete, return ASAP. */
+
+    /* Find the element following the last one to delete. The count in the
+     * header may be unreliable with a corrupt listpack, so we stop at the
+     * EOF rather than trusting 'num'. */
+    first = tail = *p;
+    while (num--) {
+        deleted++;
+        tail = lpSkip(tail);
+        if (tail[0] == LP_EOF) break;
+        lpAssertValidEntry(lp, bytes, tail);
+    }
+
+    /* Store the offset of 'first', so that we can obtain its address
+     * again after the reallocation. */
+    unsigned long poff = first-lp;
+
+    /* Move the tail, EOF included, over the deleted elements. */
+    memmove(first,tail,eofptr-tail+1);
+    lpSetTotalBytes(lp,bytes-(tail-first));
+    uint32_t numele = lpGetNumElements(lp);
+    if (numele != LP_HDR_NUMELE_UNKNOWN)
+        lpSetNumElements(lp,numele-deleted);
+    lp = lpShrinkToFit(lp);
+
+    *p = lp+poff;
+    if ((*p)[0] == LP_EOF) *p = NULL;
+    return lp;
+}
+
+/* Delete 'num' consecutive elements starting at the zero-based 'index'
+ * (negative indexes count from the tail, as in lpSeek()). */
+unsigned char *lpDeleteRange(unsigned char *lp, long index, unsigned long num) {
+    unsigned char *p;
+    uint32_t numele = lpGetNumElements(lp);
+
+    if (num == 0) return lp; /* Nothing to delete, return ASAP. */
+    if ((p = lpSeek(lp,index)) == NULL) return lp;
+
+    /* If we know that everything up to the end goes away, just move the
+     * EOF marker instead of walking the elements to delete. */
+    if (numele != LP_HDR_NUMELE_UNKNOWN && index < 0) index = (long)numele+index;
+    if (numele != LP_HDR_NUMELE_UNKNOWN && (numele-(unsigned long)index) <= num) {
+        p[0] = LP_EOF;
+        lpSetTotalBytes(lp,p-lp+1);
+        lpSetNumElements(lp,index);
+        return lpShrinkToFit(lp);
+    }
+    return lpDeleteRangeWithEntry(lp,&p,num);
+}
+
 /* Return the total number of bytes the listpack is composed of. */
 uint32_t lpBytes(unsigned char *lp) {
     return lpGetTotalBytes(lp);
@@ -864,6 +999,302 @@ unsigned char *lpSeek(unsigned char *lp, long index) {
     }
 }
 
+/* The first 16 bytes of the encoding of a needle of lpFind(): the header
+ * byte of a 6 bit string followed by the first 15 bytes of the string, and
+ * the mask of the bytes that are significant. */
+typedef struct {
+    unsigned char bytes[16];
+    unsigned int mask;
+} lpNeedlePrefix;
+
+static inline void lpNeedlePrefixInit(lpNeedlePrefix *np, unsigned char *s, uint32_t slen) {
+    uint32_t n = slen < 15 ? slen : 15;
+
+    memset(np->bytes,0,sizeof(np->bytes));
+    np->bytes[0] = LP_ENCODING_6BIT_STR | slen;
+    memcpy(np->bytes+1,s,n);
+    np->mask = (1u << (n+1)) - 1;
+}
+
+/* Compare the prefix with the 16 bytes at 'p', that must all be inside
+ * the listpack. Since the header byte encodes the length, a match means
+ * that the element is a string of the needle length, with the same first
+ * 15 bytes. */
+static inline int lpNeedlePrefixMatch(lpNeedlePrefix *np, unsigned char *p) {
+#if defined(__SSE2__)
+    __m128i ele = _mm_loadu_si128((const __m128i*)p);
+    __m128i needle = _mm_loadu_si128((const __m128i*)np->bytes);
+    unsigned int eq = _mm_movemask_epi8(_mm_cmpeq_epi8(ele,needle));
+    return (eq & np->mask) == np->mask;
+#else
+    for (int j = 0; j < 16; j++) {
+        if ((np->mask & (1u << j)) && p[j] != np->bytes[j]) return 0;
+    }
+    return 1;
+#endif
+}
+
+/* Find pointer to the element equal to the specified string 's' of length
+ * 'slen', starting from 'p' and skipping 'skip' elements after every
+ * comparison (so with skip 1 only the fields of field/value pairs are
+ * compared). Returns NULL when the element could not be found.
+ *
+ * Needles that are short strings not representable as integers, which is
+ * the common case for hash fields and zset members, are compared against
+ * 6 bit string and small integer elements 16 bytes at a time, header byte
+ * included, so that most of the elements are rejected without decoding
+ * them. */
+unsigned char *lpFind(unsigned char *lp, unsigned char *p, unsigned char *s, uint32_t slen, unsigned int skip) {
+    int skipcnt = 0;
+    unsigned char *value;
+    int64_t ll, vll = 0;
+    uint64_t entry_size = 123456789; /* initialized to avoid warning. */
+    uint32_t lp_bytes = lpBytes(lp);
+    unsigned char *lp_end = lp+lp_bytes;
+    lpNeedlePrefix np;
+
+    /* Integer elements can only be equal to a needle that converts to an
+     * integer without loss, see lpStringToInt64(). */
+    int needle_is_int = slen > 0 && slen < 32 &&
+                        lpStringToInt64((const char*)s,slen,&vll);
+    int fast = !needle_is_int && slen < 64;
+    if (fast) lpNeedlePrefixInit(&np,s,slen);
+
+    assert(p);
+    while (p) {
+        if (skipcnt == 0) {
+            if (fast && p+16 <= lp_end &&
+                (LP_ENCODING_IS_6BIT_STR(p[0]) || LP_ENCODING_IS_7BIT_UINT(p[0])))
+            {
+                entry_size = lpCurrentEncodedSizeUnsafe(p);
+                entry_size += lpEncodeBacklen(NULL,entry_size);
+                if (lpNeedlePrefixMatch(&np,p)) {
+                    assert(p+entry_size < lp_end);
+                    if (slen <= 15 || memcmp(p+16,s+15,slen-15) == 0)
+                        return p;
+                }
+            } else {
+                value = lpGetWithSize(p,&ll,NULL,&entry_size);
+                if (value) {
+                    /* Check the value doesn't reach outside the listpack
+                     * before accessing it. */
+                    assert(p >= lp+LP_HDR_SIZE && p+entry_size < lp_end);
+                    if (slen == ll && memcmp(value,s,slen) == 0) return p;
+                } else if (needle_is_int && ll == vll) {
+                    return p;
+                }
+            }
+
+            /* Reset skip count */
+            skipcnt = skip;
+            p += entry_size;
+        } else {
+            /* Skip entry */
+            skipcnt--;
+            entry_size = lpCurrentEncodedSizeUnsafe(p);
+            p += entry_size+lpEncodeBacklen(NULL,entry_size);
+        }
+
+        /* Decoding the next element may read up to 8 bytes past 'p', use
+         * the slower full validation only near the end. */
+        if (p+8 >= lp_end)
+            lpAssertValidEntry(lp,lp_bytes,p);
+        else
+            assert(p >= lp+LP_HDR_SIZE && p < lp_end);
+        if (p[0] == LP_EOF) break;
+    }
+    return NULL;
+}
+
+/* Return 1 if the element pointed by 'p' is equal to the string 's' of
+ * length 'slen', 0 otherwise. */
+unsigned int lpCompare(unsigned char *p, unsigned char *s, uint32_t slen) {
+    unsigned char *value;
+    int64_t sz, sval;
+
+    if (p[0] == LP_EOF) return 0;
+    value = lpGet(p,&sz,NULL);
+    if (value) return slen == sz && memcmp(value,s,slen) == 0;
+    if (lpStringToInt64((const char*)s,slen,&sval)) return sz == sval;
+    return 0;
+}
+
+/* Store a string from 'val' or an integer from 'lval' into 'dest'. */
+static inline void lpSaveValue(unsigned char *val, unsigned int len, long long lval, listpackEntry *dest) {
+    dest->sval = val;
+    dest->slen = len;
+    dest->lval = lval;
+}
+
+/* Randomly select a pair of key and value. 'total_count' is a pre-computed
+ * length/2 of the listpack (to avoid calls to lpLength). 'val' can be NULL,
+ * in which case the value is not fetched. */
+void lpRandomPair(unsigned char *lp, unsigned long total_count, listpackEntry *key, listpackEntry *val) {
+    unsigned char *p;
+
+    /* Avoid div by zero on corrupt listpack */
+    assert(total_count);
+
+    /* Generate even numbers, because the listpack holds K-V pairs */
+    int r = (rand() % total_count) * 2;
+    assert((p = lpSeek(lp,r)));
+    key->sval = lpGetValue(p,&key->slen,&key->lval);
+
+    if (!val) return;
+    assert((p = lpNext(lp,p)));
+    val->sval = lpGetValue(p,&val->slen,&val->lval);
+}
+
+/* int compare for qsort */
+static int lpUintCompare(const void *a, const void *b) {
+    return (*(unsigned int *) a - *(unsigned int *) b);
+}
+
+/* Randomly select 'count' pairs of key and value and store them into 'keys'
+ * and 'vals'. The order of the picked entries is random, and the selections
+ * are non-unique (repetitions are possible). 'vals' can be NULL, in which
+ * case the values are skipped. */
+void lpRandomPairs(unsigned char *lp, unsigned int count, listpackEntry *keys, listpackEntry *vals) {
+    unsigned char *p, *key, *value;
+    unsigned int klen = 0, vlen = 0;
+    long long klval = 0, vlval = 0;
+
+    /* Notice: the index member must be first due to the use in lpUintCompare */
+    typedef struct {
+        unsigned int index;
+        unsigned int order;
+    } rand_pick;
+    rand_pick *picks = lp_malloc(sizeof(rand_pick)*count);
+    unsigned int total_size = lpLength(lp)/2;
+
+    /* Avoid div by zero on corrupt listpack */
+    assert(total_size);
+
+    /* create a pool of random indexes (some may be duplicate). */
+    for (unsigned int i = 0; i < count; i++) {
+        picks[i].index = (rand() % total_size) * 2; /* Generate even indexes */
+        /* keep track of the order we picked them */
+        picks[i].order = i;
+    }
+
+    /* sort by indexes. */
+    qsort(picks, count, sizeof(rand_pick), lpUintCompare);
+
+    /* fetch the elements form the listpack into a output array respecting
+     * the original order. */
+    unsigned int lpindex = 0, pickindex = 0;
+    p = lpFirst(lp);
+    while (p && pickindex < count) {
+        key = lpGetValue(p,&klen,&klval);
+        assert((p = lpNext(lp,p)));
+        value = lpGetValue(p,&vlen,&vlval);
+        while (pickindex < count && lpindex == picks[pickindex].index) {
+            int storeorder = picks[pickindex].order;
+            lpSaveValue(key, klen, klval, &keys[storeorder]);
+            if (vals)
+                lpSaveValue(value, vlen, vlval, &vals[storeorder]);
+            pickindex++;
+        }
+        lpindex += 2;
+        p = lpNext(lp,p);
+    }
+
+    lp_free(picks);
+}
+
+/* Randomly select 'count' pairs of key and value and store them into 'keys'
+ * and 'vals'. The selections are unique (no repetitions), and the order of
+ * the picked entries is NOT-random. 'vals' can be NULL, in which case the
+ * values are skipped. The return value is the number of pairs picked, which
+ * can be lower than 'count' if the listpack doesn't hold enough pairs. */
+unsigned int lpRandomPairsUnique(unsigned char *lp, unsigned int count, listpackEntry *keys, listpackEntry *vals) {
+    unsigned char *p, *key;
+    unsigned int klen = 0;
+    long long klval = 0;
+    unsigned int total_size = lpLength(lp)/2;
+    unsigned int index = 0;
+    if (count > total_size)
+        count = total_size;
+
+    /* To only iterate once, every time we try to pick a member, the probability
+     * we pick it is the quotient of the count left we want to pick and the
+     * count still we haven't visited in the listpack, this way, we could make
+     * every member be equally picked.*/
+    p = lpFirst(lp);
+    unsigned int picked = 0, remaining = count;
+    while (picked < count && p) {
+        double randomDouble = ((double)rand()) / RAND_MAX;
+        double threshold = ((double)remaining) / (total_size - index);
+        if (randomDouble <= threshold) {
+            key = lpGetValue(p,&klen,&klval);
+            lpSaveValue(key, klen, klval, &keys[picked]);
+            assert((p = lpNext(lp,p)));
+            if (vals) {
+                key = lpGetValue(p,&klen,&klval);
+                lpSaveValue(key, klen, klval, &vals[picked]);
+            }
+            remaining--;
+            picked++;
+        } else {
+            assert((p = lpNext(lp,p)));
+        }
+        p = lpNext(lp,p);
+        index++;
+    }
+    return picked;
+}
+
+/* Print the listpack elements to stdout, for DEBUG LISTPACK. */
+void lpRepr(unsigned char *lp) {
+    unsigned char *p, *vstr;
+    int64_t vlen;
+    unsigned char intbuf[LP_INTBUF_SIZE];
+    int index = 0;
+
+    printf("{total bytes %lu} {num entries %lu}\n",
+        (unsigned long)lpBytes(lp), (unsigned long)lpLength(lp));
+    p = lpFirst(lp);
+    while(p) {
+        uint32_t encoded_size_bytes = lpCurrentEncodedSizeBytes(p);
+        uint32_t encoded_size = lpCurrentEncodedSizeUnsafe(p);
+        unsigned long back_len = lpEncodeBacklen(NULL, encoded_size);
+        printf(
+            "{\n"
+                "\taddr: 0x%08lx,\n"
+                "\tindex: %2d,\n"
+                "\toffset: %1lu,\n"
+                "\thdr+entrylen+backlen: %2lu,\n"
+                "\thdrlen: %3u,\n"
+                "\tbacklen: %2lu,\n"
+                "\tpayload: %1u\n",
+            (long unsigned)p,
+            index,
+            (unsigned long) (p-lp),
+            encoded_size + back_len,
+            encoded_size_bytes,
+            back_len,
+            encoded_size - encoded_size_bytes);
+        printf("\tbytes: ");
+        for (unsigned int i = 0; i < (encoded_size + back_len); i++) {
+            printf("%02x|",p[i]);
+        }
+        printf("\n");
+
+        vstr = lpGet(p, &vlen, intbuf);
+        printf("\t[str]");
+        if (vlen > 40) {
+            if (fwrite(vstr, 40, 1, stdout) == 0) perror("fwrite");
+            printf("...");
+        } else {
+            if (fwrite(vstr, vlen, 1, stdout) == 0) perror("fwrite");
+        }
+        printf("\n}\n");
+        index++;
+        p = lpNext(lp, p);
+    }
+    printf("{end}\n\n");
+}
+
 /* Same as lpFirst but without validation assert, to be used right before lpValidateNext. */
 unsigned char *lpValidateFirst(unsigned char *lp) {
     unsigned char *p = lp + LP_HDR_SIZE; /* Skip the header. */
@@ -929,8 +1360,10 @@ static inline void lpAssertValidEntry(unsigned char* lp, size_t lpbytes, unsigne
 
 /* Validate the integrity of the data structure.
  * when `deep` is 0, only the integrity of the header is validated.
- * when `deep` is 1, we scan all the entries one by one. */
-int lpValidateIntegrity(unsigned char *lp, size_t size, int deep){
+ * when `deep` is 1, we scan all the entries one by one, calling 'entry_cb'
+ * (if not NULL) for each of them: a 0 return value fails the validation. */
+int lpValidateIntegrity(unsigned char *lp, size_t size, int deep,
+                        listpackValidateEntryCB entry_cb, void *cb_userdata) {
     /* Check that we can actually read the header. (and EOF) */
     if (size < LP_HDR_SIZE + 1)
         return 0;
@@ -951,8 +1384,13 @@ int lpValidateIntegrity(unsigned char *lp, size_t size, int deep){
     uint32_t count = 0;
     unsigned char *p = lp + LP_HDR_SIZE;
     while(p && p[0] != LP_EOF) {
+        unsigned char *prev = p;
+
         if (!lpValidateNext(lp, &p, bytes))
             return 0;
+        /* Optionally let the caller validate the entry too. */
+        if (entry_cb && !entry_cb(prev, cb_userdata))
+            return 0;
         count++;
     }
 
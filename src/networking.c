@@ -30,6 +30,8 @@
 #include "server.h"
 #include "atomicvar.h"
 #include "cluster.h"
+#include "numa_io_threads.h"
+#include "numa_reply_pool.h"
 #include <sys/socket.h>
 #include <sys/uio.h>
 #include <math.h>
@@ -78,7 +80,7 @@ void *dupClientReplyValue(void *o) {
 }
 
 void freeClientReplyValue(void *o) {
-    zfree(o);
+    if (!numaReplyPoolPut(o)) zfree(o);
 }
 
 int listMatchObjects(void *a, void *b) {
@@ -117,6 +119,10 @@ int authRequired(client *c) {
 }
 
 client *createClient(connection *conn) {
+    /* With NUMA-aware io-threads the client structure and its buffers are
+     * allocated on the node the connection is affine to. */
+    int numa_node = numaIOClientAttach(conn);
+    int alloc_token = numaIOAllocBegin(numa_node);
     client *c = zmalloc(sizeof(client));
 
     /* passing NULL as conn it is possible to create a non connected client.
@@ -142,12 +148,15 @@ client *createClient(connection *conn) {
     c->bufpos = 0;
     c->qb_pos = 0;
     c->querybuf = sdsempty();
+    c->numa_node = numa_node;
     c->pending_querybuf = sdsempty();
     c->querybuf_peak = 0;
     c->reqtype = 0;
     c->argc = 0;
     c->argv = NULL;
     c->argv_len_sum = 0;
+    c->argv_cache = NULL;
+    c->prefetch_window = 0;
     c->original_argc = 0;
     c->original_argv = NULL;
     c->cmd = c->lastcmd = NULL;
@@ -163,6 +172,7 @@ client *createClient(connection *conn) {
     c->read_reploff = 0;
     c->repl_ack_off = 0;
     c->repl_ack_time = 0;
+    c->repl_backlog_ref_off = -1;
     c->repl_last_partial_write = 0;
     c->slave_listening_port = 0;
     c->slave_addr = NULL;
@@ -201,6 +211,7 @@ client *createClient(connection *conn) {
     listSetMatchMethod(c->pubsub_patterns,listMatchObjects);
     if (conn) linkClient(c);
     initClientMultiState(c);
+    numaIOAllocEnd(alloc_token);
     return c;
 }
 
@@ -337,7 +348,13 @@ void _addReplyProtoToList(client *c, const char *s, size_t len) {
         /* Create a new node, make sure it is allocated to at
          * least PROTO_REPLY_CHUNK_BYTES */
         size_t size = len < PROTO_REPLY_CHUNK_BYTES? PROTO_REPLY_CHUNK_BYTES: len;
-        tail = zmalloc(size + sizeof(clientReplyBlock));
+        tail = NULL;
+        if (size == PROTO_REPLY_CHUNK_BYTES) tail = numaReplyPoolGet(c->numa_node);
+        if (!tail) {
+            int alloc_token = numaIOAllocBegin(c->numa_node);
+            tail = zmalloc(size + sizeof(clientReplyBlock));
+            numaIOAllocEnd(alloc_token);
+        }
         /* take over the allocation's internal fragmentation */
         tail->size = zmalloc_usable_size(tail) - sizeof(clientReplyBlock);
         tail->used = len;
@@ -565,7 +582,9 @@ void trimReplyUnusedTailSpace(client *c) {
         tail->used < PROTO_REPLY_CHUNK_BYTES)
     {
         size_t old_size = tail->size;
+        int alloc_token = numaIOAllocBegin(c->numa_node);
         tail = zrealloc(tail, tail->used + sizeof(clientReplyBlock));
+        numaIOAllocEnd(alloc_token);
         /* take over the allocation's internal fragmentation (at least for
          * memory usage tracking) */
         tail->size = zmalloc_usable_size(tail) - sizeof(clientReplyBlock);
@@ -632,7 +651,9 @@ void setDeferredReply(client *c, void *node, const char *s, size_t length) {
         listDelNode(c->reply,ln);
     } else {
         /* Create a new node */
+        int alloc_token = numaIOAllocBegin(c->numa_node);
         clientReplyBlock *buf = zmalloc(length + sizeof(clientReplyBlock));
+        numaIOAllocEnd(alloc_token);
         /* Take over the allocation's internal fragmentation */
         buf->size = zmalloc_usable_size(buf) - sizeof(clientReplyBlock);
         buf->used = length;
@@ -1044,7 +1065,9 @@ void deferredAfterErrorReply(client *c, list *errors) {
 /* Return true if the specified client has pending reply buffers to write to
  * the socket. */
 int clientHasPendingReplies(client *c) {
-    return c->bufpos || listLength(c->reply);
+    return c->bufpos || listLength(c->reply) ||
+           (c->repl_backlog_ref_off != -1 &&
+            c->repl_backlog_ref_off < server.master_repl_offset);
 }
 
 void clientAcceptHandler(connection *conn) {
@@ -1259,10 +1282,84 @@ void freeClientOriginalArgv(client *c) {
     c->original_argc = 0;
 }
 
+/* With client-argv-cache, EMBSTR argument objects that only the client
+ * still references when its command completes are kept in a small
+ * per-client cache, by allocation size, and reused for the arguments of
+ * the next commands without going through the allocator. Arguments that
+ * the command retained (stored in the keyspace, queued by MULTI, ...)
+ * have more references and are released as usual. */
+#define ARGV_CACHE_CLASSES 3    /* 32, 48 and 64 byte objects. */
+#define ARGV_CACHE_SLOTS 16     /* Objects kept per class. */
+#define ARGV_CACHE_MAX_ARGV 1024 /* Larger argv arrays are not reused. */
+#define ARGV_CACHE_OBJ_OVERHEAD (sizeof(robj)+sizeof(struct sdshdr8)+1)
+
+typedef struct clientArgvCache {
+    robj *objs[ARGV_CACHE_CLASSES][ARGV_CACHE_SLOTS];
+    int count[ARGV_CACHE_CLASSES];
+} clientArgvCache;
+
+/* Allocation size of the objects of class 'class'. */
+static size_t argvCacheClassSize(int class) {
+    return 32 + (size_t)class*16;
+}
+
+/* Return the class of objects able to hold a string of 'len' bytes, or -1
+ * if the string is too long for the cache. */
+static int argvCacheClassForLen(size_t len) {
+    size_t size = ARGV_CACHE_OBJ_OVERHEAD + len;
+    for (int class = 0; class < ARGV_CACHE_CLASSES; class++)
+        if (size <= argvCacheClassSize(class)) return class;
+    return -1;
+}
+
+/* Create a string object for a command argument, reusing a cached object
+ * if possible. */
+static robj *createClientArgvObject(client *c, const char *ptr, size_t len) {
+    int class;
+    if (!server.client_argv_cache || (class = argvCacheClassForLen(len)) == -1)
+        return createStringObject(ptr,len);
+
+    clientArgvCache *cache = c->argv_cache;
+    if (cache && cache->count[class])
+        return initEmbeddedStringObject(cache->objs[class][--cache->count[class]],ptr,len);
+    return initEmbeddedStringObject(zmalloc(argvCacheClassSize(class)),ptr,len);
+}
+
+/* Keep an argument object in the client cache instead of releasing it.
+ * Returns 1 if the object was cached. */
+static int clientArgvCacheRelease(client *c, robj *o) {
+    if (!server.client_argv_cache || o->refcount != 1 ||
+        o->type != OBJ_STRING || o->encoding != OBJ_ENCODING_EMBSTR) return 0;
+
+    size_t size = zmalloc_usable_size(o);
+    int class;
+    for (class = 0; class < ARGV_CACHE_CLASSES; class++)
+        if (size == argvCacheClassSize(class)) break;
+    if (class == ARGV_CACHE_CLASSES) return 0;
+
+    if (!c->argv_cache) c->argv_cache = zcalloc(sizeof(clientArgvCache));
+    clientArgvCache *cache = c->argv_cache;
+    if (cache->count[class] == ARGV_CACHE_SLOTS) return 0;
+    cache->objs[class][cache->count[class]++] = o;
+    return 1;
+}
+
+static void freeClientArgvCache(client *c) {
+    clientArgvCache *cache = c->argv_cache;
+    if (!cache) return;
+    for (int class = 0; class < ARGV_CACHE_CLASSES; class++)
+        for (int j = 0; j < cache->count[class]; j++)
+            zfree(cache->objs[class][j]);
+    zfree(cache);
+    c->argv_cache = NULL;
+}
+
 static void freeClientArgv(client *c) {
     int j;
-    for (j = 0; j < c->argc; j++)
-        decrRefCount(c->argv[j]);
+    for (j = 0; j < c->argc; j++) {
+        if (!clientArgvCacheRelease(c,c->argv[j]))
+            decrRefCount(c->argv[j]);
+    }
     c->argc = 0;
     c->cmd = NULL;
     c->argv_len_sum = 0;
@@ -1378,6 +1475,11 @@ void freeClient(client *c) {
         return;
     }
 
+    /* A cached master keeps the client but not the connection: it is
+     * attached again when resurrected. */
+    numaIOClientDetach(c->numa_node);
+    c->numa_node = -1;
+
     /* For connected clients, call the disconnection event of modules hooks. */
     if (c->conn) {
         moduleFireServerEvent(REDISMODULE_EVENT_CLIENT_CHANGE,
@@ -1502,6 +1604,7 @@ void freeClient(client *c) {
     if (c->name) decrRefCount(c->name);
     zfree(c->argv);
     c->argv_len_sum = 0;
+    freeClientArgvCache(c);
     freeClientMultiState(c);
     sdsfree(c->peerid);
     sdsfree(c->sockname);
@@ -1579,7 +1682,24 @@ int writeToClient(client *c, int handler_installed) {
     clientReplyBlock *o;
 
     while(clientHasPendingReplies(c)) {
-        if (c->bufpos > 0) {
+        if (c->repl_backlog_ref_off != -1 &&
+            c->repl_backlog_ref_off < server.master_repl_offset)
+        {
+            /* Slave sending from the replication backlog: the unsent
+             * bytes are the last ones fed to it, see replication.c. */
+            long long pending = server.master_repl_offset -
+                                c->repl_backlog_ref_off;
+            long long idx = (server.repl_backlog_idx +
+                             (server.repl_backlog_size - pending)) %
+                             server.repl_backlog_size;
+            long long thislen = server.repl_backlog_size - idx;
+            if (thislen > pending) thislen = pending;
+
+            nwritten = connWrite(c->conn,server.repl_backlog+idx,thislen);
+            if (nwritten <= 0) break;
+            c->repl_backlog_ref_off += nwritten;
+            totwritten += nwritten;
+        } else if (c->bufpos > 0) {
             nwritten = connWrite(c->conn,c->buf+c->sentlen,c->bufpos-c->sentlen);
             if (nwritten <= 0) break;
             c->sentlen += nwritten;
@@ -1635,6 +1755,7 @@ int writeToClient(client *c, int handler_installed) {
             !(c->flags & CLIENT_SLAVE)) break;
     }
     atomicIncr(server.stat_net_output_bytes, totwritten);
+    numaIOAddWriteBytes(c->numa_node, totwritten);
     if (nwritten == -1) {
         if (connGetState(c->conn) != CONN_STATE_CONNECTED) {
             serverLog(LL_VERBOSE,
@@ -1663,6 +1784,9 @@ int writeToClient(client *c, int handler_installed) {
             freeClientAsync(c);
             return C_ERR;
         }
+
+        /* Drained slaves send the next stream bytes from the backlog. */
+        if (c->flags & CLIENT_SLAVE) replicationBacklogTryAttach(c);
     }
     return C_OK;
 }
@@ -1953,9 +2077,15 @@ int processMultibulkBuffer(client *c) {
 
         c->multibulklen = ll;
 
-        /* Setup argv array on client structure */
-        if (c->argv) zfree(c->argv);
-        c->argv = zmalloc(sizeof(robj*)*c->multibulklen);
+        /* Setup argv array on client structure. With client-argv-cache
+         * the previous array is reused when it is large enough. */
+        if (!server.client_argv_cache || !c->argv ||
+            c->multibulklen > ARGV_CACHE_MAX_ARGV ||
+            zmalloc_usable_size(c->argv) < sizeof(robj*)*c->multibulklen)
+        {
+            if (c->argv) zfree(c->argv);
+            c->argv = zmalloc(sizeof(robj*)*c->multibulklen);
+        }
         c->argv_len_sum = 0;
     }
 
@@ -2041,7 +2171,7 @@ int processMultibulkBuffer(client *c) {
                 sdsclear(c->querybuf);
             } else {
                 c->argv[c->argc++] =
-                    createStringObject(c->querybuf+c->qb_pos,c->bulklen);
+                    createClientArgvObject(c,c->querybuf+c->qb_pos,c->bulklen);
                 c->argv_len_sum += c->bulklen;
                 c->qb_pos += c->bulklen+2;
             }
@@ -2140,6 +2270,93 @@ int processPendingCommandsAndResetClient(client *c) {
     return C_OK;
 }
 
+/* Scan the complete multibulk command starting at '*pos' in the query
+ * buffer without creating any object. On success the position after the
+ * command is stored in '*pos', the second argument (the key of most
+ * commands) in '*key' and '*keylen' ('*key' is NULL if there is none),
+ * and 1 is returned. Returns 0 if there is no complete multibulk command
+ * at '*pos'. Malformed input is left to processMultibulkBuffer(). */
+static int scanPipelinedCommand(client *c, size_t *pos, const char **key, size_t *keylen) {
+    const char *buf = c->querybuf, *end = buf+sdslen(c->querybuf);
+    const char *p = buf+*pos, *newline;
+    long long argc, len;
+
+    if (p >= end || *p != '*') return 0;
+    newline = memchr(p,'\r',end-p);
+    if (newline == NULL || newline+1 >= end) return 0;
+    if (!string2ll(p+1,newline-(p+1),&argc) || argc <= 0) return 0;
+    p = newline+2;
+
+    *key = NULL;
+    for (long long j = 0; j < argc; j++) {
+        if (p >= end || *p != '$') return 0;
+        newline = memchr(p,'\r',end-p);
+        if (newline == NULL || newline+1 >= end) return 0;
+        if (!string2ll(p+1,newline-(p+1),&len) || len < 0) return 0;
+        p = newline+2;
+        if (len+2 > end-p) return 0;
+        if (j == 1) {
+            *key = p;
+            *keylen = len;
+        }
+        p += len+2;
+    }
+    *pos = p-buf;
+    return 1;
+}
+
+/* With pipeline-prefetch-batch, the query buffer of a pipelining client is
+ * scanned ahead for up to that many complete commands before executing
+ * them, and the keyspace memory that looking up their key will touch is
+ * prefetched for all of them at once: the hash bucket, then the dictEntry,
+ * then the key and value objects, then the value body. Each stage only
+ * dereferences pointers prefetched by the previous one, so the cache misses
+ * of the batch overlap instead of being taken one command at a time.
+ *
+ * Returns the number of commands scanned, that will be executed before
+ * scanning again. */
+static int prefetchPipelinedKeys(client *c) {
+    const char *keys[PROTO_PREFETCH_MAX_BATCH];
+    size_t lens[PROTO_PREFETCH_MAX_BATCH];
+    uint64_t hashes[PROTO_PREFETCH_MAX_BATCH];
+    void *buckets[PROTO_PREFETCH_MAX_BATCH];
+    dictEntry *des[PROTO_PREFETCH_MAX_BATCH];
+    size_t pos = c->qb_pos;
+    int ncmds = 0, nkeys = 0;
+
+    while (ncmds < server.pipeline_prefetch_batch &&
+           scanPipelinedCommand(c,&pos,&keys[nkeys],&lens[nkeys]))
+    {
+        ncmds++;
+        if (keys[nkeys]) nkeys++;
+    }
+    /* A single command gains nothing from prefetching. */
+    dict *d = c->db->dict;
+    if (ncmds < 2 || dictSize(d) == 0) return ncmds;
+
+    for (int j = 0; j < nkeys; j++) {
+        hashes[j] = dictGenHashFunction(keys[j],lens[j]);
+        buckets[j] = dictGetBucket(d,hashes[j]);
+        redis_prefetch(buckets[j]);
+    }
+    for (int j = 0; j < nkeys; j++) {
+        des[j] = dictBucketCandidate(d,buckets[j],hashes[j]);
+        if (des[j]) redis_prefetch(des[j]);
+    }
+    for (int j = 0; j < nkeys; j++) {
+        if (!des[j]) continue;
+        redis_prefetch(dictGetKey(des[j]));
+        redis_prefetch(dictGetVal(des[j]));
+    }
+    for (int j = 0; j < nkeys; j++) {
+        if (!des[j]) continue;
+        robj *o = dictGetVal(des[j]);
+        if (o->encoding != OBJ_ENCODING_EMBSTR && o->encoding != OBJ_ENCODING_INT)
+            redis_prefetch(o->ptr);
+    }
+    return ncmds;
+}
+
 /* This function is called every time, in the client structure 'c', there is
  * more query buffer to process, because we read more data from the socket
  * or because a client was blocked and later reactivated, so there could be
@@ -2167,6 +2384,14 @@ void processInputBuffer(client *c) {
          * The same applies for clients we want to terminate ASAP. */
         if (c->flags & (CLIENT_CLOSE_AFTER_REPLY|CLIENT_CLOSE_ASAP)) break;
 
+        /* Prefetch the keys of the next pipelined commands. Not done by the
+         * I/O threads, since the keyspace can change under them. */
+        if (server.pipeline_prefetch_batch && c->prefetch_window == 0 &&
+            !c->reqtype && !(c->flags & CLIENT_PENDING_READ))
+        {
+            c->prefetch_window = prefetchPipelinedKeys(c);
+        }
+
         /* Determine request type when unknown. */
         if (!c->reqtype) {
             if (c->querybuf[c->qb_pos] == '*') {
@@ -2209,6 +2434,7 @@ void processInputBuffer(client *c) {
             }
 
             /* We are finally ready to execute the command. */
+            if (c->prefetch_window) c->prefetch_window--;
             if (processCommandAndResetClient(c) == C_ERR) {
                 /* If the client is no longer valid, we avoid exiting this
                  * loop and trimming the client buffer later. So we return
@@ -2256,7 +2482,9 @@ void readQueryFromClient(connection *conn) {
 
     qblen = sdslen(c->querybuf);
     if (c->querybuf_peak < qblen) c->querybuf_peak = qblen;
+    int alloc_token = numaIOAllocBegin(c->numa_node);
     c->querybuf = sdsMakeRoomFor(c->querybuf, readlen);
+    numaIOAllocEnd(alloc_token);
     nread = connRead(c->conn, c->querybuf+qblen, readlen);
     if (nread == -1) {
         if (connGetState(conn) == CONN_STATE_CONNECTED) {
@@ -2282,6 +2510,7 @@ void readQueryFromClient(connection *conn) {
     c->lastinteraction = server.unixtime;
     if (c->flags & CLIENT_MASTER) c->read_reploff += nread;
     atomicIncr(server.stat_net_input_bytes, nread);
+    numaIOAddReadBytes(c->numa_node, nread);
     if (sdslen(c->querybuf) > server.client_max_querybuf_len) {
         sds ci = catClientInfoString(sdsempty(),c), bytes = sdsempty();
 
@@ -3546,6 +3775,7 @@ void *IOThreadMain(void *myid) {
     snprintf(thdname, sizeof(thdname), "io_thd_%ld", id);
     redis_set_thread_title(thdname);
     redisSetCpuAffinity(server.server_cpulist);
+    numaIOThreadBind(id);
     makeThreadKillable();
 
     while(1) {
@@ -3597,6 +3827,9 @@ void initThreadedIO(void) {
         exit(1);
     }
 
+    /* Group the threads per NUMA node before they start. */
+    numaIOThreadsInit(server.io_threads_num);
+
     /* Spawn and initialize the I/O threads. */
     for (int i = 0; i < server.io_threads_num; i++) {
         /* Things we do for all the threads including the main thread. */
@@ -3702,7 +3935,8 @@ int handleClientsWithPendingWritesUsingThreads(void) {
             continue;
         }
 
-        int target_id = item_id % server.io_threads_num;
+        int target_id = numaIOPickThread(c->numa_node,
+                                         item_id % server.io_threads_num);
         listAddNodeTail(io_threads_list[target_id],c);
         item_id++;
     }
@@ -3789,7 +4023,8 @@ int handleClientsWithPendingReadsUsingThreads(void) {
     int item_id = 0;
     while((ln = listNext(&li))) {
         client *c = listNodeValue(ln);
-        int target_id = item_id % server.io_threads_num;
+        int target_id = numaIOPickThread(c->numa_node,
+                                         item_id % server.io_threads_num);
         listAddNodeTail(io_threads_list[target_id],c);
         item_id++;
     }
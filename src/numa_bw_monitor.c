@@ -18,6 +18,8 @@
 #include <string.h>
 #include <sys/time.h>
 #include <sys/stat.h>
+#include <time.h>
+#include <pthread.h>
 #include <numa.h>
 
 /* ========== 日志输出 ========== */
@@ -220,6 +222,293 @@ static void sample_manual(void) {
     (void)0;  /* 空操作，避免编译警告 */
 }
 
+/* ========== 高频采样线程 ========== */
+
+/*
+ * 采样线程按 interval_ms（10~100ms）读取后端计数器，得到每节点的瞬时带宽，
+ * 写入线程私有的样本环。每个窗口（1s/10s/60s）维护一个尾指针和一个
+ * 利用率直方图：新样本进入时计数加一，样本滑出窗口时减一，因此每次采样
+ * 的维护代价是 O(1)，分位数由 101 档直方图直接求得。
+ *
+ * 计算结果以 seqlock 发布：写者把 seq 置为奇数、写快照、再置为偶数；
+ * 读者在 seq 为偶数且前后一致时接受拷贝，主线程读取永不阻塞。
+ */
+
+static const uint32_t bw_window_ms[NUMA_BW_WINDOWS] = { 1000, 10000, 60000 };
+
+typedef struct {
+    uint64_t ts_us;
+    float mbps;
+    float usage;
+} bw_sample_t;
+
+/* 采样线程私有的每节点状态 */
+typedef struct {
+    bw_sample_t ring[NUMA_BW_HF_RING_SIZE];
+    uint32_t head;                              /* 下一个写入位置 */
+    uint32_t count;                             /* 环中有效样本数 */
+    uint32_t tail[NUMA_BW_WINDOWS];             /* 各窗口最旧样本位置 */
+    uint32_t win_count[NUMA_BW_WINDOWS];        /* 各窗口样本数 */
+    uint32_t hist[NUMA_BW_WINDOWS][NUMA_BW_HIST_BUCKETS];
+    uint64_t counter_prev;                      /* 上次读取的后端计数 */
+    uint64_t ts_prev;
+} bw_hf_node_t;
+
+static struct {
+    pthread_t thread;
+    pthread_mutex_t lock;                       /* 仅保护 interval/stop 与条件变量 */
+    pthread_cond_t cond;
+    int running;
+    int stop;
+    uint32_t interval_ms;
+    bw_hf_node_t *nodes;                        /* num_nodes 个，线程私有 */
+
+    /* seqlock 发布的快照 */
+    uint64_t seq;
+    numa_bw_node_snapshot_t snap[NUMA_BW_MAX_NODES];
+} bw_sampler = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+    .interval_ms = NUMA_BW_HF_DEFAULT_INTERVAL_MS
+};
+
+/* 读取后端累计计数并换算为字节 */
+static uint64_t read_backend_bytes(int node_id) {
+    switch (g_bw_monitor.backend) {
+        case NUMA_BW_BACKEND_RESCTRL:  return read_resctrl_bytes(node_id);
+        case NUMA_BW_BACKEND_NUMASTAT: return read_numastat_pages(node_id) * 4096;
+        default:                       return 0;
+    }
+}
+
+static inline int usage_bucket(float usage) {
+    int b = (int)(usage * 100.0f + 0.5f);
+    if (b < 0) b = 0;
+    if (b >= NUMA_BW_HIST_BUCKETS) b = NUMA_BW_HIST_BUCKETS - 1;
+    return b;
+}
+
+/* 追加一个样本，并让各窗口滑出过期样本 */
+static void bw_hf_push(bw_hf_node_t *n, uint64_t now_us, float mbps, float usage) {
+    /* 环满时最旧样本即将被覆盖，先把它从仍包含它的窗口中移除 */
+    if (n->count == NUMA_BW_HF_RING_SIZE) {
+        for (int w = 0; w < NUMA_BW_WINDOWS; w++) {
+            if (n->win_count[w] > 0 && n->tail[w] == n->head) {
+                n->hist[w][usage_bucket(n->ring[n->head].usage)]--;
+                n->tail[w] = (n->tail[w] + 1) % NUMA_BW_HF_RING_SIZE;
+                n->win_count[w]--;
+            }
+        }
+        n->count--;
+    }
+
+    bw_sample_t *s = &n->ring[n->head];
+    s->ts_us = now_us;
+    s->mbps = mbps;
+    s->usage = usage;
+    int bucket = usage_bucket(usage);
+    for (int w = 0; w < NUMA_BW_WINDOWS; w++) {
+        if (n->win_count[w] == 0) n->tail[w] = n->head;
+        n->hist[w][bucket]++;
+        n->win_count[w]++;
+    }
+    n->head = (n->head + 1) % NUMA_BW_HF_RING_SIZE;
+    n->count++;
+
+    for (int w = 0; w < NUMA_BW_WINDOWS; w++) {
+        uint64_t horizon = (uint64_t)bw_window_ms[w] * 1000;
+        while (n->win_count[w] > 1 && now_us - n->ring[n->tail[w]].ts_us > horizon) {
+            n->hist[w][usage_bucket(n->ring[n->tail[w]].usage)]--;
+            n->tail[w] = (n->tail[w] + 1) % NUMA_BW_HF_RING_SIZE;
+            n->win_count[w]--;
+        }
+    }
+}
+
+/* 由直方图求窗口统计 */
+static void bw_hf_window_stats(bw_hf_node_t *n, int w, numa_bw_window_stats_t *out) {
+    uint32_t total = n->win_count[w];
+    out->samples = total;
+    out->p50 = out->p99 = out->max = out->max_mbps = 0.0;
+    if (total == 0) return;
+
+    uint32_t rank50 = (total * 50 + 99) / 100;
+    uint32_t rank99 = (total * 99 + 99) / 100;
+    uint32_t seen = 0;
+    int p50 = -1, p99 = -1, max = 0;
+    for (int b = 0; b < NUMA_BW_HIST_BUCKETS; b++) {
+        if (n->hist[w][b] == 0) continue;
+        seen += n->hist[w][b];
+        if (p50 < 0 && seen >= rank50) p50 = b;
+        if (p99 < 0 && seen >= rank99) p99 = b;
+        max = b;
+    }
+    out->p50 = p50 / 100.0;
+    out->p99 = p99 / 100.0;
+    out->max = max / 100.0;
+
+    /* 窗口最大带宽直接遍历样本（仅在发布时计算一次）*/
+    uint32_t idx = n->tail[w];
+    for (uint32_t i = 0; i < total; i++) {
+        if (n->ring[idx].mbps > out->max_mbps) out->max_mbps = n->ring[idx].mbps;
+        idx = (idx + 1) % NUMA_BW_HF_RING_SIZE;
+    }
+}
+
+static void bw_hf_sample_once(void) {
+    uint64_t now = get_current_time_us();
+    numa_bw_node_snapshot_t snap[NUMA_BW_MAX_NODES];
+
+    for (int i = 0; i < g_bw_monitor.num_nodes; i++) {
+        bw_hf_node_t *n = &bw_sampler.nodes[i];
+        uint64_t curr = read_backend_bytes(i);
+
+        double mbps = 0.0;
+        if (n->ts_prev != 0 && now > n->ts_prev && curr >= n->counter_prev) {
+            double delta_sec = (double)(now - n->ts_prev) / 1000000.0;
+            mbps = (double)(curr - n->counter_prev) / (1024.0 * 1024.0) / delta_sec;
+        }
+        n->counter_prev = curr;
+        n->ts_prev = now;
+
+        double max_bw = g_bw_monitor.nodes[i].max_bandwidth_mbps;
+        double usage = (max_bw > 0) ? clamp_01(mbps / max_bw) : 0.0;
+        bw_hf_push(n, now, (float)mbps, (float)usage);
+
+        snap[i].current_bw_mbps = mbps;
+        snap[i].bw_usage = usage;
+        for (int w = 0; w < NUMA_BW_WINDOWS; w++)
+            bw_hf_window_stats(n, w, &snap[i].win[w]);
+    }
+
+    /* seqlock 写端 */
+    __atomic_add_fetch(&bw_sampler.seq, 1, __ATOMIC_RELEASE);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(bw_sampler.snap, snap, sizeof(snap[0]) * g_bw_monitor.num_nodes);
+    __atomic_add_fetch(&bw_sampler.seq, 1, __ATOMIC_RELEASE);
+}
+
+/* seqlock 读端：拷贝一个节点的快照 */
+static void bw_hf_read_snapshot(int node_id, numa_bw_node_snapshot_t *out) {
+    uint64_t s1, s2;
+    do {
+        s1 = __atomic_load_n(&bw_sampler.seq, __ATOMIC_ACQUIRE);
+        if (s1 & 1) continue;
+        memcpy(out, &bw_sampler.snap[node_id], sizeof(*out));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        s2 = __atomic_load_n(&bw_sampler.seq, __ATOMIC_RELAXED);
+    } while ((s1 & 1) || s1 != s2);
+}
+
+static void *bw_sampler_main(void *arg) {
+    (void)arg;
+
+    /* 建立计数基线，首个样本才有意义 */
+    uint64_t now = get_current_time_us();
+    for (int i = 0; i < g_bw_monitor.num_nodes; i++) {
+        bw_sampler.nodes[i].counter_prev = read_backend_bytes(i);
+        bw_sampler.nodes[i].ts_prev = now;
+    }
+
+    pthread_mutex_lock(&bw_sampler.lock);
+    while (!bw_sampler.stop) {
+        if (bw_sampler.interval_ms == 0) {
+            pthread_cond_wait(&bw_sampler.cond, &bw_sampler.lock);
+            continue;
+        }
+
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        uint64_t ns = (uint64_t)deadline.tv_nsec + (uint64_t)bw_sampler.interval_ms * 1000000ULL;
+        deadline.tv_sec += ns / 1000000000ULL;
+        deadline.tv_nsec = ns % 1000000000ULL;
+        pthread_cond_timedwait(&bw_sampler.cond, &bw_sampler.lock, &deadline);
+        if (bw_sampler.stop || bw_sampler.interval_ms == 0) continue;
+
+        pthread_mutex_unlock(&bw_sampler.lock);
+        bw_hf_sample_once();
+        pthread_mutex_lock(&bw_sampler.lock);
+    }
+    pthread_mutex_unlock(&bw_sampler.lock);
+    return NULL;
+}
+
+static int bw_sampler_spawn(void) {
+    if (!g_bw_monitor.initialized) return -1;
+    /* manual 后端没有计数器可读，高频采样无意义 */
+    if (g_bw_monitor.backend == NUMA_BW_BACKEND_MANUAL) return -1;
+
+    if (!bw_sampler.nodes) {
+        bw_sampler.nodes = calloc(g_bw_monitor.num_nodes, sizeof(bw_hf_node_t));
+        if (!bw_sampler.nodes) return -1;
+    }
+    bw_sampler.stop = 0;
+
+    int rc = pthread_create(&bw_sampler.thread, NULL, bw_sampler_main, NULL);
+    if (rc != 0) {
+        BW_LOG(LL_WARNING, "Fatal: Can't create bandwidth sampler thread: %s", strerror(rc));
+        return -1;
+    }
+    bw_sampler.running = 1;
+    BW_LOG(LL_NOTICE, "High-frequency sampler started: interval=%ums, backend=%s",
+           bw_sampler.interval_ms, backend_name(g_bw_monitor.backend));
+    return 0;
+}
+
+int numa_bw_sampler_start(uint32_t interval_ms) {
+    if (bw_sampler.running) return 0;
+    bw_sampler.interval_ms = interval_ms;
+    if (interval_ms == 0) return 0;
+    return bw_sampler_spawn();
+}
+
+void numa_bw_sampler_set_interval(uint32_t interval_ms) {
+    pthread_mutex_lock(&bw_sampler.lock);
+    bw_sampler.interval_ms = interval_ms;
+    pthread_cond_signal(&bw_sampler.cond);
+    pthread_mutex_unlock(&bw_sampler.lock);
+
+    if (interval_ms > 0 && !bw_sampler.running) bw_sampler_spawn();
+}
+
+void numa_bw_sampler_stop(void) {
+    if (!bw_sampler.running) return;
+
+    pthread_mutex_lock(&bw_sampler.lock);
+    bw_sampler.stop = 1;
+    pthread_cond_signal(&bw_sampler.cond);
+    pthread_mutex_unlock(&bw_sampler.lock);
+
+    pthread_join(bw_sampler.thread, NULL);
+    bw_sampler.running = 0;
+    free(bw_sampler.nodes);
+    bw_sampler.nodes = NULL;
+}
+
+int numa_bw_sampler_running(void) {
+    return bw_sampler.running && bw_sampler.interval_ms > 0;
+}
+
+int numa_bw_get_window_stats(int node_id, int window, numa_bw_window_stats_t *out) {
+    if (!out || !numa_bw_sampler_running()) return -1;
+    if (node_id < 0 || node_id >= g_bw_monitor.num_nodes) return -1;
+    if (window < 0 || window >= NUMA_BW_WINDOWS) return -1;
+
+    numa_bw_node_snapshot_t snap;
+    bw_hf_read_snapshot(node_id, &snap);
+    *out = snap.win[window];
+    return 0;
+}
+
+const char *numa_bw_window_name(int window) {
+    switch (window) {
+        case NUMA_BW_WINDOW_1S:  return "1s";
+        case NUMA_BW_WINDOW_10S: return "10s";
+        case NUMA_BW_WINDOW_60S: return "60s";
+        default:                 return "unknown";
+    }
+}
+
 /* ========== 公共接口实现 ========== */
 
 /* 初始化带宽监控器 */
@@ -274,6 +563,9 @@ int numa_bw_monitor_init(void) {
 /* 采样一次 */
 void numa_bw_monitor_sample(void) {
     if (!g_bw_monitor.initialized) return;
+
+    /* 高频采样线程运行时由其负责采样 */
+    if (numa_bw_sampler_running()) return;
     
     /* 检查采样间隔 */
     uint64_t now = get_current_time_us();
@@ -303,6 +595,13 @@ void numa_bw_monitor_sample(void) {
 double numa_bw_get_usage(int node_id) {
     if (!g_bw_monitor.initialized) return -1.0;
     if (node_id < 0 || node_id >= g_bw_monitor.num_nodes) return -1.0;
+
+    /* 高频采样：取 1s 窗口 p99，突发不会被平均掉 */
+    if (numa_bw_sampler_running()) {
+        numa_bw_node_snapshot_t snap;
+        bw_hf_read_snapshot(node_id, &snap);
+        return snap.win[NUMA_BW_WINDOW_1S].p99;
+    }
     
     return g_bw_monitor.nodes[node_id].bw_usage;
 }
@@ -311,6 +610,12 @@ double numa_bw_get_usage(int node_id) {
 double numa_bw_get_current_mbps(int node_id) {
     if (!g_bw_monitor.initialized) return -1.0;
     if (node_id < 0 || node_id >= g_bw_monitor.num_nodes) return -1.0;
+
+    if (numa_bw_sampler_running()) {
+        numa_bw_node_snapshot_t snap;
+        bw_hf_read_snapshot(node_id, &snap);
+        return snap.current_bw_mbps;
+    }
     
     return g_bw_monitor.nodes[node_id].current_bw_mbps;
 }
@@ -346,12 +651,286 @@ const numa_bw_monitor_t* numa_bw_get_monitor(void) {
 
 /* 清理资源 */
 void numa_bw_monitor_cleanup(void) {
+    numa_lat_probe_stop();
+    numa_bw_sampler_stop();
     if (!g_bw_monitor.initialized) return;
     
     memset(&g_bw_monitor, 0, sizeof(g_bw_monitor));
     BW_LOG_SIMPLE(LL_NOTICE, "Cleaned up");
 }
 
+/* ========== 访存延迟探针 ========== */
+
+/*
+ * 后台线程按 interval_ms 周期运行：对每个拥有 CPU 的节点，把自身绑定到该
+ * 节点，然后依次在每个内存节点的缓冲区上做随机指针追逐。缓冲区内每条
+ * cache line 存放下一条的地址，排列为单环（Sattolo 洗牌），每一步都是一次
+ * 无法预取的依赖访存，平均耗时即为该 (CPU节点, 内存节点) 的带负载延迟。
+ *
+ * 结果矩阵由 lat_probe.lock 保护；主线程的读取（降级评分、INFO）都很轻量。
+ */
+
+#define LAT_CACHE_LINE 64
+
+static struct {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int running;                        /* 线程已创建 */
+    int stop;                           /* 请求线程退出 */
+    uint32_t interval_ms;               /* 0 = 暂停 */
+    size_t buffer_bytes;
+    int num_nodes;
+    void *buffers[NUMA_BW_MAX_NODES];   /* 各内存节点上的追逐缓冲区（探针线程私有）*/
+    numa_lat_pair_t pairs[NUMA_BW_MAX_NODES][NUMA_BW_MAX_NODES];
+} lat_probe = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+    .interval_ms = NUMA_LAT_PROBE_DEFAULT_INTERVAL_MS,
+    .buffer_bytes = NUMA_LAT_PROBE_DEFAULT_BUFFER
+};
+
+/* 防止追逐循环被编译器优化掉 */
+static void * volatile lat_probe_sink;
+
+static uint64_t get_monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* 在 mem_node 上分配缓冲区并构造随机单环链表 */
+static void *lat_probe_build_chain(int mem_node, size_t bytes) {
+    if (numa_node_size64(mem_node, NULL) <= 0) return NULL;
+
+    char *buf = numa_alloc_onnode(bytes, mem_node);
+    if (!buf) return NULL;
+
+    size_t lines = bytes / LAT_CACHE_LINE;
+    uint32_t *perm = malloc(lines * sizeof(uint32_t));
+    if (!perm) {
+        numa_free(buf, bytes);
+        return NULL;
+    }
+    for (size_t i = 0; i < lines; i++) perm[i] = (uint32_t)i;
+
+    /* Sattolo 洗牌：保证排列构成一个覆盖所有 line 的单环 */
+    uint64_t rng = 0x9E3779B97F4A7C15ULL ^ (uint64_t)mem_node;
+    for (size_t i = lines - 1; i > 0; i--) {
+        rng ^= rng << 13; rng ^= rng >> 7; rng ^= rng << 17;
+        size_t j = rng % i;
+        uint32_t tmp = perm[i]; perm[i] = perm[j]; perm[j] = tmp;
+    }
+    for (size_t i = 0; i < lines; i++) {
+        void **slot = (void **)(buf + (size_t)perm[i] * LAT_CACHE_LINE);
+        *slot = buf + (size_t)perm[(i + 1) % lines] * LAT_CACHE_LINE;
+    }
+    free(perm);
+    return buf;
+}
+
+/* 追逐 steps 步，返回每步平均纳秒 */
+static double lat_probe_chase(void *buf, int steps) {
+    void **p = (void **)buf;
+    /* 预热：让链表入口所在页进入 TLB，避免首个样本偏高 */
+    for (int i = 0; i < 64; i++) p = (void **)*p;
+
+    uint64_t start = get_monotonic_ns();
+    for (int i = 0; i < steps; i++) p = (void **)*p;
+    uint64_t elapsed = get_monotonic_ns() - start;
+
+    lat_probe_sink = p;
+    return (double)elapsed / steps;
+}
+
+static void lat_probe_record(int cpu_node, int mem_node, double ns) {
+    numa_lat_pair_t *pair = &lat_probe.pairs[cpu_node][mem_node];
+
+    pthread_mutex_lock(&lat_probe.lock);
+    if (pair->samples == 0) {
+        pair->ewma_ns = ns;
+        pair->min_ns = ns;
+        pair->max_ns = ns;
+    } else {
+        pair->ewma_ns = NUMA_LAT_EWMA_ALPHA * ns + (1.0 - NUMA_LAT_EWMA_ALPHA) * pair->ewma_ns;
+        if (ns < pair->min_ns) pair->min_ns = ns;
+        if (ns > pair->max_ns) pair->max_ns = ns;
+    }
+    pair->last_ns = ns;
+    pair->history[pair->history_pos] = ns;
+    pair->history_pos = (pair->history_pos + 1) % NUMA_LAT_HISTORY;
+    pair->samples++;
+    pthread_mutex_unlock(&lat_probe.lock);
+}
+
+/* 一轮完整探测：所有 CPU 节点 x 所有内存节点 */
+static void lat_probe_round(void) {
+    for (int cpu_node = 0; cpu_node < lat_probe.num_nodes; cpu_node++) {
+        /* 纯内存节点（如 CXL 扩展内存）没有 CPU，跳过 */
+        if (numa_run_on_node(cpu_node) != 0) continue;
+
+        for (int mem_node = 0; mem_node < lat_probe.num_nodes; mem_node++) {
+            if (!lat_probe.buffers[mem_node]) continue;
+            double ns = lat_probe_chase(lat_probe.buffers[mem_node], NUMA_LAT_PROBE_STEPS);
+            lat_probe_record(cpu_node, mem_node, ns);
+        }
+    }
+    numa_run_on_node(-1);
+}
+
+static void *lat_probe_main(void *arg) {
+    (void)arg;
+
+    for (int i = 0; i < lat_probe.num_nodes; i++)
+        lat_probe.buffers[i] = lat_probe_build_chain(i, lat_probe.buffer_bytes);
+
+    pthread_mutex_lock(&lat_probe.lock);
+    while (!lat_probe.stop) {
+        uint32_t interval = lat_probe.interval_ms;
+        if (interval > 0) {
+            pthread_mutex_unlock(&lat_probe.lock);
+            lat_probe_round();
+            pthread_mutex_lock(&lat_probe.lock);
+        }
+
+        /* 暂停时无限期等待；否则等待一个周期，CONFIG SET / stop 可提前唤醒 */
+        if (lat_probe.stop) break;
+        if (lat_probe.interval_ms == 0) {
+            pthread_cond_wait(&lat_probe.cond, &lat_probe.lock);
+        } else {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            uint64_t ns = (uint64_t)deadline.tv_nsec + (uint64_t)lat_probe.interval_ms * 1000000ULL;
+            deadline.tv_sec += ns / 1000000000ULL;
+            deadline.tv_nsec = ns % 1000000000ULL;
+            pthread_cond_timedwait(&lat_probe.cond, &lat_probe.lock, &deadline);
+        }
+    }
+    pthread_mutex_unlock(&lat_probe.lock);
+
+    for (int i = 0; i < lat_probe.num_nodes; i++) {
+        if (lat_probe.buffers[i]) {
+            numa_free(lat_probe.buffers[i], lat_probe.buffer_bytes);
+            lat_probe.buffers[i] = NULL;
+        }
+    }
+    return NULL;
+}
+
+static int lat_probe_spawn(void) {
+    if (numa_available() < 0) return -1;
+    int max_node = numa_max_node();
+    if (max_node < 0 || max_node >= NUMA_BW_MAX_NODES) return -1;
+
+    lat_probe.num_nodes = max_node + 1;
+    lat_probe.stop = 0;
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    int rc = pthread_create(&lat_probe.thread, &attr, lat_probe_main, NULL);
+    pthread_attr_destroy(&attr);
+    if (rc != 0) {
+        BW_LOG(LL_WARNING, "Fatal: Can't create latency probe thread: %s", strerror(rc));
+        return -1;
+    }
+    lat_probe.running = 1;
+    BW_LOG(LL_NOTICE, "Latency probe started: nodes=%d, interval=%ums, buffer=%zu bytes",
+           lat_probe.num_nodes, lat_probe.interval_ms, lat_probe.buffer_bytes);
+    return 0;
+}
+
+int numa_lat_probe_start(uint32_t interval_ms, size_t buffer_bytes) {
+    if (lat_probe.running) return 0;
+
+    if (buffer_bytes < NUMA_LAT_PROBE_MIN_BUFFER) buffer_bytes = NUMA_LAT_PROBE_MIN_BUFFER;
+    lat_probe.buffer_bytes = buffer_bytes;
+    lat_probe.interval_ms = interval_ms;
+
+    if (interval_ms == 0) return 0;  /* 已禁用：CONFIG SET 时再启动 */
+    return lat_probe_spawn();
+}
+
+void numa_lat_probe_set_interval(uint32_t interval_ms) {
+    pthread_mutex_lock(&lat_probe.lock);
+    lat_probe.interval_ms = interval_ms;
+    pthread_cond_signal(&lat_probe.cond);
+    pthread_mutex_unlock(&lat_probe.lock);
+
+    if (interval_ms > 0 && !lat_probe.running) lat_probe_spawn();
+}
+
+void numa_lat_probe_stop(void) {
+    if (!lat_probe.running) return;
+
+    pthread_mutex_lock(&lat_probe.lock);
+    lat_probe.stop = 1;
+    pthread_cond_signal(&lat_probe.cond);
+    pthread_mutex_unlock(&lat_probe.lock);
+
+    pthread_join(lat_probe.thread, NULL);
+    lat_probe.running = 0;
+}
+
+int numa_lat_probe_running(void) {
+    return lat_probe.running && lat_probe.interval_ms > 0;
+}
+
+double numa_lat_get_ewma_ns(int cpu_node, int mem_node) {
+    if (cpu_node < 0 || cpu_node >= NUMA_BW_MAX_NODES ||
+        mem_node < 0 || mem_node >= NUMA_BW_MAX_NODES) return -1.0;
+
+    double ns = -1.0;
+    pthread_mutex_lock(&lat_probe.lock);
+    if (lat_probe.pairs[cpu_node][mem_node].samples > 0)
+        ns = lat_probe.pairs[cpu_node][mem_node].ewma_ns;
+    pthread_mutex_unlock(&lat_probe.lock);
+    return ns;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+int numa_lat_get_stats(int cpu_node, int mem_node, numa_lat_stats_t *out) {
+    if (!out || cpu_node < 0 || cpu_node >= NUMA_BW_MAX_NODES ||
+        mem_node < 0 || mem_node >= NUMA_BW_MAX_NODES) return -1;
+
+    double hist[NUMA_LAT_HISTORY];
+    uint32_t n;
+
+    pthread_mutex_lock(&lat_probe.lock);
+    numa_lat_pair_t *pair = &lat_probe.pairs[cpu_node][mem_node];
+    if (pair->samples == 0) {
+        pthread_mutex_unlock(&lat_probe.lock);
+        return -1;
+    }
+    n = pair->samples < NUMA_LAT_HISTORY ? (uint32_t)pair->samples : NUMA_LAT_HISTORY;
+    memcpy(hist, pair->history, n * sizeof(double));
+    out->ewma_ns = pair->ewma_ns;
+    out->min_ns = pair->min_ns;
+    out->max_ns = pair->max_ns;
+    out->samples = pair->samples;
+    pthread_mutex_unlock(&lat_probe.lock);
+
+    qsort(hist, n, sizeof(double), cmp_double);
+    out->p50_ns = hist[(n - 1) * 50 / 100];
+    out->p99_ns = hist[(n - 1) * 99 / 100];
+    return 0;
+}
+
+double numa_lat_get_relative(int cpu_node, int mem_node) {
+    double remote = numa_lat_get_ewma_ns(cpu_node, mem_node);
+    double local = numa_lat_get_ewma_ns(cpu_node, cpu_node);
+    if (remote > 0 && local > 0) return remote / local;
+
+    /* 无探测数据：回退到 SLIT 距离表（本地距离为 10） */
+    int dist = numa_distance(cpu_node, mem_node);
+    int base = numa_distance(cpu_node, cpu_node);
+    if (dist <= 0 || base <= 0) return 1.0;
+    return (double)dist / (double)base;
+}
+
 #else /* !HAVE_NUMA */
 
 /* ========== NUMA 未启用时的空实现 ========== */
@@ -364,5 +943,18 @@ void numa_bw_set_max_bandwidth(int node_id, double max_mbps) { (void)node_id; (v
 const char* numa_bw_get_backend_name(void) { return "disabled"; }
 const numa_bw_monitor_t* numa_bw_get_monitor(void) { return NULL; }
 void numa_bw_monitor_cleanup(void) { }
+int numa_bw_sampler_start(uint32_t interval_ms) { (void)interval_ms; return -1; }
+void numa_bw_sampler_set_interval(uint32_t interval_ms) { (void)interval_ms; }
+void numa_bw_sampler_stop(void) { }
+int numa_bw_sampler_running(void) { return 0; }
+int numa_bw_get_window_stats(int node_id, int window, numa_bw_window_stats_t *out) { (void)node_id; (void)window; (void)out; return -1; }
+const char *numa_bw_window_name(int window) { (void)window; return "disabled"; }
+int numa_lat_probe_start(uint32_t interval_ms, size_t buffer_bytes) { (void)interval_ms; (void)buffer_bytes; return -1; }
+void numa_lat_probe_set_interval(uint32_t interval_ms) { (void)interval_ms; }
+void numa_lat_probe_stop(void) { }
+int numa_lat_probe_running(void) { return 0; }
+double numa_lat_get_ewma_ns(int cpu_node, int mem_node) { (void)cpu_node; (void)mem_node; return -1.0; }
+int numa_lat_get_stats(int cpu_node, int mem_node, numa_lat_stats_t *out) { (void)cpu_node; (void)mem_node; (void)out; return -1; }
+double numa_lat_get_relative(int cpu_node, int mem_node) { (void)cpu_node; (void)mem_node; return 1.0; }
 
 #endif /* HAVE_NUMA */
@@ -4,6 +4,14 @@
  * 支持多后端：resctrl（Intel RDT）、numastat（通用 fallback）、手动配置。
  * serverCron 每秒调用 numa_bw_monitor_sample() 采样，
  * 消费方通过 numa_bw_get_usage() 获取节点带宽利用率（0.0~1.0）。
+ *
+ * 可选高频采样线程（10~100ms）：每节点保留最近 60 秒的样本环与利用率直方图，
+ * 以 seqlock 发布无锁快照，给出 1s/10s/60s 窗口的 p50/p99/max 利用率；
+ * 运行时 numa_bw_get_usage() 返回 1s 窗口 p99，使限流决策能感知亚秒级突发。
+ *
+ * 另含访存延迟探针：后台线程周期性地从每个 CPU 节点对每个内存节点做
+ * 指针追逐（pointer chasing），得到带负载的实测延迟矩阵（EWMA + 分位数），
+ * 供降级评分与复合LRU迁移决策替代静态的 numa_distance()。
  */
 #ifndef NUMA_BW_MONITOR_H
 #define NUMA_BW_MONITOR_H
@@ -28,6 +36,36 @@ typedef struct {
     uint64_t total_bytes_prev;      /* 上次采样的累计字节/页数 */
 } numa_bw_node_t;
 
+/* ========== 高频采样 ========== */
+
+#define NUMA_BW_HF_DEFAULT_INTERVAL_MS  100     /* 默认高频采样间隔 */
+#define NUMA_BW_HF_MIN_INTERVAL_MS      10
+#define NUMA_BW_HF_MAX_INTERVAL_MS      100
+#define NUMA_BW_HF_RING_SIZE            6144    /* ≥ 60s / 10ms，保证最长窗口不被覆盖 */
+#define NUMA_BW_HIST_BUCKETS            101     /* 利用率直方图：0%~100%，1% 一档 */
+
+/* 统计窗口 */
+#define NUMA_BW_WINDOW_1S       0
+#define NUMA_BW_WINDOW_10S      1
+#define NUMA_BW_WINDOW_60S      2
+#define NUMA_BW_WINDOWS         3
+
+/* 单窗口利用率统计（0.0~1.0）*/
+typedef struct {
+    double p50;
+    double p99;
+    double max;
+    double max_mbps;                /* 窗口内最大带宽(MB/s) */
+    uint32_t samples;               /* 窗口内样本数 */
+} numa_bw_window_stats_t;
+
+/* 单节点快照（由采样线程发布）*/
+typedef struct {
+    double current_bw_mbps;         /* 最近一次样本 */
+    double bw_usage;
+    numa_bw_window_stats_t win[NUMA_BW_WINDOWS];
+} numa_bw_node_snapshot_t;
+
 /* 全局监控器 */
 typedef struct {
     numa_bw_node_t nodes[NUMA_BW_MAX_NODES];
@@ -37,6 +75,36 @@ typedef struct {
     int initialized;                /* 是否已初始化 */
 } numa_bw_monitor_t;
 
+/* ========== 访存延迟探针 ========== */
+
+#define NUMA_LAT_PROBE_DEFAULT_INTERVAL_MS  1000            /* 默认探测周期 */
+#define NUMA_LAT_PROBE_DEFAULT_BUFFER   (32 * 1024 * 1024)  /* 每个内存节点的追逐缓冲区 */
+#define NUMA_LAT_PROBE_MIN_BUFFER       (1024 * 1024)
+#define NUMA_LAT_PROBE_STEPS            8192    /* 每次采样的追逐步数 */
+#define NUMA_LAT_HISTORY                64      /* 分位数计算保留的最近样本数 */
+#define NUMA_LAT_EWMA_ALPHA             0.2
+
+/* 单个 (CPU节点, 内存节点) 组合的延迟状态 */
+typedef struct {
+    double ewma_ns;                     /* 指数滑动平均延迟（纳秒）*/
+    double last_ns;                     /* 最近一次采样 */
+    double min_ns;
+    double max_ns;
+    double history[NUMA_LAT_HISTORY];   /* 最近样本环形缓冲区 */
+    uint32_t history_pos;
+    uint64_t samples;                   /* 累计采样次数，0 表示尚无数据 */
+} numa_lat_pair_t;
+
+/* 对外快照（只读）*/
+typedef struct {
+    double ewma_ns;
+    double p50_ns;
+    double p99_ns;
+    double min_ns;
+    double max_ns;
+    uint64_t samples;
+} numa_lat_stats_t;
+
 /* ========== 公共接口 ========== */
 
 /* 初始化带宽监控器，自动检测最佳后端。成功返回0 */
@@ -45,7 +113,8 @@ int  numa_bw_monitor_init(void);
 /* 采样一次（由 serverCron 每秒调用）*/
 void numa_bw_monitor_sample(void);
 
-/* 获取节点带宽利用率 (0.0~1.0)，-1 表示无效节点 */
+/* 获取节点带宽利用率 (0.0~1.0)，-1 表示无效节点。
+ * 高频采样运行时返回 1s 窗口 p99，否则为最近一次每秒采样值 */
 double numa_bw_get_usage(int node_id);
 
 /* 获取当前带宽 (MB/s) */
@@ -63,4 +132,45 @@ const numa_bw_monitor_t* numa_bw_get_monitor(void);
 /* 清理资源 */
 void numa_bw_monitor_cleanup(void);
 
+/* 启动高频采样线程（interval_ms 为 0 时只记录参数，沿用 serverCron 每秒采样）*/
+int  numa_bw_sampler_start(uint32_t interval_ms);
+
+/* 运行时调整高频采样间隔（CONFIG SET），0 表示停用并回退到每秒采样 */
+void numa_bw_sampler_set_interval(uint32_t interval_ms);
+
+/* 停止高频采样线程 */
+void numa_bw_sampler_stop(void);
+
+/* 高频采样线程是否在运行 */
+int  numa_bw_sampler_running(void);
+
+/* 读取节点窗口统计（无锁快照）。采样线程未运行或节点无效返回 -1 */
+int  numa_bw_get_window_stats(int node_id, int window, numa_bw_window_stats_t *out);
+
+/* 窗口名称（"1s"/"10s"/"60s"）*/
+const char *numa_bw_window_name(int window);
+
+/* 启动延迟探针线程。interval_ms 为 0 时只记录参数不启动。成功返回0 */
+int  numa_lat_probe_start(uint32_t interval_ms, size_t buffer_bytes);
+
+/* 运行时调整探测周期（CONFIG SET），0 表示暂停，非 0 时按需启动线程 */
+void numa_lat_probe_set_interval(uint32_t interval_ms);
+
+/* 停止探针线程并释放追逐缓冲区 */
+void numa_lat_probe_stop(void);
+
+/* 探针线程是否在运行 */
+int  numa_lat_probe_running(void);
+
+/* 获取 cpu_node -> mem_node 的 EWMA 延迟（纳秒），无数据返回 -1 */
+double numa_lat_get_ewma_ns(int cpu_node, int mem_node);
+
+/* 获取延迟统计快照（含 p50/p99），无数据返回 -1 */
+int  numa_lat_get_stats(int cpu_node, int mem_node, numa_lat_stats_t *out);
+
+/* 相对访存代价：latency(cpu,mem) / latency(cpu,cpu)。
+ * 探针尚无数据时回退到 numa_distance(cpu,mem) / numa_distance(cpu,cpu)，
+ * 因此调用方可以无条件用它替代 numa_distance() 作为距离代理。 */
+double numa_lat_get_relative(int cpu_node, int mem_node);
+
 #endif /* NUMA_BW_MONITOR_H */
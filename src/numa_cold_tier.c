@@ -0,0 +1,187 @@
+/* numa_cold_tier.c - 降级值的 LZF 压缩冷层实现
+ *
+ * 压缩在主线程的降级路径上执行；解压在 lookupKey() 命中时执行并把
+ * 数据提升回本地节点。压缩块的释放可能由 lazyfree 线程完成，因此
+ * 反映当前冷值规模的计数使用原子变量。
+ *
+ * Copyright (c) 2024, Redis-CXL Project
+ */
+
+#include "server.h"
+#include "numa_cold_tier.h"
+#include "zmalloc.h"
+#include "lzf.h"
+#include "latency.h"
+
+#ifdef HAVE_NUMA
+
+/* ========== 统计 ========== */
+
+/* 当前规模：压缩块可能在 lazyfree 线程释放 */
+static redisAtomic size_t cold_keys = 0;
+static redisAtomic size_t cold_raw_bytes = 0;
+static redisAtomic size_t cold_compressed_bytes = 0;
+
+/* 累计计数：仅主线程更新 */
+static uint64_t cold_compressions = 0;
+static uint64_t cold_compress_skipped = 0;
+static uint64_t cold_promotions = 0;
+static uint64_t cold_decompress_usec = 0;
+static uint64_t cold_decompress_max_usec = 0;
+
+/* ========== 辅助函数 ========== */
+
+/* 取对象原始数据的起始地址与长度 */
+static unsigned char *cold_raw_data(robj *o, size_t *len) {
+    if (o->type == OBJ_STRING) {
+        *len = sdslen(o->ptr);
+        return (unsigned char *)o->ptr;
+    }
+    *len = lpBytes(o->ptr);
+    return (unsigned char *)o->ptr;
+}
+
+/* 释放对象原始数据 */
+static void cold_free_raw(robj *o) {
+    if (o->type == OBJ_STRING) sdsfree(o->ptr);
+    else zfree(o->ptr);
+}
+
+/* 将压缩块解压为本地内存中的原始表示（RAW sds 或 listpack） */
+static void *cold_decode(numa_cold_blob_t *blob, int type) {
+    void *raw = (type == OBJ_STRING) ? (void *)sdsnewlen(SDS_NOINIT, blob->raw_len)
+                                     : zmalloc(blob->raw_len);
+
+    if (lzf_decompress(blob->data, blob->comp_len, raw, blob->raw_len) != blob->raw_len)
+        serverPanic("NUMA cold tier: corrupted compressed blob");
+    return raw;
+}
+
+/* 释放压缩块并扣减规模计数 */
+static void cold_release_blob(numa_cold_blob_t *blob) {
+    atomicDecr(cold_keys, 1);
+    atomicDecr(cold_raw_bytes, blob->raw_len);
+    atomicDecr(cold_compressed_bytes, blob->comp_len);
+    zfree(blob);
+}
+
+/* ========== 公共接口 ========== */
+
+int numaColdEligible(robj *o) {
+    /* 原地改写编码，不能有其他引用者（共享对象、客户端 argv 等） */
+    if (!o || o->refcount != 1) return 0;
+
+    size_t len;
+    if (o->type == OBJ_STRING && o->encoding == OBJ_ENCODING_RAW) {
+        len = sdslen(o->ptr);
+    } else if ((o->type == OBJ_HASH || o->type == OBJ_ZSET) &&
+               o->encoding == OBJ_ENCODING_LISTPACK) {
+        len = lpBytes(o->ptr);
+    } else {
+        return 0;
+    }
+    return len >= server.numa_cold_compress_min_size && len <= UINT32_MAX;
+}
+
+int numaColdCompress(robj *o, int node) {
+    if (!numaColdEligible(o)) return C_ERR;
+
+    size_t raw_len;
+    unsigned char *raw = cold_raw_data(o, &raw_len);
+
+    /* 输出上限即最低收益要求，达不到时 lzf_compress 返回 0 */
+    size_t max_out = raw_len - raw_len * NUMA_COLD_MIN_SAVING_PCT / 100;
+    if (max_out == 0) return C_ERR;
+    unsigned char *out = zmalloc(max_out);
+    unsigned int comp_len = lzf_compress(raw, raw_len, out, max_out);
+    if (comp_len == 0) {
+        zfree(out);
+        cold_compress_skipped++;
+        return C_ERR;
+    }
+
+    numa_cold_blob_t *blob = numa_zmalloc_onnode(sizeof(*blob) + comp_len, node);
+    if (!blob) {
+        zfree(out);
+        return C_ERR;
+    }
+    blob->raw_len = raw_len;
+    blob->comp_len = comp_len;
+    blob->orig_encoding = o->encoding;
+    memcpy(blob->data, out, comp_len);
+    zfree(out);
+
+    cold_free_raw(o);
+    o->ptr = blob;
+    o->encoding = OBJ_ENCODING_NUMA_COLD;
+
+    cold_compressions++;
+    atomicIncr(cold_keys, 1);
+    atomicIncr(cold_raw_bytes, raw_len);
+    atomicIncr(cold_compressed_bytes, comp_len);
+    return C_OK;
+}
+
+void numaColdPromote(robj *o) {
+    if (!o || o->encoding != OBJ_ENCODING_NUMA_COLD) return;
+
+    numa_cold_blob_t *blob = o->ptr;
+    long long start = ustime();
+    void *raw = cold_decode(blob, o->type);
+    long long elapsed = ustime() - start;
+
+    o->encoding = blob->orig_encoding;
+    o->ptr = raw;
+    cold_release_blob(blob);
+
+    cold_promotions++;
+    cold_decompress_usec += elapsed;
+    if ((uint64_t)elapsed > cold_decompress_max_usec) cold_decompress_max_usec = elapsed;
+    latencyAddSampleIfNeeded("numa-cold-decompress", elapsed / 1000);
+}
+
+robj *numaColdDecodedCopy(robj *o) {
+    numa_cold_blob_t *blob = o->ptr;
+    robj *copy = createObject(o->type, cold_decode(blob, o->type));
+    copy->encoding = blob->orig_encoding;
+    copy->lru = o->lru;
+    return copy;
+}
+
+void numaColdFree(robj *o) {
+    cold_release_blob(o->ptr);
+}
+
+size_t numaColdBlobSize(robj *o) {
+    numa_cold_blob_t *blob = o->ptr;
+    return sizeof(*blob) + blob->comp_len;
+}
+
+void numaColdGetStats(numa_cold_stats_t *stats) {
+    size_t v;
+    atomicGet(cold_keys, v);
+    stats->cold_keys = v;
+    atomicGet(cold_raw_bytes, v);
+    stats->raw_bytes = v;
+    atomicGet(cold_compressed_bytes, v);
+    stats->compressed_bytes = v;
+    stats->compressions = cold_compressions;
+    stats->compress_skipped = cold_compress_skipped;
+    stats->promotions = cold_promotions;
+    stats->decompress_usec = cold_decompress_usec;
+    stats->decompress_max_usec = cold_decompress_max_usec;
+}
+
+#else /* !HAVE_NUMA */
+
+/* ========== NUMA 未启用时的空实现 ========== */
+
+int numaColdEligible(robj *o) { (void)o; return 0; }
+int numaColdCompress(robj *o, int node) { (void)o; (void)node; return C_ERR; }
+void numaColdPromote(robj *o) { (void)o; }
+robj *numaColdDecodedCopy(robj *o) { incrRefCount(o); return o; }
+void numaColdFree(robj *o) { (void)o; }
+size_t numaColdBlobSize(robj *o) { (void)o; return 0; }
+void numaColdGetStats(numa_cold_stats_t *stats) { memset(stats, 0, sizeof(*stats)); }
+
+#endif /* HAVE_NUMA */
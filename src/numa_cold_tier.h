@@ -0,0 +1,64 @@
+/* numa_cold_tier.h - 降级值的 LZF 压缩冷层
+ *
+ * 降级到远端节点的冷值可选择以 LZF 压缩形式存放（复用 RDB 使用的
+ * lzf_c.c/lzf_d.c），使远端内存的填充速度低于近端。
+ *
+ * 压缩后对象保持原 type，encoding 置为 OBJ_ENCODING_NUMA_COLD，ptr 指向
+ * 分配在目标节点上的 numa_cold_blob_t。lookupKey() 命中冷值时透明解压
+ * 并提升回本地节点；RDB/AOF 重写等直接遍历字典的路径使用临时解压副本。
+ *
+ * 支持的编码：RAW 字符串、listpack 编码的 hash/zset。quicklist 已有
+ * list-compress-depth 的节点级 LZF 压缩，不在此处理。
+ */
+#ifndef NUMA_COLD_TIER_H
+#define NUMA_COLD_TIER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define NUMA_COLD_DEFAULT_MIN_SIZE  512     /* 低于此大小不压缩 */
+#define NUMA_COLD_MIN_SAVING_PCT    10      /* 至少节省 10% 才保留压缩结果 */
+
+/* 压缩块：分配在目标节点上，data 为 LZF 压缩数据 */
+typedef struct numa_cold_blob {
+    uint32_t raw_len;           /* 原始长度（sds 为字符串长度，listpack 为 blob 长度）*/
+    uint32_t comp_len;          /* 压缩后长度 */
+    uint8_t orig_encoding;      /* 压缩前的编码 */
+    unsigned char data[];
+} numa_cold_blob_t;
+
+/* 冷层统计 */
+typedef struct {
+    uint64_t cold_keys;             /* 当前压缩存放的值数量 */
+    uint64_t raw_bytes;             /* 当前冷值的原始字节数 */
+    uint64_t compressed_bytes;      /* 当前冷值的压缩后字节数 */
+    uint64_t compressions;          /* 累计压缩次数 */
+    uint64_t compress_skipped;      /* 压缩收益不足而放弃的次数 */
+    uint64_t promotions;            /* 累计解压提升次数 */
+    uint64_t decompress_usec;       /* 累计解压耗时（微秒）*/
+    uint64_t decompress_max_usec;   /* 单次解压最大耗时（微秒）*/
+} numa_cold_stats_t;
+
+struct redisObject;
+
+/* 对象是否可以压缩存放（类型/编码/大小满足条件） */
+int numaColdEligible(struct redisObject *o);
+
+/* 将对象压缩到 node 上；收益不足或分配失败返回 C_ERR，对象保持不变 */
+int numaColdCompress(struct redisObject *o, int node);
+
+/* 解压冷值并恢复原编码（分配在本地节点），非冷值直接返回 */
+void numaColdPromote(struct redisObject *o);
+
+/* 返回解压后的临时副本（调用方 decrRefCount），供不应修改原对象的路径使用 */
+struct redisObject *numaColdDecodedCopy(struct redisObject *o);
+
+/* 释放冷值的压缩块（由 decrRefCount 调用，可能运行在 lazyfree 线程）*/
+void numaColdFree(struct redisObject *o);
+
+/* 压缩块占用的字节数 */
+size_t numaColdBlobSize(struct redisObject *o);
+
+void numaColdGetStats(numa_cold_stats_t *stats);
+
+#endif /* NUMA_COLD_TIER_H */
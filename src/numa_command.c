@@ -17,6 +17,9 @@
 #include "numa_strategy_slots.h"
 #include "numa_configurable_strategy.h"
 #include "numa_pool.h"
+#include "numa_io_threads.h"
+#include "numa_reply_pool.h"
+#include "numa_quicklist_pool.h"
 #include <sched.h>
 #include <numa.h>
 
@@ -32,7 +35,7 @@ extern numa_config_strategy_type_t parse_strategy_name(const char *name);
 /* ========== NUMA MIGRATE 子域 ========== */
 
 /*
- * NUMA MIGRATE KEY <key> <node>
+ * NUMA MIGRATE KEY <key> <node> [COMPRESS]
  * NUMA MIGRATE DB <node>
  * NUMA MIGRATE SCAN [COUNT n]
  * NUMA MIGRATE STATS
@@ -53,10 +56,11 @@ static void numa_cmd_migrate(client *c) {
 
     const char *sub = c->argv[2]->ptr;
 
-    /* NUMA MIGRATE KEY <key> <node> */
+    /* NUMA MIGRATE KEY <key> <node> [COMPRESS] */
     if (!strcasecmp(sub, "KEY")) {
-        if (c->argc != 5) {
-            addReplyError(c, "Usage: NUMA MIGRATE KEY <key> <target_node>");
+        int compress = c->argc == 6 && !strcasecmp(c->argv[5]->ptr, "COMPRESS");
+        if (c->argc != 5 && !compress) {
+            addReplyError(c, "Usage: NUMA MIGRATE KEY <key> <target_node> [COMPRESS]");
             return;
         }
         robj *key = c->argv[3];
@@ -68,6 +72,20 @@ static void numa_cmd_migrate(client *c) {
                 target_node, numa_max_node());
             return;
         }
+        if (compress) {
+            /* 以冷层压缩形式放到目标节点，不受 numa-cold-compress 开关限制 */
+            dictEntry *de = dictFind(c->db->dict, key->ptr);
+            if (!de) {
+                addReplyError(c, "Key not found");
+            } else if (!numaColdEligible(dictGetVal(de))) {
+                addReplyError(c, "Value not eligible for cold compression");
+            } else if (numaColdCompress(dictGetVal(de), (int)target_node) != C_OK) {
+                addReplyError(c, "Value not compressible");
+            } else {
+                addReplyStatus(c, "OK");
+            }
+            return;
+        }
         int result = numa_migrate_single_key(c->db, key, (int)target_node);
         switch (result) {
             case NUMA_KEY_MIGRATE_OK:
@@ -526,7 +544,7 @@ static void numa_cmd_strategy(client *c) {
 static void numa_cmd_help(client *c) {
     addReplyArrayLen(c, 17);
     /* MIGRATE */
-    addReplyBulkCString(c, "NUMA MIGRATE KEY <key> <node>      - Migrate a key to target NUMA node");
+    addReplyBulkCString(c, "NUMA MIGRATE KEY <key> <node> [COMPRESS] - Migrate a key (optionally LZF compressed) to target NUMA node");
     addReplyBulkCString(c, "NUMA MIGRATE DB <node>             - Migrate entire database to target NUMA node");
     addReplyBulkCString(c, "NUMA MIGRATE SCAN [COUNT n]        - Trigger one round of progressive key scan");
     addReplyBulkCString(c, "NUMA MIGRATE STATS                 - Show migration statistics");
@@ -548,6 +566,120 @@ static void numa_cmd_help(client *c) {
     addReplyBulkCString(c, "NUMA HELP                          - Show this help message");
 }
 
+/* ========== INFO numa ========== */
+
+/*
+ * genNumaInfoString - 生成 INFO numa 段
+ *
+ * 每节点带宽一行（高频采样运行时另有每窗口分位数各一行），每节点内存记账
+ * 一行，io 线程分组与回复块池每节点各一行，冷层压缩统计若干行，延迟矩阵每个 (CPU节点, 内存节点) 组合一行，
+ * 格式与 Keyspace 段的 dbN:k=v,... 一致，便于脚本解析。
+ */
+sds genNumaInfoString(sds info) {
+    int num_nodes = numa_pool_num_nodes();
+
+    info = sdscatprintf(info,
+        "# Numa\r\n"
+        "numa_nodes:%d\r\n"
+        "numa_bw_backend:%s\r\n"
+        "numa_latency_probe:%s\r\n"
+        "numa_latency_probe_interval_ms:%d\r\n"
+        "numa_bw_sampler:%s\r\n"
+        "numa_bw_sample_interval_ms:%d\r\n",
+        num_nodes,
+        numa_bw_get_backend_name(),
+        numa_lat_probe_running() ? "running" : "stopped",
+        server.numa_latency_probe_interval,
+        numa_bw_sampler_running() ? "running" : "stopped",
+        server.numa_bw_sample_interval);
+
+    for (int i = 0; i < num_nodes && i < NUMA_BW_MAX_NODES; i++) {
+        double cur = numa_bw_get_current_mbps(i);
+        double usage = numa_bw_get_usage(i);
+        info = sdscatprintf(info,
+            "numa_bw_node%d:current_mbps=%.2f,usage=%.4f\r\n",
+            i, cur < 0 ? 0.0 : cur, usage < 0 ? 0.0 : usage);
+
+        for (int w = 0; w < NUMA_BW_WINDOWS; w++) {
+            numa_bw_window_stats_t ws;
+            if (numa_bw_get_window_stats(i, w, &ws) != 0) break;
+            info = sdscatprintf(info,
+                "numa_bw_node%d_%s:p50=%.2f,p99=%.2f,max=%.2f,max_mbps=%.2f,samples=%u\r\n",
+                i, numa_bw_window_name(w), ws.p50, ws.p99, ws.max, ws.max_mbps, ws.samples);
+        }
+    }
+
+    for (int i = 0; i < num_nodes && i < NUMA_ACCT_MAX_NODES; i++) {
+        info = sdscatprintf(info,
+            "numa_mem_node%d:used=%zu,capacity=%zu,pressure=%.4f\r\n",
+            i, numa_get_node_used_memory(i), numa_get_node_capacity(i),
+            numaGetNodePressure(i));
+    }
+
+    info = sdscatprintf(info, "numa_io_threads:%s\r\n",
+        numaIOThreadsEnabled() ? "enabled" : "disabled");
+    for (int i = 0; i < num_nodes && i < NUMA_ACCT_MAX_NODES; i++) {
+        numa_io_node_stats_t ios;
+        if (numaIOGetNodeStats(i, &ios) != 0) break;
+        info = sdscatprintf(info,
+            "numa_io_node%d:threads=%d,clients=%lld,read_bytes=%lld,write_bytes=%lld\r\n",
+            i, ios.threads, ios.clients, ios.read_bytes, ios.write_bytes);
+    }
+
+    for (int i = 0; i < num_nodes && i < NUMA_ACCT_MAX_NODES; i++) {
+        numa_reply_pool_stats_t rps;
+        if (numaReplyPoolGetStats(i, &rps) != 0) break;
+        info = sdscatprintf(info,
+            "numa_reply_pool_node%d:blocks=%lld,bytes=%zu,hits=%lld,misses=%lld,recycled=%lld\r\n",
+            i, rps.blocks, rps.bytes, rps.hits, rps.misses, rps.recycled);
+    }
+
+    for (int i = 0; i < num_nodes && i < NUMA_ACCT_MAX_NODES; i++) {
+        numa_quicklist_pool_stats_t qps;
+        if (numaQuicklistPoolGetStats(i, &qps) != 0) break;
+        info = sdscatprintf(info,
+            "numa_quicklist_pool_node%d:nodes=%lld,bytes=%zu,hits=%lld,misses=%lld,recycled=%lld\r\n",
+            i, qps.nodes, qps.bytes, qps.hits, qps.misses, qps.recycled);
+    }
+
+    numa_cold_stats_t cs;
+    numaColdGetStats(&cs);
+    info = sdscatprintf(info,
+        "numa_cold_compress:%s\r\n"
+        "numa_cold_keys:%llu\r\n"
+        "numa_cold_raw_bytes:%llu\r\n"
+        "numa_cold_compressed_bytes:%llu\r\n"
+        "numa_cold_compression_ratio:%.2f\r\n"
+        "numa_cold_compressions:%llu\r\n"
+        "numa_cold_compress_skipped:%llu\r\n"
+        "numa_cold_promotions:%llu\r\n"
+        "numa_cold_decompress_avg_us:%.2f\r\n"
+        "numa_cold_decompress_max_us:%llu\r\n",
+        server.numa_cold_compress ? "yes" : "no",
+        (unsigned long long)cs.cold_keys,
+        (unsigned long long)cs.raw_bytes,
+        (unsigned long long)cs.compressed_bytes,
+        cs.compressed_bytes ? (double)cs.raw_bytes / cs.compressed_bytes : 0.0,
+        (unsigned long long)cs.compressions,
+        (unsigned long long)cs.compress_skipped,
+        (unsigned long long)cs.promotions,
+        cs.promotions ? (double)cs.decompress_usec / cs.promotions : 0.0,
+        (unsigned long long)cs.decompress_max_usec);
+
+    for (int cpu = 0; cpu < num_nodes && cpu < NUMA_BW_MAX_NODES; cpu++) {
+        for (int mem = 0; mem < num_nodes && mem < NUMA_BW_MAX_NODES; mem++) {
+            numa_lat_stats_t st;
+            if (numa_lat_get_stats(cpu, mem, &st) != 0) continue;
+            info = sdscatprintf(info,
+                "numa_latency_cpu%d_mem%d:ewma_ns=%.1f,p50_ns=%.1f,p99_ns=%.1f,"
+                "min_ns=%.1f,max_ns=%.1f,relative=%.2f,samples=%llu\r\n",
+                cpu, mem, st.ewma_ns, st.p50_ns, st.p99_ns, st.min_ns, st.max_ns,
+                numa_lat_get_relative(cpu, mem), (unsigned long long)st.samples);
+        }
+    }
+    return info;
+}
+
 /* ========== 顶层入口 ========== */
 
 /*
@@ -128,6 +128,7 @@ void composite_lru_config_defaults(composite_lru_config_t *cfg) {
     cfg->overload_threshold        = 0.8;
     cfg->bandwidth_threshold       = 0.9;
     cfg->pressure_threshold        = 0.7;
+    cfg->latency_gain_threshold    = 1.2;
     cfg->auto_migrate_enabled      = 1;
 }
 
@@ -192,6 +193,9 @@ int composite_lru_load_config(const char *path, composite_lru_config_t *out) {
             out->bandwidth_threshold = atof(v);
         } else if (strcmp(k, "pressure_threshold") == 0) {
             out->pressure_threshold = atof(v);
+        } else if (strcmp(k, "latency_gain_threshold") == 0) {
+            double g = atof(v);
+            out->latency_gain_threshold = (g >= 1.0) ? g : 1.0;
         } else if (strcmp(k, "auto_migrate_enabled") == 0) {
             out->auto_migrate_enabled = atoi(v);
         } else if (strncmp(k, "max_bandwidth_node", 18) == 0) {
@@ -284,6 +288,26 @@ static int check_resource_status(composite_lru_data_t *data, int node_id) {
     return RESOURCE_AVAILABLE;
 }
 
+/*
+ * latency_gain_sufficient - 拉回本地是否值得
+ *
+ * 以延迟探针实测的 latency(cpu_node, mem_node) / latency(cpu_node, cpu_node)
+ * 衡量远程访问代价；比值低于 latency_gain_threshold 说明"远程"节点实际
+ * 并不慢（同 socket 子 NUMA、或对端负载很低），迁移只会白白消耗带宽。
+ * 无探针数据时 numa_lat_get_relative() 回退到 SLIT 距离比（通常 ≥ 2.0）。
+ */
+static int latency_gain_sufficient(composite_lru_data_t *data, int cpu_node, int mem_node) {
+    double ratio = numa_lat_get_relative(cpu_node, mem_node);
+    if (ratio < data->config.latency_gain_threshold) {
+        data->migrations_latency_skipped++;
+        _serverLog(LL_DEBUG,
+            "[Composite LRU] Skip pull node %d->%d: latency ratio %.2f < %.2f",
+            mem_node, cpu_node, ratio, data->config.latency_gain_threshold);
+        return 0;
+    }
+    return 1;
+}
+
 /* ========== 热度管理 ========== */
 
 /*
@@ -504,6 +528,9 @@ int composite_lru_scan_once(numa_strategy_t *strategy, uint32_t batch_size,
     int demote_enabled = (numa_available() >= 0 && numa_max_node() >= 1 &&
                           local_pressure >= data->config.overload_threshold);
 
+    /* 冷 key 推出目标：按实测延迟/压力/带宽评分选出，每批只计算一次 */
+    int demote_target = demote_enabled ? numaFindBestDemoteNode(0, current_node) : -1;
+
     while (scanned < batch_size && (de = dictNext(data->scan_iter)) != NULL) {
         composite_lru_heat_info_t *info = dictGetVal(de);
         scanned++;
@@ -514,6 +541,9 @@ int composite_lru_scan_once(numa_strategy_t *strategy, uint32_t batch_size,
             info->preferred_node >= 0 &&
             info->current_node != info->preferred_node) {
 
+            if (!latency_gain_sufficient(data, info->preferred_node, info->current_node))
+                continue;
+
             int status = check_resource_status(data, info->preferred_node);
             if (status == RESOURCE_BANDWIDTH_SATURATED) {
                 data->migrations_bw_blocked++;
@@ -541,10 +571,10 @@ int composite_lru_scan_once(numa_strategy_t *strategy, uint32_t batch_size,
         }
 
         /* 路径 B：冷 key 推出到远程（本地节点压力高时） */
-        if (demote_enabled &&
+        if (demote_target >= 0 &&
             info->current_node == current_node &&
             info->hotness < thr) {
-            int target = (current_node == 0) ? 1 : 0;
+            int target = demote_target;
             int status = check_resource_status(data, target);
             if (status == RESOURCE_AVAILABLE) {
                 _serverLog(LL_VERBOSE,
@@ -704,7 +734,8 @@ int composite_lru_execute(numa_strategy_t *strategy) {
                 mem_node, src_bw, effective_threshold);
         }
 
-        if (cur_hotness >= effective_threshold && mem_node != cand->target_node) {
+        if (cur_hotness >= effective_threshold && mem_node != cand->target_node &&
+            latency_gain_sufficient(data, cand->target_node, mem_node)) {
             int status = check_resource_status(data, cand->target_node);
             if (status == RESOURCE_BANDWIDTH_SATURATED) {
                 data->migrations_bw_blocked++;
@@ -813,6 +844,9 @@ static int composite_lru_set_config(numa_strategy_t *strategy,
         data->config.bandwidth_threshold = atof(value);
     } else if (strcmp(key, "pressure_threshold") == 0) {
         data->config.pressure_threshold = atof(value);
+    } else if (strcmp(key, "latency_gain_threshold") == 0) {
+        double g = atof(value);
+        data->config.latency_gain_threshold = (g >= 1.0) ? g : 1.0;
     } else if (strcmp(key, "hot_candidates_size") == 0) {
         uint32_t sz = (uint32_t)atoi(value);
         if (sz > 0 && sz != data->config.hot_candidates_size) {
@@ -856,6 +890,8 @@ static int composite_lru_get_config(numa_strategy_t *strategy,
         snprintf(buf, buf_len, "%.2f", data->config.bandwidth_threshold);
     } else if (strcmp(key, "pressure_threshold") == 0) {
         snprintf(buf, buf_len, "%.2f", data->config.pressure_threshold);
+    } else if (strcmp(key, "latency_gain_threshold") == 0) {
+        snprintf(buf, buf_len, "%.2f", data->config.latency_gain_threshold);
     } else if (strcmp(key, "hot_candidates_size") == 0) {
         snprintf(buf, buf_len, "%u", data->config.hot_candidates_size);
     } else if (strcmp(key, "scan_batch_size") == 0) {
@@ -872,6 +908,8 @@ static int composite_lru_get_config(numa_strategy_t *strategy,
         snprintf(buf, buf_len, "%llu", (unsigned long long)data->candidates_written);
     } else if (strcmp(key, "scan_keys_checked") == 0) {
         snprintf(buf, buf_len, "%llu", (unsigned long long)data->scan_keys_checked);
+    } else if (strcmp(key, "migrations_latency_skipped") == 0) {
+        snprintf(buf, buf_len, "%llu", (unsigned long long)data->migrations_latency_skipped);
     } else {
         return NUMA_STRATEGY_EINVAL;
     }
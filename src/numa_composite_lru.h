@@ -46,6 +46,7 @@ typedef struct {
     double   overload_threshold;        /* 节点内存过载阈值（0~1），默认 0.8 */
     double   bandwidth_threshold;       /* 带宽饱和阈值（0~1），默认 0.9 */
     double   pressure_threshold;        /* 迁移压力阈值（0~1），默认 0.7 */
+    double   latency_gain_threshold;    /* 远程/本地实测延迟比低于此值时不拉回，默认 1.2 */
     int      auto_migrate_enabled;      /* 1=开启后台自动迁移，0=仅手动触发，默认 1 */
 } composite_lru_config_t;
 
@@ -98,6 +99,7 @@ typedef struct {
     uint64_t candidates_written;        /* 写入候选池的次数 */
     uint64_t scan_keys_checked;         /* 渐进扫描累计检查 key 数 */
     uint64_t migrations_bw_blocked;     /* 因带宽饱和被阻止的迁移次数 */
+    uint64_t migrations_latency_skipped;/* 因远程延迟收益不足而跳过的迁移次数 */
 } composite_lru_data_t;
 
 /* ========== 公共接口 ========== */
@@ -0,0 +1,181 @@
+/* numa_io_threads.c - NUMA 感知的 io-threads 分组与客户端节点亲和实现
+ *
+ * 线程→节点映射在 initThreadedIO() 时建立一次，之后只读；节点内轮询
+ * 计数与客户端数只在主线程更新；读写字节数由 io 线程累加，使用原子变量。
+ *
+ * Copyright (c) 2024, Redis-CXL Project
+ */
+
+#include "server.h"
+#include "numa_io_threads.h"
+
+#ifdef HAVE_NUMA
+
+#include <numa.h>
+#include <sched.h>
+#include <sys/socket.h>
+
+#define NUMA_IO_MAX_THREADS 128     /* 与 IO_THREADS_MAX_NUM 一致 */
+#define NUMA_IO_ALLOC_NOOP  (-2)    /* numaIOAllocBegin 未切换节点 */
+
+static int io_enabled = 0;
+static int io_nthreads = 0;
+static int thread_node[NUMA_IO_MAX_THREADS];
+
+/* 每节点的线程列表与节点内轮询位置 */
+static int node_nthreads[NUMA_ACCT_MAX_NODES];
+static int node_threads[NUMA_ACCT_MAX_NODES][NUMA_IO_MAX_THREADS];
+static unsigned int node_rr[NUMA_ACCT_MAX_NODES];
+
+/* 有 io 线程的节点，用于无法判定来源 CPU 时的客户端轮询 */
+static int active_nodes[NUMA_ACCT_MAX_NODES];
+static int num_active_nodes = 0;
+static unsigned int client_rr = 0;
+
+static long long node_clients[NUMA_ACCT_MAX_NODES];
+static redisAtomic long long node_read_bytes[NUMA_ACCT_MAX_NODES];
+static redisAtomic long long node_write_bytes[NUMA_ACCT_MAX_NODES];
+
+/* 节点是否有 CPU（CXL 等纯内存节点不承载 io 线程） */
+static int node_has_cpus(int node) {
+    struct bitmask *cpus = numa_allocate_cpumask();
+    int has = numa_node_to_cpus(node, cpus) == 0 && numa_bitmask_weight(cpus) > 0;
+    numa_free_cpumask(cpus);
+    return has;
+}
+
+void numaIOThreadsInit(int nthreads) {
+    io_enabled = 0;
+    if (!server.numa_io_threads || nthreads <= 1 || numa_available() < 0) return;
+    if (nthreads > NUMA_IO_MAX_THREADS) nthreads = NUMA_IO_MAX_THREADS;
+
+    /* 有 CPU 的节点，主线程所在节点排在首位 */
+    int cpu_nodes[NUMA_ACCT_MAX_NODES], ncpu_nodes = 0;
+    int cpu = sched_getcpu();
+    int main_node = cpu >= 0 ? numa_node_of_cpu(cpu) : 0;
+    if (main_node < 0 || main_node >= NUMA_ACCT_MAX_NODES) main_node = 0;
+    cpu_nodes[ncpu_nodes++] = main_node;
+    for (int n = 0; n <= numa_max_node() && n < NUMA_ACCT_MAX_NODES; n++) {
+        if (n != main_node && node_has_cpus(n)) cpu_nodes[ncpu_nodes++] = n;
+    }
+
+    memset(node_nthreads, 0, sizeof(node_nthreads));
+    memset(node_rr, 0, sizeof(node_rr));
+    num_active_nodes = 0;
+
+    /* 0 号线程即主线程，其余线程在有 CPU 的节点间依次分配 */
+    for (int i = 0; i < nthreads; i++) {
+        int node = cpu_nodes[i % ncpu_nodes];
+        thread_node[i] = node;
+        if (node_nthreads[node] == 0) active_nodes[num_active_nodes++] = node;
+        node_threads[node][node_nthreads[node]++] = i;
+    }
+    io_nthreads = nthreads;
+    io_enabled = 1;
+
+    for (int k = 0; k < num_active_nodes; k++) {
+        serverLog(LL_NOTICE, "[NUMA IO] node %d: %d io thread(s)",
+            active_nodes[k], node_nthreads[active_nodes[k]]);
+    }
+}
+
+void numaIOThreadBind(int id) {
+    if (!io_enabled || id <= 0 || id >= io_nthreads) return;
+    /* 显式配置的 server_cpulist 优先 */
+    if (server.server_cpulist) return;
+    if (numa_run_on_node(thread_node[id]) != 0) {
+        serverLog(LL_WARNING, "[NUMA IO] failed to bind io thread %d to node %d",
+            id, thread_node[id]);
+    }
+}
+
+int numaIOClientAttach(connection *conn) {
+    if (!io_enabled || !conn) return -1;
+
+    /* 内核记录的收包 CPU 反映网卡队列的 IRQ 亲和 */
+    int node = -1, cpu = -1;
+#ifdef SO_INCOMING_CPU
+    socklen_t len = sizeof(cpu);
+    if (conn->fd >= 0 &&
+        getsockopt(conn->fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len) == 0 &&
+        cpu >= 0)
+    {
+        node = numa_node_of_cpu(cpu);
+    }
+#endif
+    if (node < 0 || node >= NUMA_ACCT_MAX_NODES || node_nthreads[node] == 0)
+        node = active_nodes[client_rr++ % num_active_nodes];
+
+    node_clients[node]++;
+    return node;
+}
+
+void numaIOClientDetach(int node) {
+    if (node < 0 || node >= NUMA_ACCT_MAX_NODES) return;
+    if (node_clients[node] > 0) node_clients[node]--;
+}
+
+int numaIOClientMove(int from, int to) {
+    if (!io_enabled || from == to || to < 0 || to >= NUMA_ACCT_MAX_NODES ||
+        node_nthreads[to] == 0) return from;
+    numaIOClientDetach(from);
+    node_clients[to]++;
+    return to;
+}
+
+int numaIOPickThread(int node, int fallback) {
+    if (!io_enabled || node < 0 || node >= NUMA_ACCT_MAX_NODES ||
+        node_nthreads[node] == 0) return fallback;
+    return node_threads[node][node_rr[node]++ % node_nthreads[node]];
+}
+
+int numaIOAllocBegin(int node) {
+    if (!io_enabled || node < 0) return NUMA_IO_ALLOC_NOOP;
+    return numa_set_thread_alloc_node(node);
+}
+
+void numaIOAllocEnd(int token) {
+    if (token != NUMA_IO_ALLOC_NOOP) numa_set_thread_alloc_node(token);
+}
+
+void numaIOAddReadBytes(int node, size_t bytes) {
+    if (node < 0 || node >= NUMA_ACCT_MAX_NODES) return;
+    atomicIncr(node_read_bytes[node], (long long)bytes);
+}
+
+void numaIOAddWriteBytes(int node, size_t bytes) {
+    if (node < 0 || node >= NUMA_ACCT_MAX_NODES) return;
+    atomicIncr(node_write_bytes[node], (long long)bytes);
+}
+
+int numaIOThreadsEnabled(void) {
+    return io_enabled;
+}
+
+int numaIOGetNodeStats(int node, numa_io_node_stats_t *out) {
+    if (!io_enabled || node < 0 || node >= NUMA_ACCT_MAX_NODES || !out) return -1;
+    out->threads = node_nthreads[node];
+    out->clients = node_clients[node];
+    atomicGet(node_read_bytes[node], out->read_bytes);
+    atomicGet(node_write_bytes[node], out->write_bytes);
+    return 0;
+}
+
+#else /* !HAVE_NUMA */
+
+/* ========== NUMA 未启用时的空实现 ========== */
+
+void numaIOThreadsInit(int nthreads) { (void)nthreads; }
+void numaIOThreadBind(int id) { (void)id; }
+int numaIOClientAttach(connection *conn) { (void)conn; return -1; }
+void numaIOClientDetach(int node) { (void)node; }
+int numaIOClientMove(int from, int to) { (void)to; return from; }
+int numaIOPickThread(int node, int fallback) { (void)node; return fallback; }
+int numaIOAllocBegin(int node) { (void)node; return -1; }
+void numaIOAllocEnd(int token) { (void)token; }
+void numaIOAddReadBytes(int node, size_t bytes) { (void)node; (void)bytes; }
+void numaIOAddWriteBytes(int node, size_t bytes) { (void)node; (void)bytes; }
+int numaIOThreadsEnabled(void) { return 0; }
+int numaIOGetNodeStats(int node, numa_io_node_stats_t *out) { (void)node; (void)out; return -1; }
+
+#endif /* HAVE_NUMA */
@@ -0,0 +1,57 @@
+/* numa_io_threads.h - NUMA 感知的 io-threads 分组与客户端节点亲和
+ *
+ * io 线程按 NUMA 节点分组（只分配到有 CPU 的节点，主线程即 0 号线程
+ * 归属其运行节点），每个客户端在 accept 时归属一个节点：优先取内核
+ * 处理该连接收包软中断的 CPU（SO_INCOMING_CPU，反映网卡队列/IRQ
+ * 亲和），取不到时在有 io 线程的节点间轮询。
+ *
+ * 启用后：
+ *   - 客户端只派发给所属节点的 io 线程；
+ *   - client 结构、querybuf 扩容和回复块分配在所属节点上；
+ *   - 每节点统计客户端数与读写字节数（INFO numa）。
+ */
+#ifndef NUMA_IO_THREADS_H
+#define NUMA_IO_THREADS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct connection;
+
+/* 按 io 线程数建立线程→节点映射（initThreadedIO 调用，主线程执行） */
+void numaIOThreadsInit(int nthreads);
+
+/* io 线程启动时调用：server_cpulist 未配置时绑定到所属节点的 CPU */
+void numaIOThreadBind(int id);
+
+/* 为新连接选择节点并计入客户端数；conn 为 NULL 时返回 -1 */
+int numaIOClientAttach(struct connection *conn);
+void numaIOClientDetach(int node);
+
+/* 把客户端从节点 from 改归属到节点 to（to 无 io 线程时不迁移），返回
+ * 迁移后的节点（主线程调用） */
+int numaIOClientMove(int from, int to);
+
+/* 为节点 node 上的客户端挑选 io 线程；节点无线程时返回 fallback */
+int numaIOPickThread(int node, int fallback);
+
+/* 本线程的分配临时切到客户端所属节点；返回值交给 numaIOAllocEnd() 恢复 */
+int numaIOAllocBegin(int node);
+void numaIOAllocEnd(int token);
+
+/* 每节点字节计数（可能在 io 线程调用） */
+void numaIOAddReadBytes(int node, size_t bytes);
+void numaIOAddWriteBytes(int node, size_t bytes);
+
+typedef struct {
+    int threads;                /* 归属该节点的 io 线程数（含主线程）*/
+    long long clients;          /* 当前归属该节点的客户端数 */
+    long long read_bytes;       /* 累计读取字节 */
+    long long write_bytes;      /* 累计写出字节 */
+} numa_io_node_stats_t;
+
+/* 是否启用（numa-io-threads yes 且初始化成功） */
+int numaIOThreadsEnabled(void);
+int numaIOGetNodeStats(int node, numa_io_node_stats_t *out);
+
+#endif /* NUMA_IO_THREADS_H */
@@ -29,7 +29,6 @@ extern void _serverLog(int level, const char *fmt, ...);
 /* 外部zset函数声明 */
 extern zskiplist *zslCreate(void);
 extern void zslFree(zskiplist *zsl);
-extern zskiplistNode *zslInsert(zskiplist *zsl, double score, sds ele);
 
 /* 全局上下文 */
 static numa_key_migrate_ctx_t global_ctx = {0};
@@ -302,27 +301,28 @@ void numa_perform_heat_decay(void) {
 /* 迁移 STRING 类型 */
 int migrate_string_type(robj *key_obj, robj *val_obj, int target_node) {
     (void)key_obj;  /* 未使用参数 */
-    (void)target_node;  /* sds分配时不直接使用 */
     
-    if (val_obj->encoding != OBJ_ENCODING_RAW && 
-        val_obj->encoding != OBJ_ENCODING_EMBSTR) {
-        /* 整数编码，无需迁移 */
-        return NUMA_KEY_MIGRATE_OK;
+    if (val_obj->encoding != OBJ_ENCODING_RAW) {
+        /* 整数/EMBSTR 编码的数据在 robj 内部，无法单独迁移 */
+        return (val_obj->encoding == OBJ_ENCODING_INT) ?
+            NUMA_KEY_MIGRATE_OK : NUMA_KEY_MIGRATE_ETYPE;
     }
     
     sds old_str = val_obj->ptr;
     
-    /* 创建新sds（使用标准分配，处理复杂SDS头部结构） */
-    sds new_str = sdsnewlen(old_str, sdslen(old_str));
-    if (!new_str) {
+    /* 整块复制 sds（含头部）到目标节点，保持头部类型与 alloc 不变 */
+    void *old_buf = sdsAllocPtr(old_str);
+    size_t hdr_len = (char *)old_str - (char *)old_buf;
+    size_t buf_len = hdr_len + sdsalloc(old_str) + 1;
+    void *new_buf = numa_zmalloc_onnode(buf_len, target_node);
+    if (!new_buf) {
         return NUMA_KEY_MIGRATE_ENOMEM;
     }
+    memcpy(new_buf, old_buf, hdr_len + sdslen(old_str) + 1);
     
-    /* 更新指针 */
-    val_obj->ptr = new_str;
-    
-    /* 释放旧内存 */
-    sdsfree(old_str);
+    /* 更新指针并释放旧内存 */
+    val_obj->ptr = (char *)new_buf + hdr_len;
+    zfree(old_buf);
     
     return NUMA_KEY_MIGRATE_OK;
 }
@@ -331,10 +331,10 @@ int migrate_string_type(robj *key_obj, robj *val_obj, int target_node) {
 int migrate_hash_type(robj *key_obj, robj *val_obj, int target_node) {
     (void)key_obj;  /* 未使用参数 */
     
-    if (val_obj->encoding == OBJ_ENCODING_ZIPLIST) {
-        /* Ziplist编码：整体迁移 */
+    if (val_obj->encoding == OBJ_ENCODING_LISTPACK) {
+        /* Listpack编码：整体迁移 */
         unsigned char *old_zl = val_obj->ptr;
-        size_t zl_len = ziplistBlobLen(old_zl);
+        size_t zl_len = lpBytes(old_zl);
         
         unsigned char *new_zl = numa_zmalloc_onnode(zl_len, target_node);
         if (!new_zl) {
@@ -346,7 +346,7 @@ int migrate_hash_type(robj *key_obj, robj *val_obj, int target_node) {
         zfree(old_zl);
         
         KEY_MIGRATE_LOG(LL_DEBUG, 
-            "[NUMA Key Migrate] Hash (ziplist) migrated, size: %zu bytes", zl_len);
+            "[NUMA Key Migrate] Hash (listpack) migrated, size: %zu bytes", zl_len);
         return NUMA_KEY_MIGRATE_OK;
         
     } else if (val_obj->encoding == OBJ_ENCODING_HT) {
@@ -632,10 +632,10 @@ int migrate_zset_type(robj *key_obj, robj *val_obj, int target_node) {
     (void)key_obj;  /* 未使用参数 */
     (void)target_node;  /* sds分配时不直接使用 */
     
-    if (val_obj->encoding == OBJ_ENCODING_ZIPLIST) {
-        /* Ziplist编码：整体迁移 */
+    if (val_obj->encoding == OBJ_ENCODING_LISTPACK) {
+        /* Listpack编码：整体迁移 */
         unsigned char *old_zl = val_obj->ptr;
-        size_t zl_len = ziplistBlobLen(old_zl);
+        size_t zl_len = lpBytes(old_zl);
         
         unsigned char *new_zl = numa_zmalloc_onnode(zl_len, target_node);
         if (!new_zl) {
@@ -647,7 +647,7 @@ int migrate_zset_type(robj *key_obj, robj *val_obj, int target_node) {
         zfree(old_zl);
         
         KEY_MIGRATE_LOG(LL_DEBUG, 
-            "[NUMA Key Migrate] Zset (ziplist) migrated, size: %zu bytes", zl_len);
+            "[NUMA Key Migrate] Zset (listpack) migrated, size: %zu bytes", zl_len);
         return NUMA_KEY_MIGRATE_OK;
         
     } else if (val_obj->encoding == OBJ_ENCODING_SKIPLIST) {
@@ -661,8 +661,9 @@ int migrate_zset_type(robj *key_obj, robj *val_obj, int target_node) {
             return NUMA_KEY_MIGRATE_ENOMEM;
         }
         
-        /* 创建新跳表 */
+        /* 创建新跳表（元素达到阈值后由zsetIndexAdd转为B+树） */
         new_zs->zsl = zslCreate();
+        new_zs->zbt = NULL;
         if (!new_zs->zsl) {
             zfree(new_zs);
             return NUMA_KEY_MIGRATE_ENOMEM;
@@ -684,34 +685,32 @@ int migrate_zset_type(robj *key_obj, robj *val_obj, int target_node) {
             return NUMA_KEY_MIGRATE_ENOMEM;
         }
         
-        /* 从尾到头遍历跳表以获得最佳插入顺序 */
-        zskiplistNode *old_node = old_zs->zsl->tail;
+        /* 从尾到头遍历有序索引（跳表或B+树）以获得最佳插入顺序 */
+        zsetCursor old_cursor;
         size_t migrated_elements = 0;
         
-        while (old_node) {
+        zsetIndexLast(old_zs, &old_cursor);
+        while (zsetCursorValid(&old_cursor)) {
             /* 使用标准sds创建新元素字符串 */
-            sds old_ele = old_node->ele;
+            sds old_ele = zsetCursorEle(&old_cursor);
             sds new_ele = sdsnewlen(old_ele, sdslen(old_ele));
             if (!new_ele) {
                 dictRelease(new_zs->dict);
-                zslFree(new_zs->zsl);
+                zsetIndexFree(new_zs);
                 zfree(new_zs);
                 return NUMA_KEY_MIGRATE_ENOMEM;
             }
             
-            /* 插入新跳表 */
-            zskiplistNode *new_sl_node = zslInsert(new_zs->zsl, old_node->score, new_ele);
-            
-            /* 添加到dict（元素 -> 分数指针） */
-            dictAdd(new_zs->dict, new_ele, &new_sl_node->score);
+            /* 插入新索引，并添加到dict（元素 -> 分数值） */
+            zsetIndexAdd(new_zs, zsetCursorScore(&old_cursor), new_ele);
             
             migrated_elements++;
-            old_node = old_node->backward;
+            zsetCursorPrev(&old_cursor);
         }
         
         /* 释放旧zset */
         dictRelease(old_zs->dict);
-        zslFree(old_zs->zsl);
+        zsetIndexFree(old_zs);
         zfree(old_zs);
         
         /* 更新对象指针 */
@@ -752,6 +751,11 @@ int numa_migrate_single_key(redisDb *db, robj *key, int target_node) {
         return NUMA_KEY_MIGRATE_ENOENT;
     }
     
+    /* 冷层压缩值已固定在降级节点上，访问时才会提升 */
+    if (val->encoding == OBJ_ENCODING_NUMA_COLD) {
+        return NUMA_KEY_MIGRATE_ETYPE;
+    }
+    
     uint64_t start_time = get_current_time_us();
     int result = NUMA_KEY_MIGRATE_OK;
     
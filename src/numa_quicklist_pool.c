@@ -0,0 +1,128 @@
+/* numa_quicklist_pool.c - 每节点 quicklist 节点结构回收池实现
+ *
+ * 空闲节点通过 next 指针串成单链表。取与放回都在对应节点的锁内完成，
+ * 临界区只有几次指针操作。池通过 quicklistSetNodePool() 接入 quicklist，
+ * quicklist.c 本身不依赖 server。
+ *
+ * Copyright (c) 2024, Redis-CXL Project
+ */
+
+#include "server.h"
+#include "numa_quicklist_pool.h"
+
+#ifdef HAVE_NUMA
+
+#include <numa.h>
+
+typedef struct {
+    pthread_mutex_t lock;
+    quicklistNode *free_list;
+    long long nodes;
+    long long hits;
+    long long misses;
+    long long recycled;
+} quicklist_pool_t;
+
+static quicklist_pool_t pools[NUMA_ACCT_MAX_NODES];
+static int pool_nodes = 0;
+
+static quicklistNode *quicklistPoolGet(const quicklist *ql) {
+    if (server.numa_quicklist_pool_nodes <= 0) return NULL;
+    int node = numa_get_node_id((void *)ql);
+    if (node < 0 || node >= pool_nodes) return NULL;
+
+    quicklist_pool_t *p = &pools[node];
+    pthread_mutex_lock(&p->lock);
+    quicklistNode *qn = p->free_list;
+    if (qn) {
+        p->free_list = qn->next;
+        p->nodes--;
+        p->hits++;
+    } else {
+        p->misses++;
+    }
+    pthread_mutex_unlock(&p->lock);
+    return qn;
+}
+
+static int quicklistPoolPut(quicklistNode *qn) {
+    if (server.numa_quicklist_pool_nodes <= 0) return 0;
+    int node = numa_get_node_id(qn);
+    if (node < 0 || node >= pool_nodes) return 0;
+
+    quicklist_pool_t *p = &pools[node];
+    pthread_mutex_lock(&p->lock);
+    if (p->nodes >= server.numa_quicklist_pool_nodes) {
+        pthread_mutex_unlock(&p->lock);
+        return 0;
+    }
+    qn->next = p->free_list;
+    p->free_list = qn;
+    p->nodes++;
+    p->recycled++;
+    pthread_mutex_unlock(&p->lock);
+    return 1;
+}
+
+static quicklistNodePool quicklistPool = {quicklistPoolGet, quicklistPoolPut};
+
+void numaQuicklistPoolInit(void) {
+    if (numa_available() < 0) return;
+    pool_nodes = numa_max_node() + 1;
+    if (pool_nodes > NUMA_ACCT_MAX_NODES) pool_nodes = NUMA_ACCT_MAX_NODES;
+    for (int j = 0; j < pool_nodes; j++) {
+        memset(&pools[j], 0, sizeof(pools[j]));
+        pthread_mutex_init(&pools[j].lock, NULL);
+    }
+    quicklistSetNodePool(&quicklistPool);
+}
+
+void numaQuicklistPoolTrim(void) {
+    for (int j = 0; j < pool_nodes; j++) {
+        quicklist_pool_t *p = &pools[j];
+        quicklistNode *list = NULL;
+
+        /* 超出上限的节点摘下后在锁外释放 */
+        pthread_mutex_lock(&p->lock);
+        while (p->nodes > server.numa_quicklist_pool_nodes) {
+            quicklistNode *qn = p->free_list;
+            p->free_list = qn->next;
+            qn->next = list;
+            list = qn;
+            p->nodes--;
+        }
+        pthread_mutex_unlock(&p->lock);
+
+        while (list) {
+            quicklistNode *next = list->next;
+            zfree(list);
+            list = next;
+        }
+    }
+}
+
+int numaQuicklistPoolGetStats(int node, numa_quicklist_pool_stats_t *out) {
+    if (node < 0 || node >= pool_nodes) return -1;
+    quicklist_pool_t *p = &pools[node];
+    pthread_mutex_lock(&p->lock);
+    out->nodes = p->nodes;
+    out->bytes = (size_t)p->nodes * sizeof(quicklistNode);
+    out->hits = p->hits;
+    out->misses = p->misses;
+    out->recycled = p->recycled;
+    pthread_mutex_unlock(&p->lock);
+    return 0;
+}
+
+#else /* !HAVE_NUMA */
+
+/* ========== NUMA 未启用时的空实现 ========== */
+
+void numaQuicklistPoolInit(void) {}
+void numaQuicklistPoolTrim(void) {}
+int numaQuicklistPoolGetStats(int node, numa_quicklist_pool_stats_t *out) {
+    (void)node; (void)out;
+    return -1;
+}
+
+#endif /* HAVE_NUMA */
@@ -0,0 +1,35 @@
+/* numa_quicklist_pool.h - 每节点 quicklist 节点结构回收池
+ *
+ * 以 LPUSH/RPOP 为主的队列负载中，quicklist 节点随着 ziplist 写满与取空
+ * 不断创建、释放，每次都是一次 32 字节的 numa_alloc_onnode()。启用
+ * numa-quicklist-pool-nodes 后，释放的 quicklistNode 结构按其所在节点放回
+ * 该节点的空闲链表，之后为同一节点上的列表新建节点时直接复用。
+ *
+ * 取节点时按 quicklist 结构本身所在的节点选池，使列表的节点留在列表所在
+ * 节点。池中的节点仍计入 used_memory，每节点最多保留
+ * numa-quicklist-pool-nodes 个。列表可能在 lazyfree 线程释放，每节点一把锁。
+ */
+#ifndef NUMA_QUICKLIST_POOL_H
+#define NUMA_QUICKLIST_POOL_H
+
+#include <stddef.h>
+
+#define NUMA_QUICKLIST_POOL_MAX_NODES (1 << 20)
+
+typedef struct {
+    long long nodes;            /* 池中空闲节点数 */
+    size_t bytes;               /* 池中空闲节点占用的内存 */
+    long long hits;             /* 从池中取到节点的次数 */
+    long long misses;           /* 池空、改由分配器分配的次数 */
+    long long recycled;         /* 放回池中的节点数 */
+} numa_quicklist_pool_stats_t;
+
+/* 初始化各节点的池并挂到 quicklist 上（启动时主线程调用一次） */
+void numaQuicklistPoolInit(void);
+
+/* 把每个池裁剪到 numa-quicklist-pool-nodes（配置变更时调用） */
+void numaQuicklistPoolTrim(void);
+
+int numaQuicklistPoolGetStats(int node, numa_quicklist_pool_stats_t *out);
+
+#endif /* NUMA_QUICKLIST_POOL_H */
@@ -0,0 +1,402 @@
+/* numa_rdb_loader.c - 多线程 RDB 加载管线实现
+ *
+ * 记录按批（最多 NUMA_RDB_BATCH_KEYS 条或 NUMA_RDB_BATCH_BYTES 字节）放在
+ * 环形批次数组中：主线程填充 fill 批次，解码线程依次领取 [taken, fill)
+ * 中的批次，主线程从 head 开始按顺序取回。环满时主线程阻塞等待 head
+ * 批次完成，原始字节占用的内存因此有上限。
+ *
+ * Copyright (c) 2024, Redis-CXL Project
+ */
+
+#include "server.h"
+#include "numa_rdb_loader.h"
+#include "endianconv.h"
+
+#ifdef HAVE_NUMA
+
+#include <numa.h>
+#include <signal.h>
+
+#define NUMA_RDB_BATCH_KEYS     256
+#define NUMA_RDB_BATCH_BYTES    (1024*1024)
+#define NUMA_RDB_RING_PER_THREAD 4
+
+typedef struct {
+    numaRdbRecord recs[NUMA_RDB_BATCH_KEYS];
+    int count;                  /* 记录数 */
+    int consumed;               /* 主线程已取回的记录数 */
+    size_t bytes;               /* 原始字节总数 */
+    int done;                   /* 解码完成（受 lock 保护）*/
+} rdb_batch_t;
+
+static struct {
+    int active;
+    int nthreads;
+    pthread_t threads[NUMA_RDB_LOADER_MAX_THREADS];
+    int thread_node[NUMA_RDB_LOADER_MAX_THREADS];
+    numaRdbDecodeFn *decode;
+
+    rdb_batch_t *ring;
+    unsigned long ring_size;
+    unsigned long head;         /* 最早未取回完的批次 */
+    unsigned long taken;        /* 下一个待解码线程领取的批次 */
+    unsigned long fill;         /* 主线程正在填充的批次 */
+    int shutdown;
+
+    pthread_mutex_t lock;
+    pthread_cond_t work_cond;   /* 有新批次可领取 */
+    pthread_cond_t done_cond;   /* 有批次解码完成 */
+} loader;
+
+/* ========== 值原始字节截取 ========== */
+
+/* 读取 len 字节并追加到 raw */
+static int cap_read(rio *rdb, sds *raw, size_t len) {
+    size_t old = sdslen(*raw);
+    *raw = sdsMakeRoomFor(*raw, len);
+    if (len && rioRead(rdb, *raw + old, len) == 0) return -1;
+    sdsIncrLen(*raw, len);
+    return 0;
+}
+
+/* 截取一个长度编码，语义同 rdbLoadLenByRef() */
+static int cap_len(rio *rdb, sds *raw, int *isencoded, uint64_t *lenptr) {
+    unsigned char buf[1];
+    if (isencoded) *isencoded = 0;
+    if (cap_read(rdb, raw, 1) == -1) return -1;
+    buf[0] = (*raw)[sdslen(*raw)-1];
+
+    int type = (buf[0]&0xC0)>>6;
+    if (type == RDB_ENCVAL) {
+        if (isencoded) *isencoded = 1;
+        *lenptr = buf[0]&0x3F;
+    } else if (type == RDB_6BITLEN) {
+        *lenptr = buf[0]&0x3F;
+    } else if (type == RDB_14BITLEN) {
+        if (cap_read(rdb, raw, 1) == -1) return -1;
+        *lenptr = ((buf[0]&0x3F)<<8)|(unsigned char)(*raw)[sdslen(*raw)-1];
+    } else if (buf[0] == RDB_32BITLEN) {
+        uint32_t len;
+        if (cap_read(rdb, raw, 4) == -1) return -1;
+        memcpy(&len, *raw + sdslen(*raw) - 4, 4);
+        *lenptr = ntohl(len);
+    } else if (buf[0] == RDB_64BITLEN) {
+        uint64_t len;
+        if (cap_read(rdb, raw, 8) == -1) return -1;
+        memcpy(&len, *raw + sdslen(*raw) - 8, 8);
+        *lenptr = ntohu64(len);
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+/* 截取一个字符串，语义同 rdbGenericLoadStringObject() */
+static int cap_string(rio *rdb, sds *raw) {
+    int isencoded;
+    uint64_t len, clen;
+    if (cap_len(rdb, raw, &isencoded, &len) == -1) return -1;
+    if (!isencoded) return cap_read(rdb, raw, len);
+
+    switch (len) {
+    case RDB_ENC_INT8: return cap_read(rdb, raw, 1);
+    case RDB_ENC_INT16: return cap_read(rdb, raw, 2);
+    case RDB_ENC_INT32: return cap_read(rdb, raw, 4);
+    case RDB_ENC_LZF:
+        if (cap_len(rdb, raw, NULL, &clen) == -1) return -1;
+        if (cap_len(rdb, raw, NULL, &len) == -1) return -1;
+        return cap_read(rdb, raw, clen);
+    default:
+        return -1;
+    }
+}
+
+static int cap_strings(rio *rdb, sds *raw, uint64_t count) {
+    while (count--) {
+        if (cap_string(rdb, raw) == -1) return -1;
+    }
+    return 0;
+}
+
+/* 截取 RDB_TYPE_ZSET 的文本 double，语义同 rdbLoadDoubleValue() */
+static int cap_text_double(rio *rdb, sds *raw) {
+    if (cap_read(rdb, raw, 1) == -1) return -1;
+    unsigned char len = (*raw)[sdslen(*raw)-1];
+    return len < 253 ? cap_read(rdb, raw, len) : 0;
+}
+
+/* 截取 RDB_TYPE_STREAM_LISTPACKS，字段顺序同 rdbLoadObject() */
+static int cap_stream(rio *rdb, sds *raw) {
+    uint64_t listpacks, cgroups, pel, consumers, v;
+
+    if (cap_len(rdb, raw, NULL, &listpacks) == -1) return -1;
+    if (cap_strings(rdb, raw, listpacks*2) == -1) return -1;
+    /* length, last_id.ms, last_id.seq */
+    for (int j = 0; j < 3; j++)
+        if (cap_len(rdb, raw, NULL, &v) == -1) return -1;
+
+    if (cap_len(rdb, raw, NULL, &cgroups) == -1) return -1;
+    while (cgroups--) {
+        if (cap_string(rdb, raw) == -1) return -1;
+        if (cap_len(rdb, raw, NULL, &v) == -1) return -1;
+        if (cap_len(rdb, raw, NULL, &v) == -1) return -1;
+
+        /* 全局 PEL：ID、投递时间、投递次数 */
+        if (cap_len(rdb, raw, NULL, &pel) == -1) return -1;
+        while (pel--) {
+            if (cap_read(rdb, raw, sizeof(streamID)+8) == -1) return -1;
+            if (cap_len(rdb, raw, NULL, &v) == -1) return -1;
+        }
+
+        /* 消费者：名称、seen_time、各自的 PEL ID */
+        if (cap_len(rdb, raw, NULL, &consumers) == -1) return -1;
+        while (consumers--) {
+            if (cap_string(rdb, raw) == -1) return -1;
+            if (cap_read(rdb, raw, 8) == -1) return -1;
+            if (cap_len(rdb, raw, NULL, &pel) == -1) return -1;
+            if (cap_read(rdb, raw, pel*sizeof(streamID)) == -1) return -1;
+        }
+    }
+    return 0;
+}
+
+int numaRdbLoaderCanCapture(int type) {
+    return rdbIsObjectType(type) &&
+           type != RDB_TYPE_MODULE && type != RDB_TYPE_MODULE_2;
+}
+
+sds numaRdbLoaderCapture(rio *rdb, int type) {
+    sds raw = sdsempty();
+    uint64_t len;
+    int ret;
+
+    switch (type) {
+    case RDB_TYPE_STRING:
+    case RDB_TYPE_HASH_ZIPMAP:
+    case RDB_TYPE_LIST_ZIPLIST:
+    case RDB_TYPE_SET_INTSET:
+    case RDB_TYPE_ZSET_ZIPLIST:
+    case RDB_TYPE_HASH_ZIPLIST:
+    case RDB_TYPE_HASH_LISTPACK:
+    case RDB_TYPE_ZSET_LISTPACK:
+        ret = cap_string(rdb, &raw);
+        break;
+    case RDB_TYPE_LIST:
+    case RDB_TYPE_SET:
+    case RDB_TYPE_LIST_QUICKLIST:
+        ret = cap_len(rdb, &raw, NULL, &len) == -1 ? -1 : cap_strings(rdb, &raw, len);
+        break;
+    case RDB_TYPE_HASH:
+        ret = cap_len(rdb, &raw, NULL, &len) == -1 ? -1 : cap_strings(rdb, &raw, len*2);
+        break;
+    case RDB_TYPE_ZSET:
+    case RDB_TYPE_ZSET_2:
+        ret = cap_len(rdb, &raw, NULL, &len);
+        while (ret == 0 && len--) {
+            ret = cap_string(rdb, &raw);
+            if (ret == 0) {
+                ret = (type == RDB_TYPE_ZSET) ? cap_text_double(rdb, &raw)
+                                              : cap_read(rdb, &raw, sizeof(double));
+            }
+        }
+        break;
+    case RDB_TYPE_STREAM_LISTPACKS:
+        ret = cap_stream(rdb, &raw);
+        break;
+    default:
+        ret = -1;
+        break;
+    }
+
+    if (ret == -1) {
+        sdsfree(raw);
+        return NULL;
+    }
+    return raw;
+}
+
+/* ========== 解码线程 ========== */
+
+static int node_has_cpus(int node) {
+    struct bitmask *cpus = numa_allocate_cpumask();
+    int has = numa_node_to_cpus(node, cpus) == 0 && numa_bitmask_weight(cpus) > 0;
+    numa_free_cpumask(cpus);
+    return has;
+}
+
+static void *rdb_decode_thread(void *arg) {
+    long id = (long)arg;
+    char title[32];
+    sigset_t sigset;
+
+    snprintf(title, sizeof(title), "rdb_load_%ld", id % NUMA_RDB_LOADER_MAX_THREADS);
+    redis_set_thread_title(title);
+
+    /* 只有主线程接收 watchdog 信号 */
+    sigemptyset(&sigset);
+    sigaddset(&sigset, SIGALRM);
+    pthread_sigmask(SIG_BLOCK, &sigset, NULL);
+
+    /* 对象在解码线程所在节点上构造 */
+    if (numa_run_on_node(loader.thread_node[id]) != 0) {
+        serverLog(LL_WARNING, "[NUMA RDB] failed to bind loader thread %ld to node %d",
+            id, loader.thread_node[id]);
+    }
+
+    pthread_mutex_lock(&loader.lock);
+    while (1) {
+        while (!loader.shutdown && loader.taken == loader.fill)
+            pthread_cond_wait(&loader.work_cond, &loader.lock);
+        if (loader.shutdown) break;
+
+        rdb_batch_t *b = &loader.ring[loader.taken++ % loader.ring_size];
+        pthread_mutex_unlock(&loader.lock);
+
+        for (int j = 0; j < b->count; j++) {
+            numaRdbRecord *rec = &b->recs[j];
+            loader.decode(rec);
+            sdsfree(rec->raw);
+            rec->raw = NULL;
+        }
+
+        pthread_mutex_lock(&loader.lock);
+        b->done = 1;
+        pthread_cond_broadcast(&loader.done_cond);
+    }
+    pthread_mutex_unlock(&loader.lock);
+    return NULL;
+}
+
+int numaRdbLoaderStart(numaRdbDecodeFn *decode) {
+    int nthreads = server.numa_rdb_load_threads;
+    if (nthreads <= 0 || numa_available() < 0) return C_ERR;
+    if (nthreads > NUMA_RDB_LOADER_MAX_THREADS) nthreads = NUMA_RDB_LOADER_MAX_THREADS;
+
+    /* 解码线程在有 CPU 的节点间依次分配 */
+    int cpu_nodes[NUMA_ACCT_MAX_NODES], ncpu_nodes = 0;
+    for (int n = 0; n <= numa_max_node() && n < NUMA_ACCT_MAX_NODES; n++) {
+        if (node_has_cpus(n)) cpu_nodes[ncpu_nodes++] = n;
+    }
+    if (ncpu_nodes == 0) return C_ERR;
+
+    memset(&loader, 0, sizeof(loader));
+    loader.decode = decode;
+    loader.ring_size = (unsigned long)nthreads * NUMA_RDB_RING_PER_THREAD;
+    loader.ring = zcalloc(sizeof(rdb_batch_t) * loader.ring_size);
+    pthread_mutex_init(&loader.lock, NULL);
+    pthread_cond_init(&loader.work_cond, NULL);
+    pthread_cond_init(&loader.done_cond, NULL);
+
+    for (long j = 0; j < nthreads; j++) {
+        loader.thread_node[j] = cpu_nodes[j % ncpu_nodes];
+        if (pthread_create(&loader.threads[j], NULL, rdb_decode_thread, (void *)j) != 0) {
+            serverLog(LL_WARNING, "[NUMA RDB] can't create loader thread, loading serially");
+            loader.nthreads = j;
+            loader.active = 1;
+            numaRdbLoaderStop();
+            return C_ERR;
+        }
+    }
+    loader.nthreads = nthreads;
+    loader.active = 1;
+    serverLog(LL_NOTICE, "[NUMA RDB] loading with %d decoder thread(s) on %d node(s)",
+        nthreads, ncpu_nodes < nthreads ? ncpu_nodes : nthreads);
+    return C_OK;
+}
+
+/* ========== 提交与取回（仅主线程）========== */
+
+/* 把正在填充的批次交给解码线程 */
+static void loader_dispatch(void) {
+    pthread_mutex_lock(&loader.lock);
+    loader.fill++;
+    pthread_cond_signal(&loader.work_cond);
+    pthread_mutex_unlock(&loader.lock);
+}
+
+void numaRdbLoaderSubmit(numaRdbRecord *rec) {
+    rdb_batch_t *b = &loader.ring[loader.fill % loader.ring_size];
+    numaRdbRecord *dst = &b->recs[b->count++];
+
+    *dst = *rec;
+    dst->val = NULL;
+    dst->error = 0;
+    dst->placed = 0;
+    b->bytes += sdslen(rec->raw);
+    if (b->count == NUMA_RDB_BATCH_KEYS || b->bytes >= NUMA_RDB_BATCH_BYTES)
+        loader_dispatch();
+}
+
+numaRdbRecord *numaRdbLoaderNext(int flush) {
+    if (flush && loader.ring[loader.fill % loader.ring_size].count)
+        loader_dispatch();
+
+    while (loader.head != loader.fill) {
+        rdb_batch_t *b = &loader.ring[loader.head % loader.ring_size];
+
+        pthread_mutex_lock(&loader.lock);
+        while (!b->done) {
+            /* 环未满且不要求冲刷时不等待，让主线程继续读文件 */
+            if (!flush && loader.fill - loader.head < loader.ring_size) {
+                pthread_mutex_unlock(&loader.lock);
+                return NULL;
+            }
+            pthread_cond_wait(&loader.done_cond, &loader.lock);
+        }
+        pthread_mutex_unlock(&loader.lock);
+
+        if (b->consumed < b->count) return &b->recs[b->consumed++];
+
+        /* 该批次已全部取回，复用 */
+        b->count = b->consumed = 0;
+        b->bytes = 0;
+        b->done = 0;
+        loader.head++;
+    }
+    return NULL;
+}
+
+void numaRdbLoaderStop(void) {
+    if (!loader.active) return;
+
+    pthread_mutex_lock(&loader.lock);
+    loader.shutdown = 1;
+    pthread_cond_broadcast(&loader.work_cond);
+    pthread_mutex_unlock(&loader.lock);
+    for (int j = 0; j < loader.nthreads; j++)
+        pthread_join(loader.threads[j], NULL);
+
+    /* 出错退出时释放尚未取回的记录，包括正在填充的批次（环满时它与
+     * head 批次是同一个槽位，不能重复释放） */
+    unsigned long last = loader.fill - loader.head < loader.ring_size ?
+                         loader.fill : loader.fill - 1;
+    for (unsigned long i = loader.head; i <= last; i++) {
+        rdb_batch_t *b = &loader.ring[i % loader.ring_size];
+        for (int j = b->consumed; j < b->count; j++) {
+            numaRdbRecord *rec = &b->recs[j];
+            sdsfree(rec->key);
+            sdsfree(rec->raw);
+            sdsfree(rec->errmsg);
+            if (rec->val) decrRefCount(rec->val);
+        }
+    }
+
+    zfree(loader.ring);
+    pthread_mutex_destroy(&loader.lock);
+    pthread_cond_destroy(&loader.work_cond);
+    pthread_cond_destroy(&loader.done_cond);
+    loader.active = 0;
+}
+
+#else /* !HAVE_NUMA */
+
+/* ========== NUMA 未启用时的空实现 ========== */
+
+int numaRdbLoaderStart(numaRdbDecodeFn *decode) { (void)decode; return C_ERR; }
+int numaRdbLoaderCanCapture(int type) { (void)type; return 0; }
+sds numaRdbLoaderCapture(rio *rdb, int type) { (void)rdb; (void)type; return NULL; }
+void numaRdbLoaderSubmit(numaRdbRecord *rec) { (void)rec; }
+numaRdbRecord *numaRdbLoaderNext(int flush) { (void)flush; return NULL; }
+void numaRdbLoaderStop(void) {}
+
+#endif /* HAVE_NUMA */
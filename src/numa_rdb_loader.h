@@ -0,0 +1,68 @@
+/* numa_rdb_loader.h - 多线程 RDB 加载管线
+ *
+ * 串行加载时主线程既读文件又构造全部对象，对象也都分配在主线程所在的
+ * 节点上。启用 numa-rdb-load-threads 后加载分为三段：
+ *
+ *   - 主线程读取文件：处理 opcode 与 key，把每个值的原始字节截取为一条
+ *     记录（不构造对象），按批提交；
+ *   - 解码线程（在有 CPU 的节点间分配并绑定）对记录调用 rdbLoadObject()，
+ *     对象在解码线程所在节点上构造；
+ *   - 主线程按提交顺序取回解码结果，只做 dbAdd、过期时间等插入工作。
+ *
+ * 模块类型的值仍在主线程串行解码（模块回调不保证线程安全）：遇到时先
+ * 取回全部在途记录，保持 key 的插入顺序与串行加载一致。
+ */
+#ifndef NUMA_RDB_LOADER_H
+#define NUMA_RDB_LOADER_H
+
+#include "sds.h"
+
+struct _rio;
+struct redisDb;
+struct redisObject;
+
+#define NUMA_RDB_LOADER_MAX_THREADS 64
+
+/* 一条待解码的 key，解码线程只写 val/error/placed 与 err* 字段 */
+typedef struct numaRdbRecord {
+    int type;                       /* RDB 对象类型 */
+    struct redisDb *db;             /* 所属数据库 */
+    sds key;
+    sds raw;                        /* 值的原始字节，解码后释放 */
+    struct redisObject *val;        /* 解码结果，失败为 NULL */
+    int error;                      /* rdbLoadObject() 的错误码 */
+    int placed;                     /* 值已按 numa_placement 分配在记录的节点上 */
+    sds errmsg;                     /* 解码线程不能报告错误（可能退出进程），
+                                     * 记录下来由主线程报告；无错误为 NULL */
+    int errline;                    /* 出错位置（rdb.c 行号） */
+    int errcorrupt;                 /* 是否为格式损坏错误 */
+    long long expiretime;
+    long long lru_idle;
+    long long lfu_freq;
+    long long numa_placement;
+} numaRdbRecord;
+
+/* 解码回调：在解码线程中由 raw 构造 val */
+typedef void numaRdbDecodeFn(numaRdbRecord *rec);
+
+/* 按 numa-rdb-load-threads 启动解码线程；未启用时返回 C_ERR，调用方串行加载 */
+int numaRdbLoaderStart(numaRdbDecodeFn *decode);
+
+/* 该类型的值能否截取原始字节交给解码线程（模块类型不能） */
+int numaRdbLoaderCanCapture(int type);
+
+/* 从 rdb 中读出一个 type 类型值的原始字节；I/O 错误或格式错误返回 NULL */
+sds numaRdbLoaderCapture(struct _rio *rdb, int type);
+
+/* 提交一条记录（内容被复制，key/raw 的所有权转给管线） */
+void numaRdbLoaderSubmit(numaRdbRecord *rec);
+
+/* 按提交顺序取回下一条已解码的记录，所有权（key/val）转给调用方。
+ * flush 为 0 时只在在途批次达到上限时阻塞，没有可取的记录返回 NULL；
+ * flush 为 1 时提交未满的批次并阻塞到有记录可取，管线为空时返回 NULL。 */
+numaRdbRecord *numaRdbLoaderNext(int flush);
+
+/* 停止解码线程，释放尚未取回的记录（出错退出时） */
+void numaRdbLoaderStop(void);
+
+#endif /* NUMA_RDB_LOADER_H */
@@ -0,0 +1,304 @@
+/* numa_rdb_saver.c - 快照子进程的按节点并行序列化实现
+ *
+ * 只在 fork 出的子进程中使用，父进程不受影响。每个节点线程有自己的待
+ * 序列化批次队列；序列化完成的缓冲进入共享的完成队列，由主线程写出。
+ * 在途批次数有上限，子进程额外占用的内存因此有界。
+ *
+ * numa-placement AUX 字段只在位置变化时写出，其状态是线程局部的：
+ * 每个缓冲从空状态开始，主线程写出缓冲后也重置自己的状态，所以缓冲以
+ * 任意顺序拼接都能正确加载。
+ *
+ * Copyright (c) 2024, Redis-CXL Project
+ */
+
+#include "server.h"
+#include "numa_rdb_saver.h"
+
+#ifdef HAVE_NUMA
+
+#include <numa.h>
+
+#define NUMA_RDB_SAVER_BATCH_KEYS   128
+#define NUMA_RDB_SAVER_INFLIGHT     4           /* 每个节点线程的在途批次上限 */
+#define NUMA_RDB_SAVER_BIG_BYTES    (1024*1024) /* 超过此大小的值由主线程直接写 */
+#define NUMA_RDB_SAVER_BIG_ELEMENTS 100000
+
+typedef struct saver_batch {
+    struct {
+        sds key;
+        robj *val;
+        long long expire;
+    } keys[NUMA_RDB_SAVER_BATCH_KEYS];
+    int count;
+    sds out;                    /* 序列化结果 */
+    int failed;
+    struct saver_batch *next;
+} saver_batch;
+
+typedef struct {
+    pthread_t thread;
+    int node;                   /* 负责的节点 */
+    saver_batch *filling;       /* 主线程正在填充的批次 */
+    saver_batch *queue_head;    /* 待序列化批次（受 lock 保护）*/
+    saver_batch *queue_tail;
+    pthread_cond_t work_cond;
+} saver_worker;
+
+static struct {
+    int active;
+    int nworkers;
+    saver_worker workers[NUMA_RDB_SAVER_MAX_NODES];
+    saver_batch *done_head;     /* 已序列化待写出的批次（受 lock 保护）*/
+    saver_batch *done_tail;
+    int inflight;               /* 已派发但尚未写出的批次数 */
+    int shutdown;
+    pthread_mutex_t lock;
+    pthread_cond_t done_cond;
+} saver;
+
+/* 距离 node 最近的有 CPU 的节点（node 本身有 CPU 时即为 node） */
+static int nearest_cpu_node(int node) {
+    struct bitmask *cpus = numa_allocate_cpumask();
+    int target = -1, best = INT_MAX;
+
+    for (int n = 0; n <= numa_max_node(); n++) {
+        if (numa_node_to_cpus(n, cpus) != 0 || numa_bitmask_weight(cpus) == 0)
+            continue;
+        int dist = (n == node) ? -1 : numa_distance(node, n);
+        if (dist < best) {
+            best = dist;
+            target = n;
+        }
+    }
+    numa_free_cpumask(cpus);
+    return target;
+}
+
+/* 值是否大到不宜在内存中整体序列化 */
+static int value_is_big(robj *o) {
+    if (o->encoding == OBJ_ENCODING_NUMA_COLD)
+        return ((numa_cold_blob_t *)o->ptr)->raw_len > NUMA_RDB_SAVER_BIG_BYTES;
+
+    switch (o->type) {
+    case OBJ_STRING:
+        return sdsEncodedObject(o) && sdslen(o->ptr) > NUMA_RDB_SAVER_BIG_BYTES;
+    case OBJ_LIST: return listTypeLength(o) > NUMA_RDB_SAVER_BIG_ELEMENTS;
+    case OBJ_SET: return setTypeSize(o) > NUMA_RDB_SAVER_BIG_ELEMENTS;
+    case OBJ_ZSET: return zsetLength(o) > NUMA_RDB_SAVER_BIG_ELEMENTS;
+    case OBJ_HASH: return hashTypeLength(o) > NUMA_RDB_SAVER_BIG_ELEMENTS;
+    case OBJ_STREAM: return ((stream *)o->ptr)->length > NUMA_RDB_SAVER_BIG_ELEMENTS;
+    default: return 1;         /* 模块类型：回调不保证线程安全 */
+    }
+}
+
+/* ========== 节点线程 ========== */
+
+static void *saver_thread(void *arg) {
+    saver_worker *w = arg;
+    char title[32];
+
+    snprintf(title, sizeof(title), "rdb_save_%d", w->node % NUMA_RDB_SAVER_MAX_NODES);
+    redis_set_thread_title(title);
+
+    int cpu_node = nearest_cpu_node(w->node);
+    if (cpu_node < 0 || numa_run_on_node(cpu_node) != 0) {
+        serverLog(LL_WARNING, "[NUMA RDB] failed to bind save thread of node %d", w->node);
+    }
+
+    pthread_mutex_lock(&saver.lock);
+    while (1) {
+        while (!saver.shutdown && w->queue_head == NULL)
+            pthread_cond_wait(&w->work_cond, &saver.lock);
+        if (saver.shutdown) break;
+
+        saver_batch *b = w->queue_head;
+        w->queue_head = b->next;
+        if (!w->queue_head) w->queue_tail = NULL;
+        pthread_mutex_unlock(&saver.lock);
+
+        rio buf;
+        rioInitWithBuffer(&buf, sdsempty());
+        rdbNumaPlacementReset();
+        for (int j = 0; j < b->count && !b->failed; j++) {
+            robj key;
+            initStaticStringObject(key, b->keys[j].key);
+            if (rdbSaveKeyValuePair(&buf, &key, b->keys[j].val, b->keys[j].expire) == -1)
+                b->failed = 1;
+        }
+        b->out = buf.io.buffer.ptr;
+
+        pthread_mutex_lock(&saver.lock);
+        b->next = NULL;
+        if (saver.done_tail) saver.done_tail->next = b;
+        else saver.done_head = b;
+        saver.done_tail = b;
+        pthread_cond_signal(&saver.done_cond);
+    }
+    pthread_mutex_unlock(&saver.lock);
+    return NULL;
+}
+
+int numaRdbSaverStart(void) {
+    if (!server.numa_bgsave_per_node || server.in_fork_child == CHILD_TYPE_NONE ||
+        numa_available() < 0) return C_ERR;
+
+    memset(&saver, 0, sizeof(saver));
+    pthread_mutex_init(&saver.lock, NULL);
+    pthread_cond_init(&saver.done_cond, NULL);
+
+    int nodes = numa_max_node() + 1;
+    if (nodes > NUMA_RDB_SAVER_MAX_NODES) nodes = NUMA_RDB_SAVER_MAX_NODES;
+    for (int j = 0; j < nodes; j++) {
+        saver_worker *w = &saver.workers[j];
+        w->node = j;
+        pthread_cond_init(&w->work_cond, NULL);
+        if (pthread_create(&w->thread, NULL, saver_thread, w) != 0) {
+            serverLog(LL_WARNING, "[NUMA RDB] can't create save threads, saving serially");
+            saver.nworkers = j;
+            saver.active = 1;
+            numaRdbSaverStop();
+            return C_ERR;
+        }
+        saver.nworkers++;
+    }
+    saver.active = 1;
+    serverLog(LL_NOTICE, "[NUMA RDB] saving with %d per-node thread(s)", saver.nworkers);
+    return C_OK;
+}
+
+/* ========== 派发与写出（仅主线程）========== */
+
+/* 写出一个已序列化的批次并释放 */
+static int saver_write_batch(rio *rdb, saver_batch *b) {
+    int ok = !b->failed && rioWrite(rdb, b->out, sdslen(b->out)) != 0;
+    sdsfree(b->out);
+    zfree(b);
+    saver.inflight--;
+    /* 流中的位置状态已由该批次决定，本线程下一个 key 需重新写出 */
+    rdbNumaPlacementReset();
+    return ok ? C_OK : C_ERR;
+}
+
+/* 写出已完成的批次；block 为 1 时至少等待并写出一个 */
+static int saver_write_done(rio *rdb, int block) {
+    while (1) {
+        pthread_mutex_lock(&saver.lock);
+        while (block && saver.done_head == NULL)
+            pthread_cond_wait(&saver.done_cond, &saver.lock);
+        saver_batch *list = saver.done_head;
+        saver.done_head = saver.done_tail = NULL;
+        pthread_mutex_unlock(&saver.lock);
+
+        if (list == NULL) return C_OK;
+        while (list) {
+            saver_batch *next = list->next;
+            if (saver_write_batch(rdb, list) == C_ERR) {
+                /* 剩余批次挂回完成队列，由 numaRdbSaverStop() 释放 */
+                pthread_mutex_lock(&saver.lock);
+                saver_batch *tail = next;
+                while (tail && tail->next) tail = tail->next;
+                if (next) {
+                    tail->next = saver.done_head;
+                    if (!saver.done_head) saver.done_tail = tail;
+                    saver.done_head = next;
+                }
+                pthread_mutex_unlock(&saver.lock);
+                return C_ERR;
+            }
+            list = next;
+        }
+        block = 0;
+    }
+}
+
+/* 把节点线程正在填充的批次加入其队列 */
+static void saver_dispatch(saver_worker *w) {
+    saver_batch *b = w->filling;
+    w->filling = NULL;
+    b->next = NULL;
+
+    pthread_mutex_lock(&saver.lock);
+    if (w->queue_tail) w->queue_tail->next = b;
+    else w->queue_head = b;
+    w->queue_tail = b;
+    saver.inflight++;
+    pthread_cond_signal(&w->work_cond);
+    pthread_mutex_unlock(&saver.lock);
+}
+
+int numaRdbSaverSaveKey(rio *rdb, sds key, robj *val, long long expire) {
+    int node = numaGetObjectNode(val);
+
+    if (node < 0 || node >= saver.nworkers || value_is_big(val)) {
+        robj keyobj;
+        initStaticStringObject(keyobj, key);
+        return rdbSaveKeyValuePair(rdb, &keyobj, val, expire) == -1 ? C_ERR : C_OK;
+    }
+
+    saver_worker *w = &saver.workers[node];
+    if (!w->filling) w->filling = zcalloc(sizeof(saver_batch));
+    saver_batch *b = w->filling;
+    b->keys[b->count].key = key;
+    b->keys[b->count].val = val;
+    b->keys[b->count].expire = expire;
+    if (++b->count == NUMA_RDB_SAVER_BATCH_KEYS) saver_dispatch(w);
+
+    /* 在途批次达到上限时等待写出，否则只写出已完成的 */
+    int block = saver.inflight >= saver.nworkers * NUMA_RDB_SAVER_INFLIGHT;
+    return saver_write_done(rdb, block);
+}
+
+int numaRdbSaverFlush(rio *rdb) {
+    for (int j = 0; j < saver.nworkers; j++) {
+        if (saver.workers[j].filling) saver_dispatch(&saver.workers[j]);
+    }
+    while (saver.inflight > 0) {
+        if (saver_write_done(rdb, 1) == C_ERR) return C_ERR;
+    }
+    return C_OK;
+}
+
+static void saver_free_list(saver_batch *b) {
+    while (b) {
+        saver_batch *next = b->next;
+        sdsfree(b->out);
+        zfree(b);
+        b = next;
+    }
+}
+
+void numaRdbSaverStop(void) {
+    if (!saver.active) return;
+
+    pthread_mutex_lock(&saver.lock);
+    saver.shutdown = 1;
+    for (int j = 0; j < saver.nworkers; j++)
+        pthread_cond_signal(&saver.workers[j].work_cond);
+    pthread_mutex_unlock(&saver.lock);
+
+    for (int j = 0; j < saver.nworkers; j++) {
+        saver_worker *w = &saver.workers[j];
+        pthread_join(w->thread, NULL);
+        saver_free_list(w->queue_head);
+        saver_free_list(w->filling);
+        pthread_cond_destroy(&w->work_cond);
+    }
+    saver_free_list(saver.done_head);
+    pthread_mutex_destroy(&saver.lock);
+    pthread_cond_destroy(&saver.done_cond);
+    saver.active = 0;
+}
+
+#else /* !HAVE_NUMA */
+
+/* ========== NUMA 未启用时的空实现 ========== */
+
+int numaRdbSaverStart(void) { return C_ERR; }
+int numaRdbSaverSaveKey(rio *rdb, sds key, robj *val, long long expire) {
+    (void)rdb; (void)key; (void)val; (void)expire;
+    return C_ERR;
+}
+int numaRdbSaverFlush(rio *rdb) { (void)rdb; return C_OK; }
+void numaRdbSaverStop(void) {}
+
+#endif /* HAVE_NUMA */
@@ -0,0 +1,37 @@
+/* numa_rdb_saver.h - 快照子进程的按节点并行序列化
+ *
+ * 串行保存时子进程的单个线程读取所有节点上的值，远端节点的数据受跨
+ * socket 带宽限制。启用 numa-bgsave-per-node 后，子进程为每个 NUMA 节点
+ * 启动一个序列化线程（绑定到该节点的 CPU，纯内存节点使用最近的有 CPU
+ * 节点）：主线程遍历字典，按值主体的 PREFIX node_id 把 key 派发给对应
+ * 节点的线程，线程把整批 key 序列化到内存缓冲，主线程再把缓冲依次写入
+ * 同一个 RDB 流。
+ *
+ * 同一数据库内 key 的顺序不影响加载，因此输出仍是普通的单文件 RDB。
+ * 模块类型的值与特别大的值由主线程直接写出（前者的回调不保证线程安全，
+ * 后者避免在内存中再复制一份）。
+ */
+#ifndef NUMA_RDB_SAVER_H
+#define NUMA_RDB_SAVER_H
+
+#include "sds.h"
+
+struct _rio;
+struct redisObject;
+
+#define NUMA_RDB_SAVER_MAX_NODES 16
+
+/* 在子进程中启动各节点的序列化线程；未启用或不在子进程中返回 C_ERR */
+int numaRdbSaverStart(void);
+
+/* 保存一个 key：派发给值所在节点的线程，或由本线程直接写入 rdb。
+ * 写入失败返回 C_ERR。 */
+int numaRdbSaverSaveKey(struct _rio *rdb, sds key, struct redisObject *val, long long expire);
+
+/* 等待已派发的 key 全部序列化并写入 rdb（切换数据库前与保存结束时调用）*/
+int numaRdbSaverFlush(struct _rio *rdb);
+
+/* 停止序列化线程并丢弃未写出的数据 */
+void numaRdbSaverStop(void);
+
+#endif /* NUMA_RDB_SAVER_H */
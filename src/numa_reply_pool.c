@@ -0,0 +1,133 @@
+/* numa_reply_pool.c - 每节点回复块回收池实现
+ *
+ * 空闲块通过块首的指针串成单链表（块内容此时无用）。取块与放回都在
+ * 对应节点的锁内完成，临界区只有几次指针操作。
+ *
+ * Copyright (c) 2024, Redis-CXL Project
+ */
+
+#include "server.h"
+#include "numa_reply_pool.h"
+
+#ifdef HAVE_NUMA
+
+#include <numa.h>
+#include <sched.h>
+
+#define NUMA_REPLY_BLOCK_SIZE (sizeof(clientReplyBlock) + PROTO_REPLY_CHUNK_BYTES)
+
+typedef struct {
+    pthread_mutex_t lock;
+    void *free_list;
+    long long blocks;
+    long long hits;
+    long long misses;
+    long long recycled;
+} reply_pool_t;
+
+static reply_pool_t pools[NUMA_ACCT_MAX_NODES];
+static int pool_nodes = 0;
+
+void numaReplyPoolInit(void) {
+    if (numa_available() < 0) return;
+    pool_nodes = numa_max_node() + 1;
+    if (pool_nodes > NUMA_ACCT_MAX_NODES) pool_nodes = NUMA_ACCT_MAX_NODES;
+    for (int j = 0; j < pool_nodes; j++) {
+        memset(&pools[j], 0, sizeof(pools[j]));
+        pthread_mutex_init(&pools[j].lock, NULL);
+    }
+}
+
+void *numaReplyPoolGet(int node) {
+    if (server.numa_reply_pool_blocks <= 0 || pool_nodes == 0) return NULL;
+    if (node < 0) {
+        int cpu = sched_getcpu();
+        node = cpu >= 0 ? numa_node_of_cpu(cpu) : -1;
+    }
+    if (node < 0 || node >= pool_nodes) return NULL;
+
+    reply_pool_t *p = &pools[node];
+    pthread_mutex_lock(&p->lock);
+    void *block = p->free_list;
+    if (block) {
+        p->free_list = *(void **)block;
+        p->blocks--;
+        p->hits++;
+    } else {
+        p->misses++;
+    }
+    pthread_mutex_unlock(&p->lock);
+    return block;
+}
+
+int numaReplyPoolPut(void *block) {
+    if (server.numa_reply_pool_blocks <= 0 || pool_nodes == 0) return 0;
+    if (zmalloc_usable_size(block) != NUMA_REPLY_BLOCK_SIZE) return 0;
+    int node = numa_get_node_id(block);
+    if (node < 0 || node >= pool_nodes) return 0;
+
+    reply_pool_t *p = &pools[node];
+    pthread_mutex_lock(&p->lock);
+    if (p->blocks >= server.numa_reply_pool_blocks) {
+        pthread_mutex_unlock(&p->lock);
+        return 0;
+    }
+    *(void **)block = p->free_list;
+    p->free_list = block;
+    p->blocks++;
+    p->recycled++;
+    pthread_mutex_unlock(&p->lock);
+    return 1;
+}
+
+void numaReplyPoolTrim(void) {
+    for (int j = 0; j < pool_nodes; j++) {
+        reply_pool_t *p = &pools[j];
+        void *list = NULL;
+
+        /* 超出上限的块摘下后在锁外释放 */
+        pthread_mutex_lock(&p->lock);
+        while (p->blocks > server.numa_reply_pool_blocks) {
+            void *block = p->free_list;
+            p->free_list = *(void **)block;
+            *(void **)block = list;
+            list = block;
+            p->blocks--;
+        }
+        pthread_mutex_unlock(&p->lock);
+
+        while (list) {
+            void *next = *(void **)list;
+            zfree(list);
+            list = next;
+        }
+    }
+}
+
+int numaReplyPoolGetStats(int node, numa_reply_pool_stats_t *out) {
+    if (node < 0 || node >= pool_nodes) return -1;
+    reply_pool_t *p = &pools[node];
+    pthread_mutex_lock(&p->lock);
+    out->blocks = p->blocks;
+    out->bytes = (size_t)p->blocks * NUMA_REPLY_BLOCK_SIZE;
+    out->hits = p->hits;
+    out->misses = p->misses;
+    out->recycled = p->recycled;
+    pthread_mutex_unlock(&p->lock);
+    return 0;
+}
+
+#else /* !HAVE_NUMA */
+
+/* ========== NUMA 未启用时的空实现 ========== */
+
+void numaReplyPoolInit(void) {}
+void *numaReplyPoolGet(int node) { (void)node; return NULL; }
+int numaReplyPoolPut(void *block) { (void)block; return 0; }
+void numaReplyPoolTrim(void) {}
+int numaReplyPoolGetStats(int node, numa_reply_pool_stats_t *out) {
+    (void)node; (void)out;
+    return -1;
+}
+
+#endif /* HAVE_NUMA */
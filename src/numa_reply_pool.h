@@ -0,0 +1,43 @@
+/* numa_reply_pool.h - 每节点回复块回收池
+ *
+ * 客户端回复链表中的块（clientReplyBlock）大多是 PROTO_REPLY_CHUNK_BYTES
+ * 的定长块，NUMA 构建下这种大小的分配每次都走 numa_alloc_onnode()。启用
+ * numa-reply-pool-blocks 后，写完释放的定长块按其所在节点放回该节点的
+ * 空闲链表，下次为同一节点的客户端分配回复块时直接复用，不再经过通用
+ * 分配器。
+ *
+ * 只回收恰好为定长块大小的块（被 trimReplyUnusedTailSpace() 收缩或超长
+ * 回复的块照常释放）。池中的块仍计入 used_memory，每节点最多保留
+ * numa-reply-pool-blocks 个。释放可能发生在 io 线程，每节点一把锁。
+ */
+#ifndef NUMA_REPLY_POOL_H
+#define NUMA_REPLY_POOL_H
+
+#include <stddef.h>
+
+#define NUMA_REPLY_POOL_MAX_BLOCKS 65536
+
+typedef struct {
+    long long blocks;           /* 池中空闲块数 */
+    size_t bytes;               /* 池中空闲块占用的内存 */
+    long long hits;             /* 从池中取到块的次数 */
+    long long misses;           /* 池空、改由分配器分配的次数 */
+    long long recycled;         /* 放回池中的块数 */
+} numa_reply_pool_stats_t;
+
+/* 初始化各节点的池（启动时主线程调用一次） */
+void numaReplyPoolInit(void);
+
+/* 为节点 node 上的客户端取一个定长回复块（node 为 -1 时取当前 CPU 所在
+ * 节点）；未启用或池空返回 NULL，由调用方分配 */
+void *numaReplyPoolGet(int node);
+
+/* 回收一个回复块：放回其所在节点的池返回 1，不满足条件返回 0（调用方释放） */
+int numaReplyPoolPut(void *block);
+
+/* 把每个池裁剪到 numa-reply-pool-blocks（配置变更时调用） */
+void numaReplyPoolTrim(void);
+
+int numaReplyPoolGetStats(int node, numa_reply_pool_stats_t *out);
+
+#endif /* NUMA_REPLY_POOL_H */
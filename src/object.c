@@ -83,7 +83,14 @@ robj *createRawStringObject(const char *ptr, size_t len) {
  * an object where the sds string is actually an unmodifiable string
  * allocated in the same chunk as the object itself. */
 robj *createEmbeddedStringObject(const char *ptr, size_t len) {
-    robj *o = zmalloc(sizeof(robj)+sizeof(struct sdshdr8)+len+1);
+    return initEmbeddedStringObject(zmalloc(sizeof(robj)+sizeof(struct sdshdr8)+len+1),ptr,len);
+}
+
+/* Initialize an EMBSTR object in 'block', which must be at least
+ * sizeof(robj)+sizeof(struct sdshdr8)+len+1 bytes. Used to reuse the
+ * allocation of an object that is no longer referenced. */
+robj *initEmbeddedStringObject(void *block, const char *ptr, size_t len) {
+    robj *o = block;
     struct sdshdr8 *sh = (void*)(o+1);
 
     o->type = OBJ_STRING;
@@ -256,9 +263,9 @@ robj *createIntsetObject(void) {
 }
 
 robj *createHashObject(void) {
-    unsigned char *zl = ziplistNew();
+    unsigned char *zl = lpNew(0);
     robj *o = createObject(OBJ_HASH, zl);
-    o->encoding = OBJ_ENCODING_ZIPLIST;
+    o->encoding = OBJ_ENCODING_LISTPACK;
     return o;
 }
 
@@ -268,15 +275,16 @@ robj *createZsetObject(void) {
 
     zs->dict = dictCreate(&zsetDictType,NULL);
     zs->zsl = zslCreate();
+    zs->zbt = NULL;
     o = createObject(OBJ_ZSET,zs);
     o->encoding = OBJ_ENCODING_SKIPLIST;
     return o;
 }
 
-robj *createZsetZiplistObject(void) {
-    unsigned char *zl = ziplistNew();
-    robj *o = createObject(OBJ_ZSET,zl);
-    o->encoding = OBJ_ENCODING_ZIPLIST;
+robj *createZsetListpackObject(void) {
+    unsigned char *lp = lpNew(0);
+    robj *o = createObject(OBJ_ZSET,lp);
+    o->encoding = OBJ_ENCODING_LISTPACK;
     return o;
 }
 
@@ -327,10 +335,10 @@ void freeZsetObject(robj *o) {
     case OBJ_ENCODING_SKIPLIST:
         zs = o->ptr;
         dictRelease(zs->dict);
-        zslFree(zs->zsl);
+        zsetIndexFree(zs);
         zfree(zs);
         break;
-    case OBJ_ENCODING_ZIPLIST:
+    case OBJ_ENCODING_LISTPACK:
         zfree(o->ptr);
         break;
     default:
@@ -343,7 +351,7 @@ void freeHashObject(robj *o) {
     case OBJ_ENCODING_HT:
         dictRelease((dict*) o->ptr);
         break;
-    case OBJ_ENCODING_ZIPLIST:
+    case OBJ_ENCODING_LISTPACK:
         zfree(o->ptr);
         break;
     default:
@@ -376,6 +384,13 @@ void incrRefCount(robj *o) {
 
 void decrRefCount(robj *o) {
     if (o->refcount == 1) {
+#ifdef HAVE_NUMA
+        if (o->encoding == OBJ_ENCODING_NUMA_COLD) {
+            numaColdFree(o);
+            zfree(o);
+            return;
+        }
+#endif
         switch(o->type) {
         case OBJ_STRING: freeStringObject(o); break;
         case OBJ_LIST: freeListObject(o); break;
@@ -771,6 +786,8 @@ char *strEncoding(int encoding) {
     case OBJ_ENCODING_SKIPLIST: return "skiplist";
     case OBJ_ENCODING_EMBSTR: return "embstr";
     case OBJ_ENCODING_STREAM: return "stream";
+    case OBJ_ENCODING_NUMA_COLD: return "numa-cold";
+    case OBJ_ENCODING_LISTPACK: return "listpack";
     default: return "unknown";
     }
 }
@@ -805,7 +822,6 @@ size_t streamRadixTreeMemoryUsage(rax *rax) {
  * Note that the returned value is just an approximation, especially in the
  * case of aggregated data types where only "sample_size" elements
  * are checked and averaged to estimate the total size. */
-#define OBJ_COMPUTE_SIZE_DEF_SAMPLES 5 /* Default sample size. */
 size_t objectComputeSize(robj *o, size_t sample_size) {
     sds ele, ele2;
     dict *d;
@@ -813,6 +829,11 @@ size_t objectComputeSize(robj *o, size_t sample_size) {
     struct dictEntry *de;
     size_t asize = 0, elesize = 0, samples = 0;
 
+#ifdef HAVE_NUMA
+    if (o->encoding == OBJ_ENCODING_NUMA_COLD)
+        return numaColdBlobSize(o)+sizeof(*o);
+#endif
+
     if (o->type == OBJ_STRING) {
         if(o->encoding == OBJ_ENCODING_INT) {
             asize = sizeof(*o);
@@ -857,28 +878,43 @@ size_t objectComputeSize(robj *o, size_t sample_size) {
             serverPanic("Unknown set encoding");
         }
     } else if (o->type == OBJ_ZSET) {
-        if (o->encoding == OBJ_ENCODING_ZIPLIST) {
-            asize = sizeof(*o)+(ziplistBlobLen(o->ptr));
+        if (o->encoding == OBJ_ENCODING_LISTPACK) {
+            asize = sizeof(*o)+(lpBytes(o->ptr));
         } else if (o->encoding == OBJ_ENCODING_SKIPLIST) {
-            d = ((zset*)o->ptr)->dict;
-            zskiplist *zsl = ((zset*)o->ptr)->zsl;
-            zskiplistNode *znode = zsl->header->level[0].forward;
-            asize = sizeof(*o)+sizeof(zset)+sizeof(zskiplist)+sizeof(dict)+
-                    (sizeof(struct dictEntry*)*dictSlots(d))+
-                    zmalloc_size(zsl->header);
-            while(znode != NULL && samples < sample_size) {
-                elesize += sdsZmallocSize(znode->ele);
-                elesize += sizeof(struct dictEntry) + zmalloc_size(znode);
-                samples++;
-                znode = znode->level[0].forward;
+            zset *zs = o->ptr;
+            d = zs->dict;
+            asize = sizeof(*o)+sizeof(zset)+sizeof(dict)+
+                    (sizeof(struct dictEntry*)*dictSlots(d));
+            if (zs->zsl) {
+                zskiplist *zsl = zs->zsl;
+                zskiplistNode *znode = zsl->header->level[0].forward;
+                asize += sizeof(zskiplist)+zmalloc_size(zsl->header);
+                while(znode != NULL && samples < sample_size) {
+                    elesize += sdsZmallocSize(znode->ele);
+                    elesize += sizeof(struct dictEntry) + zmalloc_size(znode);
+                    samples++;
+                    znode = znode->level[0].forward;
+                }
+            } else {
+                zsetCursor zc;
+                /* B+tree nodes are counted as a whole, only the elements
+                 * are sampled. */
+                asize += zbtAllocSize(zs->zbt);
+                zsetIndexFirst(zs,&zc);
+                while(zsetCursorValid(&zc) && samples < sample_size) {
+                    elesize += sdsZmallocSize(zsetCursorEle(&zc));
+                    elesize += sizeof(struct dictEntry);
+                    samples++;
+                    zsetCursorNext(&zc);
+                }
             }
             if (samples) asize += (double)elesize/samples*dictSize(d);
         } else {
             serverPanic("Unknown sorted set encoding");
         }
     } else if (o->type == OBJ_HASH) {
-        if (o->encoding == OBJ_ENCODING_ZIPLIST) {
-            asize = sizeof(*o)+(ziplistBlobLen(o->ptr));
+        if (o->encoding == OBJ_ENCODING_LISTPACK) {
+            asize = sizeof(*o)+(lpBytes(o->ptr));
         } else if (o->encoding == OBJ_ENCODING_HT) {
             d = o->ptr;
             di = dictGetIterator(d);
@@ -1055,14 +1091,12 @@ struct redisMemOverhead *getMemoryOverheadData(void) {
         mh->db = zrealloc(mh->db,sizeof(mh->db[0])*(mh->num_dbs+1));
         mh->db[mh->num_dbs].dbid = j;
 
-        mem = dictSize(db->dict) * sizeof(dictEntry) +
-              dictSlots(db->dict) * sizeof(dictEntry*) +
+        mem = dictMemUsage(db->dict) +
               dictSize(db->dict) * sizeof(robj);
         mh->db[mh->num_dbs].overhead_ht_main = mem;
         mem_total+=mem;
 
-        mem = dictSize(db->expires) * sizeof(dictEntry) +
-              dictSlots(db->expires) * sizeof(dictEntry*);
+        mem = dictMemUsage(db->expires);
         mh->db[mh->num_dbs].overhead_ht_expires = mem;
         mem_total+=mem;
 
@@ -1354,8 +1388,12 @@ NULL
             return;
         }
         size_t usage = objectComputeSize(dictGetVal(de),samples);
-        usage += sdsZmallocSize(dictGetKey(de));
-        usage += sizeof(dictEntry);
+        if (dictEmbedsKey(c->db->dict,dictGetKey(de))) {
+            usage += zmalloc_size(de);
+        } else {
+            usage += sdsZmallocSize(dictGetKey(de));
+            usage += sizeof(dictEntry);
+        }
         addReplyLongLong(c,usage);
     } else if (!strcasecmp(c->argv[1]->ptr,"stats") && c->argc == 2) {
         struct redisMemOverhead *mh = getMemoryOverheadData();
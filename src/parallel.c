@@ -0,0 +1,291 @@
+/* parallel.c - Fork-join worker pool for CPU bound command phases
+ *
+ * The pool threads sleep on a condition variable and are woken up for every
+ * batch of jobs published by parallelRun(). Jobs are handed out one at a
+ * time under the pool lock: batches have at most a few jobs per thread, each
+ * one processing a large slice of the input, so contention is irrelevant.
+ * The main thread executes jobs as well, then waits for the others.
+ *
+ * The pool is resized on the next parallelRun() after parallel-ops-threads
+ * is changed with CONFIG SET.
+ *
+ * Copyright (c) 2024, Redis-CXL Project
+ */
+
+#include "server.h"
+#include "parallel.h"
+
+static struct {
+    int nworkers;
+    pthread_t threads[PARALLEL_MAX_THREADS];
+    pthread_mutex_t lock;
+    pthread_cond_t work_cond;   /* A new batch was published. */
+    pthread_cond_t done_cond;   /* The last job of the batch completed. */
+    unsigned long batch;        /* Incremented by every parallelRun(). */
+    parallelJob *job;
+    void *privdata;
+    int njobs, next, done;
+    int shutdown;
+} pool = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .work_cond = PTHREAD_COND_INITIALIZER,
+    .done_cond = PTHREAD_COND_INITIALIZER
+};
+
+/* Execute jobs of the current batch until none is left to start. Called and
+ * returns with the pool lock held. */
+static void parallelConsume(void) {
+    parallelJob *job = pool.job;
+    void *privdata = pool.privdata;
+
+    while (pool.next < pool.njobs) {
+        int idx = pool.next++;
+        pthread_mutex_unlock(&pool.lock);
+        job(privdata,idx);
+        pthread_mutex_lock(&pool.lock);
+        if (++pool.done == pool.njobs) pthread_cond_signal(&pool.done_cond);
+    }
+}
+
+static void *parallelThreadMain(void *arg) {
+    long id = (long)arg;
+    char thdname[16];
+    unsigned long seen;
+
+    snprintf(thdname, sizeof(thdname), "par_thd_%ld", id);
+    redis_set_thread_title(thdname);
+    redisSetCpuAffinity(server.server_cpulist);
+    makeThreadKillable();
+
+    pthread_mutex_lock(&pool.lock);
+    seen = pool.batch;
+    while (1) {
+        while (!pool.shutdown && pool.batch == seen)
+            pthread_cond_wait(&pool.work_cond,&pool.lock);
+        if (pool.shutdown) break;
+        seen = pool.batch;
+        parallelConsume();
+    }
+    pthread_mutex_unlock(&pool.lock);
+    return NULL;
+}
+
+static void parallelStart(int nworkers) {
+    for (int j = 0; j < nworkers; j++) {
+        if (pthread_create(&pool.threads[j],NULL,parallelThreadMain,(void*)(long)j) != 0) {
+            serverLog(LL_WARNING,
+                "Can't create parallel ops thread %d, using %d thread(s)", j, j+1);
+            break;
+        }
+        pool.nworkers++;
+    }
+}
+
+void parallelStop(void) {
+    if (pool.nworkers == 0) return;
+
+    pthread_mutex_lock(&pool.lock);
+    pool.shutdown = 1;
+    pthread_cond_broadcast(&pool.work_cond);
+    pthread_mutex_unlock(&pool.lock);
+    for (int j = 0; j < pool.nworkers; j++)
+        pthread_join(pool.threads[j],NULL);
+    pool.nworkers = 0;
+    pool.shutdown = 0;
+}
+
+int parallelThreadsNum(void) {
+    int n = server.parallel_ops_threads;
+    if (n < 1) return 1;
+    return n > PARALLEL_MAX_THREADS ? PARALLEL_MAX_THREADS : n;
+}
+
+void parallelRun(parallelJob *job, void *privdata, int njobs) {
+    int wanted = parallelThreadsNum()-1;
+
+    if (wanted != pool.nworkers) {
+        parallelStop();
+        parallelStart(wanted);
+    }
+
+    if (pool.nworkers == 0 || njobs == 1) {
+        for (int j = 0; j < njobs; j++) job(privdata,j);
+        return;
+    }
+
+    pthread_mutex_lock(&pool.lock);
+    pool.job = job;
+    pool.privdata = privdata;
+    pool.njobs = njobs;
+    pool.next = 0;
+    pool.done = 0;
+    pool.batch++;
+    pthread_cond_broadcast(&pool.work_cond);
+    parallelConsume();
+    while (pool.done < pool.njobs)
+        pthread_cond_wait(&pool.done_cond,&pool.lock);
+    pthread_mutex_unlock(&pool.lock);
+}
+
+/* ---------------------------- Parallel sort ------------------------------- */
+
+typedef int parallelCompare(const void *, const void *);
+
+typedef struct {
+    char *base;
+    size_t size;
+    parallelCompare *cmp;
+    size_t *bounds;             /* Run i is [bounds[i], bounds[i+1]). */
+    struct mergeTask {
+        char *a, *b, *out;      /* Runs to merge and their destination. */
+        size_t alen, blen;
+        size_t from, to;        /* Slice of the output of this task. */
+    } *tasks;
+} sortJob;
+
+static void sortRunJob(void *privdata, int idx) {
+    sortJob *sj = privdata;
+    size_t start = sj->bounds[idx], end = sj->bounds[idx+1];
+    qsort(sj->base+start*sj->size,end-start,sj->size,sj->cmp);
+}
+
+/* Number of elements of 'a' among the first k elements of the stable merge
+ * of a and b: the smallest i such that a[i] sorts after b[k-i-1]. */
+static size_t mergeSplit(struct mergeTask *t, size_t k, size_t size,
+                         parallelCompare *cmp)
+{
+    size_t lo = k > t->blen ? k-t->blen : 0;
+    size_t hi = k < t->alen ? k : t->alen;
+
+    while (lo < hi) {
+        size_t i = lo+(hi-lo)/2, j = k-i;
+        if (j > 0 && cmp(t->a+i*size,t->b+(j-1)*size) <= 0)
+            lo = i+1;
+        else
+            hi = i;
+    }
+    return lo;
+}
+
+static void sortMergeJob(void *privdata, int idx) {
+    sortJob *sj = privdata;
+    struct mergeTask *t = &sj->tasks[idx];
+    size_t size = sj->size;
+    size_t i = mergeSplit(t,t->from,size,sj->cmp), j = t->from-i;
+    size_t iend = mergeSplit(t,t->to,size,sj->cmp), jend = t->to-iend;
+    char *out = t->out+t->from*size;
+
+    while (i < iend && j < jend) {
+        if (sj->cmp(t->a+i*size,t->b+j*size) <= 0) {
+            memcpy(out,t->a+i*size,size);
+            i++;
+        } else {
+            memcpy(out,t->b+j*size,size);
+            j++;
+        }
+        out += size;
+    }
+    memcpy(out,t->a+i*size,(iend-i)*size);
+    out += (iend-i)*size;
+    memcpy(out,t->b+j*size,(jend-j)*size);
+}
+
+/* Sort like qsort(), using the pool: every thread sorts a slice of the
+ * array, then sorted runs are merged pairwise. Merges are split in slices
+ * too, so that the last ones, having only one or two runs left to merge,
+ * still use all the threads. */
+void parallelSort(void *base, size_t nmemb, size_t size, parallelCompare *cmp) {
+    int nthreads = parallelThreadsNum();
+    int nruns = nthreads;
+    sortJob sj;
+
+    if (nthreads == 1 || nmemb < (size_t)nthreads*2) {
+        qsort(base,nmemb,size,cmp);
+        return;
+    }
+
+    sj.base = base;
+    sj.size = size;
+    sj.cmp = cmp;
+    sj.bounds = zmalloc(sizeof(size_t)*(nruns+1));
+    sj.tasks = zmalloc(sizeof(struct mergeTask)*nthreads);
+    for (int j = 0; j <= nruns; j++) sj.bounds[j] = nmemb*j/nruns;
+    parallelRun(sortRunJob,&sj,nruns);
+
+    char *src = base, *dst = zmalloc(nmemb*size), *tmp = dst;
+    while (nruns > 1) {
+        int pairs = nruns/2, ntasks = 0;
+        int slices = nthreads/pairs > 1 ? nthreads/pairs : 1;
+
+        for (int p = 0; p < pairs; p++) {
+            size_t start = sj.bounds[2*p], mid = sj.bounds[2*p+1];
+            size_t end = sj.bounds[2*p+2];
+            for (int s = 0; s < slices; s++) {
+                struct mergeTask *t = &sj.tasks[ntasks++];
+                t->a = src+start*size;
+                t->alen = mid-start;
+                t->b = src+mid*size;
+                t->blen = end-mid;
+                t->out = dst+start*size;
+                t->from = (end-start)*s/slices;
+                t->to = (end-start)*(s+1)/slices;
+            }
+        }
+        parallelRun(sortMergeJob,&sj,ntasks);
+
+        /* An odd run left out is just carried over. */
+        if (nruns & 1) {
+            size_t start = sj.bounds[nruns-1];
+            memcpy(dst+start*size,src+start*size,(nmemb-start)*size);
+        }
+        for (int j = 0; j <= pairs; j++) sj.bounds[j] = sj.bounds[2*j];
+        sj.bounds[pairs+(nruns&1)] = nmemb;
+        nruns = pairs+(nruns&1);
+
+        char *swap = src;
+        src = dst;
+        dst = swap;
+    }
+    if (src != base) memcpy(base,src,nmemb*size);
+    zfree(tmp);
+    zfree(sj.tasks);
+    zfree(sj.bounds);
+}
+
+#ifdef REDIS_TEST
+#include <stdio.h>
+
+static int parallelTestCompare(const void *a, const void *b) {
+    long la = *(const long*)a, lb = *(const long*)b;
+    return (la > lb) - (la < lb);
+}
+
+int parallelTest(int argc, char *argv[], int accurate) {
+    UNUSED(argc);
+    UNUSED(argv);
+    size_t sizes[] = {0, 1, 7, 100, 4097, 100000, accurate ? 5000000 : 300000};
+    int threads[] = {1, 2, 3, 4, 8};
+
+    for (unsigned t = 0; t < sizeof(threads)/sizeof(threads[0]); t++) {
+        server.parallel_ops_threads = threads[t];
+        printf("parallel: sort with %d thread(s)\n", threads[t]);
+        for (unsigned s = 0; s < sizeof(sizes)/sizeof(sizes[0]); s++) {
+            size_t n = sizes[s];
+            long *a = zmalloc(sizeof(long)*(n+1)), *b = zmalloc(sizeof(long)*(n+1));
+            for (size_t j = 0; j < n; j++) a[j] = b[j] = rand() % (n/4+1);
+            qsort(a,n,sizeof(long),parallelTestCompare);
+            parallelSort(b,n,sizeof(long),parallelTestCompare);
+            if (n && memcmp(a,b,sizeof(long)*n) != 0) {
+                printf("parallel: sort of %zu elements differs from qsort\n", n);
+                return 1;
+            }
+            zfree(a);
+            zfree(b);
+        }
+    }
+    parallelStop();
+    server.parallel_ops_threads = 1;
+    printf("parallel: all tests passed\n");
+    return 0;
+}
+#endif
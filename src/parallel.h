@@ -0,0 +1,46 @@
+/* parallel.h - Fork-join worker pool for CPU bound command phases
+ *
+ * Commands like SORT or ZUNIONSTORE on millions of elements spend seconds in
+ * pure computation (parsing scores, comparing, aggregating) over values that
+ * nothing else can touch while the command runs. parallelRun() splits such a
+ * phase in jobs that are executed by a pool of parallel-ops-threads threads,
+ * the main thread included: the main thread returns only once every job is
+ * done, so the command is still atomic and is replicated as usual.
+ *
+ * Jobs must not touch the keyspace, reply to clients, or modify the values
+ * they read. Dicts they look up must have rehashing paused by the caller,
+ * since a lookup would otherwise perform a rehashing step.
+ *
+ * Copyright (c) 2024, Redis-CXL Project
+ */
+
+#ifndef __PARALLEL_H
+#define __PARALLEL_H
+
+#include <stddef.h>
+
+#define PARALLEL_MAX_THREADS 64
+
+typedef void parallelJob(void *privdata, int idx);
+
+/* Number of threads parallelRun() can use, main thread included: 1 when the
+ * pool is disabled. */
+int parallelThreadsNum(void);
+
+/* Run job(privdata, idx) for idx in [0, njobs) and return when all the jobs
+ * completed. Must be called by the main thread. */
+void parallelRun(parallelJob *job, void *privdata, int njobs);
+
+/* Sort like qsort() using the pool threads. The order of elements comparing
+ * equal may differ from the one qsort() would produce. */
+void parallelSort(void *base, size_t nmemb, size_t size,
+                  int (*cmp)(const void *, const void *));
+
+/* Terminate the pool threads (they are started again on demand). */
+void parallelStop(void);
+
+#ifdef REDIS_TEST
+int parallelTest(int argc, char *argv[], int accurate);
+#endif
+
+#endif
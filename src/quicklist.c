@@ -141,9 +141,18 @@ quicklist *quicklistNew(int fill, int compress) {
     return quicklist;
 }
 
-REDIS_STATIC quicklistNode *quicklistCreateNode(void) {
-    quicklistNode *node;
-    node = zmalloc(sizeof(*node));
+static quicklistNodePool *node_pool = NULL;
+
+/* Let 'pool' provide the quicklistNode structs and take back the ones that
+ * are no longer used (NULL to always use the allocator). */
+void quicklistSetNodePool(quicklistNodePool *pool) {
+    node_pool = pool;
+}
+
+REDIS_STATIC quicklistNode *quicklistCreateNode(const quicklist *quicklist) {
+    quicklistNode *node = NULL;
+    if (node_pool) node = node_pool->get(quicklist);
+    if (!node) node = zmalloc(sizeof(*node));
     node->zl = NULL;
     node->count = 0;
     node->sz = 0;
@@ -154,6 +163,11 @@ REDIS_STATIC quicklistNode *quicklistCreateNode(void) {
     return node;
 }
 
+/* Free a node struct whose ziplist was already freed or moved. */
+REDIS_STATIC void quicklistFreeNode(quicklistNode *node) {
+    if (!node_pool || !node_pool->put(node)) zfree(node);
+}
+
 /* Return cached quicklist count */
 unsigned long quicklistCount(const quicklist *ql) { return ql->count; }
 
@@ -170,7 +184,7 @@ void quicklistRelease(quicklist *quicklist) {
         zfree(current->zl);
         quicklist->count -= current->count;
 
-        zfree(current);
+        quicklistFreeNode(current);
 
         quicklist->len--;
         current = next;
@@ -498,7 +512,7 @@ int quicklistPushHead(quicklist *quicklist, void *value, size_t sz) {
             ziplistPush(quicklist->head->zl, value, sz, ZIPLIST_HEAD);
         quicklistNodeUpdateSz(quicklist->head);
     } else {
-        quicklistNode *node = quicklistCreateNode();
+        quicklistNode *node = quicklistCreateNode(quicklist);
         node->zl = ziplistPush(ziplistNew(), value, sz, ZIPLIST_HEAD);
 
         quicklistNodeUpdateSz(node);
@@ -522,7 +536,7 @@ int quicklistPushTail(quicklist *quicklist, void *value, size_t sz) {
             ziplistPush(quicklist->tail->zl, value, sz, ZIPLIST_TAIL);
         quicklistNodeUpdateSz(quicklist->tail);
     } else {
-        quicklistNode *node = quicklistCreateNode();
+        quicklistNode *node = quicklistCreateNode(quicklist);
         node->zl = ziplistPush(ziplistNew(), value, sz, ZIPLIST_TAIL);
 
         quicklistNodeUpdateSz(node);
@@ -533,11 +547,100 @@ int quicklistPushTail(quicklist *quicklist, void *value, size_t sz) {
     return (orig_tail != quicklist->tail);
 }
 
+/* Return how many of the 'count' values fit in a node of 'sz' bytes with
+ * 'entries' entries, starting from the first value, or from the last one if
+ * 'backward' is set. An empty node always takes at least one value. */
+REDIS_STATIC unsigned long _quicklistNodeBulkFit(size_t sz, unsigned int entries,
+                                                 int fill, unsigned int *sizes,
+                                                 unsigned long count,
+                                                 int backward) {
+    quicklistNode node;
+    unsigned long n;
+
+    node.sz = sz;
+    node.count = entries;
+    for (n = 0; n < count; n++) {
+        size_t vsz = sizes[backward ? count - 1 - n : n];
+        if (node.count && !_quicklistNodeAllowInsert(&node, fill, vsz))
+            break;
+        /* Same estimate _quicklistNodeAllowInsert() uses. */
+        node.sz += vsz + (vsz < 254 ? 1 : 5) +
+                   (vsz < 64 ? 1 : (vsz < 16384 ? 2 : 5));
+        node.count++;
+    }
+    return n;
+}
+
+/* Push 'count' values like calling quicklistPush() for each of them in
+ * order, so with QUICKLIST_HEAD the last value becomes the new head.
+ *
+ * The values that don't fit in the current head/tail node go in new nodes
+ * whose ziplist is built with a single allocation, instead of growing it one
+ * entry at a time. The 'values' and 'sizes' arrays may be reordered. */
+void quicklistPushBulk(quicklist *quicklist, int where, unsigned char **values,
+                       unsigned int *sizes, unsigned long count) {
+    quicklistNode *node;
+    unsigned long j = 0, n;
+    int fill = quicklist->fill;
+
+    if (where == QUICKLIST_TAIL) {
+        /* What fits in the tail node is appended with a single resize. */
+        node = quicklist->tail;
+        if (node && (n = _quicklistNodeBulkFit(node->sz, node->count, fill,
+                                               sizes, count, 0))) {
+            node->zl = ziplistAppendBulk(node->zl, values, sizes, n);
+            node->count += n;
+            quicklistNodeUpdateSz(node);
+            quicklist->count += n;
+            j = n;
+        }
+        while (j < count) {
+            n = _quicklistNodeBulkFit(0, 0, fill, sizes + j, count - j, 0);
+            node = quicklistCreateNode(quicklist);
+            node->zl = ziplistAppendBulk(NULL, values + j, sizes + j, n);
+            node->count = n;
+            quicklistNodeUpdateSz(node);
+            _quicklistInsertNodeAfter(quicklist, quicklist->tail, node);
+            quicklist->count += n;
+            j += n;
+        }
+    } else {
+        /* The head node takes the first values one at a time, each one
+         * becoming the new head. */
+        while (j < count &&
+               _quicklistNodeAllowInsert(quicklist->head, fill, sizes[j])) {
+            quicklistPushHead(quicklist, values[j], sizes[j]);
+            j++;
+        }
+
+        /* The others end up before it in reverse order: reverse them, then
+         * fill new nodes from the ones closest to the current head. */
+        for (unsigned long a = j, b = count - 1; j < count && a < b; a++, b--) {
+            unsigned char *v = values[a];
+            unsigned int sz = sizes[a];
+            values[a] = values[b];
+            sizes[a] = sizes[b];
+            values[b] = v;
+            sizes[b] = sz;
+        }
+        while (count > j) {
+            n = _quicklistNodeBulkFit(0, 0, fill, sizes + j, count - j, 1);
+            count -= n;
+            node = quicklistCreateNode(quicklist);
+            node->zl = ziplistAppendBulk(NULL, values + count, sizes + count, n);
+            node->count = n;
+            quicklistNodeUpdateSz(node);
+            _quicklistInsertNodeBefore(quicklist, quicklist->head, node);
+            quicklist->count += n;
+        }
+    }
+}
+
 /* Create new node consisting of a pre-formed ziplist.
  * Used for loading RDBs where entire ziplists have been stored
  * to be retrieved later. */
 void quicklistAppendZiplist(quicklist *quicklist, unsigned char *zl) {
-    quicklistNode *node = quicklistCreateNode();
+    quicklistNode *node = quicklistCreateNode(quicklist);
 
     node->zl = zl;
     node->count = ziplistLen(node->zl);
@@ -623,7 +726,7 @@ REDIS_STATIC void __quicklistDelNode(quicklist *quicklist,
     __quicklistCompress(quicklist, NULL);
 
     zfree(node->zl);
-    zfree(node);
+    quicklistFreeNode(node);
 }
 
 /* Delete one entry from list given the node for the entry and a pointer
@@ -817,11 +920,12 @@ REDIS_STATIC void _quicklistMergeNodes(quicklist *quicklist,
  * The input node keeps all elements not taken by the returned node.
  *
  * Returns newly created node or NULL if split not possible. */
-REDIS_STATIC quicklistNode *_quicklistSplitNode(quicklistNode *node, int offset,
+REDIS_STATIC quicklistNode *_quicklistSplitNode(quicklist *quicklist,
+                                                quicklistNode *node, int offset,
                                                 int after) {
     size_t zl_sz = node->sz;
 
-    quicklistNode *new_node = quicklistCreateNode();
+    quicklistNode *new_node = quicklistCreateNode(quicklist);
     new_node->zl = zmalloc(zl_sz);
 
     /* Copy original ziplist so we can split it */
@@ -863,7 +967,7 @@ REDIS_STATIC void _quicklistInsert(quicklist *quicklist, quicklistEntry *entry,
     if (!node) {
         /* we have no reference node, so let's create only node in the list */
         D("No node given!");
-        new_node = quicklistCreateNode();
+        new_node = quicklistCreateNode(quicklist);
         new_node->zl = ziplistPush(ziplistNew(), value, sz, ZIPLIST_HEAD);
         __quicklistInsertNode(quicklist, NULL, new_node, after);
         new_node->count++;
@@ -941,7 +1045,7 @@ REDIS_STATIC void _quicklistInsert(quicklist *quicklist, quicklistEntry *entry,
         /* If we are: full, and our prev/next is full, then:
          *   - create new node and attach to quicklist */
         D("\tprovisioning new node...");
-        new_node = quicklistCreateNode();
+        new_node = quicklistCreateNode(quicklist);
         new_node->zl = ziplistPush(ziplistNew(), value, sz, ZIPLIST_HEAD);
         new_node->count++;
         quicklistNodeUpdateSz(new_node);
@@ -951,7 +1055,7 @@ REDIS_STATIC void _quicklistInsert(quicklist *quicklist, quicklistEntry *entry,
         /* covers both after and !after cases */
         D("\tsplitting node...");
         quicklistDecompressNodeForUse(node);
-        new_node = _quicklistSplitNode(node, entry->offset, after);
+        new_node = _quicklistSplitNode(quicklist, node, entry->offset, after);
         new_node->zl = ziplistPush(new_node->zl, value, sz,
                                    after ? ZIPLIST_HEAD : ZIPLIST_TAIL);
         new_node->count++;
@@ -1214,7 +1318,7 @@ quicklist *quicklistDup(quicklist *orig) {
 
     for (quicklistNode *current = orig->head; current;
          current = current->next) {
-        quicklistNode *node = quicklistCreateNode();
+        quicklistNode *node = quicklistCreateNode(copy);
 
         if (current->encoding == QUICKLIST_NODE_ENCODING_LZF) {
             quicklistLZF *lzf = (quicklistLZF *)current->zl;
@@ -1806,6 +1910,71 @@ int quicklistTest(int argc, char *argv[], int accurate) {
             }
         }
 
+        TEST_DESC("bulk push matches single pushes at compress %d",
+                  options[_i]) {
+            unsigned char *vals[300];
+            unsigned int lens[300];
+            for (int i = 0; i < 300; i++) {
+                char *s = zmalloc(9000);
+                if (i % 3 == 0)
+                    lens[i] = snprintf(s, 9000, "%d", i * 1000 - 7);
+                else
+                    lens[i] = i == 200 ? 9000 : (i * 37) % 600;
+                if (i % 3) memset(s, 'a' + i % 26, lens[i]);
+                vals[i] = (unsigned char *)s;
+            }
+            for (int f = 0; f < fill_count; f++) {
+                for (int where = 0; where < 2; where++) {
+                    for (int pre = 0; pre < 10; pre += 3) {
+                        int pos = where ? QUICKLIST_TAIL : QUICKLIST_HEAD;
+                        quicklist *ref = quicklistNew(fills[f], options[_i]);
+                        quicklist *ql = quicklistNew(fills[f], options[_i]);
+                        for (int i = 0; i < pre; i++) {
+                            quicklistPush(ref, genstr("pre", i), 8, pos);
+                            quicklistPush(ql, genstr("pre", i), 8, pos);
+                        }
+                        unsigned char *bvals[300];
+                        unsigned int blens[300];
+                        memcpy(bvals, vals, sizeof(vals));
+                        memcpy(blens, lens, sizeof(lens));
+                        for (int i = 0; i < 300; i++)
+                            quicklistPush(ref, vals[i], lens[i], pos);
+                        quicklistPushBulk(ql, pos, bvals, blens, 300);
+                        ql_verify(ql, ql->len, ref->count, ql->head->count,
+                                  ql->tail->count);
+
+                        quicklistIter *a = quicklistGetIterator(ref, AL_START_HEAD);
+                        quicklistIter *b = quicklistGetIterator(ql, AL_START_HEAD);
+                        quicklistEntry ea, eb;
+                        while (quicklistNext(a, &ea)) {
+                            if (!quicklistNext(b, &eb) || ea.sz != eb.sz ||
+                                (ea.value ? memcmp(ea.value, eb.value, ea.sz)
+                                          : ea.longval != eb.longval))
+                                ERR("Bulk %s push differs at fill %d",
+                                    where ? "tail" : "head", fills[f]);
+                        }
+                        quicklistReleaseIterator(a);
+                        quicklistReleaseIterator(b);
+
+                        for (quicklistNode *n = ql->head; n; n = n->next) {
+                            if (fills[f] > 0 && (int)n->count > fills[f])
+                                ERR("Node holds %u entries at fill %d",
+                                    n->count, fills[f]);
+                            if (n->encoding == QUICKLIST_NODE_ENCODING_RAW &&
+                                (!ziplistValidateIntegrity(n->zl, n->sz, 1,
+                                                           NULL, NULL) ||
+                                 ziplistLen(n->zl) != n->count))
+                                ERR("Invalid bulk built node at fill %d",
+                                    fills[f]);
+                        }
+                        quicklistRelease(ref);
+                        quicklistRelease(ql);
+                    }
+                }
+            }
+            for (int i = 0; i < 300; i++) zfree(vals[i]);
+        }
+
         TEST("rotate empty") {
             quicklist *ql = quicklistNew(-2, options[_i]);
             quicklistRotate(ql);
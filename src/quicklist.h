@@ -148,17 +148,30 @@ typedef struct quicklistEntry {
 #define quicklistNodeIsCompressed(node)                                        \
     ((node)->encoding == QUICKLIST_NODE_ENCODING_LZF)
 
+/* Provider of quicklistNode structs, see quicklistSetNodePool(). */
+typedef struct quicklistNodePool {
+    /* Return a node struct for a new node of 'ql', or NULL to have it
+     * allocated with zmalloc(). */
+    quicklistNode *(*get)(const quicklist *ql);
+    /* Take back the struct of a freed node, returning 0 if it must be
+     * released with zfree() instead. May be called by any thread. */
+    int (*put)(quicklistNode *node);
+} quicklistNodePool;
+
 /* Prototypes */
 quicklist *quicklistCreate(void);
 quicklist *quicklistNew(int fill, int compress);
 void quicklistSetCompressDepth(quicklist *quicklist, int depth);
 void quicklistSetFill(quicklist *quicklist, int fill);
 void quicklistSetOptions(quicklist *quicklist, int fill, int depth);
+void quicklistSetNodePool(quicklistNodePool *pool);
 void quicklistRelease(quicklist *quicklist);
 int quicklistPushHead(quicklist *quicklist, void *value, const size_t sz);
 int quicklistPushTail(quicklist *quicklist, void *value, const size_t sz);
 void quicklistPush(quicklist *quicklist, void *value, const size_t sz,
                    int where);
+void quicklistPushBulk(quicklist *quicklist, int where, unsigned char **values,
+                       unsigned int *sizes, unsigned long count);
 void quicklistAppendZiplist(quicklist *quicklist, unsigned char *zl);
 quicklist *quicklistAppendValuesFromZiplist(quicklist *quicklist,
                                             unsigned char *zl);
@@ -32,6 +32,8 @@
 #include "zipmap.h"
 #include "endianconv.h"
 #include "stream.h"
+#include "numa_rdb_loader.h"
+#include "numa_rdb_saver.h"
 
 #include <math.h>
 #include <fcntl.h>
@@ -43,12 +45,18 @@
 #include <sys/stat.h>
 #include <sys/param.h>
 
+#ifdef HAVE_NUMA
+#include <numa.h>
+#endif
+
 /* This macro is called when the internal RDB structure is corrupt */
 #define rdbReportCorruptRDB(...) rdbReportError(1, __LINE__,__VA_ARGS__)
 /* This macro is called when RDB read failed (possibly a short read) */
 #define rdbReportReadError(...) rdbReportError(0, __LINE__,__VA_ARGS__)
 
 char* rdbFileBeingLoaded = NULL; /* used for rdb checking on read error */
+/* Record decoded by this loader thread, see rdbDecodeRecord(). */
+static __thread numaRdbRecord *rdbDecodingRecord = NULL;
 extern int rdbCheckMode;
 void rdbCheckError(const char *fmt, ...);
 void rdbCheckSetError(const char *fmt, ...);
@@ -61,6 +69,20 @@ void rdbReportError(int corruption_error, int linenum, char *reason, ...) {
     char msg[1024];
     int len;
 
+    if (rdbDecodingRecord) {
+        /* In a loader thread: reporting may terminate the server, so just
+         * record the first error, the main thread reports it. The caller
+         * returns the error as in the RESTORE case. */
+        if (!rdbDecodingRecord->errmsg) {
+            va_start(ap,reason);
+            rdbDecodingRecord->errmsg = sdscatvprintf(sdsempty(),reason,ap);
+            va_end(ap);
+            rdbDecodingRecord->errline = linenum;
+            rdbDecodingRecord->errcorrupt = corruption_error;
+        }
+        return;
+    }
+
     len = snprintf(msg,sizeof(msg),
         "Internal error in RDB reading offset %llu, function at rdb.c:%d -> ",
         (unsigned long long)server.loading_loaded_bytes, linenum);
@@ -680,15 +702,15 @@ int rdbSaveObjectType(rio *rdb, robj *o) {
         else
             serverPanic("Unknown set encoding");
     case OBJ_ZSET:
-        if (o->encoding == OBJ_ENCODING_ZIPLIST)
-            return rdbSaveType(rdb,RDB_TYPE_ZSET_ZIPLIST);
+        if (o->encoding == OBJ_ENCODING_LISTPACK)
+            return rdbSaveType(rdb,RDB_TYPE_ZSET_LISTPACK);
         else if (o->encoding == OBJ_ENCODING_SKIPLIST)
             return rdbSaveType(rdb,RDB_TYPE_ZSET_2);
         else
             serverPanic("Unknown sorted set encoding");
     case OBJ_HASH:
-        if (o->encoding == OBJ_ENCODING_ZIPLIST)
-            return rdbSaveType(rdb,RDB_TYPE_HASH_ZIPLIST);
+        if (o->encoding == OBJ_ENCODING_LISTPACK)
+            return rdbSaveType(rdb,RDB_TYPE_HASH_LISTPACK);
         else if (o->encoding == OBJ_ENCODING_HT)
             return rdbSaveType(rdb,RDB_TYPE_HASH);
         else
@@ -872,16 +894,16 @@ ssize_t rdbSaveObject(rio *rdb, robj *o, robj *key) {
         }
     } else if (o->type == OBJ_ZSET) {
         /* Save a sorted set value */
-        if (o->encoding == OBJ_ENCODING_ZIPLIST) {
-            size_t l = ziplistBlobLen((unsigned char*)o->ptr);
+        if (o->encoding == OBJ_ENCODING_LISTPACK) {
+            size_t l = lpBytes((unsigned char*)o->ptr);
 
             if ((n = rdbSaveRawString(rdb,o->ptr,l)) == -1) return -1;
             nwritten += n;
         } else if (o->encoding == OBJ_ENCODING_SKIPLIST) {
             zset *zs = o->ptr;
-            zskiplist *zsl = zs->zsl;
+            zsetCursor zc;
 
-            if ((n = rdbSaveLen(rdb,zsl->length)) == -1) return -1;
+            if ((n = rdbSaveLen(rdb,zsetIndexLength(zs))) == -1) return -1;
             nwritten += n;
 
             /* We save the skiplist elements from the greatest to the smallest
@@ -890,26 +912,27 @@ ssize_t rdbSaveObject(rio *rdb, robj *o, robj *key) {
              * element will always be the smaller, so adding to the skiplist
              * will always immediately stop at the head, making the insertion
              * O(1) instead of O(log(N)). */
-            zskiplistNode *zn = zsl->tail;
-            while (zn != NULL) {
+            zsetIndexLast(zs,&zc);
+            while (zsetCursorValid(&zc)) {
+                sds ele = zsetCursorEle(&zc);
                 if ((n = rdbSaveRawString(rdb,
-                    (unsigned char*)zn->ele,sdslen(zn->ele))) == -1)
+                    (unsigned char*)ele,sdslen(ele))) == -1)
                 {
                     return -1;
                 }
                 nwritten += n;
-                if ((n = rdbSaveBinaryDoubleValue(rdb,zn->score)) == -1)
+                if ((n = rdbSaveBinaryDoubleValue(rdb,zsetCursorScore(&zc))) == -1)
                     return -1;
                 nwritten += n;
-                zn = zn->backward;
+                zsetCursorPrev(&zc);
             }
         } else {
             serverPanic("Unknown sorted set encoding");
         }
     } else if (o->type == OBJ_HASH) {
         /* Save a hash value */
-        if (o->encoding == OBJ_ENCODING_ZIPLIST) {
-            size_t l = ziplistBlobLen((unsigned char*)o->ptr);
+        if (o->encoding == OBJ_ENCODING_LISTPACK) {
+            size_t l = lpBytes((unsigned char*)o->ptr);
 
             if ((n = rdbSaveRawString(rdb,o->ptr,l)) == -1) return -1;
             nwritten += n;
@@ -1079,6 +1102,71 @@ size_t rdbSavedObjectLen(robj *o, robj *key) {
     return len;
 }
 
+/* NUMA placement of the keys that follow a "numa-placement" AUX field,
+ * encoded as ((node+1) << 3) | hotness, where node -1 means unknown. Being an
+ * AUX field, loaders that don't know it just skip it. The field is only
+ * emitted when the placement changes, so a run of keys on the same node with
+ * the same hotness costs nothing. -1 means "not emitted yet". */
+#define RDB_NUMA_PLACEMENT_NONE -1
+#define RDB_NUMA_PLACEMENT_NOOP -2  /* rdbNumaPlacementBegin() did nothing. */
+static __thread long long rdb_numa_last_placement = RDB_NUMA_PLACEMENT_NONE;
+
+/* Forget the placement emitted last by this thread, so that the next key
+ * emits its field. Used when buffers serialized by different threads are
+ * concatenated into the same stream. */
+void rdbNumaPlacementReset(void) {
+    rdb_numa_last_placement = RDB_NUMA_PLACEMENT_NONE;
+}
+
+#ifdef HAVE_NUMA
+ssize_t rdbSaveAuxFieldStrInt(rio *rdb, char *key, long long val);
+
+/* Write the placement field for 'val' if it differs from the one of the
+ * previous key. */
+static int rdbSaveNumaPlacement(rio *rdb, robj *val) {
+    long long placement = ((long long)(numaGetObjectNode(val)+1) << 3) |
+                          (numa_get_hotness(val) & NUMA_HOTNESS_MAX);
+    if (placement == rdb_numa_last_placement) return 0;
+    if (rdbSaveAuxFieldStrInt(rdb,"numa-placement",placement) == -1) return -1;
+    rdb_numa_last_placement = placement;
+    return 0;
+}
+
+/* Allocate the next loaded value on the node recorded in 'placement', if
+ * that node exists here. Returns a token for rdbNumaPlacementEnd(). */
+static int rdbNumaPlacementBegin(long long placement) {
+    if (placement <= 0 || numa_available() < 0) return RDB_NUMA_PLACEMENT_NOOP;
+    int node = (int)(placement >> 3) - 1;
+    if (node < 0 || node > numa_max_node()) return RDB_NUMA_PLACEMENT_NOOP;
+    return numa_set_thread_alloc_node(node);
+}
+
+static void rdbNumaPlacementEnd(int token) {
+    if (token != RDB_NUMA_PLACEMENT_NOOP) numa_set_thread_alloc_node(token);
+}
+
+/* Restore the recorded hotness on a loaded value. */
+static void rdbNumaPlacementApply(robj *val, long long placement) {
+    if (placement <= 0 || val->refcount == OBJ_SHARED_REFCOUNT) return;
+    numa_set_hotness(val,placement & NUMA_HOTNESS_MAX);
+}
+#else
+static int rdbSaveNumaPlacement(rio *rdb, robj *val) {
+    UNUSED(rdb);
+    UNUSED(val);
+    return 0;
+}
+static int rdbNumaPlacementBegin(long long placement) {
+    UNUSED(placement);
+    return RDB_NUMA_PLACEMENT_NOOP;
+}
+static void rdbNumaPlacementEnd(int token) { UNUSED(token); }
+static void rdbNumaPlacementApply(robj *val, long long placement) {
+    UNUSED(val);
+    UNUSED(placement);
+}
+#endif
+
 /* Save a key-value pair, with expire time, type, key, value.
  * On error -1 is returned.
  * On success if the key was actually saved 1 is returned. */
@@ -1112,10 +1200,29 @@ int rdbSaveKeyValuePair(rio *rdb, robj *key, robj *val, long long expiretime) {
         if (rdbWriteRaw(rdb,buf,1) == -1) return -1;
     }
 
+    /* Save the NUMA placement, so that loading restores it. Hot-first saves
+     * always carry it, so that the receiver knows the hotness. */
+    if ((server.numa_rdb_placement || server.numa_rdb_hot_first) &&
+        rdbSaveNumaPlacement(rdb,val) == -1)
+        return -1;
+
+#ifdef HAVE_NUMA
+    /* 冷层压缩值以解压后的原始编码落盘，RDB 格式不感知冷层 */
+    if (val->encoding == OBJ_ENCODING_NUMA_COLD) {
+        robj *decoded = numaColdDecodedCopy(val);
+        int ret = rdbSaveObjectType(rdb,decoded) != -1 &&
+                  rdbSaveStringObject(rdb,key) != -1 &&
+                  rdbSaveObject(rdb,decoded,key) != -1;
+        decrRefCount(decoded);
+        if (!ret) return -1;
+    } else
+#endif
+    {
     /* Save type, key, value */
     if (rdbSaveObjectType(rdb,val) == -1) return -1;
     if (rdbSaveStringObject(rdb,key) == -1) return -1;
     if (rdbSaveObject(rdb,val,key) == -1) return -1;
+    }
 
     /* Delay return if required (for testing) */
     if (server.rdb_key_save_delay)
@@ -1214,6 +1321,82 @@ ssize_t rdbSaveSingleModuleAux(rio *rdb, int when, moduleType *mt) {
     return io.bytes;
 }
 
+/* With numa-rdb-hot-first, keys hotter than new keys get by default are saved
+ * first, from the hottest level down, so that a replica doing a full sync
+ * loads the hot set before the rest. */
+#define RDB_HOTNESS_LEVELS 8
+#define RDB_HOT_FIRST_MIN_LEVEL 2
+
+/* DB iterator used by rdbSaveRio(). The hot entries are collected in a
+ * first pass; the dict is not modified while saving, and rehashing is paused
+ * (lookups may rehash, moving the entries of a bucketed dict) so they stay
+ * valid. */
+typedef struct rdbSaveIterator {
+    dictIterator *di;
+    int hot_first;
+    int level;                  /* Hot level being emitted, 0 when done. */
+    size_t pos;
+    dictEntry **hot[RDB_HOTNESS_LEVELS];
+    size_t hot_len[RDB_HOTNESS_LEVELS];
+    size_t hot_cap[RDB_HOTNESS_LEVELS];
+} rdbSaveIterator;
+
+static int rdbValueHotness(robj *val) {
+#ifdef HAVE_NUMA
+    return numa_get_hotness(val) & NUMA_HOTNESS_MAX;
+#else
+    UNUSED(val);
+    return 0;
+#endif
+}
+
+static void rdbSaveIteratorInit(rdbSaveIterator *it, dict *d) {
+    memset(it,0,sizeof(*it));
+    if (server.numa_rdb_hot_first) {
+        dictIterator *di = dictGetSafeIterator(d);
+        dictEntry *de;
+        while((de = dictNext(di)) != NULL) {
+            int level = rdbValueHotness(dictGetVal(de));
+            if (level < RDB_HOT_FIRST_MIN_LEVEL) continue;
+            if (it->hot_len[level] == it->hot_cap[level]) {
+                it->hot_cap[level] = it->hot_cap[level] ? it->hot_cap[level]*2 : 1024;
+                it->hot[level] = zrealloc(it->hot[level],
+                    sizeof(dictEntry*)*it->hot_cap[level]);
+            }
+            it->hot[level][it->hot_len[level]++] = de;
+        }
+        dictReleaseIterator(di);
+        dictPauseRehashing(d);
+        it->hot_first = 1;
+        it->level = RDB_HOTNESS_LEVELS-1;
+    }
+    it->di = dictGetSafeIterator(d);
+}
+
+static dictEntry *rdbSaveIteratorNext(rdbSaveIterator *it) {
+    dictEntry *de;
+
+    while (it->level >= RDB_HOT_FIRST_MIN_LEVEL) {
+        if (it->pos < it->hot_len[it->level])
+            return it->hot[it->level][it->pos++];
+        it->level--;
+        it->pos = 0;
+    }
+    it->level = 0;
+    while((de = dictNext(it->di)) != NULL) {
+        if (!it->hot_first ||
+            rdbValueHotness(dictGetVal(de)) < RDB_HOT_FIRST_MIN_LEVEL) return de;
+    }
+    return NULL;
+}
+
+static void rdbSaveIteratorRelease(rdbSaveIterator *it) {
+    for (int j = 0; j < RDB_HOTNESS_LEVELS; j++) zfree(it->hot[j]);
+    if (it->hot_first) dictResumeRehashing(it->di->d);
+    dictReleaseIterator(it->di);
+    it->di = NULL;
+}
+
 /* Produces a dump of the database in RDB format sending it to the specified
  * Redis I/O channel. On success C_OK is returned, otherwise C_ERR
  * is returned and part of the output, or all the output, can be
@@ -1224,6 +1407,7 @@ ssize_t rdbSaveSingleModuleAux(rio *rdb, int when, moduleType *mt) {
  * error. */
 int rdbSaveRio(rio *rdb, int *error, int rdbflags, rdbSaveInfo *rsi) {
     dictIterator *di = NULL;
+    rdbSaveIterator it = {0};
     dictEntry *de;
     char magic[10];
     uint64_t cksum;
@@ -1232,6 +1416,7 @@ int rdbSaveRio(rio *rdb, int *error, int rdbflags, rdbSaveInfo *rsi) {
     long key_count = 0;
     long long info_updated_time = 0;
     char *pname = (rdbflags & RDBFLAGS_AOF_PREAMBLE) ? "AOF rewrite" :  "RDB";
+    int per_node = 0;
 
     if (server.rdb_checksum)
         rdb->update_cksum = rioGenericUpdateChecksum;
@@ -1239,12 +1424,18 @@ int rdbSaveRio(rio *rdb, int *error, int rdbflags, rdbSaveInfo *rsi) {
     if (rdbWriteRaw(rdb,magic,9) == -1) goto werr;
     if (rdbSaveInfoAuxFields(rdb,rdbflags,rsi) == -1) goto werr;
     if (rdbSaveModulesAux(rdb, REDISMODULE_AUX_BEFORE_RDB) == -1) goto werr;
+    rdbNumaPlacementReset();
+
+    /* In the fork child, optionally serialize each value from a thread
+     * running on the node that holds it. */
+    if (numaRdbSaverStart() == C_OK) per_node = 1;
 
     for (j = 0; j < server.dbnum; j++) {
         redisDb *db = server.db+j;
         dict *d = db->dict;
         if (dictSize(d) == 0) continue;
-        di = dictGetSafeIterator(d);
+        rdbSaveIteratorInit(&it,d);
+        int group = it.level;
 
         /* Write the SELECT DB opcode */
         if (rdbSaveType(rdb,RDB_OPCODE_SELECTDB) == -1) goto werr;
@@ -1259,14 +1450,24 @@ int rdbSaveRio(rio *rdb, int *error, int rdbflags, rdbSaveInfo *rsi) {
         if (rdbSaveLen(rdb,expires_size) == -1) goto werr;
 
         /* Iterate this DB writing every entry */
-        while((de = dictNext(di)) != NULL) {
+        while((de = rdbSaveIteratorNext(&it)) != NULL) {
             sds keystr = dictGetKey(de);
             robj key, *o = dictGetVal(de);
             long long expire;
 
             initStaticStringObject(key,keystr);
             expire = getExpire(db,&key);
-            if (rdbSaveKeyValuePair(rdb,&key,o,expire) == -1) goto werr;
+            if (per_node && it.level != group) {
+                /* Keep the hotness groups in order in the output. */
+                if (numaRdbSaverFlush(rdb) == C_ERR) goto werr;
+                group = it.level;
+            }
+            if (per_node) {
+                if (numaRdbSaverSaveKey(rdb,keystr,o,expire) == C_ERR)
+                    goto werr;
+            } else {
+                if (rdbSaveKeyValuePair(rdb,&key,o,expire) == -1) goto werr;
+            }
 
             /* When this RDB is produced as part of an AOF rewrite, move
              * accumulated diff from parent to child while rewriting in
@@ -1289,8 +1490,13 @@ int rdbSaveRio(rio *rdb, int *error, int rdbflags, rdbSaveInfo *rsi) {
                 }
             }
         }
-        dictReleaseIterator(di);
-        di = NULL; /* So that we don't release it again on error. */
+        /* The keys of this DB must be written before the next SELECT. */
+        if (per_node && numaRdbSaverFlush(rdb) == C_ERR) goto werr;
+        rdbSaveIteratorRelease(&it); /* Sets it.di to NULL. */
+    }
+    if (per_node) {
+        numaRdbSaverStop();
+        per_node = 0;
     }
 
     /* If we are storing the replication information on disk, persist
@@ -1322,6 +1528,8 @@ int rdbSaveRio(rio *rdb, int *error, int rdbflags, rdbSaveInfo *rsi) {
 
 werr:
     if (error) *error = errno;
+    if (per_node) numaRdbSaverStop();
+    if (it.di) rdbSaveIteratorRelease(&it);
     if (di) dictReleaseIterator(di);
     return C_ERR;
 }
@@ -1523,6 +1731,68 @@ robj *rdbLoadCheckModuleValue(rio *rdb, char *modulename) {
     return createStringObject("module-dummy-value",18);
 }
 
+/* Callback for ziplistPairsConvertAndValidateIntegrity().
+ * Check that the ziplist doesn't have duplicate field names, and append
+ * every entry to the listpack we are converting to. */
+static int _ziplistPairsEntryConvertAndValidate(unsigned char *p, void *userdata) {
+    unsigned char *str;
+    unsigned int slen;
+    long long vll;
+
+    struct {
+        long count;
+        dict *fields;
+        unsigned char **lp;
+    } *data = userdata;
+
+    if (!ziplistGet(p, &str, &slen, &vll))
+        return 0;
+
+    /* Even records are field names, add to dict and check that's not a dup */
+    if (((data->count) & 1) == 0) {
+        sds field = str? sdsnewlen(str, slen): sdsfromlonglong(vll);
+        if (dictAdd(data->fields, field, NULL) != DICT_OK) {
+            /* Duplicate, return an error */
+            sdsfree(field);
+            return 0;
+        }
+    }
+
+    if (str) {
+        *(data->lp) = lpAppend(*(data->lp), str, slen);
+    } else {
+        char buf[LONG_STR_SIZE];
+        int len = ll2string(buf, sizeof(buf), vll);
+        *(data->lp) = lpAppend(*(data->lp), (unsigned char*)buf, len);
+    }
+
+    (data->count)++;
+    return 1;
+}
+
+/* Validate the integrity of a ziplist encoded hash or sorted set saved by
+ * an older version, and convert it to a listpack stored at '*lp'. The whole
+ * ziplist is always scanned, so this is a `deep` validation, which also
+ * checks for duplicate fields and an odd number of records.
+ * Returns 1 on success, 0 if the ziplist is corrupted. */
+static int ziplistPairsConvertAndValidateIntegrity(unsigned char *zl, size_t size, unsigned char **lp) {
+    /* Keep track of the field names to locate duplicate ones */
+    struct {
+        long count;
+        dict *fields;
+        unsigned char **lp;
+    } data = {0, dictCreate(&hashDictType, NULL), lp};
+
+    int ret = ziplistValidateIntegrity(zl, size, 1, _ziplistPairsEntryConvertAndValidate, &data);
+
+    /* make sure we have an even number of records. */
+    if (data.count & 1)
+        ret = 0;
+
+    dictRelease(data.fields);
+    return ret;
+}
+
 /* Load a Redis object of the specified type from the specified file.
  * On success a newly allocated object is returned, otherwise NULL.
  * When the function returns NULL and if 'error' is not NULL, the
@@ -1659,7 +1929,6 @@ robj *rdbLoadObject(int rdbtype, rio *rdb, sds key, int *error) {
         while(zsetlen--) {
             sds sdsele;
             double score;
-            zskiplistNode *znode;
 
             if ((sdsele = rdbGenericLoadStringObject(rdb,RDB_LOAD_SDS,NULL)) == NULL) {
                 decrRefCount(o);
@@ -1684,21 +1953,20 @@ robj *rdbLoadObject(int rdbtype, rio *rdb, sds key, int *error) {
             if (sdslen(sdsele) > maxelelen) maxelelen = sdslen(sdsele);
             totelelen += sdslen(sdsele);
 
-            znode = zslInsert(zs->zsl,score,sdsele);
-            if (dictAdd(zs->dict,sdsele,&znode->score) != DICT_OK) {
+            if (zsetIndexAdd(zs,score,sdsele) != C_OK) {
                 rdbReportCorruptRDB("Duplicate zset fields detected");
                 decrRefCount(o);
-                /* no need to free 'sdsele', will be released by zslFree together with 'o' */
+                sdsfree(sdsele);
                 return NULL;
             }
         }
 
         /* Convert *after* loading, since sorted sets are not stored ordered. */
-        if (zsetLength(o) <= server.zset_max_ziplist_entries &&
-            maxelelen <= server.zset_max_ziplist_value &&
-            ziplistSafeToAdd(NULL, totelelen))
+        if (zsetLength(o) <= server.zset_max_listpack_entries &&
+            maxelelen <= server.zset_max_listpack_value &&
+            lpSafeToAdd(NULL, totelelen))
         {
-            zsetConvert(o,OBJ_ENCODING_ZIPLIST);
+            zsetConvert(o,OBJ_ENCODING_LISTPACK);
         }
     } else if (rdbtype == RDB_TYPE_HASH) {
         uint64_t len;
@@ -1713,19 +1981,19 @@ robj *rdbLoadObject(int rdbtype, rio *rdb, sds key, int *error) {
         o = createHashObject();
 
         /* Too many entries? Use a hash table right from the start. */
-        if (len > server.hash_max_ziplist_entries)
+        if (len > server.hash_max_listpack_entries)
             hashTypeConvert(o, OBJ_ENCODING_HT);
         else if (deep_integrity_validation) {
             /* In this mode, we need to guarantee that the server won't crash
-             * later when the ziplist is converted to a dict.
+             * later when the listpack is converted to a dict.
              * Create a set (dict with no values) to for a dup search.
-             * We can dismiss it as soon as we convert the ziplist to a hash. */
+             * We can dismiss it as soon as we convert the listpack to a hash. */
             dupSearchDict = dictCreate(&hashDictType, NULL);
         }
 
 
-        /* Load every field and value into the ziplist */
-        while (o->encoding == OBJ_ENCODING_ZIPLIST && len > 0) {
+        /* Load every field and value into the listpack */
+        while (o->encoding == OBJ_ENCODING_LISTPACK && len > 0) {
             len--;
             /* Load raw strings */
             if ((field = rdbGenericLoadStringObject(rdb,RDB_LOAD_SDS,NULL)) == NULL) {
@@ -1754,9 +2022,9 @@ robj *rdbLoadObject(int rdbtype, rio *rdb, sds key, int *error) {
             }
 
             /* Convert to hash table if size threshold is exceeded */
-            if (sdslen(field) > server.hash_max_ziplist_value ||
-                sdslen(value) > server.hash_max_ziplist_value ||
-                !ziplistSafeToAdd(o->ptr, sdslen(field)+sdslen(value)))
+            if (sdslen(field) > server.hash_max_listpack_value ||
+                sdslen(value) > server.hash_max_listpack_value ||
+                !lpSafeToAdd(o->ptr, sdslen(field)+sdslen(value)))
             {
                 hashTypeConvert(o, OBJ_ENCODING_HT);
                 ret = dictAdd((dict*)o->ptr, field, value);
@@ -1771,11 +2039,9 @@ robj *rdbLoadObject(int rdbtype, rio *rdb, sds key, int *error) {
                 break;
             }
 
-            /* Add pair to ziplist */
-            o->ptr = ziplistPush(o->ptr, (unsigned char*)field,
-                    sdslen(field), ZIPLIST_TAIL);
-            o->ptr = ziplistPush(o->ptr, (unsigned char*)value,
-                    sdslen(value), ZIPLIST_TAIL);
+            /* Add pair to listpack */
+            o->ptr = lpAppend(o->ptr, (unsigned char*)field, sdslen(field));
+            o->ptr = lpAppend(o->ptr, (unsigned char*)value, sdslen(value));
 
             sdsfree(field);
             sdsfree(value);
@@ -1839,7 +2105,7 @@ robj *rdbLoadObject(int rdbtype, rio *rdb, sds key, int *error) {
                 decrRefCount(o);
                 return NULL;
             }
-            if (deep_integrity_validation) server.stat_dump_payload_sanitizations++;
+            if (deep_integrity_validation) atomicIncr(server.stat_dump_payload_sanitizations,1);
             if (!ziplistValidateIntegrity(zl, encoded_len, deep_integrity_validation, NULL, NULL)) {
                 rdbReportCorruptRDB("Ziplist integrity check failed.");
                 decrRefCount(o);
@@ -1864,7 +2130,9 @@ robj *rdbLoadObject(int rdbtype, rio *rdb, sds key, int *error) {
                rdbtype == RDB_TYPE_LIST_ZIPLIST ||
                rdbtype == RDB_TYPE_SET_INTSET   ||
                rdbtype == RDB_TYPE_ZSET_ZIPLIST ||
-               rdbtype == RDB_TYPE_HASH_ZIPLIST)
+               rdbtype == RDB_TYPE_ZSET_LISTPACK ||
+               rdbtype == RDB_TYPE_HASH_ZIPLIST ||
+               rdbtype == RDB_TYPE_HASH_LISTPACK)
     {
         size_t encoded_len;
         unsigned char *encoded =
@@ -1890,10 +2158,10 @@ robj *rdbLoadObject(int rdbtype, rio *rdb, sds key, int *error) {
                     decrRefCount(o);
                     return NULL;
                 }
-                /* Convert to ziplist encoded hash. This must be deprecated
+                /* Convert to listpack encoded hash. This must be deprecated
                  * when loading dumps created by Redis 2.4 gets deprecated. */
                 {
-                    unsigned char *zl = ziplistNew();
+                    unsigned char *lp = lpNew(0);
                     unsigned char *zi = zipmapRewind(o->ptr);
                     unsigned char *fstr, *vstr;
                     unsigned int flen, vlen;
@@ -1907,35 +2175,36 @@ robj *rdbLoadObject(int rdbtype, rio *rdb, sds key, int *error) {
                         /* search for duplicate records */
                         sds field = sdstrynewlen(fstr, flen);
                         if (!field || dictAdd(dupSearchDict, field, NULL) != DICT_OK ||
-                            !ziplistSafeToAdd(zl, (size_t)flen + vlen)) {
+                            !lpSafeToAdd(lp, (size_t)flen + vlen)) {
                             rdbReportCorruptRDB("Hash zipmap with dup elements, or big length (%u)", flen);
                             dictRelease(dupSearchDict);
                             sdsfree(field);
+                            zfree(lp);
                             zfree(encoded);
                             o->ptr = NULL;
                             decrRefCount(o);
                             return NULL;
                         }
 
-                        zl = ziplistPush(zl, fstr, flen, ZIPLIST_TAIL);
-                        zl = ziplistPush(zl, vstr, vlen, ZIPLIST_TAIL);
+                        lp = lpAppend(lp, fstr, flen);
+                        lp = lpAppend(lp, vstr, vlen);
                     }
 
                     dictRelease(dupSearchDict);
                     zfree(o->ptr);
-                    o->ptr = zl;
+                    o->ptr = lp;
                     o->type = OBJ_HASH;
-                    o->encoding = OBJ_ENCODING_ZIPLIST;
+                    o->encoding = OBJ_ENCODING_LISTPACK;
 
-                    if (hashTypeLength(o) > server.hash_max_ziplist_entries ||
-                        maxlen > server.hash_max_ziplist_value)
+                    if (hashTypeLength(o) > server.hash_max_listpack_entries ||
+                        maxlen > server.hash_max_listpack_value)
                     {
                         hashTypeConvert(o, OBJ_ENCODING_HT);
                     }
                 }
                 break;
             case RDB_TYPE_LIST_ZIPLIST:
-                if (deep_integrity_validation) server.stat_dump_payload_sanitizations++;
+                if (deep_integrity_validation) atomicIncr(server.stat_dump_payload_sanitizations,1);
                 if (!ziplistValidateIntegrity(encoded, encoded_len, deep_integrity_validation, NULL, NULL)) {
                     rdbReportCorruptRDB("List ziplist integrity check failed.");
                     zfree(encoded);
@@ -1956,7 +2225,7 @@ robj *rdbLoadObject(int rdbtype, rio *rdb, sds key, int *error) {
                 listTypeConvert(o,OBJ_ENCODING_QUICKLIST);
                 break;
             case RDB_TYPE_SET_INTSET:
-                if (deep_integrity_validation) server.stat_dump_payload_sanitizations++;
+                if (deep_integrity_validation) atomicIncr(server.stat_dump_payload_sanitizations,1);
                 if (!intsetValidateIntegrity(encoded, encoded_len, deep_integrity_validation)) {
                     rdbReportCorruptRDB("Intset integrity check failed.");
                     zfree(encoded);
@@ -1970,16 +2239,59 @@ robj *rdbLoadObject(int rdbtype, rio *rdb, sds key, int *error) {
                     setTypeConvert(o,OBJ_ENCODING_HT);
                 break;
             case RDB_TYPE_ZSET_ZIPLIST:
-                if (deep_integrity_validation) server.stat_dump_payload_sanitizations++;
-                if (!zsetZiplistValidateIntegrity(encoded, encoded_len, deep_integrity_validation)) {
-                    rdbReportCorruptRDB("Zset ziplist integrity check failed.");
+            case RDB_TYPE_HASH_ZIPLIST:
+                /* Small hashes and sorted sets are no longer kept as
+                 * ziplists, convert the blob to a listpack. The conversion
+                 * visits every entry anyway, so it is always done with
+                 * `deep` validation. */
+                {
+                    unsigned char *lp = lpNew(encoded_len);
+                    if (deep_integrity_validation) atomicIncr(server.stat_dump_payload_sanitizations,1);
+                    if (!ziplistPairsConvertAndValidateIntegrity(encoded, encoded_len, &lp)) {
+                        rdbReportCorruptRDB("%s ziplist integrity check failed.",
+                            rdbtype == RDB_TYPE_ZSET_ZIPLIST ? "Zset" : "Hash");
+                        zfree(lp);
+                        zfree(encoded);
+                        o->ptr = NULL;
+                        decrRefCount(o);
+                        return NULL;
+                    }
+
+                    zfree(o->ptr);
+                    o->ptr = lp;
+                    o->type = rdbtype == RDB_TYPE_ZSET_ZIPLIST ? OBJ_ZSET : OBJ_HASH;
+                    o->encoding = OBJ_ENCODING_LISTPACK;
+                    if (lpLength(lp) == 0) {
+                        zfree(lp);
+                        o->ptr = NULL;
+                        decrRefCount(o);
+                        goto emptykey;
+                    }
+
+                    if (o->type == OBJ_ZSET) {
+                        if (zsetLength(o) > server.zset_max_listpack_entries)
+                            zsetConvert(o,OBJ_ENCODING_SKIPLIST);
+                        else
+                            o->ptr = lpShrinkToFit(o->ptr);
+                    } else {
+                        if (hashTypeLength(o) > server.hash_max_listpack_entries)
+                            hashTypeConvert(o, OBJ_ENCODING_HT);
+                        else
+                            o->ptr = lpShrinkToFit(o->ptr);
+                    }
+                }
+                break;
+            case RDB_TYPE_ZSET_LISTPACK:
+                if (deep_integrity_validation) atomicIncr(server.stat_dump_payload_sanitizations,1);
+                if (!zsetListpackValidateIntegrity(encoded, encoded_len, deep_integrity_validation)) {
+                    rdbReportCorruptRDB("Zset listpack integrity check failed.");
                     zfree(encoded);
                     o->ptr = NULL;
                     decrRefCount(o);
                     return NULL;
                 }
                 o->type = OBJ_ZSET;
-                o->encoding = OBJ_ENCODING_ZIPLIST;
+                o->encoding = OBJ_ENCODING_LISTPACK;
                 if (zsetLength(o) == 0) {
                     zfree(encoded);
                     o->ptr = NULL;
@@ -1987,20 +2299,20 @@ robj *rdbLoadObject(int rdbtype, rio *rdb, sds key, int *error) {
                     goto emptykey;
                 }
 
-                if (zsetLength(o) > server.zset_max_ziplist_entries)
+                if (zsetLength(o) > server.zset_max_listpack_entries)
                     zsetConvert(o,OBJ_ENCODING_SKIPLIST);
                 break;
-            case RDB_TYPE_HASH_ZIPLIST:
-                if (deep_integrity_validation) server.stat_dump_payload_sanitizations++;
-                if (!hashZiplistValidateIntegrity(encoded, encoded_len, deep_integrity_validation)) {
-                    rdbReportCorruptRDB("Hash ziplist integrity check failed.");
+            case RDB_TYPE_HASH_LISTPACK:
+                if (deep_integrity_validation) atomicIncr(server.stat_dump_payload_sanitizations,1);
+                if (!hashListpackValidateIntegrity(encoded, encoded_len, deep_integrity_validation)) {
+                    rdbReportCorruptRDB("Hash listpack integrity check failed.");
                     zfree(encoded);
                     o->ptr = NULL;
                     decrRefCount(o);
                     return NULL;
                 }
                 o->type = OBJ_HASH;
-                o->encoding = OBJ_ENCODING_ZIPLIST;
+                o->encoding = OBJ_ENCODING_LISTPACK;
                 if (hashTypeLength(o) == 0) {
                     zfree(encoded);
                     o->ptr = NULL;
@@ -2008,7 +2320,7 @@ robj *rdbLoadObject(int rdbtype, rio *rdb, sds key, int *error) {
                     goto emptykey;
                 }
 
-                if (hashTypeLength(o) > server.hash_max_ziplist_entries)
+                if (hashTypeLength(o) > server.hash_max_listpack_entries)
                     hashTypeConvert(o, OBJ_ENCODING_HT);
                 break;
             default:
@@ -2054,7 +2366,7 @@ robj *rdbLoadObject(int rdbtype, rio *rdb, sds key, int *error) {
                 decrRefCount(o);
                 return NULL;
             }
-            if (deep_integrity_validation) server.stat_dump_payload_sanitizations++;
+            if (deep_integrity_validation) atomicIncr(server.stat_dump_payload_sanitizations,1);
             if (!streamValidateListpackIntegrity(lp, lp_size, deep_integrity_validation)) {
                 rdbReportCorruptRDB("Stream listpack integrity check failed.");
                 sdsfree(nodekey);
@@ -2337,6 +2649,7 @@ void startLoading(size_t size, int rdbflags) {
     server.loading = 1;
     server.loading_start_time = time(NULL);
     server.loading_loaded_bytes = 0;
+    server.loading_loaded_keys = 0;
     server.loading_total_bytes = size;
     server.loading_rdb_used_mem = 0;
     blockingOperationStarts();
@@ -2421,6 +2734,129 @@ void rdbLoadProgressCallback(rio *r, const void *buf, size_t len) {
     }
 }
 
+/* Settings and counters shared by the keys of a single rdbLoadRio() call. */
+typedef struct rdbLoadState {
+    int rdbflags;
+    long long now;
+    long long lru_clock;
+    long long keys_loaded;
+    long long expired_keys_skipped;
+    long long empty_keys_skipped;
+    long long numa_keys_placed;
+} rdbLoadState;
+
+/* Add a loaded key to its database, or drop it if it is empty or already
+ * expired. Takes ownership of rec->key and rec->val. Returns C_ERR if the
+ * value could not be loaded, so that the caller aborts the loading. */
+static int rdbLoadAddRecord(rdbLoadState *ls, numaRdbRecord *rec) {
+    redisDb *db = rec->db;
+    sds key = rec->key;
+    robj *val = rec->val;
+
+    if (rec->errmsg) {
+        /* Decoded by a loader thread: report the error here, after stopping
+         * the threads, since it may terminate the server. Stopping the
+         * loader frees 'rec', so copy what we need first. */
+        sds msg = rec->errmsg;
+        int line = rec->errline, corrupt = rec->errcorrupt;
+        rec->errmsg = NULL;
+        sdsfree(key);
+        if (val) decrRefCount(val);
+        numaRdbLoaderStop();
+        rdbReportError(corrupt,line,"%s",msg);
+        sdsfree(msg);
+        return C_ERR;
+    }
+
+    /* Check if the key already expired. This function is used when loading
+     * an RDB file from disk, either at startup, or when an RDB was
+     * received from the master. In the latter case, the master is
+     * responsible for key expiry. If we would expire keys here, the
+     * snapshot taken by the master may not be reflected on the slave.
+     * Similarly if the RDB is the preamble of an AOF file, we want to
+     * load all the keys as they are, since the log of operations later
+     * assume to work in an exact keyspace state. */
+    if (val == NULL) {
+        /* Since we used to have bug that could lead to empty keys
+         * (See #8453), we rather not fail when empty key is encountered
+         * in an RDB file, instead we will silently discard it and
+         * continue loading. */
+        if (rec->error == RDB_LOAD_ERR_EMPTY_KEY) {
+            if(ls->empty_keys_skipped++ < 10)
+                serverLog(LL_WARNING, "rdbLoadObject skipping empty key: %s", key);
+            sdsfree(key);
+        } else {
+            sdsfree(key);
+            return C_ERR;
+        }
+    } else if (iAmMaster() &&
+        !(ls->rdbflags&RDBFLAGS_AOF_PREAMBLE) &&
+        rec->expiretime != -1 && rec->expiretime < ls->now)
+    {
+        sdsfree(key);
+        decrRefCount(val);
+        ls->expired_keys_skipped++;
+    } else {
+        robj keyobj;
+        initStaticStringObject(keyobj,key);
+
+        /* Add the new object in the hash table */
+        int added = dbAddRDBLoad(db,key,val);
+        ls->keys_loaded++;
+        server.loading_loaded_keys++;
+        if (!added) {
+            if (ls->rdbflags & RDBFLAGS_ALLOW_DUP) {
+                /* This flag is useful for DEBUG RELOAD special modes.
+                 * When it's set we allow new keys to replace the current
+                 * keys with the same name. */
+                dbSyncDelete(db,&keyobj);
+                dbAddRDBLoad(db,key,val);
+            } else {
+                serverLog(LL_WARNING,
+                    "RDB has duplicated key '%s' in DB %d",key,db->id);
+                serverPanic("Duplicated key found in RDB file");
+            }
+        }
+
+        /* Set the expire time if needed */
+        if (rec->expiretime != -1) {
+            setExpire(NULL,db,&keyobj,rec->expiretime);
+        }
+
+        /* Set usage information (for eviction). */
+        objectSetLRUOrLFU(val,rec->lfu_freq,rec->lru_idle,ls->lru_clock,1000);
+        if (rec->placed) {
+            rdbNumaPlacementApply(val,rec->numa_placement);
+            ls->numa_keys_placed++;
+        }
+
+        /* call key space notification on key loaded for modules only */
+        moduleNotifyKeyspaceEvent(NOTIFY_LOADED, "loaded", &keyobj, db->id);
+
+        /* The key name was copied into its dict entry. */
+        if (dictEmbedsKey(db->dict,key)) sdsfree(key);
+    }
+
+    /* Loading the database more slowly is useful in order to test
+     * certain edge cases. */
+    if (server.key_load_delay)
+        debugDelay(server.key_load_delay);
+    return C_OK;
+}
+
+/* Decode the raw value bytes of a record. Called by the loader threads when
+ * the RDB is loaded with numa-rdb-load-threads. */
+static void rdbDecodeRecord(numaRdbRecord *rec) {
+    rio payload;
+    rioInitWithBuffer(&payload,rec->raw);
+    int numa_token = rdbNumaPlacementBegin(rec->numa_placement);
+    rdbDecodingRecord = rec;
+    rec->val = rdbLoadObject(rec->type,&payload,rec->key,&rec->error);
+    rdbDecodingRecord = NULL;
+    rdbNumaPlacementEnd(numa_token);
+    rec->placed = numa_token != RDB_NUMA_PLACEMENT_NOOP;
+}
+
 /* Load an RDB file from the rio stream 'rdb'. On success C_OK is returned,
  * otherwise C_ERR is returned and 'errno' is set accordingly. */
 int rdbLoadRio(rio *rdb, int rdbflags, rdbSaveInfo *rsi) {
@@ -2428,8 +2864,10 @@ int rdbLoadRio(rio *rdb, int rdbflags, rdbSaveInfo *rsi) {
     int type, rdbver;
     redisDb *db = server.db+0;
     char buf[1024];
-    int error;
-    long long empty_keys_skipped = 0, expired_keys_skipped = 0, keys_loaded = 0;
+    rdbLoadState ls = {.rdbflags = rdbflags};
+    numaRdbRecord *done;
+    int pipelined = 0;
+    long long start = ustime();
 
     rdb->update_cksum = rdbLoadProgressCallback;
     rdb->max_processing_chunk = server.loading_process_events_interval_bytes;
@@ -2448,12 +2886,19 @@ int rdbLoadRio(rio *rdb, int rdbflags, rdbSaveInfo *rsi) {
     }
 
     /* Key-specific attributes, set by opcodes before the key type. */
-    long long lru_idle = -1, lfu_freq = -1, expiretime = -1, now = mstime();
-    long long lru_clock = LRU_CLOCK();
+    long long lru_idle = -1, lfu_freq = -1, expiretime = -1;
+    ls.now = mstime();
+    ls.lru_clock = LRU_CLOCK();
+    /* NUMA placement is not key-specific: it holds until the next field. */
+    long long numa_placement = RDB_NUMA_PLACEMENT_NONE;
+
+    /* Decode values in the loader threads if configured: this thread keeps
+     * reading the file and adding the decoded keys in the original order. */
+    if (!rdbCheckMode && numaRdbLoaderStart(rdbDecodeRecord) == C_OK)
+        pipelined = 1;
 
     while(1) {
         sds key;
-        robj *val;
 
         /* Read type. */
         if ((type = rdbLoadType(rdb)) == -1) goto eoferr;
@@ -2565,6 +3010,9 @@ int rdbLoadRio(rio *rdb, int rdbflags, rdbSaveInfo *rsi) {
                 if (haspreamble) serverLog(LL_NOTICE,"RDB has an AOF tail");
             } else if (!strcasecmp(auxkey->ptr,"redis-bits")) {
                 /* Just ignored. */
+            } else if (!strcasecmp(auxkey->ptr,"numa-placement")) {
+                /* Node and hotness of the following keys. */
+                numa_placement = strtoll(auxval->ptr,NULL,10);
             } else {
                 /* We ignore fields we don't understand, as by AUX field
                  * contract. */
@@ -2634,81 +3082,57 @@ int rdbLoadRio(rio *rdb, int rdbflags, rdbSaveInfo *rsi) {
         /* Read key */
         if ((key = rdbGenericLoadStringObject(rdb,RDB_LOAD_SDS,NULL)) == NULL)
             goto eoferr;
-        /* Read value */
-        val = rdbLoadObject(type,rdb,key,&error);
-
-        /* Check if the key already expired. This function is used when loading
-         * an RDB file from disk, either at startup, or when an RDB was
-         * received from the master. In the latter case, the master is
-         * responsible for key expiry. If we would expire keys here, the
-         * snapshot taken by the master may not be reflected on the slave.
-         * Similarly if the RDB is the preamble of an AOF file, we want to
-         * load all the keys as they are, since the log of operations later
-         * assume to work in an exact keyspace state. */
-        if (val == NULL) {
-            /* Since we used to have bug that could lead to empty keys
-             * (See #8453), we rather not fail when empty key is encountered
-             * in an RDB file, instead we will silently discard it and
-             * continue loading. */
-            if (error == RDB_LOAD_ERR_EMPTY_KEY) {
-                if(empty_keys_skipped++ < 10)
-                    serverLog(LL_WARNING, "rdbLoadObject skipping empty key: %s", key);
-                sdsfree(key);
-            } else {
+
+        numaRdbRecord rec = {
+            .type = type, .db = db, .key = key,
+            .expiretime = expiretime, .lru_idle = lru_idle,
+            .lfu_freq = lfu_freq, .numa_placement = numa_placement
+        };
+
+        if (pipelined && numaRdbLoaderCanCapture(type)) {
+            /* Hand the raw value to the loader threads, then add the keys
+             * they finished decoding so far. */
+            if ((rec.raw = numaRdbLoaderCapture(rdb,type)) == NULL) {
                 sdsfree(key);
                 goto eoferr;
             }
-        } else if (iAmMaster() &&
-            !(rdbflags&RDBFLAGS_AOF_PREAMBLE) &&
-            expiretime != -1 && expiretime < now)
-        {
-            sdsfree(key);
-            decrRefCount(val);
-            expired_keys_skipped++;
+            numaRdbLoaderSubmit(&rec);
+            while ((done = numaRdbLoaderNext(0)) != NULL) {
+                if (rdbLoadAddRecord(&ls,done) == C_ERR) goto eoferr;
+            }
         } else {
-            robj keyobj;
-            initStaticStringObject(keyobj,key);
-
-            /* Add the new object in the hash table */
-            int added = dbAddRDBLoad(db,key,val);
-            keys_loaded++;
-            if (!added) {
-                if (rdbflags & RDBFLAGS_ALLOW_DUP) {
-                    /* This flag is useful for DEBUG RELOAD special modes.
-                     * When it's set we allow new keys to replace the current
-                     * keys with the same name. */
-                    dbSyncDelete(db,&keyobj);
-                    dbAddRDBLoad(db,key,val);
-                } else {
-                    serverLog(LL_WARNING,
-                        "RDB has duplicated key '%s' in DB %d",key,db->id);
-                    serverPanic("Duplicated key found in RDB file");
+            /* Module values are decoded here: add the keys still in the
+             * pipeline first, so that keys are added in the file order. */
+            while (pipelined && (done = numaRdbLoaderNext(1)) != NULL) {
+                if (rdbLoadAddRecord(&ls,done) == C_ERR) {
+                    sdsfree(key);
+                    goto eoferr;
                 }
             }
 
-            /* Set the expire time if needed */
-            if (expiretime != -1) {
-                setExpire(NULL,db,&keyobj,expiretime);
-            }
-
-            /* Set usage information (for eviction). */
-            objectSetLRUOrLFU(val,lfu_freq,lru_idle,lru_clock,1000);
-
-            /* call key space notification on key loaded for modules only */
-            moduleNotifyKeyspaceEvent(NOTIFY_LOADED, "loaded", &keyobj, db->id);
+            /* Read value, allocating it on its recorded NUMA node if any. */
+            int numa_token = rdbNumaPlacementBegin(numa_placement);
+            rec.val = rdbLoadObject(type,rdb,key,&rec.error);
+            rdbNumaPlacementEnd(numa_token);
+            rec.placed = numa_token != RDB_NUMA_PLACEMENT_NOOP;
+            if (rdbLoadAddRecord(&ls,&rec) == C_ERR) goto eoferr;
         }
 
-        /* Loading the database more slowly is useful in order to test
-         * certain edge cases. */
-        if (server.key_load_delay)
-            debugDelay(server.key_load_delay);
-
         /* Reset the state that is key-specified and is populated by
          * opcodes before the key, so that we start from scratch again. */
         expiretime = -1;
         lfu_freq = -1;
         lru_idle = -1;
     }
+
+    if (pipelined) {
+        while ((done = numaRdbLoaderNext(1)) != NULL) {
+            if (rdbLoadAddRecord(&ls,done) == C_ERR) goto eoferr;
+        }
+        numaRdbLoaderStop();
+        pipelined = 0;
+    }
+
     /* Verify the checksum if RDB version is >= 5 */
     if (rdbver >= 5) {
         uint64_t cksum, expected = rdb->cksum;
@@ -2729,14 +3153,25 @@ int rdbLoadRio(rio *rdb, int rdbflags, rdbSaveInfo *rsi) {
         }
     }
 
-    if (empty_keys_skipped) {
+    if (ls.empty_keys_skipped) {
         serverLog(LL_WARNING,
             "Done loading RDB, keys loaded: %lld, keys expired: %lld, empty keys skipped: %lld.",
-                keys_loaded, expired_keys_skipped, empty_keys_skipped);
+                ls.keys_loaded, ls.expired_keys_skipped, ls.empty_keys_skipped);
     } else {
         serverLog(LL_WARNING,
             "Done loading RDB, keys loaded: %lld, keys expired: %lld.",
-                keys_loaded, expired_keys_skipped);
+                ls.keys_loaded, ls.expired_keys_skipped);
+    }
+    if (ls.numa_keys_placed) {
+        serverLog(LL_NOTICE,
+            "NUMA placement restored for %lld keys.", ls.numa_keys_placed);
+    }
+
+    /* Load throughput, reported in INFO persistence. */
+    double elapsed = (double)(ustime()-start)/1000000;
+    if (elapsed > 0) {
+        server.rdb_last_load_keys_per_sec = ls.keys_loaded/elapsed;
+        server.rdb_last_load_mb_per_sec = rdb->processed_bytes/elapsed/(1024*1024);
     }
     return C_OK;
 
@@ -2745,6 +3180,7 @@ int rdbLoadRio(rio *rdb, int rdbflags, rdbSaveInfo *rsi) {
      * the RDB file from a socket during initial SYNC (diskless replica mode),
      * we'll report the error to the caller, so that we can retry. */
 eoferr:
+    if (pipelined) numaRdbLoaderStop();
     serverLog(LL_WARNING,
         "Short read or OOM loading DB. Unrecoverable error, aborting now.");
     rdbReportReadError("Unexpected EOF reading RDB file");
@@ -90,7 +90,9 @@ char *rdb_type_string[] = {
     "zset-ziplist",
     "hash-ziplist",
     "quicklist",
-    "stream"
+    "stream",
+    "hash-listpack",
+    "zset-listpack"
 };
 
 /* Show a few stats collected into 'rdbstate' */
@@ -273,8 +275,10 @@ int redis_check_rdb(char *rdbfilename, FILE *fp) {
             if ((auxkey = rdbLoadStringObject(&rdb)) == NULL) goto eoferr;
             if ((auxval = rdbLoadStringObject(&rdb)) == NULL) goto eoferr;
 
-            rdbCheckInfo("AUX FIELD %s = '%s'",
-                (char*)auxkey->ptr, (char*)auxval->ptr);
+            /* NUMA placements are emitted between keys: don't log them. */
+            if (strcasecmp(auxkey->ptr,"numa-placement"))
+                rdbCheckInfo("AUX FIELD %s = '%s'",
+                    (char*)auxkey->ptr, (char*)auxval->ptr);
             decrRefCount(auxkey);
             decrRefCount(auxval);
             continue; /* Read type again. */
@@ -32,6 +32,7 @@
 #include "server.h"
 #include "cluster.h"
 #include "bio.h"
+#include "numa_io_threads.h"
 
 #include <sys/time.h>
 #include <unistd.h>
@@ -39,6 +40,10 @@
 #include <sys/socket.h>
 #include <sys/stat.h>
 
+#ifdef HAVE_NUMA
+#include <numa.h>
+#endif
+
 void replicationDiscardCachedMaster(void);
 void replicationResurrectCachedMaster(connection *conn);
 void replicationSendAck(void);
@@ -107,9 +112,26 @@ int bg_unlink(const char *filename) {
 
 /* ---------------------------------- MASTER -------------------------------- */
 
+/* Allocate the backlog buffer, on the node set by numa-repl-backlog-node
+ * if any. */
+static char *allocReplicationBacklog(long long size) {
+#ifdef HAVE_NUMA
+    if (server.numa_repl_backlog_node >= 0 &&
+        numa_available() >= 0 &&
+        server.numa_repl_backlog_node <= numa_max_node())
+    {
+        int old = numa_set_thread_alloc_node(server.numa_repl_backlog_node);
+        char *buf = zmalloc(size);
+        numa_set_thread_alloc_node(old);
+        return buf;
+    }
+#endif
+    return zmalloc(size);
+}
+
 void createReplicationBacklog(void) {
     serverAssert(server.repl_backlog == NULL);
-    server.repl_backlog = zmalloc(server.repl_backlog_size);
+    server.repl_backlog = allocReplicationBacklog(server.repl_backlog_size);
     server.repl_backlog_histlen = 0;
     server.repl_backlog_idx = 0;
 
@@ -136,9 +158,11 @@ void resizeReplicationBacklog(long long newsize) {
          * empty one. It will refill with new data incrementally.
          * The reason is that copying a few gigabytes adds latency and even
          * worse often we need to alloc additional space before freeing the
-         * old buffer. */
+         * old buffer. Replicas sending from the old buffer get their
+         * pending bytes copied first. */
+        replicationBacklogDetachReplicas();
         zfree(server.repl_backlog);
-        server.repl_backlog = zmalloc(server.repl_backlog_size);
+        server.repl_backlog = allocReplicationBacklog(server.repl_backlog_size);
         server.repl_backlog_histlen = 0;
         server.repl_backlog_idx = 0;
         /* Next byte we have is... the next since the buffer is empty. */
@@ -198,6 +222,115 @@ void feedReplicationBacklogWithObject(robj *o) {
     feedReplicationBacklog(p,len);
 }
 
+/* ------------------ Replica output shared with the backlog ------------------
+ * With repl-backlog-shared-output, an online replica whose output buffers
+ * are drained stops getting a private copy of the replication stream in its
+ * reply list. It only remembers the replication offset it was sent up to
+ * (repl_backlog_ref_off), and writeToClient() sends the rest directly from
+ * the backlog, so N replicas share one copy of the stream.
+ *
+ * The backlog is circular: before a command is fed to it, every such replica
+ * that would be overrun gets its unsent bytes copied into its reply list and
+ * goes back to normal buffering (it may switch again once drained). */
+
+/* Unsent backlog bytes of a replica sending from the backlog. */
+static long long replicationBacklogRefPending(client *replica) {
+    return server.master_repl_offset - replica->repl_backlog_ref_off;
+}
+
+/* Copy the unsent backlog bytes of 'replica' into its reply list and stop
+ * sending from the backlog. */
+static void replicationBacklogDetach(client *replica) {
+    long long pending = replicationBacklogRefPending(replica);
+    replica->repl_backlog_ref_off = -1;
+    if (pending <= 0) return;
+
+    serverAssert(pending <= server.repl_backlog_histlen);
+    long long idx = (server.repl_backlog_idx +
+                     (server.repl_backlog_size - pending)) %
+                     server.repl_backlog_size;
+    while(pending) {
+        long long thislen = server.repl_backlog_size - idx;
+        if (thislen > pending) thislen = pending;
+        addReplyProto(replica,server.repl_backlog+idx,thislen);
+        pending -= thislen;
+        idx = 0;
+    }
+}
+
+/* Stop every replica from sending from the backlog, before the backlog
+ * is released or reset. */
+void replicationBacklogDetachReplicas(void) {
+    listNode *ln;
+    listIter li;
+
+    listRewind(server.slaves,&li);
+    while((ln = listNext(&li))) {
+        client *slave = ln->value;
+        if (slave->repl_backlog_ref_off != -1) replicationBacklogDetach(slave);
+    }
+}
+
+/* Make room for 'len' bytes about to be fed to the backlog: replicas that
+ * would have unsent bytes overwritten, or all of them if the feature was
+ * turned off, go back to their own reply list. */
+static void replicationBacklogReserve(size_t len) {
+    listNode *ln;
+    listIter li;
+
+    listRewind(server.slaves,&li);
+    while((ln = listNext(&li))) {
+        client *slave = ln->value;
+        if (slave->repl_backlog_ref_off == -1) continue;
+        if (!server.repl_backlog_shared_output ||
+            replicationBacklogRefPending(slave) + (long long)len >
+            server.repl_backlog_size)
+        {
+            replicationBacklogDetach(slave);
+        }
+    }
+}
+
+/* Called by writeToClient() once the output buffers of 'c' are drained:
+ * switch an online replica to sending from the backlog. */
+void replicationBacklogTryAttach(client *c) {
+    if (!server.repl_backlog_shared_output || server.repl_backlog == NULL)
+        return;
+    if (!(c->flags & CLIENT_SLAVE) || c->flags & CLIENT_REPL_RDBONLY ||
+        c->flags & CLIENT_CLOSE_ASAP) return;
+    if (c->replstate != SLAVE_STATE_ONLINE || c->repl_put_online_on_ack)
+        return;
+    if (c->repl_backlog_ref_off != -1) return;
+    c->repl_backlog_ref_off = server.master_repl_offset;
+}
+
+/* A replica sending from the backlog got new data: schedule the write, and
+ * with numa-io-threads move it to the backlog's node so that it is served
+ * by the io threads local to the buffer it sends from. */
+static void replicationBacklogRefNotify(client *replica) {
+    if (server.numa_repl_backlog_node >= 0 &&
+        replica->numa_node != server.numa_repl_backlog_node)
+    {
+        replica->numa_node = numaIOClientMove(replica->numa_node,
+                                              server.numa_repl_backlog_node);
+    }
+    clientInstallWriteHandler(replica);
+}
+
+/* Number of replicas currently sending from the backlog. */
+int replicationBacklogRefReplicas(void) {
+    listNode *ln;
+    listIter li;
+    int count = 0;
+
+    listRewind(server.slaves,&li);
+    while((ln = listNext(&li))) {
+        client *slave = ln->value;
+        if (slave->repl_backlog_ref_off != -1) count++;
+    }
+    return count;
+}
+
 int canFeedReplicaReplBuffer(client *replica) {
     /* Don't feed replicas that only want the RDB. */
     if (replica->flags & CLIENT_REPL_RDBONLY) return 0;
@@ -233,6 +366,15 @@ void replicationFeedSlaves(list *slaves, int dictid, robj **argv, int argc) {
     /* We can't have slaves attached and no backlog. */
     serverAssert(!(listLength(slaves) != 0 && server.repl_backlog == NULL));
 
+    /* Replicas sending from the backlog must not be overrun by what follows:
+     * an upper bound of the SELECT plus the command is enough. */
+    if (server.repl_backlog) {
+        size_t reserve = 64 + LONG_STR_SIZE;
+        for (j = 0; j < argc; j++)
+            reserve += stringObjectLen(argv[j]) + LONG_STR_SIZE + 5;
+        replicationBacklogReserve(reserve);
+    }
+
     /* Send SELECT command to every slave if needed. */
     if (server.slaveseldb != dictid) {
         robj *selectcmd;
@@ -259,6 +401,7 @@ void replicationFeedSlaves(list *slaves, int dictid, robj **argv, int argc) {
             client *slave = ln->value;
 
             if (!canFeedReplicaReplBuffer(slave)) continue;
+            if (slave->repl_backlog_ref_off != -1) continue;
             addReply(slave,selectcmd);
         }
 
@@ -301,6 +444,12 @@ void replicationFeedSlaves(list *slaves, int dictid, robj **argv, int argc) {
 
         if (!canFeedReplicaReplBuffer(slave)) continue;
 
+        /* Replicas sending from the backlog already have it all. */
+        if (slave->repl_backlog_ref_off != -1) {
+            replicationBacklogRefNotify(slave);
+            continue;
+        }
+
         /* Feed slaves that are waiting for the initial SYNC (so these commands
          * are queued in the output buffer until the initial SYNC completes),
          * or are already in sync with the master. */
@@ -366,12 +515,19 @@ void replicationFeedSlavesFromMasterStream(list *slaves, char *buf, size_t bufle
         printf("\n");
     }
 
-    if (server.repl_backlog) feedReplicationBacklog(buf,buflen);
+    if (server.repl_backlog) {
+        replicationBacklogReserve(buflen);
+        feedReplicationBacklog(buf,buflen);
+    }
     listRewind(slaves,&li);
     while((ln = listNext(&li))) {
         client *slave = ln->value;
 
         if (!canFeedReplicaReplBuffer(slave)) continue;
+        if (slave->repl_backlog_ref_off != -1) {
+            replicationBacklogRefNotify(slave);
+            continue;
+        }
         addReplyProto(slave,buf,buflen);
     }
 }
@@ -2996,6 +3152,7 @@ void replicationResurrectCachedMaster(connection *conn) {
     server.master = server.cached_master;
     server.cached_master = NULL;
     server.master->conn = conn;
+    server.master->numa_node = numaIOClientAttach(conn);
     connSetPrivateData(server.master->conn, server.master);
     server.master->flags &= ~(CLIENT_CLOSE_AFTER_REPLY|CLIENT_CLOSE_ASAP);
     server.master->authenticated = 1;
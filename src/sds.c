@@ -173,6 +173,56 @@ sds sdstrynewlen(const void *init, size_t initlen) {
     return _sdsnewlen(init, initlen, 1);
 }
 
+/* Return the bytes sdsnewembedded() needs to store a string of 'initlen'
+ * bytes. */
+size_t sdsEmbedSize(size_t initlen) {
+    return sdsHdrSize(sdsReqType(initlen))+initlen+1;
+}
+
+/* Create an sds string holding 'init' in the caller owned buffer 'buf', of
+ * at least sdsEmbedSize(initlen) bytes. The string has no spare room and
+ * lives as long as the buffer: it can be read, compared and duplicated,
+ * but never grown or freed with sdsfree(). */
+sds sdsnewembedded(void *buf, const void *init, size_t initlen) {
+    char type = sdsReqType(initlen);
+    sds s = (char*)buf+sdsHdrSize(type);
+    unsigned char *fp = ((unsigned char*)s)-1;
+
+    switch(type) {
+        case SDS_TYPE_5: {
+            *fp = type | (initlen << SDS_TYPE_BITS);
+            break;
+        }
+        case SDS_TYPE_8: {
+            SDS_HDR_VAR(8,s);
+            sh->len = sh->alloc = initlen;
+            *fp = type;
+            break;
+        }
+        case SDS_TYPE_16: {
+            SDS_HDR_VAR(16,s);
+            sh->len = sh->alloc = initlen;
+            *fp = type;
+            break;
+        }
+        case SDS_TYPE_32: {
+            SDS_HDR_VAR(32,s);
+            sh->len = sh->alloc = initlen;
+            *fp = type;
+            break;
+        }
+        case SDS_TYPE_64: {
+            SDS_HDR_VAR(64,s);
+            sh->len = sh->alloc = initlen;
+            *fp = type;
+            break;
+        }
+    }
+    if (initlen) memcpy(s, init, initlen);
+    s[initlen] = '\0';
+    return s;
+}
+
 /* Create an empty (zero length) sds string. Even in this case the string
  * always has an implicit null term. */
 sds sdsempty(void) {
@@ -217,6 +217,8 @@ static inline void sdssetalloc(sds s, size_t newlen) {
 
 sds sdsnewlen(const void *init, size_t initlen);
 sds sdstrynewlen(const void *init, size_t initlen);
+size_t sdsEmbedSize(size_t initlen);
+sds sdsnewembedded(void *buf, const void *init, size_t initlen);
 sds sdsnew(const char *init);
 sds sdsempty(void);
 sds sdsdup(const sds s);
@@ -36,6 +36,8 @@
 #include "atomicvar.h"
 #include "mt19937-64.h"
 #include "zmalloc.h"
+#include "numa_reply_pool.h"
+#include "numa_quicklist_pool.h"
 
 #include <time.h>
 #include <signal.h>
@@ -1292,6 +1294,20 @@ void dictSdsDestructor(void *privdata, void *val)
     sdsfree(val);
 }
 
+/* Keys of the main dict not longer than keyspace-embedded-key-max-len are
+ * copied into their dictEntry allocation, see dictType.keyEmbedLen. */
+size_t dictSdsKeyEmbedLen(const void *key) {
+    size_t len = sdslen((sds)key);
+
+    if (server.keyspace_embedded_key_max_len == 0 ||
+        len > (size_t)server.keyspace_embedded_key_max_len) return 0;
+    return sdsEmbedSize(len);
+}
+
+void *dictSdsKeyEmbed(void *buf, const void *key) {
+    return sdsnewembedded(buf,key,sdslen((sds)key));
+}
+
 int dictObjKeyCompare(void *privdata, const void *key1,
         const void *key2)
 {
@@ -1409,7 +1425,8 @@ dictType zsetDictType = {
     NULL                       /* allow to expand */
 };
 
-/* Db->dict, keys are sds strings, vals are Redis objects. */
+/* Db->dict, keys are sds strings (short ones embedded in the dictEntry),
+ * vals are Redis objects. */
 dictType dbDictType = {
     dictSdsHash,                /* hash function */
     NULL,                       /* key dup */
@@ -1417,7 +1434,9 @@ dictType dbDictType = {
     dictSdsKeyCompare,          /* key compare */
     dictSdsDestructor,          /* key destructor */
     dictObjectDestructor,       /* val destructor */
-    dictExpandAllowed           /* allow to expand */
+    dictExpandAllowed,          /* allow to expand */
+    dictSdsKeyEmbedLen,         /* key embed len */
+    dictSdsKeyEmbed             /* key embed */
 };
 
 /* server.lua_scripts sha (as sds string) -> scripts (as robj) cache. */
@@ -1453,7 +1472,7 @@ dictType commandTableDictType = {
     NULL                        /* allow to expand */
 };
 
-/* Hash type hash table (note that small hashes are represented with ziplists) */
+/* Hash type hash table (note that small hashes are represented with listpacks) */
 dictType hashDictType = {
     dictSdsHash,                /* hash function */
     NULL,                       /* key dup */
@@ -1575,19 +1594,48 @@ void tryResizeHashTables(int dbid) {
  * The function returns 1 if some rehashing was performed, otherwise 0
  * is returned. */
 int incrementallyRehash(int dbid) {
-    /* Keys dictionary */
-    if (dictIsRehashing(server.db[dbid].dict)) {
+    mstime_t latency;
+
+    /* Keys dictionary. With numa-keyspace-shards every shard rehashes on
+     * its own, dictRehashMilliseconds() steps the ones that are rehashing. */
+    if (dictRehashPending(server.db[dbid].dict)) {
+        latencyStartMonitor(latency);
         dictRehashMilliseconds(server.db[dbid].dict,1);
+        latencyEndMonitor(latency);
+        latencyAddSampleIfNeeded("dict-rehash",latency);
         return 1; /* already used our millisecond for this loop... */
     }
     /* Expires */
-    if (dictIsRehashing(server.db[dbid].expires)) {
+    if (dictRehashPending(server.db[dbid].expires)) {
+        latencyStartMonitor(latency);
         dictRehashMilliseconds(server.db[dbid].expires,1);
+        latencyEndMonitor(latency);
+        latencyAddSampleIfNeeded("dict-rehash",latency);
         return 1; /* already used our millisecond for this loop... */
     }
     return 0;
 }
 
+/* Big dict tables are allocated, and freed after rehashing, by the lazyfree
+ * workers when dict-background-resize-threshold is set, see dict.c. */
+static void dictBackgroundSubmit(int node, void (*fn)(void *args[]), void *arg) {
+    bioCreateLazyFreeJobOnNode(node,fn,1,arg);
+}
+
+/* Dicts are also resized and freed by the RDB loader threads and the worker
+ * pool, while the latency monitor may only be written by the main thread. */
+static void dictReportLatency(const char *event, long long ms) {
+    if (!pthread_equal(pthread_self(),server.main_thread_id)) return;
+    latencyAddSampleIfNeeded(event,ms);
+}
+
+static dictBackgroundHooks dictBgHooks = {0, dictBackgroundSubmit, dictReportLatency};
+
+void updateDictBackgroundHooks(void) {
+    dictBgHooks.min_bytes = server.dict_background_resize_threshold;
+    dictSetBackgroundHooks(&dictBgHooks);
+}
+
 /* This function is called once a background process of some kind terminates,
  * as we want to avoid resizing the hash tables when there is a child in order
  * to play well with copy-on-write (otherwise when a resize happens lots of
@@ -3163,6 +3211,8 @@ void resetServerStats(void) {
     atomicSet(server.stat_total_reads_processed, 0);
     server.stat_io_writes_processed = 0;
     atomicSet(server.stat_total_writes_processed, 0);
+    server.stat_parallel_sort_ops = 0;
+    server.stat_parallel_zset_ops = 0;
     for (j = 0; j < STATS_METRIC_COUNT; j++) {
         server.inst_metric[j].idx = 0;
         server.inst_metric[j].last_sample_time = mstime();
@@ -3174,7 +3224,7 @@ void resetServerStats(void) {
     atomicSet(server.stat_net_output_bytes, 0);
     server.stat_unexpected_error_replies = 0;
     server.stat_total_error_replies = 0;
-    server.stat_dump_payload_sanitizations = 0;
+    atomicSet(server.stat_dump_payload_sanitizations, 0);
     server.aof_delayed_fsync = 0;
 }
 
@@ -3311,8 +3361,8 @@ void initServer(void) {
 
     /* Create the Redis databases, and initialize other internal state. */
     for (j = 0; j < server.dbnum; j++) {
-        server.db[j].dict = dictCreate(&dbDictType,NULL);
-        server.db[j].expires = dictCreate(&dbExpiresDictType,NULL);
+        server.db[j].dict = dbCreateDict(&dbDictType);
+        server.db[j].expires = dbCreateDict(&dbExpiresDictType);
         server.db[j].expires_cursor = 0;
         server.db[j].blocking_keys = dictCreate(&keylistDictType,NULL);
         server.db[j].ready_keys = dictCreate(&objectKeyPointerValueDictType,NULL);
@@ -3445,6 +3495,7 @@ void initServer(void) {
  * see: https://sourceware.org/bugzilla/show_bug.cgi?id=19329 */
 void InitServerLast() {
     bioInit();
+    updateDictBackgroundHooks();
     initThreadedIO();
     set_jemalloc_bg_thread(server.jemalloc_bg_thread);
     server.initial_memory_usage = zmalloc_used_memory();
@@ -4179,7 +4230,7 @@ int processCommand(client *c) {
      * the event loop since there is a busy Lua script running in timeout
      * condition, to avoid mixing the propagation of scripts with the
      * propagation of DELs due to eviction. */
-    if (server.maxmemory && !server.lua_timedout) {
+    if ((server.maxmemory || evictionNodeBudgetsActive()) && !server.lua_timedout) {
         int out_of_memory = (performEvictions() == EVICT_FAIL);
 
         /* performEvictions may evict keys, so we need flush pending tracking
@@ -4974,6 +5025,16 @@ sds genRedisInfoString(const char *section) {
             lazyfreeGetPendingObjectsCount(),
             lazyfreeGetFreedObjectsCount()
         );
+        for (int j = 0; j < bioLazyFreeNodeWorkers(); j++) {
+            bioWorkerStats ws;
+            if (bioGetLazyFreeNodeStats(j,&ws) == C_ERR) continue;
+            /* The rate is per second the worker spent freeing, not per
+             * second of wall time: it measures the worker speed. */
+            info = sdscatprintf(info,
+                "lazyfree_node%d:pending=%llu,freed=%llu,busy_usec=%llu,freed_per_busy_sec=%.2f\r\n",
+                j, ws.pending, ws.processed, ws.busy_usec,
+                ws.busy_usec ? (double)ws.processed*1000000/ws.busy_usec : 0);
+        }
         freeMemoryOverheadData(mh);
     }
 
@@ -5004,6 +5065,8 @@ sds genRedisInfoString(const char *section) {
             "rdb_last_bgsave_time_sec:%jd\r\n"
             "rdb_current_bgsave_time_sec:%jd\r\n"
             "rdb_last_cow_size:%zu\r\n"
+            "rdb_last_load_keys_per_sec:%.2f\r\n"
+            "rdb_last_load_mb_per_sec:%.2f\r\n"
             "aof_enabled:%d\r\n"
             "aof_rewrite_in_progress:%d\r\n"
             "aof_rewrite_scheduled:%d\r\n"
@@ -5028,6 +5091,8 @@ sds genRedisInfoString(const char *section) {
             (intmax_t)((server.child_type != CHILD_TYPE_RDB) ?
                 -1 : time(NULL)-server.rdb_save_time_start),
             server.stat_rdb_cow_bytes,
+            server.rdb_last_load_keys_per_sec,
+            server.rdb_last_load_mb_per_sec,
             server.aof_state != AOF_OFF,
             server.child_type == CHILD_TYPE_AOF,
             server.aof_rewrite_scheduled,
@@ -5083,19 +5148,28 @@ sds genRedisInfoString(const char *section) {
                 eta = (elapsed*remaining_bytes)/(server.loading_loaded_bytes+1);
             }
 
+            /* Throughput so far, the first second counts as a whole one. */
+            time_t rate_elapsed = elapsed ? elapsed : 1;
+
             info = sdscatprintf(info,
                 "loading_start_time:%jd\r\n"
                 "loading_total_bytes:%llu\r\n"
                 "loading_rdb_used_mem:%llu\r\n"
                 "loading_loaded_bytes:%llu\r\n"
                 "loading_loaded_perc:%.2f\r\n"
-                "loading_eta_seconds:%jd\r\n",
+                "loading_eta_seconds:%jd\r\n"
+                "loading_loaded_keys:%lld\r\n"
+                "loading_keys_per_sec:%.2f\r\n"
+                "loading_mb_per_sec:%.2f\r\n",
                 (intmax_t) server.loading_start_time,
                 (unsigned long long) server.loading_total_bytes,
                 (unsigned long long) server.loading_rdb_used_mem,
                 (unsigned long long) server.loading_loaded_bytes,
                 perc,
-                (intmax_t)eta
+                (intmax_t)eta,
+                server.loading_loaded_keys,
+                (double)server.loading_loaded_keys/rate_elapsed,
+                (double)server.loading_loaded_bytes/rate_elapsed/(1024*1024)
             );
         }
     }
@@ -5104,10 +5178,12 @@ sds genRedisInfoString(const char *section) {
     if (allsections || defsections || !strcasecmp(section,"stats")) {
         long long stat_total_reads_processed, stat_total_writes_processed;
         long long stat_net_input_bytes, stat_net_output_bytes;
+        long long stat_dump_payload_sanitizations;
         atomicGet(server.stat_total_reads_processed, stat_total_reads_processed);
         atomicGet(server.stat_total_writes_processed, stat_total_writes_processed);
         atomicGet(server.stat_net_input_bytes, stat_net_input_bytes);
         atomicGet(server.stat_net_output_bytes, stat_net_output_bytes);
+        atomicGet(server.stat_dump_payload_sanitizations, stat_dump_payload_sanitizations);
 
         if (sections++) info = sdscat(info,"\r\n");
         info = sdscatprintf(info,
@@ -5154,7 +5230,9 @@ sds genRedisInfoString(const char *section) {
             "total_reads_processed:%lld\r\n"
             "total_writes_processed:%lld\r\n"
             "io_threaded_reads_processed:%lld\r\n"
-            "io_threaded_writes_processed:%lld\r\n",
+            "io_threaded_writes_processed:%lld\r\n"
+            "parallel_sort_ops:%lld\r\n"
+            "parallel_zset_ops:%lld\r\n",
             server.stat_numconnections,
             server.stat_numcommands,
             getInstantaneousMetric(STATS_METRIC_COMMAND),
@@ -5193,11 +5271,13 @@ sds genRedisInfoString(const char *section) {
             (unsigned long long) trackingGetTotalPrefixes(),
             server.stat_unexpected_error_replies,
             server.stat_total_error_replies,
-            server.stat_dump_payload_sanitizations,
+            stat_dump_payload_sanitizations,
             stat_total_reads_processed,
             stat_total_writes_processed,
             server.stat_io_reads_processed,
-            server.stat_io_writes_processed);
+            server.stat_io_writes_processed,
+            server.stat_parallel_sort_ops,
+            server.stat_parallel_zset_ops);
     }
 
     /* Replication */
@@ -5336,7 +5416,8 @@ sds genRedisInfoString(const char *section) {
             "repl_backlog_active:%d\r\n"
             "repl_backlog_size:%lld\r\n"
             "repl_backlog_first_byte_offset:%lld\r\n"
-            "repl_backlog_histlen:%lld\r\n",
+            "repl_backlog_histlen:%lld\r\n"
+            "repl_backlog_shared_replicas:%d\r\n",
             getFailoverStateString(),
             server.replid,
             server.replid2,
@@ -5345,7 +5426,8 @@ sds genRedisInfoString(const char *section) {
             server.repl_backlog != NULL,
             server.repl_backlog_size,
             server.repl_backlog_off,
-            server.repl_backlog_histlen);
+            server.repl_backlog_histlen,
+            replicationBacklogRefReplicas());
     }
 
     /* CPU */
@@ -5435,6 +5517,14 @@ sds genRedisInfoString(const char *section) {
         server.cluster_enabled);
     }
 
+#ifdef HAVE_NUMA
+    /* NUMA */
+    if (allsections || defsections || !strcasecmp(section,"numa")) {
+        if (sections++) info = sdscat(info,"\r\n");
+        info = genNumaInfoString(info);
+    }
+#endif
+
     /* Key space */
     if (allsections || defsections || !strcasecmp(section,"keyspace")) {
         if (sections++) info = sdscat(info,"\r\n");
@@ -6274,7 +6364,10 @@ struct redisTest {
     {"crc64", crc64Test},
     {"zmalloc", zmalloc_test},
     {"sds", sdsTest},
-    {"dict", dictTest}
+    {"dict", dictTest},
+    {"bitops", bitopsTest},
+    {"zbtree", zbtreeTest},
+    {"parallel", parallelTest}
 };
 redisTestProc *getTestProcByName(const char *name) {
     int numtests = sizeof(redisTests)/sizeof(struct redisTest);
@@ -6504,6 +6597,19 @@ int main(int argc, char **argv) {
         serverLog(LL_WARNING, "Failed to initialize NUMA key migration module");
     }
 
+    /* 每节点回复块回收池 */
+    numaReplyPoolInit();
+
+    /* 每节点 quicklist 节点回收池 */
+    numaQuicklistPoolInit();
+
+    /* 应用 numa-node-capacity（加载配置文件时不触发 update 回调，此处统一应用） */
+    {
+        const char *err = NULL;
+        if (!numaApplyNodeCapacitySpec(server.numa_node_capacity, 1, &err))
+            serverLog(LL_WARNING, "Invalid numa-node-capacity: %s", err);
+    }
+
     /* 初始化带宽监控 */
     if (numa_bw_monitor_init() == 0) {
         serverLog(LL_NOTICE, "NUMA bandwidth monitor initialized");
@@ -6511,6 +6617,18 @@ int main(int argc, char **argv) {
         serverLog(LL_WARNING, "NUMA bandwidth monitor init failed, using defaults");
     }
 
+    /* 启动访存延迟探针（numa-latency-probe-interval 为 0 时不启动） */
+    if (numa_lat_probe_start(server.numa_latency_probe_interval,
+                             server.numa_latency_probe_buffer) != 0) {
+        serverLog(LL_WARNING, "NUMA latency probe not started, falling back to numa_distance()");
+    }
+
+    /* 启动带宽高频采样线程（manual 后端或间隔为 0 时由 serverCron 每秒采样） */
+    if (server.numa_bw_sample_interval > 0 &&
+        numa_bw_sampler_start(server.numa_bw_sample_interval) != 0) {
+        serverLog(LL_NOTICE, "NUMA bandwidth sampler not started, sampling from serverCron");
+    }
+
     /* 如果配置文件中指定了 numa-migrate-config，加载 JSON 配置并应用到默认策略 */
     if (server.numa_migrate_config_file) {
         composite_lru_config_t numa_cfg;
@@ -65,7 +65,10 @@ typedef long long ustime_t; /* microsecond time type. */
 #include "zmalloc.h" /* total memory usage aware version of malloc/free */
 #include "anet.h"    /* Networking the easy way */
 #include "ziplist.h" /* Compact list data structure */
+#include "listpack.h" /* Compact list of strings and integers */
 #include "intset.h"  /* Compact integer set structure */
+#include "zbtree.h"  /* B+tree index of large sorted sets */
+#include "parallel.h" /* Worker pool for CPU bound command phases */
 #include "version.h" /* Version macro */
 #include "util.h"    /* Misc functions useful in many places */
 #include "latency.h" /* Latency monitor API */
@@ -156,6 +159,7 @@ typedef long long ustime_t; /* microsecond time type. */
 /* Protocol and I/O related defines */
 #define PROTO_IOBUF_LEN         (1024*16)  /* Generic I/O buffer size */
 #define PROTO_REPLY_CHUNK_BYTES (16*1024) /* 16k output buffer */
+#define PROTO_PREFETCH_MAX_BATCH 128 /* Max pipeline-prefetch-batch. */
 #define PROTO_INLINE_MAX_SIZE   (1024*64) /* Max size of inline reads */
 #define PROTO_MBULK_BIG_ARG     (1024*32)
 #define LONG_STR_SIZE      21          /* Bytes needed for long -> str + '\0' */
@@ -674,6 +678,8 @@ typedef struct RedisModuleDigest {
 #define OBJ_ENCODING_EMBSTR 8  /* Embedded sds string encoding */
 #define OBJ_ENCODING_QUICKLIST 9 /* Encoded as linked list of ziplists */
 #define OBJ_ENCODING_STREAM 10 /* Encoded as a radix tree of listpacks */
+#define OBJ_ENCODING_NUMA_COLD 11 /* LZF compressed blob on a far NUMA node */
+#define OBJ_ENCODING_LISTPACK 12 /* Encoded as a listpack */
 
 #define LRU_BITS 24
 #define LRU_CLOCK_MAX ((1<<LRU_BITS)-1) /* Max value of obj->lru */
@@ -880,11 +886,14 @@ typedef struct client {
                                replication stream that we are receiving from
                                the master. */
     size_t querybuf_peak;   /* Recent (100ms or more) peak of querybuf size. */
+    int numa_node;          /* NUMA node the client is affine to (-1 = none). */
     int argc;               /* Num of arguments of current command. */
     robj **argv;            /* Arguments of current command. */
     int original_argc;      /* Num of arguments of original command if arguments were rewritten. */
     robj **original_argv;   /* Arguments of original command if arguments were rewritten. */
     size_t argv_len_sum;    /* Sum of lengths of objects in argv list. */
+    struct clientArgvCache *argv_cache; /* Argument objects to reuse (client-argv-cache). */
+    int prefetch_window;    /* Pipelined commands whose keys were prefetched. */
     struct redisCommand *cmd, *lastcmd;  /* Last command executed. */
     user *user;             /* User associated with this connection. If the
                                user is set to NULL the connection can do
@@ -912,6 +921,8 @@ typedef struct client {
     long long read_reploff; /* Read replication offset if this is a master. */
     long long reploff;      /* Applied replication offset if this is a master. */
     long long repl_ack_off; /* Replication ack offset, if this is a slave. */
+    long long repl_backlog_ref_off; /* Offset sent so far if this slave sends
+                                       from the backlog, else -1. */
     long long repl_ack_time;/* Replication ack time, if this is a slave. */
     long long repl_last_partial_write; /* The last time the server did a partial write from the RDB child pipe to this replica  */
     long long psync_initial_offset; /* FULLRESYNC reply offset other slaves
@@ -1025,11 +1036,46 @@ typedef struct zskiplist {
     int level;
 } zskiplist;
 
+/* The dict maps every element to its score (stored by value in the entry),
+ * the ordered index is a skiplist or, once the sorted set reaches
+ * zset-btree-min-entries elements, a B+tree: exactly one of 'zsl' and 'zbt'
+ * is set. The encoding is OBJ_ENCODING_SKIPLIST in both cases. */
 typedef struct zset {
     dict *dict;
     zskiplist *zsl;
+    zbtree *zbt;
 } zset;
 
+/* Position of an element in the ordered index of a zset: 'node' is used for
+ * skiplists, 'bt' for B+trees. It points to no element when both 'node'
+ * and 'bt.leaf' are NULL. */
+typedef struct zsetCursor {
+    zskiplistNode *node;
+    zbtCursor bt;
+} zsetCursor;
+
+static inline int zsetCursorValid(const zsetCursor *c) {
+    return c->node != NULL || c->bt.leaf != NULL;
+}
+
+static inline double zsetCursorScore(const zsetCursor *c) {
+    return c->node ? c->node->score : zbtCursorScore(&c->bt);
+}
+
+static inline sds zsetCursorEle(const zsetCursor *c) {
+    return c->node ? c->node->ele : zbtCursorEle(&c->bt);
+}
+
+static inline void zsetCursorNext(zsetCursor *c) {
+    if (c->node) c->node = c->node->level[0].forward;
+    else zbtNext(&c->bt);
+}
+
+static inline void zsetCursorPrev(zsetCursor *c) {
+    if (c->node) c->node = c->node->backward;
+    else zbtPrev(&c->bt);
+}
+
 typedef struct clientBufferLimitsConfig {
     unsigned long long hard_limit_bytes;
     unsigned long long soft_limit_bytes;
@@ -1256,6 +1302,9 @@ struct redisServer {
     int io_threads_num;         /* Number of IO threads to use. */
     int io_threads_do_reads;    /* Read and parse from IO threads? */
     int io_threads_active;      /* Is IO threads currently active? */
+    int parallel_ops_threads;   /* Threads for SORT / ZUNION / ZINTER. */
+    size_t parallel_sort_min_elements; /* Smallest SORT using them. */
+    size_t parallel_zset_min_elements; /* Smallest ZUNION / ZINTER using them. */
     long long events_processed_while_blocked; /* processEventsWhileBlocked() */
 
     /* RDB / AOF loading information */
@@ -1263,7 +1312,10 @@ struct redisServer {
     off_t loading_total_bytes;
     off_t loading_rdb_used_mem;
     off_t loading_loaded_bytes;
+    long long loading_loaded_keys;
     time_t loading_start_time;
+    double rdb_last_load_keys_per_sec; /* Throughput of the last RDB load. */
+    double rdb_last_load_mb_per_sec;
     off_t loading_process_events_interval_bytes;
     /* Fast pointers to often looked up command */
     struct redisCommand *delCommand, *multiCommand, *lpushCommand,
@@ -1319,9 +1371,11 @@ struct redisServer {
     uint64_t stat_clients_type_memory[CLIENT_TYPE_COUNT];/* Mem usage by type */
     long long stat_unexpected_error_replies; /* Number of unexpected (aof-loading, replica to master, etc.) error replies */
     long long stat_total_error_replies; /* Total number of issued error replies ( command + rejected errors ) */
-    long long stat_dump_payload_sanitizations; /* Number deep dump payloads integrity validations. */
+    redisAtomic long long stat_dump_payload_sanitizations; /* Number deep dump payloads integrity validations. */
     long long stat_io_reads_processed; /* Number of read events processed by IO / Main threads */
     long long stat_io_writes_processed; /* Number of write events processed by IO / Main threads */
+    long long stat_parallel_sort_ops; /* SORT commands executed by the parallel ops pool */
+    long long stat_parallel_zset_ops; /* ZUNION / ZINTER commands executed by the pool */
     redisAtomic long long stat_total_reads_processed; /* Total number of read events processed */
     redisAtomic long long stat_total_writes_processed; /* Total number of write events processed */
     /* The following two are used to track instantaneous metrics, like
@@ -1518,6 +1572,7 @@ struct redisServer {
     int maxmemory_eviction_tenacity;/* Aggressiveness of eviction processing */
     int lfu_log_factor;             /* LFU logarithmic counter factor. */
     int lfu_decay_time;             /* LFU counter decay factor. */
+    size_t maxmemory_node[NUMA_ACCT_MAX_NODES]; /* 每节点内存预算 (maxmemory-node, 0=不限) */
     /* NUMA Demotion 配置 */
     int numa_demote_enabled;           /* 启用 NUMA 降级 */
     size_t numa_demote_min_size;       /* 最小降级大小 */
@@ -1528,6 +1583,28 @@ struct redisServer {
     int numa_demote_bandwidth_weight;  /* NUMA降级带宽权重 (0-100, 默认30) */
     double numa_bw_saturation_threshold; /* 带宽饱和排除阈值 (默认0.95) */
     int numa_demote_prefer_closer;     /* 优先更近节点 */
+    int numa_latency_probe_interval;   /* 延迟探针周期 (毫秒, 0=禁用) */
+    size_t numa_latency_probe_buffer;  /* 每个内存节点的探针缓冲区大小 */
+    char *numa_node_capacity;          /* 每节点容量覆盖 "节点:容量 ..." (NULL=探测值) */
+    int numa_bw_sample_interval;       /* 带宽高频采样周期 (毫秒, 0=随 serverCron 每秒采样) */
+    int numa_cold_compress;            /* 降级时以 LZF 压缩形式存放冷值 */
+    size_t numa_cold_compress_min_size; /* 冷层压缩最小值大小 */
+    int numa_io_threads;               /* io 线程按 NUMA 节点分组，客户端节点亲和 */
+    int numa_lazyfree_workers;         /* 每个 NUMA 节点一个 lazyfree 线程，按值所在节点释放 */
+    int numa_rdb_placement;            /* RDB 中记录每个 key 的节点与热度，加载时恢复 */
+    int numa_rdb_load_threads;         /* RDB 加载解码线程数 (0=主线程串行加载) */
+    int numa_bgsave_per_node;          /* 快照子进程按值所在节点并行序列化 */
+    int numa_rdb_hot_first;            /* RDB 按热度分组保存，热 key 在前 */
+    int numa_reply_pool_blocks;        /* 每节点回复块回收池的块数上限 (0=不回收) */
+    int numa_quicklist_pool_nodes;     /* 每节点 quicklist 节点回收池上限 (0=不回收) */
+    int client_argv_cache;             /* Reuse argv objects and arrays of clients. */
+    int pipeline_prefetch_batch;       /* Pipelined commands to prefetch keys for (0=off). */
+    int numa_repl_backlog_node;        /* 复制积压缓冲区所在节点 (-1=不指定) */
+    int repl_backlog_shared_output;    /* Online slaves send from the backlog. */
+    int keyspace_bucketed_dict;        /* DB dicts store entries in cache line buckets. */
+    int numa_keyspace_shards;          /* Node partitioned sub-dicts per DB dict, 0 = off. */
+    int keyspace_embedded_key_max_len; /* Keys up to this length live in their dictEntry, 0 = off. */
+    size_t dict_background_resize_threshold; /* Min table size resized in background. */
     long long proto_max_bulk_len;   /* Protocol bulk length maximum size. */
     int oom_score_adj_base;         /* Base oom_score_adj value, as observed on startup */
     int oom_score_adj_values[CONFIG_OOM_COUNT];   /* Linux oom_score_adj configuration */
@@ -1549,11 +1626,12 @@ struct redisServer {
     int sort_bypattern;
     int sort_store;
     /* Zip structure config, see redis.conf for more information  */
-    size_t hash_max_ziplist_entries;
-    size_t hash_max_ziplist_value;
+    size_t hash_max_listpack_entries;
+    size_t hash_max_listpack_value;
     size_t set_max_intset_entries;
-    size_t zset_max_ziplist_entries;
-    size_t zset_max_ziplist_value;
+    size_t zset_max_listpack_entries;
+    size_t zset_max_listpack_value;
+    size_t zset_btree_min_entries;
     size_t hll_sparse_max_bytes;
     size_t stream_node_max_bytes;
     long long stream_node_max_entries;
@@ -1835,6 +1913,9 @@ void getRandomBytes(unsigned char *p, size_t len);
 uint64_t crc64(uint64_t crc, const unsigned char *s, uint64_t l);
 void exitFromChild(int retcode);
 long long redisPopcount(void *s, long count);
+#ifdef REDIS_TEST
+int bitopsTest(int argc, char **argv, int accurate);
+#endif
 int redisSetProcTitle(char *title);
 int validateProcTitleTemplate(const char *template);
 int redisCommunicateSystemd(const char *sd_notify_msg);
@@ -1930,6 +2011,7 @@ int handleClientsWithPendingWritesUsingThreads(void);
 int handleClientsWithPendingReadsUsingThreads(void);
 int stopThreadedIOIfNeeded(void);
 int clientHasPendingReplies(client *c);
+void clientInstallWriteHandler(client *c);
 void unlinkClient(client *c);
 int writeToClient(client *c, int handler_installed);
 void linkClient(client *c);
@@ -1969,6 +2051,7 @@ int checkPrefixCollisionsOrReply(client *c, robj **prefix, size_t numprefix);
 /* List data type */
 void listTypeTryConversion(robj *subject, robj *value);
 void listTypePush(robj *subject, robj *value, int where);
+void listTypePushBulk(robj *subject, robj **values, int count, int where);
 robj *listTypePop(robj *subject, int where);
 unsigned long listTypeLength(const robj *subject);
 listTypeIterator *listTypeInitIterator(robj *subject, long index, unsigned char direction);
@@ -2015,6 +2098,7 @@ robj *createObject(int type, void *ptr);
 robj *createStringObject(const char *ptr, size_t len);
 robj *createRawStringObject(const char *ptr, size_t len);
 robj *createEmbeddedStringObject(const char *ptr, size_t len);
+robj *initEmbeddedStringObject(void *block, const char *ptr, size_t len);
 robj *tryCreateRawStringObject(const char *ptr, size_t len);
 robj *tryCreateStringObject(const char *ptr, size_t len);
 robj *dupStringObject(const robj *o);
@@ -2023,6 +2107,7 @@ int isObjectRepresentableAsLongLong(robj *o, long long *llongval);
 robj *tryObjectEncoding(robj *o);
 robj *getDecodedObject(robj *o);
 size_t stringObjectLen(robj *o);
+#define OBJ_COMPUTE_SIZE_DEF_SAMPLES 5 /* Default sample size. */
 size_t objectComputeSize(robj *o, size_t sample_size);
 robj *createStringObjectFromLongLong(long long value);
 robj *createStringObjectFromLongLongForValue(long long value);
@@ -2033,7 +2118,7 @@ robj *createSetObject(void);
 robj *createIntsetObject(void);
 robj *createHashObject(void);
 robj *createZsetObject(void);
-robj *createZsetZiplistObject(void);
+robj *createZsetListpackObject(void);
 robj *createStreamObject(void);
 robj *createModuleObject(moduleType *mt, void *value);
 int getLongFromObjectOrReply(client *c, robj *o, long *target, const char *msg);
@@ -2070,6 +2155,9 @@ void replicationStartPendingFork(void);
 void replicationHandleMasterDisconnection(void);
 void replicationCacheMaster(client *c);
 void resizeReplicationBacklog(long long newsize);
+void replicationBacklogDetachReplicas(void);
+void replicationBacklogTryAttach(client *c);
+int replicationBacklogRefReplicas(void);
 void replicationSetMaster(char *ip, int port);
 void replicationUnsetMaster(void);
 void refreshGoodSlavesCount(void);
@@ -2218,16 +2306,16 @@ unsigned char *zzlFirstInRange(unsigned char *zl, zrangespec *range);
 unsigned char *zzlLastInRange(unsigned char *zl, zrangespec *range);
 unsigned long zsetLength(const robj *zobj);
 void zsetConvert(robj *zobj, int encoding);
-void zsetConvertToZiplistIfNeeded(robj *zobj, size_t maxelelen, size_t totelelen);
+void zsetConvertToListpackIfNeeded(robj *zobj, size_t maxelelen, size_t totelelen);
 int zsetScore(robj *zobj, sds member, double *score);
 unsigned long zslGetRank(zskiplist *zsl, double score, sds o);
 int zsetAdd(robj *zobj, double score, sds ele, int in_flags, int *out_flags, double *newscore);
 long zsetRank(robj *zobj, sds ele, int reverse);
 int zsetDel(robj *zobj, sds ele);
 robj *zsetDup(robj *o);
-int zsetZiplistValidateIntegrity(unsigned char *zl, size_t size, int deep);
+int zsetListpackValidateIntegrity(unsigned char *zl, size_t size, int deep);
 void genericZpopCommand(client *c, robj **keyv, int keyc, int where, int emitkey, robj *countarg);
-sds ziplistGetObject(unsigned char *sptr);
+sds lpGetObject(unsigned char *sptr);
 int zslValueGteMin(double value, zrangespec *spec);
 int zslValueLteMax(double value, zrangespec *spec);
 void zslFreeLexRange(zlexrangespec *spec);
@@ -2240,6 +2328,16 @@ int zzlLexValueGteMin(unsigned char *p, zlexrangespec *spec);
 int zzlLexValueLteMax(unsigned char *p, zlexrangespec *spec);
 int zslLexValueGteMin(sds value, zlexrangespec *spec);
 int zslLexValueLteMax(sds value, zlexrangespec *spec);
+unsigned long zsetIndexLength(const zset *zs);
+int zsetIndexAdd(zset *zs, double score, sds ele);
+void zsetIndexFree(zset *zs);
+int zsetIndexFirst(zset *zs, zsetCursor *c);
+int zsetIndexLast(zset *zs, zsetCursor *c);
+int zsetIndexFirstInRange(zset *zs, zrangespec *range, zsetCursor *c);
+int zsetIndexLastInRange(zset *zs, zrangespec *range, zsetCursor *c);
+int zsetIndexFirstInLexRange(zset *zs, zlexrangespec *range, zsetCursor *c);
+int zsetIndexLastInLexRange(zset *zs, zlexrangespec *range, zsetCursor *c);
+int zsetIndexElementByRank(zset *zs, unsigned long rank, zsetCursor *c);
 
 /* Core functions */
 int getMaxmemoryState(size_t *total, size_t *logical, size_t *tofree, float *level);
@@ -2332,10 +2430,10 @@ unsigned long hashTypeLength(const robj *o);
 hashTypeIterator *hashTypeInitIterator(robj *subject);
 void hashTypeReleaseIterator(hashTypeIterator *hi);
 int hashTypeNext(hashTypeIterator *hi);
-void hashTypeCurrentFromZiplist(hashTypeIterator *hi, int what,
-                                unsigned char **vstr,
-                                unsigned int *vlen,
-                                long long *vll);
+void hashTypeCurrentFromListpack(hashTypeIterator *hi, int what,
+                                 unsigned char **vstr,
+                                 unsigned int *vlen,
+                                 long long *vll);
 sds hashTypeCurrentFromHashTable(hashTypeIterator *hi, int what);
 void hashTypeCurrentObject(hashTypeIterator *hi, int what, unsigned char **vstr, unsigned int *vlen, long long *vll);
 sds hashTypeCurrentObjectNewSds(hashTypeIterator *hi, int what);
@@ -2343,7 +2441,7 @@ robj *hashTypeLookupWriteOrCreate(client *c, robj *key);
 robj *hashTypeGetValueObject(robj *o, sds field);
 int hashTypeSet(robj *o, sds field, sds value, int flags);
 robj *hashTypeDup(robj *o);
-int hashZiplistValidateIntegrity(unsigned char *zl, size_t size, int deep);
+int hashListpackValidateIntegrity(unsigned char *zl, size_t size, int deep);
 
 /* Pub / Sub */
 int pubsubUnsubscribeAllChannels(client *c, int notify);
@@ -2371,6 +2469,8 @@ int removeExpire(redisDb *db, robj *key);
 void deleteExpiredKeyAndPropagate(redisDb *db, robj *keyobj);
 void propagateExpire(redisDb *db, robj *key, int lazy);
 int keyIsExpired(redisDb *db, robj *key);
+dict *dbCreateDict(dictType *type);
+void updateDictBackgroundHooks(void);
 int expireIfNeeded(redisDb *db, robj *key);
 long long getExpire(redisDb *db, robj *key);
 void setExpire(client *c, redisDb *db, robj *key, long long when);
@@ -2515,6 +2615,7 @@ unsigned long LFUDecrAndReturn(robj *o);
 #define EVICT_RUNNING 1
 #define EVICT_FAIL 2
 int performEvictions(void);
+int evictionNodeBudgetsActive(void);
 
 
 /* Keys hashing / comparison functions for dict.c hash tables. */
@@ -2808,6 +2909,11 @@ int iAmMaster(void);
 #include "numa_key_migrate.h"
 #include "numa_composite_lru.h"
 #include "numa_bw_monitor.h"
+#include "evict.h"
+#include "numa_cold_tier.h"
+
+/* INFO numa 段（实现于 numa_command.c）*/
+sds genNumaInfoString(sds info);
 #endif
 
 #endif
@@ -33,8 +33,6 @@
 #include "pqsort.h" /* Partial qsort for SORT+LIMIT */
 #include <math.h> /* isnan() */
 
-zskiplistNode* zslGetElementByRank(zskiplist *zsl, unsigned long rank);
-
 redisSortOperation *createSortOperation(int type, robj *pattern) {
     redisSortOperation *so = zmalloc(sizeof(*so));
     so->type = type;
@@ -187,6 +185,46 @@ int sortCompare(const void *s1, const void *s2) {
     return server.sort_desc ? -cmp : cmp;
 }
 
+/* Set the numeric score of 'so' from 'byval'. Returns 0 if the value can't
+ * be converted to a double. */
+static int sortParseScore(redisSortObject *so, robj *byval) {
+    if (sdsEncodedObject(byval)) {
+        char *eptr;
+
+        so->u.score = strtod(byval->ptr,&eptr);
+        if (eptr[0] != '\0' || errno == ERANGE || isnan(so->u.score))
+            return 0;
+    } else if (byval->encoding == OBJ_ENCODING_INT) {
+        /* Don't need to decode the object if it's
+         * integer-encoded (the only encoding supported) so
+         * far. We can just cast it */
+        so->u.score = (long)byval->ptr;
+    } else {
+        serverAssertWithInfo(NULL,byval,1 != 1);
+    }
+    return 1;
+}
+
+/* Numeric SORT without BY: the scores are parsed from the elements
+ * themselves, a slice of the vector per pool thread. */
+typedef struct {
+    redisSortObject *vector;
+    int vectorlen, njobs;
+    int errors[PARALLEL_MAX_THREADS];
+} sortScoresJob;
+
+static void sortParseScoresJob(void *privdata, int idx) {
+    sortScoresJob *sj = privdata;
+    long start = (long)sj->vectorlen*idx/sj->njobs;
+    long end = (long)sj->vectorlen*(idx+1)/sj->njobs;
+
+    errno = 0;
+    for (long j = start; j < end; j++) {
+        if (!sortParseScore(&sj->vector[j],sj->vector[j].obj))
+            sj->errors[idx] = 1;
+    }
+}
+
 /* The SORT command is the most complex command in Redis. Warning: this code
  * is optimized for speed and a bit less for readability */
 void sortCommand(client *c) {
@@ -406,8 +444,7 @@ void sortCommand(client *c) {
          * way, just getting the required range, as an optimization. */
 
         zset *zs = sortval->ptr;
-        zskiplist *zsl = zs->zsl;
-        zskiplistNode *ln;
+        zsetCursor zc;
         sds sdsele;
         int rangelen = vectorlen;
 
@@ -415,23 +452,25 @@ void sortCommand(client *c) {
         if (desc) {
             long zsetlen = dictSize(((zset*)sortval->ptr)->dict);
 
-            ln = zsl->tail;
             if (start > 0)
-                ln = zslGetElementByRank(zsl,zsetlen-start);
+                zsetIndexElementByRank(zs,zsetlen-start,&zc);
+            else
+                zsetIndexLast(zs,&zc);
         } else {
-            ln = zsl->header->level[0].forward;
             if (start > 0)
-                ln = zslGetElementByRank(zsl,start+1);
+                zsetIndexElementByRank(zs,start+1,&zc);
+            else
+                zsetIndexFirst(zs,&zc);
         }
 
         while(rangelen--) {
-            serverAssertWithInfo(c,sortval,ln != NULL);
-            sdsele = ln->ele;
+            serverAssertWithInfo(c,sortval,zsetCursorValid(&zc));
+            sdsele = zsetCursorEle(&zc);
             vector[j].obj = createStringObject(sdsele,sdslen(sdsele));
             vector[j].u.score = 0;
             vector[j].u.cmpobj = NULL;
             j++;
-            ln = desc ? ln->backward : ln->level[0].forward;
+            if (desc) zsetCursorPrev(&zc); else zsetCursorNext(&zc);
         }
         /* Fix start/end: output code is not aware of this optimization. */
         end -= start;
@@ -455,8 +494,18 @@ void sortCommand(client *c) {
     }
     serverAssertWithInfo(c,sortval,j == vectorlen);
 
+    /* Big inputs are parsed and sorted by the parallel ops threads: only the
+     * BY lookups, that access the keyspace, are left to this thread. */
+    int parallel = !dontsort && parallelThreadsNum() > 1 &&
+                   (size_t)vectorlen >= server.parallel_sort_min_elements;
+
     /* Now it's time to load the right scores in the sorting vector */
-    if (!dontsort) {
+    if (parallel && !sortby && !alpha) {
+        sortScoresJob sj = {vector, vectorlen, parallelThreadsNum(), {0}};
+        parallelRun(sortParseScoresJob,&sj,sj.njobs);
+        for (j = 0; j < sj.njobs; j++)
+            if (sj.errors[j]) int_conversion_error = 1;
+    } else if (!dontsort) {
         for (j = 0; j < vectorlen; j++) {
             robj *byval;
             if (sortby) {
@@ -471,23 +520,8 @@ void sortCommand(client *c) {
             if (alpha) {
                 if (sortby) vector[j].u.cmpobj = getDecodedObject(byval);
             } else {
-                if (sdsEncodedObject(byval)) {
-                    char *eptr;
-
-                    vector[j].u.score = strtod(byval->ptr,&eptr);
-                    if (eptr[0] != '\0' || errno == ERANGE ||
-                        isnan(vector[j].u.score))
-                    {
-                        int_conversion_error = 1;
-                    }
-                } else if (byval->encoding == OBJ_ENCODING_INT) {
-                    /* Don't need to decode the object if it's
-                     * integer-encoded (the only encoding supported) so
-                     * far. We can just cast it */
-                    vector[j].u.score = (long)byval->ptr;
-                } else {
-                    serverAssertWithInfo(c,sortval,1 != 1);
-                }
+                if (!sortParseScore(&vector[j],byval))
+                    int_conversion_error = 1;
             }
 
             /* when the object was retrieved using lookupKeyByPattern,
@@ -496,12 +530,17 @@ void sortCommand(client *c) {
                 decrRefCount(byval);
             }
         }
+    }
 
+    if (!dontsort) {
         server.sort_desc = desc;
         server.sort_alpha = alpha;
         server.sort_bypattern = sortby ? 1 : 0;
         server.sort_store = storekey ? 1 : 0;
-        if (sortby && (start != 0 || end != vectorlen-1))
+        if (parallel) {
+            parallelSort(vector,vectorlen,sizeof(redisSortObject),sortCompare);
+            server.stat_parallel_sort_ops++;
+        } else if (sortby && (start != 0 || end != vectorlen-1))
             pqsort(vector,vectorlen,sizeof(redisSortObject),sortCompare, start,end);
         else
             qsort(vector,vectorlen,sizeof(redisSortObject),sortCompare);
@@ -55,6 +55,41 @@ void listTypePush(robj *subject, robj *value, int where) {
     }
 }
 
+/* Push 'count' values like calling listTypePush() for each of them, letting
+ * the quicklist build the nodes it needs in a single allocation each. */
+void listTypePushBulk(robj *subject, robj **values, int count, int where) {
+    if (subject->encoding != OBJ_ENCODING_QUICKLIST)
+        serverPanic("Unknown list encoding");
+
+    int pos = (where == LIST_HEAD) ? QUICKLIST_HEAD : QUICKLIST_TAIL;
+    unsigned char **vals = zmalloc(sizeof(unsigned char*)*count);
+    unsigned int *lens = zmalloc(sizeof(unsigned int)*count);
+    char buf[32];
+    int j;
+
+    for (j = 0; j < count; j++) {
+        if (!sdsEncodedObject(values[j])) break;
+        vals[j] = values[j]->ptr;
+        lens[j] = sdslen(values[j]->ptr);
+    }
+    if (j == count) {
+        quicklistPushBulk(subject->ptr, pos, vals, lens, count);
+    } else {
+        /* Integer encoded values need a conversion buffer each. */
+        for (j = 0; j < count; j++) {
+            robj *o = values[j];
+            if (o->encoding == OBJ_ENCODING_INT) {
+                ll2string(buf, sizeof(buf), (long)o->ptr);
+                quicklistPush(subject->ptr, buf, strlen(buf), pos);
+            } else {
+                quicklistPush(subject->ptr, o->ptr, sdslen(o->ptr), pos);
+            }
+        }
+    }
+    zfree(vals);
+    zfree(lens);
+}
+
 void *listPopSaver(unsigned char *data, unsigned int sz) {
     return createStringObject((char*)data,sz);
 }
@@ -247,8 +282,11 @@ void pushGenericCommand(client *c, int where, int xx) {
         dbAdd(c->db,c->argv[1],lobj);
     }
 
-    for (j = 2; j < c->argc; j++) {
-        listTypePush(lobj,c->argv[j],where);
+    if (c->argc > 3) {
+        listTypePushBulk(lobj,c->argv+2,c->argc-2,where);
+        server.dirty += c->argc-2;
+    } else {
+        listTypePush(lobj,c->argv[2],where);
         server.dirty++;
     }
 
@@ -715,7 +715,218 @@ zskiplistNode *zslLastInLexRange(zskiplist *zsl, zlexrangespec *range) {
 }
 
 /*-----------------------------------------------------------------------------
- * Ziplist-backed sorted set API
+ * Ordered index of skiplist encoded sorted sets
+ *
+ * Sorted sets with at least zset-btree-min-entries elements replace the
+ * skiplist with a B+tree (see zbtree.c). The functions below hide which of
+ * the two is in use, positions are returned as a zsetCursor.
+ *----------------------------------------------------------------------------*/
+
+unsigned long zsetIndexLength(const zset *zs) {
+    return zs->zsl ? zs->zsl->length : zs->zbt->length;
+}
+
+/* Move the elements of the skiplist into a new B+tree. They come in order,
+ * so every leaf gets filled completely. */
+static void zsetIndexConvertToBtree(zset *zs) {
+    zskiplist *zsl = zs->zsl;
+    zskiplistNode *node = zsl->header->level[0].forward, *next;
+
+    zs->zbt = zbtCreate();
+    while (node) {
+        next = node->level[0].forward;
+        zbtInsert(zs->zbt,node->score,node->ele);
+        node->ele = NULL;
+        zslFreeNode(node);
+        node = next;
+    }
+    zfree(zsl->header);
+    zfree(zsl);
+    zs->zsl = NULL;
+}
+
+/* Add a new element to the dict and to the ordered index of the sorted set.
+ * The SDS string 'ele' is owned by the sorted set after the call, unless
+ * the element already exists: then nothing is done and C_ERR is returned. */
+int zsetIndexAdd(zset *zs, double score, sds ele) {
+    dictEntry *de = dictAddRaw(zs->dict,ele,NULL);
+
+    if (de == NULL) return C_ERR;
+    dictSetDoubleVal(de,score);
+    if (zs->zsl) {
+        zslInsert(zs->zsl,score,ele);
+        if (server.zset_btree_min_entries &&
+            zs->zsl->length >= server.zset_btree_min_entries)
+            zsetIndexConvertToBtree(zs);
+    } else {
+        zbtInsert(zs->zbt,score,ele);
+    }
+    return C_OK;
+}
+
+/* Free the ordered index together with the element strings. */
+void zsetIndexFree(zset *zs) {
+    if (zs->zsl) zslFree(zs->zsl);
+    else zbtFree(zs->zbt);
+}
+
+/* Remove an element from the ordered index, freeing its SDS string. The
+ * caller already removed it from the dict. */
+static void zsetIndexDelete(zset *zs, double score, sds ele) {
+    int retval;
+
+    if (zs->zsl) retval = zslDelete(zs->zsl,score,ele,NULL);
+    else retval = zbtDelete(zs->zbt,score,ele,1);
+    serverAssert(retval);
+}
+
+static void zsetIndexUpdateScore(zset *zs, double curscore, sds ele, double newscore) {
+    if (zs->zsl) zslUpdateScore(zs->zsl,curscore,ele,newscore);
+    else zbtUpdateScore(zs->zbt,curscore,ele,newscore);
+}
+
+static unsigned long zsetIndexRank(zset *zs, double score, sds ele) {
+    if (zs->zsl) return zslGetRank(zs->zsl,score,ele);
+    return zbtGetRank(zs->zbt,score,ele);
+}
+
+/* The zsetIndex*() lookups below set 'c' and return 1 when the element
+ * exists, otherwise they return 0 leaving 'c' pointing to no element. */
+static int zsetCursorFromNode(zsetCursor *c, zskiplistNode *node) {
+    c->node = node;
+    c->bt.leaf = NULL;
+    c->bt.pos = 0;
+    return node != NULL;
+}
+
+static int zsetCursorFromBtree(zsetCursor *c, int found) {
+    c->node = NULL;
+    if (!found) c->bt.leaf = NULL;
+    return found;
+}
+
+int zsetIndexFirst(zset *zs, zsetCursor *c) {
+    if (zs->zsl) return zsetCursorFromNode(c,zs->zsl->header->level[0].forward);
+    return zsetCursorFromBtree(c,zbtFirst(zs->zbt,&c->bt));
+}
+
+int zsetIndexLast(zset *zs, zsetCursor *c) {
+    if (zs->zsl) return zsetCursorFromNode(c,zs->zsl->tail);
+    return zsetCursorFromBtree(c,zbtLast(zs->zbt,&c->bt));
+}
+
+/* 'rank' is 1-based. */
+int zsetIndexElementByRank(zset *zs, unsigned long rank, zsetCursor *c) {
+    if (zs->zsl) return zsetCursorFromNode(c,zslGetElementByRank(zs->zsl,rank));
+    return zsetCursorFromBtree(c,zbtGetElementByRank(zs->zbt,rank,&c->bt));
+}
+
+int zsetIndexFirstInRange(zset *zs, zrangespec *range, zsetCursor *c) {
+    if (zs->zsl) return zsetCursorFromNode(c,zslFirstInRange(zs->zsl,range));
+    if (!zbtSeekScoreGte(zs->zbt,range->min,range->minex,&c->bt) ||
+        !zslValueLteMax(zbtCursorScore(&c->bt),range))
+        return zsetCursorFromBtree(c,0);
+    return zsetCursorFromBtree(c,1);
+}
+
+int zsetIndexLastInRange(zset *zs, zrangespec *range, zsetCursor *c) {
+    if (zs->zsl) return zsetCursorFromNode(c,zslLastInRange(zs->zsl,range));
+    if (!zbtSeekScoreLte(zs->zbt,range->max,range->maxex,&c->bt) ||
+        !zslValueGteMin(zbtCursorScore(&c->bt),range))
+        return zsetCursorFromBtree(c,0);
+    return zsetCursorFromBtree(c,1);
+}
+
+static int zbtLexGteMin(double score, sds ele, void *range) {
+    UNUSED(score);
+    return zslLexValueGteMin(ele,range);
+}
+
+static int zbtLexLteMax(double score, sds ele, void *range) {
+    UNUSED(score);
+    return zslLexValueLteMax(ele,range);
+}
+
+int zsetIndexFirstInLexRange(zset *zs, zlexrangespec *range, zsetCursor *c) {
+    if (zs->zsl) return zsetCursorFromNode(c,zslFirstInLexRange(zs->zsl,range));
+    if (!zbtSeekFirst(zs->zbt,zbtLexGteMin,range,&c->bt) ||
+        !zslLexValueLteMax(zbtCursorEle(&c->bt),range))
+        return zsetCursorFromBtree(c,0);
+    return zsetCursorFromBtree(c,1);
+}
+
+int zsetIndexLastInLexRange(zset *zs, zlexrangespec *range, zsetCursor *c) {
+    if (zs->zsl) return zsetCursorFromNode(c,zslLastInLexRange(zs->zsl,range));
+    if (!zbtSeekLast(zs->zbt,zbtLexLteMax,range,&c->bt) ||
+        !zslLexValueGteMin(zbtCursorEle(&c->bt),range))
+        return zsetCursorFromBtree(c,0);
+    return zsetCursorFromBtree(c,1);
+}
+
+/* Range deletions: the B+tree version seeks the first element of the range
+ * and lets zbtDeleteRange() walk the leaves from there, removing every
+ * element from the dict as well through the callbacks below. */
+typedef struct {
+    dict *dict;
+    zrangespec *range;
+    zlexrangespec *lexrange;
+    unsigned long left;         /* Elements still to delete by rank. */
+} zsetDeleteRangeCtx;
+
+static int zbtDeleteInRange(double score, sds ele, void *privdata) {
+    zsetDeleteRangeCtx *ctx = privdata;
+    if (!zslValueLteMax(score,ctx->range)) return 0;
+    dictDelete(ctx->dict,ele);
+    return 1;
+}
+
+static int zbtDeleteInLexRange(double score, sds ele, void *privdata) {
+    zsetDeleteRangeCtx *ctx = privdata;
+    UNUSED(score);
+    if (!zslLexValueLteMax(ele,ctx->lexrange)) return 0;
+    dictDelete(ctx->dict,ele);
+    return 1;
+}
+
+static int zbtDeleteInRankRange(double score, sds ele, void *privdata) {
+    zsetDeleteRangeCtx *ctx = privdata;
+    UNUSED(score);
+    if (ctx->left == 0) return 0;
+    ctx->left--;
+    dictDelete(ctx->dict,ele);
+    return 1;
+}
+
+static unsigned long zsetIndexDeleteRangeByScore(zset *zs, zrangespec *range) {
+    zsetDeleteRangeCtx ctx = {zs->dict, range, NULL, 0};
+    zsetCursor c;
+
+    if (zs->zsl) return zslDeleteRangeByScore(zs->zsl,range,zs->dict);
+    if (!zsetIndexFirstInRange(zs,range,&c)) return 0;
+    return zbtDeleteRange(zs->zbt,&c.bt,zbtDeleteInRange,&ctx,1);
+}
+
+static unsigned long zsetIndexDeleteRangeByLex(zset *zs, zlexrangespec *range) {
+    zsetDeleteRangeCtx ctx = {zs->dict, NULL, range, 0};
+    zsetCursor c;
+
+    if (zs->zsl) return zslDeleteRangeByLex(zs->zsl,range,zs->dict);
+    if (!zsetIndexFirstInLexRange(zs,range,&c)) return 0;
+    return zbtDeleteRange(zs->zbt,&c.bt,zbtDeleteInLexRange,&ctx,1);
+}
+
+/* 'start' and 'end' are 1-based and inclusive. */
+static unsigned long zsetIndexDeleteRangeByRank(zset *zs, unsigned int start, unsigned int end) {
+    zsetDeleteRangeCtx ctx = {zs->dict, NULL, NULL, end-start+1};
+    zsetCursor c;
+
+    if (zs->zsl) return zslDeleteRangeByRank(zs->zsl,start,end,zs->dict);
+    if (!zsetIndexElementByRank(zs,start,&c)) return 0;
+    return zbtDeleteRange(zs->zbt,&c.bt,zbtDeleteInRankRange,&ctx,1);
+}
+
+/*-----------------------------------------------------------------------------
+ * Listpack-backed sorted set API
  *----------------------------------------------------------------------------*/
 
 double zzlStrtod(unsigned char *vstr, unsigned int vlen) {
@@ -734,7 +945,7 @@ double zzlGetScore(unsigned char *sptr) {
     double score;
 
     serverAssert(sptr != NULL);
-    serverAssert(ziplistGet(sptr,&vstr,&vlen,&vlong));
+    vstr = lpGetValue(sptr,&vlen,&vlong);
 
     if (vstr) {
         score = zzlStrtod(vstr,vlen);
@@ -745,14 +956,14 @@ double zzlGetScore(unsigned char *sptr) {
     return score;
 }
 
-/* Return a ziplist element as an SDS string. */
-sds ziplistGetObject(unsigned char *sptr) {
+/* Return a listpack element as an SDS string. */
+sds lpGetObject(unsigned char *sptr) {
     unsigned char *vstr;
     unsigned int vlen;
     long long vlong;
 
     serverAssert(sptr != NULL);
-    serverAssert(ziplistGet(sptr,&vstr,&vlen,&vlong));
+    vstr = lpGetValue(sptr,&vlen,&vlong);
 
     if (vstr) {
         return sdsnewlen((char*)vstr,vlen);
@@ -769,7 +980,7 @@ int zzlCompareElements(unsigned char *eptr, unsigned char *cstr, unsigned int cl
     unsigned char vbuf[32];
     int minlen, cmp;
 
-    serverAssert(ziplistGet(eptr,&vstr,&vlen,&vlong));
+    vstr = lpGetValue(eptr,&vlen,&vlong);
     if (vstr == NULL) {
         /* Store string representation of long long in buf. */
         vlen = ll2string((char*)vbuf,sizeof(vbuf),vlong);
@@ -783,7 +994,7 @@ int zzlCompareElements(unsigned char *eptr, unsigned char *cstr, unsigned int cl
 }
 
 unsigned int zzlLength(unsigned char *zl) {
-    return ziplistLen(zl)/2;
+    return lpLength(zl)/2;
 }
 
 /* Move to next entry based on the values in eptr and sptr. Both are set to
@@ -792,9 +1003,9 @@ void zzlNext(unsigned char *zl, unsigned char **eptr, unsigned char **sptr) {
     unsigned char *_eptr, *_sptr;
     serverAssert(*eptr != NULL && *sptr != NULL);
 
-    _eptr = ziplistNext(zl,*sptr);
+    _eptr = lpNext(zl,*sptr);
     if (_eptr != NULL) {
-        _sptr = ziplistNext(zl,_eptr);
+        _sptr = lpNext(zl,_eptr);
         serverAssert(_sptr != NULL);
     } else {
         /* No next entry. */
@@ -811,9 +1022,9 @@ void zzlPrev(unsigned char *zl, unsigned char **eptr, unsigned char **sptr) {
     unsigned char *_eptr, *_sptr;
     serverAssert(*eptr != NULL && *sptr != NULL);
 
-    _sptr = ziplistPrev(zl,*eptr);
+    _sptr = lpPrev(zl,*eptr);
     if (_sptr != NULL) {
-        _eptr = ziplistPrev(zl,_sptr);
+        _eptr = lpPrev(zl,_sptr);
         serverAssert(_eptr != NULL);
     } else {
         /* No previous entry. */
@@ -835,13 +1046,13 @@ int zzlIsInRange(unsigned char *zl, zrangespec *range) {
             (range->min == range->max && (range->minex || range->maxex)))
         return 0;
 
-    p = ziplistIndex(zl,-1); /* Last score. */
+    p = lpSeek(zl,-1); /* Last score. */
     if (p == NULL) return 0; /* Empty sorted set */
     score = zzlGetScore(p);
     if (!zslValueGteMin(score,range))
         return 0;
 
-    p = ziplistIndex(zl,1); /* First score. */
+    p = lpSeek(zl,1); /* First score. */
     serverAssert(p != NULL);
     score = zzlGetScore(p);
     if (!zslValueLteMax(score,range))
@@ -853,14 +1064,14 @@ int zzlIsInRange(unsigned char *zl, zrangespec *range) {
 /* Find pointer to the first element contained in the specified range.
  * Returns NULL when no element is contained in the range. */
 unsigned char *zzlFirstInRange(unsigned char *zl, zrangespec *range) {
-    unsigned char *eptr = ziplistIndex(zl,0), *sptr;
+    unsigned char *eptr = lpSeek(zl,0), *sptr;
     double score;
 
     /* If everything is out of range, return early. */
     if (!zzlIsInRange(zl,range)) return NULL;
 
     while (eptr != NULL) {
-        sptr = ziplistNext(zl,eptr);
+        sptr = lpNext(zl,eptr);
         serverAssert(sptr != NULL);
 
         score = zzlGetScore(sptr);
@@ -872,7 +1083,7 @@ unsigned char *zzlFirstInRange(unsigned char *zl, zrangespec *range) {
         }
 
         /* Move to next element. */
-        eptr = ziplistNext(zl,sptr);
+        eptr = lpNext(zl,sptr);
     }
 
     return NULL;
@@ -881,14 +1092,14 @@ unsigned char *zzlFirstInRange(unsigned char *zl, zrangespec *range) {
 /* Find pointer to the last element contained in the specified range.
  * Returns NULL when no element is contained in the range. */
 unsigned char *zzlLastInRange(unsigned char *zl, zrangespec *range) {
-    unsigned char *eptr = ziplistIndex(zl,-2), *sptr;
+    unsigned char *eptr = lpSeek(zl,-2), *sptr;
     double score;
 
     /* If everything is out of range, return early. */
     if (!zzlIsInRange(zl,range)) return NULL;
 
     while (eptr != NULL) {
-        sptr = ziplistNext(zl,eptr);
+        sptr = lpNext(zl,eptr);
         serverAssert(sptr != NULL);
 
         score = zzlGetScore(sptr);
@@ -901,9 +1112,9 @@ unsigned char *zzlLastInRange(unsigned char *zl, zrangespec *range) {
 
         /* Move to previous element by moving to the score of previous element.
          * When this returns NULL, we know there also is no element. */
-        sptr = ziplistPrev(zl,eptr);
+        sptr = lpPrev(zl,eptr);
         if (sptr != NULL)
-            serverAssert((eptr = ziplistPrev(zl,sptr)) != NULL);
+            serverAssert((eptr = lpPrev(zl,sptr)) != NULL);
         else
             eptr = NULL;
     }
@@ -912,14 +1123,14 @@ unsigned char *zzlLastInRange(unsigned char *zl, zrangespec *range) {
 }
 
 int zzlLexValueGteMin(unsigned char *p, zlexrangespec *spec) {
-    sds value = ziplistGetObject(p);
+    sds value = lpGetObject(p);
     int res = zslLexValueGteMin(value,spec);
     sdsfree(value);
     return res;
 }
 
 int zzlLexValueLteMax(unsigned char *p, zlexrangespec *spec) {
-    sds value = ziplistGetObject(p);
+    sds value = lpGetObject(p);
     int res = zslLexValueLteMax(value,spec);
     sdsfree(value);
     return res;
@@ -935,12 +1146,12 @@ int zzlIsInLexRange(unsigned char *zl, zlexrangespec *range) {
     if (cmp > 0 || (cmp == 0 && (range->minex || range->maxex)))
         return 0;
 
-    p = ziplistIndex(zl,-2); /* Last element. */
+    p = lpSeek(zl,-2); /* Last element. */
     if (p == NULL) return 0;
     if (!zzlLexValueGteMin(p,range))
         return 0;
 
-    p = ziplistIndex(zl,0); /* First element. */
+    p = lpSeek(zl,0); /* First element. */
     serverAssert(p != NULL);
     if (!zzlLexValueLteMax(p,range))
         return 0;
@@ -951,7 +1162,7 @@ int zzlIsInLexRange(unsigned char *zl, zlexrangespec *range) {
 /* Find pointer to the first element contained in the specified lex range.
  * Returns NULL when no element is contained in the range. */
 unsigned char *zzlFirstInLexRange(unsigned char *zl, zlexrangespec *range) {
-    unsigned char *eptr = ziplistIndex(zl,0), *sptr;
+    unsigned char *eptr = lpSeek(zl,0), *sptr;
 
     /* If everything is out of range, return early. */
     if (!zzlIsInLexRange(zl,range)) return NULL;
@@ -965,9 +1176,9 @@ unsigned char *zzlFirstInLexRange(unsigned char *zl, zlexrangespec *range) {
         }
 
         /* Move to next element. */
-        sptr = ziplistNext(zl,eptr); /* This element score. Skip it. */
+        sptr = lpNext(zl,eptr); /* This element score. Skip it. */
         serverAssert(sptr != NULL);
-        eptr = ziplistNext(zl,sptr); /* Next element. */
+        eptr = lpNext(zl,sptr); /* Next element. */
     }
 
     return NULL;
@@ -976,7 +1187,7 @@ unsigned char *zzlFirstInLexRange(unsigned char *zl, zlexrangespec *range) {
 /* Find pointer to the last element contained in the specified lex range.
  * Returns NULL when no element is contained in the range. */
 unsigned char *zzlLastInLexRange(unsigned char *zl, zlexrangespec *range) {
-    unsigned char *eptr = ziplistIndex(zl,-2), *sptr;
+    unsigned char *eptr = lpSeek(zl,-2), *sptr;
 
     /* If everything is out of range, return early. */
     if (!zzlIsInLexRange(zl,range)) return NULL;
@@ -991,9 +1202,9 @@ unsigned char *zzlLastInLexRange(unsigned char *zl, zlexrangespec *range) {
 
         /* Move to previous element by moving to the score of previous element.
          * When this returns NULL, we know there also is no element. */
-        sptr = ziplistPrev(zl,eptr);
+        sptr = lpPrev(zl,eptr);
         if (sptr != NULL)
-            serverAssert((eptr = ziplistPrev(zl,sptr)) != NULL);
+            serverAssert((eptr = lpPrev(zl,sptr)) != NULL);
         else
             eptr = NULL;
     }
@@ -1002,33 +1213,28 @@ unsigned char *zzlLastInLexRange(unsigned char *zl, zlexrangespec *range) {
 }
 
 unsigned char *zzlFind(unsigned char *zl, sds ele, double *score) {
-    unsigned char *eptr = ziplistIndex(zl,0), *sptr;
+    unsigned char *eptr = lpSeek(zl,0), *sptr;
 
     while (eptr != NULL) {
-        sptr = ziplistNext(zl,eptr);
+        sptr = lpNext(zl,eptr);
         serverAssert(sptr != NULL);
 
-        if (ziplistCompare(eptr,(unsigned char*)ele,sdslen(ele))) {
+        if (lpCompare(eptr,(unsigned char*)ele,sdslen(ele))) {
             /* Matching element, pull out score. */
             if (score != NULL) *score = zzlGetScore(sptr);
             return eptr;
         }
 
         /* Move to next element. */
-        eptr = ziplistNext(zl,sptr);
+        eptr = lpNext(zl,sptr);
     }
     return NULL;
 }
 
-/* Delete (element,score) pair from ziplist. Use local copy of eptr because we
+/* Delete (element,score) pair from listpack. Use local copy of eptr because we
  * don't want to modify the one given as argument. */
 unsigned char *zzlDelete(unsigned char *zl, unsigned char *eptr) {
-    unsigned char *p = eptr;
-
-    /* TODO: add function to ziplist API to delete N elements from offset. */
-    zl = ziplistDelete(zl,&p);
-    zl = ziplistDelete(zl,&p);
-    return zl;
+    return lpDeleteRangeWithEntry(zl,&eptr,2);
 }
 
 unsigned char *zzlInsertAt(unsigned char *zl, unsigned char *eptr, sds ele, double score) {
@@ -1039,29 +1245,29 @@ unsigned char *zzlInsertAt(unsigned char *zl, unsigned char *eptr, sds ele, doub
 
     scorelen = d2string(scorebuf,sizeof(scorebuf),score);
     if (eptr == NULL) {
-        zl = ziplistPush(zl,(unsigned char*)ele,sdslen(ele),ZIPLIST_TAIL);
-        zl = ziplistPush(zl,(unsigned char*)scorebuf,scorelen,ZIPLIST_TAIL);
+        zl = lpAppend(zl,(unsigned char*)ele,sdslen(ele));
+        zl = lpAppend(zl,(unsigned char*)scorebuf,scorelen);
     } else {
         /* Keep offset relative to zl, as it might be re-allocated. */
         offset = eptr-zl;
-        zl = ziplistInsert(zl,eptr,(unsigned char*)ele,sdslen(ele));
+        zl = lpInsert(zl,(unsigned char*)ele,sdslen(ele),eptr,LP_BEFORE,NULL);
         eptr = zl+offset;
 
         /* Insert score after the element. */
-        serverAssert((sptr = ziplistNext(zl,eptr)) != NULL);
-        zl = ziplistInsert(zl,sptr,(unsigned char*)scorebuf,scorelen);
+        serverAssert((sptr = lpNext(zl,eptr)) != NULL);
+        zl = lpInsert(zl,(unsigned char*)scorebuf,scorelen,sptr,LP_BEFORE,NULL);
     }
     return zl;
 }
 
-/* Insert (element,score) pair in ziplist. This function assumes the element is
+/* Insert (element,score) pair in listpack. This function assumes the element is
  * not yet present in the list. */
 unsigned char *zzlInsert(unsigned char *zl, sds ele, double score) {
-    unsigned char *eptr = ziplistIndex(zl,0), *sptr;
+    unsigned char *eptr = lpSeek(zl,0), *sptr;
     double s;
 
     while (eptr != NULL) {
-        sptr = ziplistNext(zl,eptr);
+        sptr = lpNext(zl,eptr);
         serverAssert(sptr != NULL);
         s = zzlGetScore(sptr);
 
@@ -1080,7 +1286,7 @@ unsigned char *zzlInsert(unsigned char *zl, sds ele, double score) {
         }
 
         /* Move to next element. */
-        eptr = ziplistNext(zl,sptr);
+        eptr = lpNext(zl,sptr);
     }
 
     /* Push on tail of list when it was not yet inserted. */
@@ -1099,14 +1305,12 @@ unsigned char *zzlDeleteRangeByScore(unsigned char *zl, zrangespec *range, unsig
     eptr = zzlFirstInRange(zl,range);
     if (eptr == NULL) return zl;
 
-    /* When the tail of the ziplist is deleted, eptr will point to the sentinel
-     * byte and ziplistNext will return NULL. */
-    while ((sptr = ziplistNext(zl,eptr)) != NULL) {
+    /* When the tail of the listpack is deleted, eptr will be NULL. */
+    while (eptr && (sptr = lpNext(zl,eptr)) != NULL) {
         score = zzlGetScore(sptr);
         if (zslValueLteMax(score,range)) {
             /* Delete both the element and the score. */
-            zl = ziplistDelete(zl,&eptr);
-            zl = ziplistDelete(zl,&eptr);
+            zl = lpDeleteRangeWithEntry(zl,&eptr,2);
             num++;
         } else {
             /* No longer in range. */
@@ -1127,13 +1331,11 @@ unsigned char *zzlDeleteRangeByLex(unsigned char *zl, zlexrangespec *range, unsi
     eptr = zzlFirstInLexRange(zl,range);
     if (eptr == NULL) return zl;
 
-    /* When the tail of the ziplist is deleted, eptr will point to the sentinel
-     * byte and ziplistNext will return NULL. */
-    while ((sptr = ziplistNext(zl,eptr)) != NULL) {
+    /* When the tail of the listpack is deleted, eptr will be NULL. */
+    while (eptr && (sptr = lpNext(zl,eptr)) != NULL) {
         if (zzlLexValueLteMax(eptr,range)) {
             /* Delete both the element and the score. */
-            zl = ziplistDelete(zl,&eptr);
-            zl = ziplistDelete(zl,&eptr);
+            zl = lpDeleteRangeWithEntry(zl,&eptr,2);
             num++;
         } else {
             /* No longer in range. */
@@ -1150,7 +1352,7 @@ unsigned char *zzlDeleteRangeByLex(unsigned char *zl, zlexrangespec *range, unsi
 unsigned char *zzlDeleteRangeByRank(unsigned char *zl, unsigned int start, unsigned int end, unsigned long *deleted) {
     unsigned int num = (end-start)+1;
     if (deleted) *deleted = num;
-    zl = ziplistDeleteRange(zl,2*(start-1),2*num);
+    zl = lpDeleteRange(zl,2*(start-1),2*num);
     return zl;
 }
 
@@ -1160,10 +1362,10 @@ unsigned char *zzlDeleteRangeByRank(unsigned char *zl, unsigned int start, unsig
 
 unsigned long zsetLength(const robj *zobj) {
     unsigned long length = 0;
-    if (zobj->encoding == OBJ_ENCODING_ZIPLIST) {
+    if (zobj->encoding == OBJ_ENCODING_LISTPACK) {
         length = zzlLength(zobj->ptr);
     } else if (zobj->encoding == OBJ_ENCODING_SKIPLIST) {
-        length = ((const zset*)zobj->ptr)->zsl->length;
+        length = zsetIndexLength(zobj->ptr);
     } else {
         serverPanic("Unknown sorted set encoding");
     }
@@ -1172,12 +1374,12 @@ unsigned long zsetLength(const robj *zobj) {
 
 void zsetConvert(robj *zobj, int encoding) {
     zset *zs;
-    zskiplistNode *node, *next;
+    zsetCursor c;
     sds ele;
     double score;
 
     if (zobj->encoding == encoding) return;
-    if (zobj->encoding == OBJ_ENCODING_ZIPLIST) {
+    if (zobj->encoding == OBJ_ENCODING_LISTPACK) {
         unsigned char *zl = zobj->ptr;
         unsigned char *eptr, *sptr;
         unsigned char *vstr;
@@ -1190,23 +1392,23 @@ void zsetConvert(robj *zobj, int encoding) {
         zs = zmalloc(sizeof(*zs));
         zs->dict = dictCreate(&zsetDictType,NULL);
         zs->zsl = zslCreate();
+        zs->zbt = NULL;
 
-        eptr = ziplistIndex(zl,0);
+        eptr = lpSeek(zl,0);
         if (eptr != NULL) {
-            sptr = ziplistNext(zl,eptr);
+            sptr = lpNext(zl,eptr);
             serverAssertWithInfo(NULL,zobj,sptr != NULL);
         }
 
         while (eptr != NULL) {
             score = zzlGetScore(sptr);
-            serverAssertWithInfo(NULL,zobj,ziplistGet(eptr,&vstr,&vlen,&vlong));
+            vstr = lpGetValue(eptr,&vlen,&vlong);
             if (vstr == NULL)
                 ele = sdsfromlonglong(vlong);
             else
                 ele = sdsnewlen((char*)vstr,vlen);
 
-            node = zslInsert(zs->zsl,score,ele);
-            serverAssert(dictAdd(zs->dict,ele,&node->score) == DICT_OK);
+            zsetIndexAdd(zs,score,ele);
             zzlNext(zl,&eptr,&sptr);
         }
 
@@ -1214,46 +1416,40 @@ void zsetConvert(robj *zobj, int encoding) {
         zobj->ptr = zs;
         zobj->encoding = OBJ_ENCODING_SKIPLIST;
     } else if (zobj->encoding == OBJ_ENCODING_SKIPLIST) {
-        unsigned char *zl = ziplistNew();
+        unsigned char *zl = lpNew(0);
 
-        if (encoding != OBJ_ENCODING_ZIPLIST)
+        if (encoding != OBJ_ENCODING_LISTPACK)
             serverPanic("Unknown target encoding");
 
-        /* Approach similar to zslFree(), since we want to free the skiplist at
-         * the same time as creating the ziplist. */
         zs = zobj->ptr;
-        dictRelease(zs->dict);
-        node = zs->zsl->header->level[0].forward;
-        zfree(zs->zsl->header);
-        zfree(zs->zsl);
-
-        while (node) {
-            zl = zzlInsertAt(zl,NULL,node->ele,node->score);
-            next = node->level[0].forward;
-            zslFreeNode(node);
-            node = next;
+        zsetIndexFirst(zs,&c);
+        while (zsetCursorValid(&c)) {
+            zl = zzlInsertAt(zl,NULL,zsetCursorEle(&c),zsetCursorScore(&c));
+            zsetCursorNext(&c);
         }
 
+        dictRelease(zs->dict);
+        zsetIndexFree(zs);
         zfree(zs);
         zobj->ptr = zl;
-        zobj->encoding = OBJ_ENCODING_ZIPLIST;
+        zobj->encoding = OBJ_ENCODING_LISTPACK;
     } else {
         serverPanic("Unknown sorted set encoding");
     }
 }
 
-/* Convert the sorted set object into a ziplist if it is not already a ziplist
+/* Convert the sorted set object into a listpack if it is not already a listpack
  * and if the number of elements and the maximum element size and total elements size
  * are within the expected ranges. */
-void zsetConvertToZiplistIfNeeded(robj *zobj, size_t maxelelen, size_t totelelen) {
-    if (zobj->encoding == OBJ_ENCODING_ZIPLIST) return;
+void zsetConvertToListpackIfNeeded(robj *zobj, size_t maxelelen, size_t totelelen) {
+    if (zobj->encoding == OBJ_ENCODING_LISTPACK) return;
     zset *zset = zobj->ptr;
 
-    if (zset->zsl->length <= server.zset_max_ziplist_entries &&
-        maxelelen <= server.zset_max_ziplist_value &&
-        ziplistSafeToAdd(NULL, totelelen))
+    if (zsetIndexLength(zset) <= server.zset_max_listpack_entries &&
+        maxelelen <= server.zset_max_listpack_value &&
+        lpSafeToAdd(NULL, totelelen))
     {
-        zsetConvert(zobj,OBJ_ENCODING_ZIPLIST);
+        zsetConvert(zobj,OBJ_ENCODING_LISTPACK);
     }
 }
 
@@ -1264,13 +1460,13 @@ void zsetConvertToZiplistIfNeeded(robj *zobj, size_t maxelelen, size_t totelelen
 int zsetScore(robj *zobj, sds member, double *score) {
     if (!zobj || !member) return C_ERR;
 
-    if (zobj->encoding == OBJ_ENCODING_ZIPLIST) {
+    if (zobj->encoding == OBJ_ENCODING_LISTPACK) {
         if (zzlFind(zobj->ptr, member, score) == NULL) return C_ERR;
     } else if (zobj->encoding == OBJ_ENCODING_SKIPLIST) {
         zset *zs = zobj->ptr;
         dictEntry *de = dictFind(zs->dict, member);
         if (de == NULL) return C_ERR;
-        *score = *(double*)dictGetVal(de);
+        *score = dictGetDoubleVal(de);
     } else {
         serverPanic("Unknown sorted set encoding");
     }
@@ -1316,7 +1512,7 @@ int zsetScore(robj *zobj, sds member, double *score) {
  * start.
  *
  * The command as a side effect of adding a new element may convert the sorted
- * set internal encoding from ziplist to hashtable+skiplist.
+ * set internal encoding from listpack to hashtable+skiplist.
  *
  * Memory management of 'ele':
  *
@@ -1339,7 +1535,7 @@ int zsetAdd(robj *zobj, double score, sds ele, int in_flags, int *out_flags, dou
     }
 
     /* Update the sorted set according to its encoding. */
-    if (zobj->encoding == OBJ_ENCODING_ZIPLIST) {
+    if (zobj->encoding == OBJ_ENCODING_LISTPACK) {
         unsigned char *eptr;
 
         if ((eptr = zzlFind(zobj->ptr,ele,&curscore)) != NULL) {
@@ -1376,9 +1572,9 @@ int zsetAdd(robj *zobj, double score, sds ele, int in_flags, int *out_flags, dou
         } else if (!xx) {
             /* check if the element is too large or the list
              * becomes too long *before* executing zzlInsert. */
-            if (zzlLength(zobj->ptr)+1 > server.zset_max_ziplist_entries ||
-                sdslen(ele) > server.zset_max_ziplist_value ||
-                !ziplistSafeToAdd(zobj->ptr, sdslen(ele)))
+            if (zzlLength(zobj->ptr)+1 > server.zset_max_listpack_entries ||
+                sdslen(ele) > server.zset_max_listpack_value ||
+                !lpSafeToAdd(zobj->ptr, sdslen(ele)))
             {
                 zsetConvert(zobj,OBJ_ENCODING_SKIPLIST);
             } else {
@@ -1393,11 +1589,10 @@ int zsetAdd(robj *zobj, double score, sds ele, int in_flags, int *out_flags, dou
         }
     }
 
-    /* Note that the above block handling ziplist would have either returned or
+    /* Note that the above block handling listpack would have either returned or
      * converted the key to skiplist. */
     if (zobj->encoding == OBJ_ENCODING_SKIPLIST) {
         zset *zs = zobj->ptr;
-        zskiplistNode *znode;
         dictEntry *de;
 
         de = dictFind(zs->dict,ele);
@@ -1408,7 +1603,7 @@ int zsetAdd(robj *zobj, double score, sds ele, int in_flags, int *out_flags, dou
                 return 1;
             }
 
-            curscore = *(double*)dictGetVal(de);
+            curscore = dictGetDoubleVal(de);
 
             /* Prepare the score for the increment if needed. */
             if (incr) {
@@ -1429,18 +1624,16 @@ int zsetAdd(robj *zobj, double score, sds ele, int in_flags, int *out_flags, dou
 
             /* Remove and re-insert when score changes. */
             if (score != curscore) {
-                znode = zslUpdateScore(zs->zsl,curscore,ele,score);
+                zsetIndexUpdateScore(zs,curscore,ele,score);
                 /* Note that we did not removed the original element from
                  * the hash table representing the sorted set, so we just
                  * update the score. */
-                dictGetVal(de) = &znode->score; /* Update score ptr. */
+                dictSetDoubleVal(de,score);
                 *out_flags |= ZADD_OUT_UPDATED;
             }
             return 1;
         } else if (!xx) {
-            ele = sdsdup(ele);
-            znode = zslInsert(zs->zsl,score,ele);
-            serverAssert(dictAdd(zs->dict,ele,&znode->score) == DICT_OK);
+            zsetIndexAdd(zs,score,sdsdup(ele));
             *out_flags |= ZADD_OUT_ADDED;
             if (newscore) *newscore = score;
             return 1;
@@ -1465,7 +1658,7 @@ static int zsetRemoveFromSkiplist(zset *zs, sds ele) {
     de = dictUnlink(zs->dict,ele);
     if (de != NULL) {
         /* Get the score in order to delete from the skiplist later. */
-        score = *(double*)dictGetVal(de);
+        score = dictGetDoubleVal(de);
 
         /* Delete from the hash table and later from the skiplist.
          * Note that the order is important: deleting from the skiplist
@@ -1474,9 +1667,8 @@ static int zsetRemoveFromSkiplist(zset *zs, sds ele) {
          * we need to delete from the skiplist as the final step. */
         dictFreeUnlinkedEntry(zs->dict,de);
 
-        /* Delete from skiplist. */
-        int retval = zslDelete(zs->zsl,score,ele,NULL);
-        serverAssert(retval);
+        /* Delete from skiplist (or B+tree). */
+        zsetIndexDelete(zs,score,ele);
 
         return 1;
     }
@@ -1487,7 +1679,7 @@ static int zsetRemoveFromSkiplist(zset *zs, sds ele) {
 /* Delete the element 'ele' from the sorted set, returning 1 if the element
  * existed and was deleted, 0 otherwise (the element was not there). */
 int zsetDel(robj *zobj, sds ele) {
-    if (zobj->encoding == OBJ_ENCODING_ZIPLIST) {
+    if (zobj->encoding == OBJ_ENCODING_LISTPACK) {
         unsigned char *eptr;
 
         if ((eptr = zzlFind(zobj->ptr,ele,NULL)) != NULL) {
@@ -1523,18 +1715,18 @@ long zsetRank(robj *zobj, sds ele, int reverse) {
 
     llen = zsetLength(zobj);
 
-    if (zobj->encoding == OBJ_ENCODING_ZIPLIST) {
+    if (zobj->encoding == OBJ_ENCODING_LISTPACK) {
         unsigned char *zl = zobj->ptr;
         unsigned char *eptr, *sptr;
 
-        eptr = ziplistIndex(zl,0);
+        eptr = lpSeek(zl,0);
         serverAssert(eptr != NULL);
-        sptr = ziplistNext(zl,eptr);
+        sptr = lpNext(zl,eptr);
         serverAssert(sptr != NULL);
 
         rank = 1;
         while(eptr != NULL) {
-            if (ziplistCompare(eptr,(unsigned char*)ele,sdslen(ele)))
+            if (lpCompare(eptr,(unsigned char*)ele,sdslen(ele)))
                 break;
             rank++;
             zzlNext(zl,&eptr,&sptr);
@@ -1550,14 +1742,13 @@ long zsetRank(robj *zobj, sds ele, int reverse) {
         }
     } else if (zobj->encoding == OBJ_ENCODING_SKIPLIST) {
         zset *zs = zobj->ptr;
-        zskiplist *zsl = zs->zsl;
         dictEntry *de;
         double score;
 
         de = dictFind(zs->dict,ele);
         if (de != NULL) {
-            score = *(double*)dictGetVal(de);
-            rank = zslGetRank(zsl,score,ele);
+            score = dictGetDoubleVal(de);
+            rank = zsetIndexRank(zs,score,ele);
             /* Existing elements always have a rank. */
             serverAssert(rank != 0);
             if (reverse)
@@ -1585,36 +1776,31 @@ robj *zsetDup(robj *o) {
     serverAssert(o->type == OBJ_ZSET);
 
     /* Create a new sorted set object that have the same encoding as the original object's encoding */
-    if (o->encoding == OBJ_ENCODING_ZIPLIST) {
+    if (o->encoding == OBJ_ENCODING_LISTPACK) {
         unsigned char *zl = o->ptr;
-        size_t sz = ziplistBlobLen(zl);
+        size_t sz = lpBytes(zl);
         unsigned char *new_zl = zmalloc(sz);
         memcpy(new_zl, zl, sz);
         zobj = createObject(OBJ_ZSET, new_zl);
-        zobj->encoding = OBJ_ENCODING_ZIPLIST;
+        zobj->encoding = OBJ_ENCODING_LISTPACK;
     } else if (o->encoding == OBJ_ENCODING_SKIPLIST) {
         zobj = createZsetObject();
         zs = o->ptr;
         new_zs = zobj->ptr;
         dictExpand(new_zs->dict,dictSize(zs->dict));
-        zskiplist *zsl = zs->zsl;
-        zskiplistNode *ln;
-        sds ele;
-        long llen = zsetLength(o);
+        zsetCursor c;
 
         /* We copy the skiplist elements from the greatest to the
          * smallest (that's trivial since the elements are already ordered in
          * the skiplist): this improves the load process, since the next loaded
          * element will always be the smaller, so adding to the skiplist
          * will always immediately stop at the head, making the insertion
-         * O(1) instead of O(log(N)). */
-        ln = zsl->tail;
-        while (llen--) {
-            ele = ln->ele;
-            sds new_ele = sdsdup(ele);
-            zskiplistNode *znode = zslInsert(new_zs->zsl,ln->score,new_ele);
-            dictAdd(new_zs->dict,new_ele,&znode->score);
-            ln = ln->backward;
+         * O(1) instead of O(log(N)). The B+tree fills its leaves completely
+         * both ways. */
+        zsetIndexLast(zs,&c);
+        while (zsetCursorValid(&c)) {
+            zsetIndexAdd(new_zs,zsetCursorScore(&c),sdsdup(zsetCursorEle(&c)));
+            zsetCursorPrev(&c);
         }
     } else {
         serverPanic("Unknown sorted set encoding");
@@ -1622,8 +1808,8 @@ robj *zsetDup(robj *o) {
     return zobj;
 }
 
-/* callback for to check the ziplist doesn't have duplicate recoreds */
-static int _zsetZiplistValidateIntegrity(unsigned char *p, void *userdata) {
+/* callback for to check the listpack doesn't have duplicate records */
+static int _zsetListpackValidateIntegrity(unsigned char *p, void *userdata) {
     struct {
         long count;
         dict *fields;
@@ -1634,9 +1820,8 @@ static int _zsetZiplistValidateIntegrity(unsigned char *p, void *userdata) {
         unsigned char *str;
         unsigned int slen;
         long long vll;
-        if (!ziplistGet(p, &str, &slen, &vll))
-            return 0;
-        sds field = str? sdsnewlen(str, slen): sdsfromlonglong(vll);;
+        str = lpGetValue(p, &slen, &vll);
+        sds field = str? sdsnewlen(str, slen): sdsfromlonglong(vll);
         if (dictAdd(data->fields, field, NULL) != DICT_OK) {
             /* Duplicate, return an error */
             sdsfree(field);
@@ -1651,9 +1836,9 @@ static int _zsetZiplistValidateIntegrity(unsigned char *p, void *userdata) {
 /* Validate the integrity of the data structure.
  * when `deep` is 0, only the integrity of the header is validated.
  * when `deep` is 1, we scan all the entries one by one. */
-int zsetZiplistValidateIntegrity(unsigned char *zl, size_t size, int deep) {
+int zsetListpackValidateIntegrity(unsigned char *zl, size_t size, int deep) {
     if (!deep)
-        return ziplistValidateIntegrity(zl, size, 0, NULL, NULL);
+        return lpValidateIntegrity(zl, size, 0, NULL, NULL);
 
     /* Keep track of the field names to locate duplicate ones */
     struct {
@@ -1661,7 +1846,7 @@ int zsetZiplistValidateIntegrity(unsigned char *zl, size_t size, int deep) {
         dict *fields;
     } data = {0, dictCreate(&hashDictType, NULL)};
 
-    int ret = ziplistValidateIntegrity(zl, size, 1, _zsetZiplistValidateIntegrity, &data);
+    int ret = lpValidateIntegrity(zl, size, 1, _zsetListpackValidateIntegrity, &data);
 
     /* make sure we have an even number of records. */
     if (data.count & 1)
@@ -1671,13 +1856,13 @@ int zsetZiplistValidateIntegrity(unsigned char *zl, size_t size, int deep) {
     return ret;
 }
 
-/* Create a new sds string from the ziplist entry. */
-sds zsetSdsFromZiplistEntry(ziplistEntry *e) {
+/* Create a new sds string from the listpack entry. */
+sds zsetSdsFromListpackEntry(listpackEntry *e) {
     return e->sval ? sdsnewlen(e->sval, e->slen) : sdsfromlonglong(e->lval);
 }
 
-/* Reply with bulk string from the ziplist entry. */
-void zsetReplyFromZiplistEntry(client *c, ziplistEntry *e) {
+/* Reply with bulk string from the listpack entry. */
+void zsetReplyFromListpackEntry(client *c, listpackEntry *e) {
     if (e->sval)
         addReplyBulkCBuffer(c, e->sval, e->slen);
     else
@@ -1689,7 +1874,7 @@ void zsetReplyFromZiplistEntry(client *c, ziplistEntry *e) {
  * 'key' and 'val' will be set to hold the element.
  * The memory in `key` is not to be freed or modified by the caller.
  * 'score' can be NULL in which case it's not extracted. */
-void zsetTypeRandomElement(robj *zsetobj, unsigned long zsetsize, ziplistEntry *key, double *score) {
+void zsetTypeRandomElement(robj *zsetobj, unsigned long zsetsize, listpackEntry *key, double *score) {
     if (zsetobj->encoding == OBJ_ENCODING_SKIPLIST) {
         zset *zs = zsetobj->ptr;
         dictEntry *de = dictGetFairRandomKey(zs->dict);
@@ -1697,10 +1882,10 @@ void zsetTypeRandomElement(robj *zsetobj, unsigned long zsetsize, ziplistEntry *
         key->sval = (unsigned char*)s;
         key->slen = sdslen(s);
         if (score)
-            *score = *(double*)dictGetVal(de);
-    } else if (zsetobj->encoding == OBJ_ENCODING_ZIPLIST) {
-        ziplistEntry val;
-        ziplistRandomPair(zsetobj->ptr, zsetsize, key, &val);
+            *score = dictGetDoubleVal(de);
+    } else if (zsetobj->encoding == OBJ_ENCODING_LISTPACK) {
+        listpackEntry val;
+        lpRandomPair(zsetobj->ptr, zsetsize, key, &val);
         if (score) {
             if (val.sval) {
                 *score = zzlStrtod(val.sval,val.slen);
@@ -1799,12 +1984,12 @@ void zaddGenericCommand(client *c, int flags) {
     if (checkType(c,zobj,OBJ_ZSET)) goto cleanup;
     if (zobj == NULL) {
         if (xx) goto reply_to_client; /* No key + XX option: nothing to do. */
-        if (server.zset_max_ziplist_entries == 0 ||
-            server.zset_max_ziplist_value < sdslen(c->argv[scoreidx+1]->ptr))
+        if (server.zset_max_listpack_entries == 0 ||
+            server.zset_max_listpack_value < sdslen(c->argv[scoreidx+1]->ptr))
         {
             zobj = createZsetObject();
         } else {
-            zobj = createZsetZiplistObject();
+            zobj = createZsetListpackObject();
         }
         dbAdd(c->db,key,zobj);
     }
@@ -1942,7 +2127,7 @@ void zremrangeGenericCommand(client *c, zrange_type rangetype) {
     }
 
     /* Step 3: Perform the range deletion operation. */
-    if (zobj->encoding == OBJ_ENCODING_ZIPLIST) {
+    if (zobj->encoding == OBJ_ENCODING_LISTPACK) {
         switch(rangetype) {
         case ZRANGE_AUTO:
         case ZRANGE_RANK:
@@ -1964,13 +2149,13 @@ void zremrangeGenericCommand(client *c, zrange_type rangetype) {
         switch(rangetype) {
         case ZRANGE_AUTO:
         case ZRANGE_RANK:
-            deleted = zslDeleteRangeByRank(zs->zsl,start+1,end+1,zs->dict);
+            deleted = zsetIndexDeleteRangeByRank(zs,start+1,end+1);
             break;
         case ZRANGE_SCORE:
-            deleted = zslDeleteRangeByScore(zs->zsl,&range,zs->dict);
+            deleted = zsetIndexDeleteRangeByScore(zs,&range);
             break;
         case ZRANGE_LEX:
-            deleted = zslDeleteRangeByLex(zs->zsl,&lexrange,zs->dict);
+            deleted = zsetIndexDeleteRangeByLex(zs,&lexrange);
             break;
         }
         if (htNeedsResize(zs->dict)) dictResize(zs->dict);
@@ -2036,7 +2221,7 @@ typedef struct {
             } zl;
             struct {
                 zset *zs;
-                zskiplistNode *node;
+                zsetCursor c;
             } sl;
         } zset;
     } iter;
@@ -2088,16 +2273,16 @@ void zuiInitIterator(zsetopsrc *op) {
          * the insertion of the elements in a new list as in
          * ZDIFF/ZINTER/ZUNION */
         iterzset *it = &op->iter.zset;
-        if (op->encoding == OBJ_ENCODING_ZIPLIST) {
+        if (op->encoding == OBJ_ENCODING_LISTPACK) {
             it->zl.zl = op->subject->ptr;
-            it->zl.eptr = ziplistIndex(it->zl.zl,-2);
+            it->zl.eptr = lpSeek(it->zl.zl,-2);
             if (it->zl.eptr != NULL) {
-                it->zl.sptr = ziplistNext(it->zl.zl,it->zl.eptr);
+                it->zl.sptr = lpNext(it->zl.zl,it->zl.eptr);
                 serverAssert(it->zl.sptr != NULL);
             }
         } else if (op->encoding == OBJ_ENCODING_SKIPLIST) {
             it->sl.zs = op->subject->ptr;
-            it->sl.node = it->sl.zs->zsl->tail;
+            zsetIndexLast(it->sl.zs,&it->sl.c);
         } else {
             serverPanic("Unknown sorted set encoding");
         }
@@ -2121,7 +2306,7 @@ void zuiClearIterator(zsetopsrc *op) {
         }
     } else if (op->type == OBJ_ZSET) {
         iterzset *it = &op->iter.zset;
-        if (op->encoding == OBJ_ENCODING_ZIPLIST) {
+        if (op->encoding == OBJ_ENCODING_LISTPACK) {
             UNUSED(it); /* skip */
         } else if (op->encoding == OBJ_ENCODING_SKIPLIST) {
             UNUSED(it); /* skip */
@@ -2147,11 +2332,11 @@ unsigned long zuiLength(zsetopsrc *op) {
             serverPanic("Unknown set encoding");
         }
     } else if (op->type == OBJ_ZSET) {
-        if (op->encoding == OBJ_ENCODING_ZIPLIST) {
+        if (op->encoding == OBJ_ENCODING_LISTPACK) {
             return zzlLength(op->subject->ptr);
         } else if (op->encoding == OBJ_ENCODING_SKIPLIST) {
             zset *zs = op->subject->ptr;
-            return zs->zsl->length;
+            return zsetIndexLength(zs);
         } else {
             serverPanic("Unknown sorted set encoding");
         }
@@ -2197,23 +2382,23 @@ int zuiNext(zsetopsrc *op, zsetopval *val) {
         }
     } else if (op->type == OBJ_ZSET) {
         iterzset *it = &op->iter.zset;
-        if (op->encoding == OBJ_ENCODING_ZIPLIST) {
+        if (op->encoding == OBJ_ENCODING_LISTPACK) {
             /* No need to check both, but better be explicit. */
             if (it->zl.eptr == NULL || it->zl.sptr == NULL)
                 return 0;
-            serverAssert(ziplistGet(it->zl.eptr,&val->estr,&val->elen,&val->ell));
+            val->estr = lpGetValue(it->zl.eptr,&val->elen,&val->ell);
             val->score = zzlGetScore(it->zl.sptr);
 
             /* Move to next element (going backwards, see zuiInitIterator). */
             zzlPrev(it->zl.zl,&it->zl.eptr,&it->zl.sptr);
         } else if (op->encoding == OBJ_ENCODING_SKIPLIST) {
-            if (it->sl.node == NULL)
+            if (!zsetCursorValid(&it->sl.c))
                 return 0;
-            val->ele = it->sl.node->ele;
-            val->score = it->sl.node->score;
+            val->ele = zsetCursorEle(&it->sl.c);
+            val->score = zsetCursorScore(&it->sl.c);
 
             /* Move to next element. (going backwards, see zuiInitIterator) */
-            it->sl.node = it->sl.node->backward;
+            zsetCursorPrev(&it->sl.c);
         } else {
             serverPanic("Unknown sorted set encoding");
         }
@@ -2315,7 +2500,7 @@ int zuiFind(zsetopsrc *op, zsetopval *val, double *score) {
     } else if (op->type == OBJ_ZSET) {
         zuiSdsFromValue(val);
 
-        if (op->encoding == OBJ_ENCODING_ZIPLIST) {
+        if (op->encoding == OBJ_ENCODING_LISTPACK) {
             if (zzlFind(op->subject->ptr,val->ele,score) != NULL) {
                 /* Score is already set by zzlFind. */
                 return 1;
@@ -2326,7 +2511,7 @@ int zuiFind(zsetopsrc *op, zsetopval *val, double *score) {
             zset *zs = op->subject->ptr;
             dictEntry *de;
             if ((de = dictFind(zs->dict,val->ele)) != NULL) {
-                *score = *(double*)dictGetVal(de);
+                *score = dictGetDoubleVal(de);
                 return 1;
             } else {
                 return 0;
@@ -2354,7 +2539,6 @@ static int zuiCompareByRevCardinality(const void *s1, const void *s2) {
 #define REDIS_AGGR_SUM 1
 #define REDIS_AGGR_MIN 2
 #define REDIS_AGGR_MAX 3
-#define zunionInterDictValue(_e) (dictGetVal(_e) == NULL ? 1.0 : *(double*)dictGetVal(_e))
 
 inline static void zunionInterAggregate(double *target, double val, int aggregate) {
     if (aggregate == REDIS_AGGR_SUM) {
@@ -2408,7 +2592,6 @@ static void zdiffAlgorithm1(zsetopsrc *src, long setnum, zset *dstzset, size_t *
      * The final complexity of this algorithm is O(N*M + K*log(K)). */
     int j;
     zsetopval zval;
-    zskiplistNode *znode;
     sds tmp;
 
     /* With algorithm 1 it is better to order the sets to subtract
@@ -2437,8 +2620,7 @@ static void zdiffAlgorithm1(zsetopsrc *src, long setnum, zset *dstzset, size_t *
 
         if (!exists) {
             tmp = zuiNewSdsFromValue(&zval);
-            znode = zslInsert(dstzset->zsl,zval.score,tmp);
-            dictAdd(dstzset->dict,tmp,&znode->score);
+            zsetIndexAdd(dstzset,zval.score,tmp);
             if (sdslen(tmp) > *maxelelen) *maxelelen = sdslen(tmp);
             (*totelelen) += sdslen(tmp);
         }
@@ -2466,7 +2648,6 @@ static void zdiffAlgorithm2(zsetopsrc *src, long setnum, zset *dstzset, size_t *
     int j;
     int cardinality = 0;
     zsetopval zval;
-    zskiplistNode *znode;
     sds tmp;
 
     for (j = 0; j < setnum; j++) {
@@ -2477,8 +2658,7 @@ static void zdiffAlgorithm2(zsetopsrc *src, long setnum, zset *dstzset, size_t *
         while (zuiNext(&src[j],&zval)) {
             if (j == 0) {
                 tmp = zuiNewSdsFromValue(&zval);
-                znode = zslInsert(dstzset->zsl,zval.score,tmp);
-                dictAdd(dstzset->dict,tmp,&znode->score);
+                zsetIndexAdd(dstzset,zval.score,tmp);
                 cardinality++;
             } else {
                 tmp = zuiSdsFromValue(&zval);
@@ -2565,6 +2745,206 @@ dictType setAccumulatorDictType = {
     NULL                       /* allow to expand */
 };
 
+/* Parallel ZUNION / ZINTER. Every pool thread computes a disjoint part of the
+ * result: for ZINTER a slice of the smallest input, for ZUNION the elements
+ * whose hash falls in its partition. The parts are sorted in the threads, so
+ * that the main thread only has to merge them while adding the elements to
+ * the destination in order. */
+typedef struct {
+    sds ele;
+    double score;
+} zsetopResult;
+
+typedef struct {
+    zsetopsrc *src;
+    long setnum;
+    int op, aggregate, njobs;
+    struct zsetopPart {
+        zsetopResult *res;
+        unsigned long len;
+        size_t maxelelen, totelelen;
+    } parts[PARALLEL_MAX_THREADS];
+} zsetopJob;
+
+static int zsetopResultCompare(const void *a, const void *b) {
+    const zsetopResult *ra = a, *rb = b;
+    if (ra->score < rb->score) return -1;
+    if (ra->score > rb->score) return 1;
+    return sdscmp(ra->ele,rb->ele);
+}
+
+static void zsetopPartAdd(struct zsetopPart *part, sds ele, double score) {
+    part->res[part->len].ele = ele;
+    part->res[part->len].score = score;
+    part->len++;
+    part->totelelen += sdslen(ele);
+    if (sdslen(ele) > part->maxelelen) part->maxelelen = sdslen(ele);
+}
+
+/* Partition of an element hash. The high bits are used because the low
+ * ones select the bucket in the per thread accumulators. */
+static inline int zsetopPartition(uint64_t hash, int njobs) {
+    return (int)(((hash >> 32) * (uint64_t)njobs) >> 32);
+}
+
+/* Dict that lookups or iterations of 'op' use, if any. */
+static dict *zuiDict(zsetopsrc *op) {
+    if (op->subject == NULL) return NULL;
+    if (op->type == OBJ_SET && op->encoding == OBJ_ENCODING_HT)
+        return op->subject->ptr;
+    if (op->type == OBJ_ZSET && op->encoding == OBJ_ENCODING_SKIPLIST)
+        return ((zset*)op->subject->ptr)->dict;
+    return NULL;
+}
+
+static void zinterPartJob(zsetopJob *job, int idx) {
+    struct zsetopPart *part = &job->parts[idx];
+    zsetopsrc *src = job->src;
+    zsetopsrc first = src[0]; /* Private iterator over the smallest input. */
+    unsigned long length = zuiLength(&first), pos = 0;
+    unsigned long lo = length*idx/job->njobs, hi = length*(idx+1)/job->njobs;
+    zsetopval zval;
+    long j;
+
+    part->res = zmalloc(sizeof(zsetopResult)*(hi-lo+1));
+    memset(&zval,0,sizeof(zval));
+    zuiInitIterator(&first);
+    while (pos < hi && zuiNext(&first,&zval)) {
+        double score, value;
+
+        if (pos++ < lo) continue;
+        score = first.weight * zval.score;
+        if (isnan(score)) score = 0;
+
+        for (j = 1; j < job->setnum; j++) {
+            if (src[j].subject == first.subject) {
+                value = zval.score*src[j].weight;
+                zunionInterAggregate(&score,value,job->aggregate);
+            } else if (zuiFind(&src[j],&zval,&value)) {
+                value *= src[j].weight;
+                zunionInterAggregate(&score,value,job->aggregate);
+            } else {
+                break;
+            }
+        }
+        if (j == job->setnum)
+            zsetopPartAdd(part,zuiNewSdsFromValue(&zval),score);
+    }
+    if (zval.flags & OPVAL_DIRTY_SDS) sdsfree(zval.ele);
+    zuiClearIterator(&first);
+}
+
+static void zunionPartJob(zsetopJob *job, int idx) {
+    struct zsetopPart *part = &job->parts[idx];
+    zsetopsrc *src = job->src;
+    dict *accumulator = dictCreate(&setAccumulatorDictType,NULL);
+    dictIterator *di;
+    dictEntry *de, *existing;
+    zsetopval zval;
+
+    dictExpand(accumulator,zuiLength(&src[job->setnum-1])/job->njobs);
+    memset(&zval,0,sizeof(zval));
+    for (long i = 0; i < job->setnum; i++) {
+        zsetopsrc it = src[i];
+
+        if (zuiLength(&it) == 0) continue;
+        zuiInitIterator(&it);
+        while (zuiNext(&it,&zval)) {
+            double score;
+
+            zuiBufferFromValue(&zval);
+            if (zsetopPartition(dictGenHashFunction(zval.estr,zval.elen),
+                                job->njobs) != idx) continue;
+
+            score = it.weight * zval.score;
+            if (isnan(score)) score = 0;
+            de = dictAddRaw(accumulator,zuiSdsFromValue(&zval),&existing);
+            if (!existing) {
+                dictSetKey(accumulator,de,zuiNewSdsFromValue(&zval));
+                dictSetDoubleVal(de,score);
+            } else {
+                zunionInterAggregate(&existing->v.d,score,job->aggregate);
+            }
+        }
+        zuiClearIterator(&it);
+    }
+
+    part->res = zmalloc(sizeof(zsetopResult)*(dictSize(accumulator)+1));
+    di = dictGetIterator(accumulator);
+    while ((de = dictNext(di)) != NULL)
+        zsetopPartAdd(part,dictGetKey(de),dictGetDoubleVal(de));
+    dictReleaseIterator(di);
+    dictRelease(accumulator);
+}
+
+static void zsetopPartJob(void *privdata, int idx) {
+    zsetopJob *job = privdata;
+
+    if (job->op == SET_OP_INTER)
+        zinterPartJob(job,idx);
+    else
+        zunionPartJob(job,idx);
+    qsort(job->parts[idx].res,job->parts[idx].len,sizeof(zsetopResult),
+          zsetopResultCompare);
+}
+
+/* Return 1 if ZUNION / ZINTER of 'src' is worth running in the pool. */
+static int zsetopUseParallel(zsetopsrc *src, long setnum, int op) {
+    unsigned long work = 0;
+
+    if (op == SET_OP_DIFF || parallelThreadsNum() == 1) return 0;
+    if (op == SET_OP_INTER) {
+        work = zuiLength(&src[0]);
+    } else {
+        for (long i = 0; i < setnum; i++) work += zuiLength(&src[i]);
+    }
+    return work >= server.parallel_zset_min_elements;
+}
+
+static void zunionInterParallel(zsetopsrc *src, long setnum, int op, int aggregate,
+                                zset *dstzset, size_t *maxelelen, size_t *totelelen)
+{
+    zsetopJob job = {.src = src, .setnum = setnum, .op = op,
+                     .aggregate = aggregate, .njobs = parallelThreadsNum()};
+    unsigned long pos[PARALLEL_MAX_THREADS] = {0}, total = 0;
+    int p;
+
+    /* Lookups in the inputs must not perform rehashing steps. */
+    for (long i = 0; i < setnum; i++) {
+        dict *d = zuiDict(&src[i]);
+        if (d) dictPauseRehashing(d);
+    }
+    parallelRun(zsetopPartJob,&job,job.njobs);
+    for (long i = 0; i < setnum; i++) {
+        dict *d = zuiDict(&src[i]);
+        if (d) dictResumeRehashing(d);
+    }
+
+    for (p = 0; p < job.njobs; p++) {
+        total += job.parts[p].len;
+        *totelelen += job.parts[p].totelelen;
+        if (job.parts[p].maxelelen > *maxelelen)
+            *maxelelen = job.parts[p].maxelelen;
+    }
+    if (total) dictExpand(dstzset->dict,total);
+
+    while (1) {
+        int best = -1;
+        for (p = 0; p < job.njobs; p++) {
+            if (pos[p] == job.parts[p].len) continue;
+            if (best == -1 ||
+                zsetopResultCompare(&job.parts[p].res[pos[p]],
+                                    &job.parts[best].res[pos[best]]) < 0)
+                best = p;
+        }
+        if (best == -1) break;
+
+        zsetopResult *r = &job.parts[best].res[pos[best]++];
+        zsetIndexAdd(dstzset,r->score,r->ele);
+    }
+    for (p = 0; p < job.njobs; p++) zfree(job.parts[p].res);
+}
+
 /* The zunionInterDiffGenericCommand() function is called in order to implement the
  * following commands: ZUNION, ZINTER, ZDIFF, ZUNIONSTORE, ZINTERSTORE, ZDIFFSTORE.
  *
@@ -2583,7 +2963,6 @@ void zunionInterDiffGenericCommand(client *c, robj *dstkey, int numkeysIndex, in
     size_t maxelelen = 0, totelelen = 0;
     robj *dstobj;
     zset *dstzset;
-    zskiplistNode *znode;
     int withscores = 0;
 
     /* expect setnum input keys to be given */
@@ -2685,7 +3064,11 @@ void zunionInterDiffGenericCommand(client *c, robj *dstkey, int numkeysIndex, in
     dstzset = dstobj->ptr;
     memset(&zval, 0, sizeof(zval));
 
-    if (op == SET_OP_INTER) {
+    if (zsetopUseParallel(src, setnum, op)) {
+        zunionInterParallel(src, setnum, op, aggregate, dstzset,
+                            &maxelelen, &totelelen);
+        server.stat_parallel_zset_ops++;
+    } else if (op == SET_OP_INTER) {
         /* Skip everything if the smallest input is empty. */
         if (zuiLength(&src[0]) > 0) {
             /* Precondition: as src[0] is non-empty and the inputs are ordered
@@ -2714,8 +3097,7 @@ void zunionInterDiffGenericCommand(client *c, robj *dstkey, int numkeysIndex, in
                 /* Only continue when present in every input. */
                 if (j == setnum) {
                     tmp = zuiNewSdsFromValue(&zval);
-                    znode = zslInsert(dstzset->zsl,score,tmp);
-                    dictAdd(dstzset->dict,tmp,&znode->score);
+                    zsetIndexAdd(dstzset,score,tmp);
                     totelelen += sdslen(tmp);
                     if (sdslen(tmp) > maxelelen) maxelelen = sdslen(tmp);
                 }
@@ -2751,7 +3133,7 @@ void zunionInterDiffGenericCommand(client *c, robj *dstkey, int numkeysIndex, in
                 if (!existing) {
                     tmp = zuiNewSdsFromValue(&zval);
                     /* Remember the longest single element encountered,
-                     * to understand if it's possible to convert to ziplist
+                     * to understand if it's possible to convert to listpack
                      * at the end. */
                      totelelen += sdslen(tmp);
                      if (sdslen(tmp) > maxelelen) maxelelen = sdslen(tmp);
@@ -2782,8 +3164,7 @@ void zunionInterDiffGenericCommand(client *c, robj *dstkey, int numkeysIndex, in
         while((de = dictNext(di)) != NULL) {
             sds ele = dictGetKey(de);
             score = dictGetDoubleVal(de);
-            znode = zslInsert(dstzset->zsl,score,ele);
-            dictAdd(dstzset->dict,ele,&znode->score);
+            zsetIndexAdd(dstzset,score,ele);
         }
         dictReleaseIterator(di);
         dictRelease(accumulator);
@@ -2794,8 +3175,8 @@ void zunionInterDiffGenericCommand(client *c, robj *dstkey, int numkeysIndex, in
     }
 
     if (dstkey) {
-        if (dstzset->zsl->length) {
-            zsetConvertToZiplistIfNeeded(dstobj, maxelelen, totelelen);
+        if (zsetIndexLength(dstzset)) {
+            zsetConvertToListpackIfNeeded(dstobj, maxelelen, totelelen);
             setKey(c, c->db, dstkey, dstobj);
             addReplyLongLong(c, zsetLength(dstobj));
             notifyKeyspaceEvent(NOTIFY_ZSET,
@@ -2812,9 +3193,8 @@ void zunionInterDiffGenericCommand(client *c, robj *dstkey, int numkeysIndex, in
             }
         }
     } else {
-        unsigned long length = dstzset->zsl->length;
-        zskiplist *zsl = dstzset->zsl;
-        zskiplistNode *zn = zsl->header->level[0].forward;
+        unsigned long length = zsetIndexLength(dstzset);
+        zsetCursor zc;
         /* In case of WITHSCORES, respond with a single array in RESP2, and
          * nested arrays in RESP3. We can't use a map response type since the
          * client library needs to know to respect the order. */
@@ -2823,11 +3203,13 @@ void zunionInterDiffGenericCommand(client *c, robj *dstkey, int numkeysIndex, in
         else
             addReplyArrayLen(c, length);
 
-        while (zn != NULL) {
+        zsetIndexFirst(dstzset,&zc);
+        while (zsetCursorValid(&zc)) {
+            sds ele = zsetCursorEle(&zc);
             if (withscores && c->resp > 2) addReplyArrayLen(c,2);
-            addReplyBulkCBuffer(c,zn->ele,sdslen(zn->ele));
-            if (withscores) addReplyDouble(c,zn->score);
-            zn = zn->level[0].forward;
+            addReplyBulkCBuffer(c,ele,sdslen(ele));
+            if (withscores) addReplyDouble(c,zsetCursorScore(&zc));
+            zsetCursorNext(&zc);
         }
     }
     decrRefCount(dstobj);
@@ -2965,10 +3347,10 @@ static void zrangeResultFinalizeClient(zrange_result_handler *handler,
 /* Result handler methods for storing the ZRANGESTORE to a zset. */
 static void zrangeResultBeginStore(zrange_result_handler *handler, long length)
 {
-    if (length > (long)server.zset_max_ziplist_entries)
+    if (length > (long)server.zset_max_listpack_entries)
         handler->dstobj = createZsetObject();
     else
-        handler->dstobj = createZsetZiplistObject();
+        handler->dstobj = createZsetListpackObject();
 }
 
 static void zrangeResultEmitCBufferForStore(zrange_result_handler *handler,
@@ -3075,7 +3457,7 @@ void genericZrangebyrankCommand(zrange_result_handler *handler,
     result_cardinality = rangelen;
 
     handler->beginResultEmission(handler, rangelen);
-    if (zobj->encoding == OBJ_ENCODING_ZIPLIST) {
+    if (zobj->encoding == OBJ_ENCODING_LISTPACK) {
         unsigned char *zl = zobj->ptr;
         unsigned char *eptr, *sptr;
         unsigned char *vstr;
@@ -3084,16 +3466,16 @@ void genericZrangebyrankCommand(zrange_result_handler *handler,
         double score = 0.0;
 
         if (reverse)
-            eptr = ziplistIndex(zl,-2-(2*start));
+            eptr = lpSeek(zl,-2-(2*start));
         else
-            eptr = ziplistIndex(zl,2*start);
+            eptr = lpSeek(zl,2*start);
 
         serverAssertWithInfo(c,zobj,eptr != NULL);
-        sptr = ziplistNext(zl,eptr);
+        sptr = lpNext(zl,eptr);
 
         while (rangelen--) {
             serverAssertWithInfo(c,zobj,eptr != NULL && sptr != NULL);
-            serverAssertWithInfo(c,zobj,ziplistGet(eptr,&vstr,&vlen,&vlong));
+            vstr = lpGetValue(eptr,&vlen,&vlong);
 
             if (withscores) /* don't bother to extract the score if it's gonna be ignored. */
                 score = zzlGetScore(sptr);
@@ -3112,25 +3494,26 @@ void genericZrangebyrankCommand(zrange_result_handler *handler,
 
     } else if (zobj->encoding == OBJ_ENCODING_SKIPLIST) {
         zset *zs = zobj->ptr;
-        zskiplist *zsl = zs->zsl;
-        zskiplistNode *ln;
+        zsetCursor zc;
 
         /* Check if starting point is trivial, before doing log(N) lookup. */
         if (reverse) {
-            ln = zsl->tail;
             if (start > 0)
-                ln = zslGetElementByRank(zsl,llen-start);
+                zsetIndexElementByRank(zs,llen-start,&zc);
+            else
+                zsetIndexLast(zs,&zc);
         } else {
-            ln = zsl->header->level[0].forward;
             if (start > 0)
-                ln = zslGetElementByRank(zsl,start+1);
+                zsetIndexElementByRank(zs,start+1,&zc);
+            else
+                zsetIndexFirst(zs,&zc);
         }
 
         while(rangelen--) {
-            serverAssertWithInfo(c,zobj,ln != NULL);
-            sds ele = ln->ele;
-            handler->emitResultFromCBuffer(handler, ele, sdslen(ele), ln->score);
-            ln = reverse ? ln->backward : ln->level[0].forward;
+            serverAssertWithInfo(c,zobj,zsetCursorValid(&zc));
+            sds ele = zsetCursorEle(&zc);
+            handler->emitResultFromCBuffer(handler, ele, sdslen(ele), zsetCursorScore(&zc));
+            if (reverse) zsetCursorPrev(&zc); else zsetCursorNext(&zc);
         }
     } else {
         serverPanic("Unknown sorted set encoding");
@@ -3167,7 +3550,6 @@ void genericZrangebyscoreCommand(zrange_result_handler *handler,
     zrangespec *range, robj *zobj, long offset, long limit, 
     int reverse) {
 
-    client *c = handler->client;
     unsigned long rangelen = 0;
 
     handler->beginResultEmission(handler, -1);
@@ -3178,7 +3560,7 @@ void genericZrangebyscoreCommand(zrange_result_handler *handler,
         return;
     }
 
-    if (zobj->encoding == OBJ_ENCODING_ZIPLIST) {
+    if (zobj->encoding == OBJ_ENCODING_LISTPACK) {
         unsigned char *zl = zobj->ptr;
         unsigned char *eptr, *sptr;
         unsigned char *vstr;
@@ -3194,7 +3576,7 @@ void genericZrangebyscoreCommand(zrange_result_handler *handler,
 
         /* Get score pointer for the first element. */
         if (eptr)
-            sptr = ziplistNext(zl,eptr);
+            sptr = lpNext(zl,eptr);
 
         /* If there is an offset, just traverse the number of elements without
          * checking the score because that is done in the next loop. */
@@ -3216,9 +3598,7 @@ void genericZrangebyscoreCommand(zrange_result_handler *handler,
                 if (!zslValueLteMax(score,range)) break;
             }
 
-            /* We know the element exists, so ziplistGet should always
-             * succeed */
-            serverAssertWithInfo(c,zobj,ziplistGet(eptr,&vstr,&vlen,&vlong));
+            vstr = lpGetValue(eptr,&vlen,&vlong);
 
             rangelen++;
             if (vstr == NULL) {
@@ -3236,42 +3616,44 @@ void genericZrangebyscoreCommand(zrange_result_handler *handler,
         }
     } else if (zobj->encoding == OBJ_ENCODING_SKIPLIST) {
         zset *zs = zobj->ptr;
-        zskiplist *zsl = zs->zsl;
-        zskiplistNode *ln;
+        zsetCursor zc;
 
         /* If reversed, get the last node in range as starting point. */
         if (reverse) {
-            ln = zslLastInRange(zsl,range);
+            zsetIndexLastInRange(zs,range,&zc);
         } else {
-            ln = zslFirstInRange(zsl,range);
+            zsetIndexFirstInRange(zs,range,&zc);
         }
 
         /* If there is an offset, just traverse the number of elements without
          * checking the score because that is done in the next loop. */
-        while (ln && offset--) {
+        while (zsetCursorValid(&zc) && offset--) {
             if (reverse) {
-                ln = ln->backward;
+                zsetCursorPrev(&zc);
             } else {
-                ln = ln->level[0].forward;
+                zsetCursorNext(&zc);
             }
         }
 
-        while (ln && limit--) {
+        while (zsetCursorValid(&zc) && limit--) {
+            double score = zsetCursorScore(&zc);
+            sds ele = zsetCursorEle(&zc);
+
             /* Abort when the node is no longer in range. */
             if (reverse) {
-                if (!zslValueGteMin(ln->score,range)) break;
+                if (!zslValueGteMin(score,range)) break;
             } else {
-                if (!zslValueLteMax(ln->score,range)) break;
+                if (!zslValueLteMax(score,range)) break;
             }
 
             rangelen++;
-            handler->emitResultFromCBuffer(handler, ln->ele, sdslen(ln->ele), ln->score);
+            handler->emitResultFromCBuffer(handler, ele, sdslen(ele), score);
 
             /* Move to next node */
             if (reverse) {
-                ln = ln->backward;
+                zsetCursorPrev(&zc);
             } else {
-                ln = ln->level[0].forward;
+                zsetCursorNext(&zc);
             }
         }
     } else {
@@ -3311,7 +3693,7 @@ void zcountCommand(client *c) {
     if ((zobj = lookupKeyReadOrReply(c, key, shared.czero)) == NULL ||
         checkType(c, zobj, OBJ_ZSET)) return;
 
-    if (zobj->encoding == OBJ_ENCODING_ZIPLIST) {
+    if (zobj->encoding == OBJ_ENCODING_LISTPACK) {
         unsigned char *zl = zobj->ptr;
         unsigned char *eptr, *sptr;
         double score;
@@ -3326,7 +3708,7 @@ void zcountCommand(client *c) {
         }
 
         /* First element is in range */
-        sptr = ziplistNext(zl,eptr);
+        sptr = lpNext(zl,eptr);
         score = zzlGetScore(sptr);
         serverAssertWithInfo(c,zobj,zslValueLteMax(score,&range));
 
@@ -3344,25 +3726,21 @@ void zcountCommand(client *c) {
         }
     } else if (zobj->encoding == OBJ_ENCODING_SKIPLIST) {
         zset *zs = zobj->ptr;
-        zskiplist *zsl = zs->zsl;
-        zskiplistNode *zn;
+        unsigned long length = zsetIndexLength(zs);
+        zsetCursor zc;
         unsigned long rank;
 
         /* Find first element in range */
-        zn = zslFirstInRange(zsl, &range);
-
-        /* Use rank of first element, if any, to determine preliminary count */
-        if (zn != NULL) {
-            rank = zslGetRank(zsl, zn->score, zn->ele);
-            count = (zsl->length - (rank - 1));
+        if (zsetIndexFirstInRange(zs, &range, &zc)) {
+            /* Use rank of first element, if any, to determine preliminary count */
+            rank = zsetIndexRank(zs, zsetCursorScore(&zc), zsetCursorEle(&zc));
+            count = (length - (rank - 1));
 
             /* Find last element in range */
-            zn = zslLastInRange(zsl, &range);
-
-            /* Use rank of last element, if any, to determine the actual count */
-            if (zn != NULL) {
-                rank = zslGetRank(zsl, zn->score, zn->ele);
-                count -= (zsl->length - rank);
+            if (zsetIndexLastInRange(zs, &range, &zc)) {
+                /* Use rank of last element, if any, to determine the actual count */
+                rank = zsetIndexRank(zs, zsetCursorScore(&zc), zsetCursorEle(&zc));
+                count -= (length - rank);
             }
         }
     } else {
@@ -3392,7 +3770,7 @@ void zlexcountCommand(client *c) {
         return;
     }
 
-    if (zobj->encoding == OBJ_ENCODING_ZIPLIST) {
+    if (zobj->encoding == OBJ_ENCODING_LISTPACK) {
         unsigned char *zl = zobj->ptr;
         unsigned char *eptr, *sptr;
 
@@ -3407,7 +3785,7 @@ void zlexcountCommand(client *c) {
         }
 
         /* First element is in range */
-        sptr = ziplistNext(zl,eptr);
+        sptr = lpNext(zl,eptr);
         serverAssertWithInfo(c,zobj,zzlLexValueLteMax(eptr,&range));
 
         /* Iterate over elements in range */
@@ -3422,25 +3800,21 @@ void zlexcountCommand(client *c) {
         }
     } else if (zobj->encoding == OBJ_ENCODING_SKIPLIST) {
         zset *zs = zobj->ptr;
-        zskiplist *zsl = zs->zsl;
-        zskiplistNode *zn;
+        unsigned long length = zsetIndexLength(zs);
+        zsetCursor zc;
         unsigned long rank;
 
         /* Find first element in range */
-        zn = zslFirstInLexRange(zsl, &range);
-
-        /* Use rank of first element, if any, to determine preliminary count */
-        if (zn != NULL) {
-            rank = zslGetRank(zsl, zn->score, zn->ele);
-            count = (zsl->length - (rank - 1));
+        if (zsetIndexFirstInLexRange(zs, &range, &zc)) {
+            /* Use rank of first element, if any, to determine preliminary count */
+            rank = zsetIndexRank(zs, zsetCursorScore(&zc), zsetCursorEle(&zc));
+            count = (length - (rank - 1));
 
             /* Find last element in range */
-            zn = zslLastInLexRange(zsl, &range);
-
-            /* Use rank of last element, if any, to determine the actual count */
-            if (zn != NULL) {
-                rank = zslGetRank(zsl, zn->score, zn->ele);
-                count -= (zsl->length - rank);
+            if (zsetIndexLastInLexRange(zs, &range, &zc)) {
+                /* Use rank of last element, if any, to determine the actual count */
+                rank = zsetIndexRank(zs, zsetCursorScore(&zc), zsetCursorEle(&zc));
+                count -= (length - rank);
             }
         }
     } else {
@@ -3456,12 +3830,11 @@ void genericZrangebylexCommand(zrange_result_handler *handler,
     zlexrangespec *range, robj *zobj, int withscores, long offset, long limit,
     int reverse)
 {
-    client *c = handler->client;
     unsigned long rangelen = 0;
 
     handler->beginResultEmission(handler, -1);
 
-    if (zobj->encoding == OBJ_ENCODING_ZIPLIST) {
+    if (zobj->encoding == OBJ_ENCODING_LISTPACK) {
         unsigned char *zl = zobj->ptr;
         unsigned char *eptr, *sptr;
         unsigned char *vstr;
@@ -3477,7 +3850,7 @@ void genericZrangebylexCommand(zrange_result_handler *handler,
 
         /* Get score pointer for the first element. */
         if (eptr)
-            sptr = ziplistNext(zl,eptr);
+            sptr = lpNext(zl,eptr);
 
         /* If there is an offset, just traverse the number of elements without
          * checking the score because that is done in the next loop. */
@@ -3501,9 +3874,7 @@ void genericZrangebylexCommand(zrange_result_handler *handler,
                 if (!zzlLexValueLteMax(eptr,range)) break;
             }
 
-            /* We know the element exists, so ziplistGet should always
-             * succeed. */
-            serverAssertWithInfo(c,zobj,ziplistGet(eptr,&vstr,&vlen,&vlong));
+            vstr = lpGetValue(eptr,&vlen,&vlong);
 
             rangelen++;
             if (vstr == NULL) {
@@ -3521,42 +3892,43 @@ void genericZrangebylexCommand(zrange_result_handler *handler,
         }
     } else if (zobj->encoding == OBJ_ENCODING_SKIPLIST) {
         zset *zs = zobj->ptr;
-        zskiplist *zsl = zs->zsl;
-        zskiplistNode *ln;
+        zsetCursor zc;
 
         /* If reversed, get the last node in range as starting point. */
         if (reverse) {
-            ln = zslLastInLexRange(zsl,range);
+            zsetIndexLastInLexRange(zs,range,&zc);
         } else {
-            ln = zslFirstInLexRange(zsl,range);
+            zsetIndexFirstInLexRange(zs,range,&zc);
         }
 
         /* If there is an offset, just traverse the number of elements without
          * checking the score because that is done in the next loop. */
-        while (ln && offset--) {
+        while (zsetCursorValid(&zc) && offset--) {
             if (reverse) {
-                ln = ln->backward;
+                zsetCursorPrev(&zc);
             } else {
-                ln = ln->level[0].forward;
+                zsetCursorNext(&zc);
             }
         }
 
-        while (ln && limit--) {
+        while (zsetCursorValid(&zc) && limit--) {
+            sds ele = zsetCursorEle(&zc);
+
             /* Abort when the node is no longer in range. */
             if (reverse) {
-                if (!zslLexValueGteMin(ln->ele,range)) break;
+                if (!zslLexValueGteMin(ele,range)) break;
             } else {
-                if (!zslLexValueLteMax(ln->ele,range)) break;
+                if (!zslLexValueLteMax(ele,range)) break;
             }
 
             rangelen++;
-            handler->emitResultFromCBuffer(handler, ln->ele, sdslen(ln->ele), ln->score);
+            handler->emitResultFromCBuffer(handler, ele, sdslen(ele), zsetCursorScore(&zc));
 
             /* Move to next node */
             if (reverse) {
-                ln = ln->backward;
+                zsetCursorPrev(&zc);
             } else {
-                ln = ln->level[0].forward;
+                zsetCursorNext(&zc);
             }
         }
     } else {
@@ -3875,7 +4247,7 @@ void genericZpopCommand(client *c, robj **keyv, int keyc, int where, int emitkey
 
     /* Remove the element. */
     do {
-        if (zobj->encoding == OBJ_ENCODING_ZIPLIST) {
+        if (zobj->encoding == OBJ_ENCODING_LISTPACK) {
             unsigned char *zl = zobj->ptr;
             unsigned char *eptr, *sptr;
             unsigned char *vstr;
@@ -3883,31 +4255,31 @@ void genericZpopCommand(client *c, robj **keyv, int keyc, int where, int emitkey
             long long vlong;
 
             /* Get the first or last element in the sorted set. */
-            eptr = ziplistIndex(zl,where == ZSET_MAX ? -2 : 0);
+            eptr = lpSeek(zl,where == ZSET_MAX ? -2 : 0);
             serverAssertWithInfo(c,zobj,eptr != NULL);
-            serverAssertWithInfo(c,zobj,ziplistGet(eptr,&vstr,&vlen,&vlong));
+            vstr = lpGetValue(eptr,&vlen,&vlong);
             if (vstr == NULL)
                 ele = sdsfromlonglong(vlong);
             else
                 ele = sdsnewlen(vstr,vlen);
 
             /* Get the score. */
-            sptr = ziplistNext(zl,eptr);
+            sptr = lpNext(zl,eptr);
             serverAssertWithInfo(c,zobj,sptr != NULL);
             score = zzlGetScore(sptr);
         } else if (zobj->encoding == OBJ_ENCODING_SKIPLIST) {
             zset *zs = zobj->ptr;
-            zskiplist *zsl = zs->zsl;
-            zskiplistNode *zln;
+            zsetCursor zc;
+            int found;
 
             /* Get the first or last element in the sorted set. */
-            zln = (where == ZSET_MAX ? zsl->tail :
-                                       zsl->header->level[0].forward);
+            found = (where == ZSET_MAX ? zsetIndexLast(zs,&zc) :
+                                         zsetIndexFirst(zs,&zc));
 
             /* There must be an element in the sorted set. */
-            serverAssertWithInfo(c,zobj,zln != NULL);
-            ele = sdsdup(zln->ele);
-            score = zln->score;
+            serverAssertWithInfo(c,zobj,found);
+            ele = sdsdup(zsetCursorEle(&zc));
+            score = zsetCursorScore(&zc);
         } else {
             serverPanic("Unknown sorted set encoding");
         }
@@ -4009,7 +4381,7 @@ void bzpopmaxCommand(client *c) {
     blockingGenericZpopCommand(c,ZSET_MAX);
 }
 
-static void zarndmemberReplyWithZiplist(client *c, unsigned int count, ziplistEntry *keys, ziplistEntry *vals) {
+static void zarndmemberReplyWithListpack(client *c, unsigned int count, listpackEntry *keys, listpackEntry *vals) {
     for (unsigned long i = 0; i < count; i++) {
         if (vals && c->resp > 2)
             addReplyArrayLen(c,2);
@@ -4077,22 +4449,22 @@ void zrandmemberWithCountCommand(client *c, long l, int withscores) {
                     addReplyArrayLen(c,2);
                 addReplyBulkCBuffer(c, key, sdslen(key));
                 if (withscores)
-                    addReplyDouble(c, *(double*)dictGetVal(de));
+                    addReplyDouble(c, dictGetDoubleVal(de));
                 if (c->flags & CLIENT_CLOSE_ASAP)
                     break;
             }
-        } else if (zsetobj->encoding == OBJ_ENCODING_ZIPLIST) {
-            ziplistEntry *keys, *vals = NULL;
+        } else if (zsetobj->encoding == OBJ_ENCODING_LISTPACK) {
+            listpackEntry *keys, *vals = NULL;
             unsigned long limit, sample_count;
             limit = count > ZRANDMEMBER_RANDOM_SAMPLE_LIMIT ? ZRANDMEMBER_RANDOM_SAMPLE_LIMIT : count;
-            keys = zmalloc(sizeof(ziplistEntry)*limit);
+            keys = zmalloc(sizeof(listpackEntry)*limit);
             if (withscores)
-                vals = zmalloc(sizeof(ziplistEntry)*limit);
+                vals = zmalloc(sizeof(listpackEntry)*limit);
             while (count) {
                 sample_count = count > limit ? limit : count;
                 count -= sample_count;
-                ziplistRandomPairs(zsetobj->ptr, sample_count, keys, vals);
-                zarndmemberReplyWithZiplist(c, sample_count, keys, vals);
+                lpRandomPairs(zsetobj->ptr, sample_count, keys, vals);
+                zarndmemberReplyWithListpack(c, sample_count, keys, vals);
                 if (c->flags & CLIENT_CLOSE_ASAP)
                     break;
             }
@@ -4184,15 +4556,15 @@ void zrandmemberWithCountCommand(client *c, long l, int withscores) {
      * to the temporary set, trying to eventually get enough unique elements
      * to reach the specified count. */
     else {
-        if (zsetobj->encoding == OBJ_ENCODING_ZIPLIST) {
+        if (zsetobj->encoding == OBJ_ENCODING_LISTPACK) {
             /* it is inefficient to repeatedly pick one random element from a
-             * ziplist. so we use this instead: */
-            ziplistEntry *keys, *vals = NULL;
-            keys = zmalloc(sizeof(ziplistEntry)*count);
+             * listpack. so we use this instead: */
+            listpackEntry *keys, *vals = NULL;
+            keys = zmalloc(sizeof(listpackEntry)*count);
             if (withscores)
-                vals = zmalloc(sizeof(ziplistEntry)*count);
-            serverAssert(ziplistRandomPairsUnique(zsetobj->ptr, count, keys, vals) == count);
-            zarndmemberReplyWithZiplist(c, count, keys, vals);
+                vals = zmalloc(sizeof(listpackEntry)*count);
+            serverAssert(lpRandomPairsUnique(zsetobj->ptr, count, keys, vals) == count);
+            zarndmemberReplyWithListpack(c, count, keys, vals);
             zfree(keys);
             zfree(vals);
             return;
@@ -4204,14 +4576,14 @@ void zrandmemberWithCountCommand(client *c, long l, int withscores) {
         dictExpand(d, count);
 
         while (added < count) {
-            ziplistEntry key;
+            listpackEntry key;
             double score;
             zsetTypeRandomElement(zsetobj, size, &key, withscores ? &score: NULL);
 
             /* Try to add the object to the dictionary. If it already exists
             * free it, otherwise increment the number of objects we have
             * in the result dictionary. */
-            sds skey = zsetSdsFromZiplistEntry(&key);
+            sds skey = zsetSdsFromListpackEntry(&key);
             if (dictAdd(d,skey,NULL) != DICT_OK) {
                 sdsfree(skey);
                 continue;
@@ -4220,7 +4592,7 @@ void zrandmemberWithCountCommand(client *c, long l, int withscores) {
 
             if (withscores && c->resp > 2)
                 addReplyArrayLen(c,2);
-            zsetReplyFromZiplistEntry(c, &key);
+            zsetReplyFromListpackEntry(c, &key);
             if (withscores)
                 addReplyDouble(c, score);
         }
@@ -4235,7 +4607,7 @@ void zrandmemberCommand(client *c) {
     long l;
     int withscores = 0;
     robj *zset;
-    ziplistEntry ele;
+    listpackEntry ele;
 
     if (c->argc >= 3) {
         if (getRangeLongFromObjectOrReply(c,c->argv[2],-LONG_MAX,LONG_MAX,&l,NULL) != C_OK) return;
@@ -4260,5 +4632,5 @@ void zrandmemberCommand(client *c) {
     }
 
     zsetTypeRandomElement(zset, zsetLength(zset), &ele,NULL);
-    zsetReplyFromZiplistEntry(c,&ele);
+    zsetReplyFromListpackEntry(c,&ele);
 }
@@ -0,0 +1,1041 @@
+/* zbtree.c - B+tree ordered index for large sorted sets
+ *
+ * See zbtree.h for the layout. A few notes on the implementation:
+ *
+ * - Leaves split in two halves when full, except when adding after the last
+ *   element or before the first one (ordered loads, conversions, RDB files
+ *   that store sorted sets in descending order): then the new element gets
+ *   a leaf of its own, so that bulk built trees have full leaves.
+ * - Deletions merge a leaf that drops below a quarter of its capacity with
+ *   a sibling when the result is at most three quarters full, and free empty
+ *   nodes. Inner nodes are not rebalanced otherwise: they only shrink when
+ *   their children go away, and the root collapses when it has one child.
+ * - Searching a node counts the scores smaller than the one we look for, a
+ *   branch free loop done four doubles at a time with AVX2 where available.
+ *   Only entries with the same score need to compare the elements.
+ *
+ * Copyright (c) 2024, Redis-CXL Project
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "zbtree.h"
+#include "zmalloc.h"
+#include "redisassert.h"
+
+#ifdef HAVE_X86_SIMD_DISPATCH
+#include <immintrin.h>
+#endif
+
+/* ----------------------------- Node search -------------------------------- */
+
+/* Number of the first 'n' sorted scores that are < x, or <= x if 'le'. */
+static int zbtCountScoresGeneric(const double *s, int n, double x, int le) {
+    int c = 0, i;
+
+    if (le) {
+        for (i = 0; i < n; i++) c += s[i] <= x;
+    } else {
+        for (i = 0; i < n; i++) c += s[i] < x;
+    }
+    return c;
+}
+
+#ifdef HAVE_X86_SIMD_DISPATCH
+__attribute__((target("avx2,popcnt")))
+static int zbtCountScoresAVX2(const double *s, int n, double x, int le) {
+    __m256d vx = _mm256_set1_pd(x);
+    int c = 0, i = 0;
+
+    if (le) {
+        for (; i+4 <= n; i += 4)
+            c += __builtin_popcount(_mm256_movemask_pd(
+                 _mm256_cmp_pd(_mm256_loadu_pd(s+i),vx,_CMP_LE_OQ)));
+    } else {
+        for (; i+4 <= n; i += 4)
+            c += __builtin_popcount(_mm256_movemask_pd(
+                 _mm256_cmp_pd(_mm256_loadu_pd(s+i),vx,_CMP_LT_OQ)));
+    }
+    return c + zbtCountScoresGeneric(s+i,n-i,x,le);
+}
+#endif
+
+static int (*zbtCountScores)(const double *s, int n, double x, int le) = NULL;
+
+static void zbtSelectKernels(void) {
+    int (*count)(const double *, int, double, int) = zbtCountScoresGeneric;
+#ifdef HAVE_X86_SIMD_DISPATCH
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt"))
+        count = zbtCountScoresAVX2;
+#endif
+    zbtCountScores = count;
+}
+
+/* Number of entries of the sorted arrays smaller than (score,ele). */
+static int zbtLowerBound(const double *scores, sds *eles, int n,
+                         double score, sds ele)
+{
+    int lo = zbtCountScores(scores,n,score,0);
+    int hi;
+
+    if (lo == n || scores[lo] != score) return lo;
+    /* Binary search among the entries with the same score. */
+    hi = zbtCountScores(scores,n,score,1);
+    while (lo < hi) {
+        int mid = (lo+hi)/2;
+        if (sdscmp(eles[mid],ele) < 0) lo = mid+1; else hi = mid;
+    }
+    return lo;
+}
+
+/* Number of entries of the sorted arrays smaller than or equal to
+ * (score,ele). */
+static int zbtUpperBound(const double *scores, sds *eles, int n,
+                         double score, sds ele)
+{
+    int lo = zbtCountScores(scores,n,score,0);
+    int hi = zbtCountScores(scores,n,score,1);
+
+    while (lo < hi) {
+        int mid = (lo+hi)/2;
+        if (sdscmp(eles[mid],ele) <= 0) lo = mid+1; else hi = mid;
+    }
+    return lo;
+}
+
+/* The child of 'in' that holds (or would hold) (score,ele): the last one
+ * whose smallest entry is not greater than it, or the first one. */
+static int zbtChildFor(zbtInner *in, double score, sds ele) {
+    int i = zbtUpperBound(in->scores,in->eles,in->hdr.count,score,ele)-1;
+    return i < 0 ? 0 : i;
+}
+
+static zbtLeaf *zbtFindLeaf(zbtree *t, double score, sds ele) {
+    zbtNode *n = t->root;
+
+    while (!n->leaf) {
+        zbtInner *in = (zbtInner*)n;
+        n = in->children[zbtChildFor(in,score,ele)];
+    }
+    return (zbtLeaf*)n;
+}
+
+/* ------------------------------- Nodes ------------------------------------ */
+
+static zbtLeaf *zbtLeafCreate(zbtree *t) {
+    zbtLeaf *l = zmalloc(sizeof(*l));
+    l->hdr.parent = NULL;
+    l->hdr.count = 0;
+    l->hdr.leaf = 1;
+    l->prev = l->next = NULL;
+    t->leaves++;
+    return l;
+}
+
+static zbtInner *zbtInnerCreate(zbtree *t) {
+    zbtInner *in = zmalloc(sizeof(*in));
+    in->hdr.parent = NULL;
+    in->hdr.count = 0;
+    in->hdr.leaf = 0;
+    t->inners++;
+    return in;
+}
+
+static void zbtNodeFree(zbtree *t, zbtNode *n) {
+    if (n->leaf) t->leaves--; else t->inners--;
+    zfree(n);
+}
+
+/* Smallest entry of a non empty node. */
+static void zbtNodeMin(zbtNode *n, double *score, sds *ele) {
+    if (n->leaf) {
+        *score = ((zbtLeaf*)n)->scores[0];
+        *ele = ((zbtLeaf*)n)->eles[0];
+    } else {
+        *score = ((zbtInner*)n)->scores[0];
+        *ele = ((zbtInner*)n)->eles[0];
+    }
+}
+
+static unsigned long zbtNodeSize(zbtNode *n) {
+    unsigned long size = 0;
+
+    if (n->leaf) return n->count;
+    for (unsigned int j = 0; j < n->count; j++)
+        size += ((zbtInner*)n)->sizes[j];
+    return size;
+}
+
+static int zbtChildIndex(zbtInner *p, zbtNode *child) {
+    for (unsigned int j = 0; j < p->hdr.count; j++)
+        if (p->children[j] == child) return j;
+    assert(0);
+    return -1;
+}
+
+/* Add 'delta' to the element counts of all the ancestors of 'n'. */
+static void zbtAddSize(zbtNode *n, long delta) {
+    while (n->parent) {
+        zbtInner *p = n->parent;
+        p->sizes[zbtChildIndex(p,n)] += delta;
+        n = &p->hdr;
+    }
+}
+
+/* The smallest entry of 'n' changed: update the separators above it. */
+static void zbtFixMin(zbtNode *n) {
+    while (n->parent && n->count) {
+        zbtInner *p = n->parent;
+        int idx = zbtChildIndex(p,n);
+        double score;
+        sds ele;
+
+        zbtNodeMin(n,&score,&ele);
+        if (p->scores[idx] == score && p->eles[idx] == ele) break;
+        p->scores[idx] = score;
+        p->eles[idx] = ele;
+        if (idx != 0) break;
+        n = &p->hdr;
+    }
+}
+
+/* Set the element counts of the ancestors of 'n' from the actual sizes of
+ * the nodes, after a split: the parent of 'n' gets all of its entries
+ * refreshed since it also holds the new sibling of 'n'. */
+static void zbtRefreshSizes(zbtNode *n) {
+    zbtInner *p = n->parent;
+
+    if (p == NULL) return;
+    for (unsigned int j = 0; j < p->hdr.count; j++)
+        p->sizes[j] = zbtNodeSize(p->children[j]);
+    n = &p->hdr;
+    while (n->parent) {
+        p = n->parent;
+        p->sizes[zbtChildIndex(p,n)] = zbtNodeSize(n);
+        n = &p->hdr;
+    }
+}
+
+static void zbtInsertChildAt(zbtree *t, zbtInner *p, int pos, zbtNode *child);
+
+/* 'right' becomes the right sibling of 'left', that was just split, growing
+ * a new root if needed. The count of 'left' in its parent is updated, the
+ * ones above are left to zbtRefreshSizes(). */
+static void zbtAttachRight(zbtree *t, zbtNode *left, zbtNode *right) {
+    zbtInner *p = left->parent;
+    int idx;
+
+    if (p == NULL) {
+        p = zbtInnerCreate(t);
+        p->hdr.count = 1;
+        p->children[0] = left;
+        zbtNodeMin(left,&p->scores[0],&p->eles[0]);
+        left->parent = p;
+        t->root = &p->hdr;
+        idx = 0;
+    } else {
+        idx = zbtChildIndex(p,left);
+    }
+    p->sizes[idx] = zbtNodeSize(left);
+    zbtInsertChildAt(t,p,idx+1,right);
+}
+
+/* Insert 'child' at position 'pos' of 'p', splitting 'p' if it is full. */
+static void zbtInsertChildAt(zbtree *t, zbtInner *p, int pos, zbtNode *child) {
+    if (p->hdr.count == ZBT_INNER_CAP) {
+        int half = ZBT_INNER_CAP/2, moved = ZBT_INNER_CAP-half;
+        zbtInner *np = zbtInnerCreate(t);
+
+        memcpy(np->scores,p->scores+half,moved*sizeof(double));
+        memcpy(np->eles,p->eles+half,moved*sizeof(sds));
+        memcpy(np->sizes,p->sizes+half,moved*sizeof(unsigned long));
+        memcpy(np->children,p->children+half,moved*sizeof(zbtNode*));
+        for (int j = 0; j < moved; j++) np->children[j]->parent = np;
+        np->hdr.count = moved;
+        p->hdr.count = half;
+        zbtAttachRight(t,&p->hdr,&np->hdr);
+        if (pos > half) {
+            p = np;
+            pos -= half;
+        }
+    }
+
+    int tail = p->hdr.count-pos;
+    memmove(p->scores+pos+1,p->scores+pos,tail*sizeof(double));
+    memmove(p->eles+pos+1,p->eles+pos,tail*sizeof(sds));
+    memmove(p->sizes+pos+1,p->sizes+pos,tail*sizeof(unsigned long));
+    memmove(p->children+pos+1,p->children+pos,tail*sizeof(zbtNode*));
+    zbtNodeMin(child,&p->scores[pos],&p->eles[pos]);
+    p->sizes[pos] = zbtNodeSize(child);
+    p->children[pos] = child;
+    child->parent = p;
+    p->hdr.count++;
+    if (pos == 0) zbtFixMin(&p->hdr);
+}
+
+/* While the root is an inner node with a single child, drop a level. */
+static void zbtCollapseRoot(zbtree *t) {
+    while (!t->root->leaf && t->root->count == 1) {
+        zbtNode *old = t->root;
+        t->root = ((zbtInner*)old)->children[0];
+        t->root->parent = NULL;
+        zbtNodeFree(t,old);
+    }
+}
+
+/* Remove the child at 'idx' of 'p' (the caller frees it), removing 'p' as
+ * well if it gets empty. */
+static void zbtRemoveChild(zbtree *t, zbtInner *p, int idx) {
+    int tail = p->hdr.count-idx-1;
+
+    memmove(p->scores+idx,p->scores+idx+1,tail*sizeof(double));
+    memmove(p->eles+idx,p->eles+idx+1,tail*sizeof(sds));
+    memmove(p->sizes+idx,p->sizes+idx+1,tail*sizeof(unsigned long));
+    memmove(p->children+idx,p->children+idx+1,tail*sizeof(zbtNode*));
+    p->hdr.count--;
+    if (p->hdr.count == 0) {
+        zbtInner *gp = p->hdr.parent;
+        assert(gp != NULL);
+        int gidx = zbtChildIndex(gp,&p->hdr);
+        zbtNodeFree(t,&p->hdr);
+        zbtRemoveChild(t,gp,gidx);
+        return;
+    }
+    if (idx == 0) zbtFixMin(&p->hdr);
+    zbtCollapseRoot(t);
+}
+
+static void zbtUnlinkLeaf(zbtree *t, zbtLeaf *l) {
+    if (l->prev) l->prev->next = l->next; else t->head = l->next;
+    if (l->next) l->next->prev = l->prev; else t->tail = l->prev;
+}
+
+/* Move all the entries of 'src' at the end of 'dst'. */
+static void zbtLeafAppend(zbtLeaf *dst, zbtLeaf *src) {
+    memcpy(dst->scores+dst->hdr.count,src->scores,src->hdr.count*sizeof(double));
+    memcpy(dst->eles+dst->hdr.count,src->eles,src->hdr.count*sizeof(sds));
+    dst->hdr.count += src->hdr.count;
+}
+
+/* Merge a leaf that got too small with one of its siblings. */
+static void zbtMaybeMerge(zbtree *t, zbtLeaf *l) {
+    zbtInner *p = l->hdr.parent;
+    int idx;
+
+    if (p == NULL || l->hdr.count >= ZBT_LEAF_CAP/4) return;
+    idx = zbtChildIndex(p,&l->hdr);
+    if (idx > 0) {
+        zbtLeaf *left = (zbtLeaf*)p->children[idx-1];
+        if (left->hdr.count+l->hdr.count <= ZBT_LEAF_CAP*3/4) {
+            p->sizes[idx-1] += l->hdr.count;
+            zbtLeafAppend(left,l);
+            zbtUnlinkLeaf(t,l);
+            zbtRemoveChild(t,p,idx);
+            zbtNodeFree(t,&l->hdr);
+            return;
+        }
+    }
+    if (idx+1 < (int)p->hdr.count) {
+        zbtLeaf *right = (zbtLeaf*)p->children[idx+1];
+        if (right->hdr.count+l->hdr.count <= ZBT_LEAF_CAP*3/4) {
+            p->sizes[idx] += right->hdr.count;
+            zbtLeafAppend(l,right);
+            zbtUnlinkLeaf(t,right);
+            zbtRemoveChild(t,p,idx+1);
+            zbtNodeFree(t,&right->hdr);
+        }
+    }
+}
+
+/* ------------------------------- API -------------------------------------- */
+
+zbtree *zbtCreate(void) {
+    zbtree *t = zmalloc(sizeof(*t));
+
+    if (zbtCountScores == NULL) zbtSelectKernels();
+    t->leaves = t->inners = 0;
+    t->length = 0;
+    t->head = t->tail = zbtLeafCreate(t);
+    t->root = &t->head->hdr;
+    return t;
+}
+
+static void zbtFreeNode(zbtree *t, zbtNode *n) {
+    if (n->leaf) {
+        zbtLeaf *l = (zbtLeaf*)n;
+        for (unsigned int j = 0; j < l->hdr.count; j++) sdsfree(l->eles[j]);
+    } else {
+        zbtInner *in = (zbtInner*)n;
+        for (unsigned int j = 0; j < in->hdr.count; j++)
+            zbtFreeNode(t,in->children[j]);
+    }
+    zbtNodeFree(t,n);
+}
+
+/* Free the tree and all its elements. */
+void zbtFree(zbtree *t) {
+    zbtFreeNode(t,t->root);
+    zfree(t);
+}
+
+/* Insert a new element (not already in the tree). The tree takes ownership
+ * of the 'ele' SDS string. */
+void zbtInsert(zbtree *t, double score, sds ele) {
+    zbtLeaf *l = zbtFindLeaf(t,score,ele);
+    int pos = zbtLowerBound(l->scores,l->eles,l->hdr.count,score,ele);
+    int split = 0;
+
+    t->length++;
+    if (l->hdr.count == ZBT_LEAF_CAP) {
+        if (pos == ZBT_LEAF_CAP && l->next == NULL) {
+            /* Appending after the last element: new leaf. */
+            zbtLeaf *nl = zbtLeafCreate(t);
+            nl->scores[0] = score;
+            nl->eles[0] = ele;
+            nl->hdr.count = 1;
+            nl->prev = l;
+            l->next = nl;
+            t->tail = nl;
+            zbtAttachRight(t,&l->hdr,&nl->hdr);
+            zbtRefreshSizes(&nl->hdr);
+            return;
+        }
+
+        /* Split in halves, or move everything to the new leaf when
+         * inserting before the first element (descending loads). */
+        int half = (pos == 0 && l->prev == NULL) ? 0 : ZBT_LEAF_CAP/2;
+        int moved = ZBT_LEAF_CAP-half;
+        zbtLeaf *nl = zbtLeafCreate(t);
+        memcpy(nl->scores,l->scores+half,moved*sizeof(double));
+        memcpy(nl->eles,l->eles+half,moved*sizeof(sds));
+        nl->hdr.count = moved;
+        l->hdr.count = half;
+        nl->prev = l;
+        nl->next = l->next;
+        if (l->next) l->next->prev = nl; else t->tail = nl;
+        l->next = nl;
+        zbtAttachRight(t,&l->hdr,&nl->hdr);
+        if (pos > half) {
+            l = nl;
+            pos -= half;
+        }
+        split = 1;
+    }
+
+    int tail = l->hdr.count-pos;
+    memmove(l->scores+pos+1,l->scores+pos,tail*sizeof(double));
+    memmove(l->eles+pos+1,l->eles+pos,tail*sizeof(sds));
+    l->scores[pos] = score;
+    l->eles[pos] = ele;
+    l->hdr.count++;
+    if (split) zbtRefreshSizes(&l->hdr);
+    else zbtAddSize(&l->hdr,1);
+    if (pos == 0) zbtFixMin(&l->hdr);
+}
+
+/* Delete the element, freeing its SDS string if 'freeele' is true.
+ * Returns 1 if the element was found, 0 otherwise. */
+int zbtDelete(zbtree *t, double score, sds ele, int freeele) {
+    zbtCursor c;
+    zbtLeaf *l;
+    sds old;
+
+    if (!zbtFind(t,score,ele,&c)) return 0;
+    l = c.leaf;
+    old = l->eles[c.pos];
+    int tail = l->hdr.count-c.pos-1;
+    memmove(l->scores+c.pos,l->scores+c.pos+1,tail*sizeof(double));
+    memmove(l->eles+c.pos,l->eles+c.pos+1,tail*sizeof(sds));
+    l->hdr.count--;
+    t->length--;
+    zbtAddSize(&l->hdr,-1);
+
+    /* Update or drop the separators pointing to the old element before
+     * freeing it. */
+    if (l->hdr.count == 0) {
+        if (l->hdr.parent) {
+            zbtUnlinkLeaf(t,l);
+            zbtRemoveChild(t,l->hdr.parent,zbtChildIndex(l->hdr.parent,&l->hdr));
+            zbtNodeFree(t,&l->hdr);
+        }
+    } else {
+        if (c.pos == 0) zbtFixMin(&l->hdr);
+        zbtMaybeMerge(t,l);
+    }
+    if (freeele) sdsfree(old);
+    return 1;
+}
+
+/* Delete the elements from the one at 'c' on, for as long as 'inrange'
+ * returns true, freeing their SDS strings if 'freeele' is true. 'inrange'
+ * is called once per element, in order, before the element is removed.
+ * Returns the number of elements deleted, 'c' is left invalid.
+ *
+ * The range is removed a leaf at a time: the leaves in the middle are
+ * emptied and dropped whole, and only the first and the last one, that
+ * keep some entries, may be merged with a sibling at the end. */
+unsigned long zbtDeleteRange(zbtree *t, zbtCursor *c, zbtPredicate *inrange,
+                             void *privdata, int freeele)
+{
+    zbtLeaf *l = c->leaf, *first = NULL, *last = NULL;
+    int pos = c->pos, done = 0;
+    unsigned long removed = 0;
+    sds old[ZBT_LEAF_CAP];
+
+    while (l && !done) {
+        zbtLeaf *next = l->next;
+        int end = pos, count = l->hdr.count;
+
+        while (end < count && inrange(l->scores[end],l->eles[end],privdata))
+            end++;
+        done = end < count;
+        int n = end-pos;
+        if (n == 0) break;
+
+        memcpy(old,l->eles+pos,n*sizeof(sds));
+        memmove(l->scores+pos,l->scores+end,(count-end)*sizeof(double));
+        memmove(l->eles+pos,l->eles+end,(count-end)*sizeof(sds));
+        l->hdr.count -= n;
+        t->length -= n;
+        removed += n;
+        zbtAddSize(&l->hdr,-n);
+
+        /* Update or drop the separators pointing to the old elements
+         * before freeing them. */
+        if (l->hdr.count == 0) {
+            if (l->hdr.parent) {
+                zbtUnlinkLeaf(t,l);
+                zbtRemoveChild(t,l->hdr.parent,zbtChildIndex(l->hdr.parent,&l->hdr));
+                zbtNodeFree(t,&l->hdr);
+            }
+        } else {
+            if (pos == 0) zbtFixMin(&l->hdr);
+            if (first == NULL) first = l; else last = l;
+        }
+        if (freeele) for (int j = 0; j < n; j++) sdsfree(old[j]);
+        l = next;
+        pos = 0;
+    }
+
+    /* Merging 'last' never frees 'first', that is on its left. */
+    if (last) zbtMaybeMerge(t,last);
+    if (first) zbtMaybeMerge(t,first);
+    c->leaf = NULL;
+    return removed;
+}
+
+/* Change the score of an existing element. */
+void zbtUpdateScore(zbtree *t, double curscore, sds ele, double newscore) {
+    zbtCursor c, prev, next;
+    int ok;
+
+    ok = zbtFind(t,curscore,ele,&c);
+    assert(ok);
+
+    /* Update in place if the element keeps its position. */
+    prev = next = c;
+    sds e = zbtCursorEle(&c);
+    if ((!zbtPrev(&prev) ||
+         zbtCursorScore(&prev) < newscore ||
+         (zbtCursorScore(&prev) == newscore && sdscmp(zbtCursorEle(&prev),e) < 0)) &&
+        (!zbtNext(&next) ||
+         zbtCursorScore(&next) > newscore ||
+         (zbtCursorScore(&next) == newscore && sdscmp(zbtCursorEle(&next),e) > 0)))
+    {
+        c.leaf->scores[c.pos] = newscore;
+        if (c.pos == 0) zbtFixMin(&c.leaf->hdr);
+        return;
+    }
+
+    zbtDelete(t,curscore,ele,0);
+    zbtInsert(t,newscore,e);
+}
+
+/* Point 'c' at the element, returning 1 if it exists, 0 otherwise. */
+int zbtFind(zbtree *t, double score, sds ele, zbtCursor *c) {
+    zbtLeaf *l = zbtFindLeaf(t,score,ele);
+    int pos = zbtLowerBound(l->scores,l->eles,l->hdr.count,score,ele);
+
+    if (pos < (int)l->hdr.count && l->scores[pos] == score &&
+        sdscmp(l->eles[pos],ele) == 0)
+    {
+        c->leaf = l;
+        c->pos = pos;
+        return 1;
+    }
+    return 0;
+}
+
+/* 1-based rank of the element, 0 if it is not in the tree. */
+unsigned long zbtGetRank(zbtree *t, double score, sds ele) {
+    zbtCursor c;
+    unsigned long rank;
+    zbtNode *n;
+
+    if (!zbtFind(t,score,ele,&c)) return 0;
+    rank = c.pos+1;
+    n = &c.leaf->hdr;
+    while (n->parent) {
+        zbtInner *p = n->parent;
+        int idx = zbtChildIndex(p,n);
+        for (int j = 0; j < idx; j++) rank += p->sizes[j];
+        n = &p->hdr;
+    }
+    return rank;
+}
+
+/* Point 'c' at the element with the given 1-based rank. */
+int zbtGetElementByRank(zbtree *t, unsigned long rank, zbtCursor *c) {
+    zbtNode *n = t->root;
+
+    if (rank == 0 || rank > t->length) return 0;
+    while (!n->leaf) {
+        zbtInner *in = (zbtInner*)n;
+        unsigned int j;
+        for (j = 0; j < in->hdr.count-1; j++) {
+            if (rank <= in->sizes[j]) break;
+            rank -= in->sizes[j];
+        }
+        n = in->children[j];
+    }
+    assert(rank <= n->count);
+    c->leaf = (zbtLeaf*)n;
+    c->pos = rank-1;
+    return 1;
+}
+
+int zbtFirst(zbtree *t, zbtCursor *c) {
+    if (t->length == 0) return 0;
+    c->leaf = t->head;
+    c->pos = 0;
+    return 1;
+}
+
+int zbtLast(zbtree *t, zbtCursor *c) {
+    if (t->length == 0) return 0;
+    c->leaf = t->tail;
+    c->pos = t->tail->hdr.count-1;
+    return 1;
+}
+
+/* Point 'c' at the first element with a score >= 'score' (> if 'ex'). */
+int zbtSeekScoreGte(zbtree *t, double score, int ex, zbtCursor *c) {
+    zbtNode *n = t->root;
+    zbtLeaf *l;
+    int pos;
+
+    while (!n->leaf) {
+        zbtInner *in = (zbtInner*)n;
+        int i = zbtCountScores(in->scores,in->hdr.count,score,ex)-1;
+        n = in->children[i < 0 ? 0 : i];
+    }
+    l = (zbtLeaf*)n;
+    pos = zbtCountScores(l->scores,l->hdr.count,score,ex);
+    if (pos == (int)l->hdr.count) {
+        l = l->next;
+        pos = 0;
+        if (l == NULL) return 0;
+    }
+    c->leaf = l;
+    c->pos = pos;
+    return 1;
+}
+
+/* Point 'c' at the last element with a score <= 'score' (< if 'ex'). */
+int zbtSeekScoreLte(zbtree *t, double score, int ex, zbtCursor *c) {
+    zbtNode *n = t->root;
+    zbtLeaf *l;
+    int pos;
+
+    while (!n->leaf) {
+        zbtInner *in = (zbtInner*)n;
+        int i = zbtCountScores(in->scores,in->hdr.count,score,!ex)-1;
+        n = in->children[i < 0 ? 0 : i];
+    }
+    l = (zbtLeaf*)n;
+    pos = zbtCountScores(l->scores,l->hdr.count,score,!ex)-1;
+    if (pos < 0) {
+        l = l->prev;
+        if (l == NULL) return 0;
+        pos = l->hdr.count-1;
+    }
+    c->leaf = l;
+    c->pos = pos;
+    return 1;
+}
+
+/* Number of leading entries for which pred() is equal to 'value', given
+ * that pred() changes value at most once along the array. */
+static int zbtPartition(const double *scores, sds *eles, int n,
+                        zbtPredicate *pred, void *privdata, int value)
+{
+    int lo = 0, hi = n;
+
+    while (lo < hi) {
+        int mid = (lo+hi)/2;
+        if (!!pred(scores[mid],eles[mid],privdata) == value) lo = mid+1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+/* Point 'c' at the first element for which pred() is true, pred() being
+ * false up to some element and true from it on. */
+int zbtSeekFirst(zbtree *t, zbtPredicate *pred, void *privdata, zbtCursor *c) {
+    zbtNode *n = t->root;
+    zbtLeaf *l;
+    int pos;
+
+    while (!n->leaf) {
+        zbtInner *in = (zbtInner*)n;
+        int i = zbtPartition(in->scores,in->eles,in->hdr.count,pred,privdata,0)-1;
+        n = in->children[i < 0 ? 0 : i];
+    }
+    l = (zbtLeaf*)n;
+    pos = zbtPartition(l->scores,l->eles,l->hdr.count,pred,privdata,0);
+    if (pos == (int)l->hdr.count) {
+        l = l->next;
+        pos = 0;
+        if (l == NULL) return 0;
+    }
+    c->leaf = l;
+    c->pos = pos;
+    return 1;
+}
+
+/* Point 'c' at the last element for which pred() is true, pred() being
+ * true up to some element and false from it on. */
+int zbtSeekLast(zbtree *t, zbtPredicate *pred, void *privdata, zbtCursor *c) {
+    zbtNode *n = t->root;
+    zbtLeaf *l;
+    int pos;
+
+    while (!n->leaf) {
+        zbtInner *in = (zbtInner*)n;
+        int i = zbtPartition(in->scores,in->eles,in->hdr.count,pred,privdata,1)-1;
+        n = in->children[i < 0 ? 0 : i];
+    }
+    l = (zbtLeaf*)n;
+    pos = zbtPartition(l->scores,l->eles,l->hdr.count,pred,privdata,1)-1;
+    if (pos < 0) {
+        l = l->prev;
+        if (l == NULL) return 0;
+        pos = l->hdr.count-1;
+    }
+    c->leaf = l;
+    c->pos = pos;
+    return 1;
+}
+
+/* Replace the SDS string of an element with an identical copy (defrag).
+ * 'oldele' may be already freed: it is only compared by address, and the
+ * separators pointing to it (all in the nodes on the way to its leaf) are
+ * replaced before searching each node. */
+void zbtReplaceEle(zbtree *t, double score, sds oldele, sds newele) {
+    zbtNode *n = t->root;
+    zbtLeaf *l;
+    unsigned int j;
+
+    while (!n->leaf) {
+        zbtInner *in = (zbtInner*)n;
+        for (j = 0; j < in->hdr.count; j++)
+            if (in->eles[j] == oldele) in->eles[j] = newele;
+        n = in->children[zbtChildFor(in,score,newele)];
+    }
+    l = (zbtLeaf*)n;
+    for (j = 0; j < l->hdr.count; j++) {
+        if (l->eles[j] == oldele) {
+            l->eles[j] = newele;
+            return;
+        }
+    }
+    assert(0);
+}
+
+static zbtNode *zbtDefragNode(zbtree *t, zbtNode *n,
+                              void *(*defragalloc)(void *ptr), long *moved)
+{
+    zbtNode *newn;
+
+    if (!n->leaf) {
+        zbtInner *in = (zbtInner*)n;
+        for (unsigned int j = 0; j < in->hdr.count; j++)
+            in->children[j] = zbtDefragNode(t,in->children[j],defragalloc,moved);
+    }
+    if ((newn = defragalloc(n)) == NULL) return n;
+    (*moved)++;
+    if (newn->leaf) {
+        zbtLeaf *l = (zbtLeaf*)newn;
+        if (l->prev) l->prev->next = l; else t->head = l;
+        if (l->next) l->next->prev = l; else t->tail = l;
+    } else {
+        zbtInner *in = (zbtInner*)newn;
+        for (unsigned int j = 0; j < in->hdr.count; j++)
+            in->children[j]->parent = in;
+    }
+    return newn;
+}
+
+/* Reallocate the nodes with 'defragalloc', that returns the new pointer
+ * or NULL if the allocation was not moved. Returns the nodes moved. */
+long zbtDefragNodes(zbtree *t, void *(*defragalloc)(void *ptr)) {
+    long moved = 0;
+    t->root = zbtDefragNode(t,t->root,defragalloc,&moved);
+    return moved;
+}
+
+/* Bytes used by the nodes (not by the elements). */
+size_t zbtAllocSize(const zbtree *t) {
+    return sizeof(*t) + t->leaves*sizeof(zbtLeaf) + t->inners*sizeof(zbtInner);
+}
+
+/* ------------------------------- Test ------------------------------------- */
+
+#ifdef REDIS_TEST
+#include <stdio.h>
+#include <math.h>
+
+#define UNUSED(x) (void)(x)
+
+/* Check all the invariants, returning the elements below 'n'. */
+static unsigned long zbtVerifyNode(zbtree *t, zbtNode *n, int depth,
+                                   int *leafdepth)
+{
+    if (n->leaf) {
+        zbtLeaf *l = (zbtLeaf*)n;
+        if (*leafdepth == -1) *leafdepth = depth;
+        assert(*leafdepth == depth);
+        assert(l->hdr.count > 0 || t->root == n);
+        for (unsigned int j = 1; j < l->hdr.count; j++) {
+            assert(l->scores[j-1] < l->scores[j] ||
+                   (l->scores[j-1] == l->scores[j] &&
+                    sdscmp(l->eles[j-1],l->eles[j]) < 0));
+        }
+        return l->hdr.count;
+    }
+
+    zbtInner *in = (zbtInner*)n;
+    unsigned long size = 0;
+    assert(in->hdr.count > 0);
+    for (unsigned int j = 0; j < in->hdr.count; j++) {
+        zbtNode *child = in->children[j];
+        double score;
+        sds ele;
+
+        assert(child->parent == in);
+        zbtNodeMin(child,&score,&ele);
+        assert(in->scores[j] == score && in->eles[j] == ele);
+        assert(zbtVerifyNode(t,child,depth+1,leafdepth) == in->sizes[j]);
+        size += in->sizes[j];
+    }
+    return size;
+}
+
+static void zbtVerify(zbtree *t) {
+    int leafdepth = -1;
+    unsigned long count = 0;
+
+    assert(t->root->parent == NULL);
+    assert(zbtVerifyNode(t,t->root,0,&leafdepth) == t->length);
+    for (zbtLeaf *l = t->head; l; l = l->next) {
+        assert(l->next || l == t->tail);
+        assert(!l->next || l->next->prev == l);
+        count += l->hdr.count;
+    }
+    assert(count == t->length);
+}
+
+static int zbtTestCompare(const void *a, const void *b) {
+    const long *x = a, *y = b;
+    return (*x > *y) - (*x < *y);
+}
+
+static int zbtTestGte(double score, sds ele, void *privdata) {
+    UNUSED(score);
+    return sdscmp(ele,privdata) >= 0;
+}
+
+static int zbtTestLt(double score, sds ele, void *privdata) {
+    UNUSED(score);
+    return sdscmp(ele,privdata) < 0;
+}
+
+/* Range deletion callback: deletes the number of elements in privdata. */
+static int zbtTestCountdown(double score, sds ele, void *privdata) {
+    long *left = privdata;
+    UNUSED(score);
+    UNUSED(ele);
+    if (*left == 0) return 0;
+    (*left)--;
+    return 1;
+}
+
+/* ./redis-server test zbtree [--accurate] */
+int zbtreeTest(int argc, char *argv[], int accurate) {
+    long n = accurate ? 200000 : 20000, j;
+    long *scores = zmalloc(sizeof(long)*n);
+    char buf[32];
+    zbtree *t = zbtCreate();
+    zbtCursor c;
+    UNUSED(argc);
+    UNUSED(argv);
+
+    /* Elements share scores in groups of four, so the element order is
+     * exercised as well. "e<j>" sorts like j when padded. */
+    printf("zbtree: random inserts of %ld elements\n", n);
+    for (j = 0; j < n; j++) scores[j] = j;
+    for (j = n-1; j > 0; j--) {
+        long k = rand() % (j+1), tmp = scores[j];
+        scores[j] = scores[k];
+        scores[k] = tmp;
+    }
+    for (j = 0; j < n; j++) {
+        snprintf(buf,sizeof(buf),"e%010ld",scores[j]);
+        zbtInsert(t,scores[j]/4,sdsnew(buf));
+        if (j % 4999 == 0) zbtVerify(t);
+    }
+    zbtVerify(t);
+    assert(t->length == (unsigned long)n);
+
+    printf("zbtree: order, rank and rank lookup\n");
+    qsort(scores,n,sizeof(long),zbtTestCompare);
+    assert(zbtFirst(t,&c));
+    for (j = 0; j < n; j++) {
+        snprintf(buf,sizeof(buf),"e%010ld",j);
+        assert(zbtCursorScore(&c) == j/4);
+        assert(!strcmp(zbtCursorEle(&c),buf));
+        if (j % 97 == 0) {
+            sds ele = sdsnew(buf);
+            zbtCursor r;
+            assert(zbtGetRank(t,j/4,ele) == (unsigned long)j+1);
+            assert(zbtGetElementByRank(t,j+1,&r));
+            assert(r.leaf == c.leaf && r.pos == c.pos);
+            sdsfree(ele);
+        }
+        assert(zbtNext(&c) == (j != n-1));
+    }
+
+    printf("zbtree: score range seeks\n");
+    for (j = 0; j < 1000; j++) {
+        double s = (rand() % (n/4+2)) - 1 + (rand() % 2 ? 0.5 : 0);
+        /* Elements before the first score >= s, and before the first
+         * score > s. */
+        long first = (long)ceil(s)*4, gt = ((long)floor(s)+1)*4;
+        if (first < 0) first = 0;
+        if (first > n) first = n;
+        if (gt < 0) gt = 0;
+        if (gt > n) gt = n;
+        int ok = zbtSeekScoreGte(t,s,0,&c);
+        assert(ok == (first < n));
+        if (ok) assert(zbtGetRank(t,zbtCursorScore(&c),zbtCursorEle(&c)) == (unsigned long)first+1);
+        ok = zbtSeekScoreGte(t,s,1,&c);
+        assert(ok == (gt < n));
+        if (ok) assert(zbtGetRank(t,zbtCursorScore(&c),zbtCursorEle(&c)) == (unsigned long)gt+1);
+        ok = zbtSeekScoreLte(t,s,0,&c);
+        assert(ok == (gt > 0));
+        if (ok) assert(zbtGetRank(t,zbtCursorScore(&c),zbtCursorEle(&c)) == (unsigned long)gt);
+        ok = zbtSeekScoreLte(t,s,1,&c);
+        assert(ok == (first > 0));
+        if (ok) assert(zbtGetRank(t,zbtCursorScore(&c),zbtCursorEle(&c)) == (unsigned long)first);
+    }
+
+    printf("zbtree: score updates\n");
+    for (j = 0; j < n; j += 3) {
+        snprintf(buf,sizeof(buf),"e%010ld",j);
+        sds ele = sdsnew(buf);
+        zbtUpdateScore(t,j/4,ele,(j % 2) ? j/4 : -j);
+        zbtUpdateScore(t,(j % 2) ? j/4 : -j,ele,j/4);
+        sdsfree(ele);
+        if (j % 3001 == 0) zbtVerify(t);
+    }
+    zbtVerify(t);
+
+    printf("zbtree: random deletes\n");
+    for (j = 0; j < n; j++) scores[j] = j;
+    for (j = n-1; j > 0; j--) {
+        long k = rand() % (j+1), tmp = scores[j];
+        scores[j] = scores[k];
+        scores[k] = tmp;
+    }
+    for (j = 0; j < n; j++) {
+        snprintf(buf,sizeof(buf),"e%010ld",scores[j]);
+        sds ele = sdsnew(buf);
+        assert(zbtDelete(t,scores[j]/4,ele,1));
+        assert(!zbtDelete(t,scores[j]/4,ele,1));
+        sdsfree(ele);
+        if (j % 4999 == 0) zbtVerify(t);
+    }
+    zbtVerify(t);
+    assert(t->length == 0 && t->leaves == 1 && t->inners == 0);
+    zbtFree(t);
+
+    /* Ordered loads must produce full leaves. */
+    printf("zbtree: ascending and descending loads\n");
+    for (int desc = 0; desc <= 1; desc++) {
+        t = zbtCreate();
+        for (j = 0; j < n; j++) {
+            long k = desc ? n-1-j : j;
+            snprintf(buf,sizeof(buf),"e%010ld",k);
+            zbtInsert(t,0,sdsnew(buf));
+        }
+        zbtVerify(t);
+        assert(t->leaves == (unsigned long)(n+ZBT_LEAF_CAP-1)/ZBT_LEAF_CAP);
+
+        /* All the scores are the same: predicate seeks by element. */
+        for (j = 0; j < 100; j++) {
+            long k = rand() % n;
+            snprintf(buf,sizeof(buf),"e%010ld",k);
+            sds ele = sdsnew(buf);
+            assert(zbtSeekFirst(t,zbtTestGte,ele,&c));
+            assert(!strcmp(zbtCursorEle(&c),ele));
+            assert(zbtSeekLast(t,zbtTestLt,ele,&c) == (k > 0));
+            if (k > 0) assert(zbtGetRank(t,0,zbtCursorEle(&c)) == (unsigned long)k);
+            sdsfree(ele);
+        }
+        zbtFree(t);
+    }
+
+    /* Range deletions of every size, from inside a leaf to most of the
+     * tree, checked against the ranks of the elements left around them. */
+    printf("zbtree: range deletes\n");
+    t = zbtCreate();
+    for (j = 0; j < n; j++) {
+        snprintf(buf,sizeof(buf),"e%010ld",j);
+        zbtInsert(t,j/4,sdsnew(buf));
+    }
+    while (t->length) {
+        unsigned long len = t->length;
+        unsigned long rank = 1 + rand() % len;
+        long count = 1 + rand() % (rand() % 4 ? 200 : len), left = count;
+        sds before = NULL, after = NULL;
+        double after_score = 0;
+
+        if ((unsigned long)count > len-rank+1) count = left = len-rank+1;
+        if (rank > 1) {
+            assert(zbtGetElementByRank(t,rank-1,&c));
+            before = zbtCursorEle(&c);
+        }
+        if (rank+count <= len) {
+            assert(zbtGetElementByRank(t,rank+count,&c));
+            after = zbtCursorEle(&c);
+            after_score = zbtCursorScore(&c);
+        }
+        assert(zbtGetElementByRank(t,rank,&c));
+        assert(zbtDeleteRange(t,&c,zbtTestCountdown,&left,1) == (unsigned long)count);
+        assert(left == 0 && t->length == len-count);
+        if (after) assert(zbtGetRank(t,after_score,after) == rank);
+        if (before) {
+            assert(zbtGetElementByRank(t,rank-1,&c));
+            assert(zbtCursorEle(&c) == before);
+        }
+        zbtVerify(t);
+    }
+    assert(t->leaves == 1 && t->inners == 0);
+    zbtFree(t);
+
+    zfree(scores);
+    printf("zbtree: all tests passed\n");
+    return 0;
+}
+#endif
@@ -0,0 +1,115 @@
+/* zbtree.h - B+tree ordered index for large sorted sets
+ *
+ * An alternative to the skiplist for sorted sets with many elements. The
+ * elements are kept in leaf blocks of up to ZBT_LEAF_CAP entries, scores
+ * and element pointers in two separate arrays so that a leaf (and the
+ * separators of an inner node) can be searched by comparing contiguous
+ * doubles. Inner nodes keep, for every child, its smallest entry and the
+ * number of elements below it, so rank lookups descend the tree summing
+ * counts instead of walking spans.
+ *
+ * Elements are ordered by score, then lexicographically, exactly like the
+ * skiplist. The tree owns the element SDS strings: they are shared with the
+ * dict of the sorted set, as with the skiplist. Separators point to the
+ * SDS of the smallest element of each child, and are kept in sync every
+ * time the first entry of a node changes.
+ *
+ * Copyright (c) 2024, Redis-CXL Project
+ */
+
+#ifndef __ZBTREE_H
+#define __ZBTREE_H
+
+#include <stddef.h>
+#include "sds.h"
+
+#define ZBT_LEAF_CAP 64
+#define ZBT_INNER_CAP 64
+#define ZBT_MAX_HEIGHT 32
+
+typedef struct zbtNode {
+    struct zbtInner *parent;
+    unsigned int count;         /* Entries (leaf) or children (inner). */
+    unsigned int leaf;          /* 1 for leaves, 0 for inner nodes. */
+} zbtNode;
+
+typedef struct zbtLeaf {
+    zbtNode hdr;
+    struct zbtLeaf *prev, *next;
+    double scores[ZBT_LEAF_CAP];
+    sds eles[ZBT_LEAF_CAP];
+} zbtLeaf;
+
+typedef struct zbtInner {
+    zbtNode hdr;
+    double scores[ZBT_INNER_CAP];       /* Smallest score of every child. */
+    sds eles[ZBT_INNER_CAP];            /* Smallest element of every child. */
+    unsigned long sizes[ZBT_INNER_CAP]; /* Elements below every child. */
+    zbtNode *children[ZBT_INNER_CAP];
+} zbtInner;
+
+typedef struct zbtree {
+    zbtNode *root;              /* Always at least an (empty) leaf. */
+    zbtLeaf *head, *tail;
+    unsigned long length;
+    unsigned long leaves, inners;
+} zbtree;
+
+/* Position of an element: leaf and index inside it. */
+typedef struct zbtCursor {
+    zbtLeaf *leaf;
+    int pos;
+} zbtCursor;
+
+/* Monotone predicate for zbtSeekFirst() / zbtSeekLast(). */
+typedef int zbtPredicate(double score, sds ele, void *privdata);
+
+zbtree *zbtCreate(void);
+void zbtFree(zbtree *t);
+void zbtInsert(zbtree *t, double score, sds ele);
+int zbtDelete(zbtree *t, double score, sds ele, int freeele);
+unsigned long zbtDeleteRange(zbtree *t, zbtCursor *c, zbtPredicate *inrange,
+                             void *privdata, int freeele);
+void zbtUpdateScore(zbtree *t, double curscore, sds ele, double newscore);
+int zbtFind(zbtree *t, double score, sds ele, zbtCursor *c);
+unsigned long zbtGetRank(zbtree *t, double score, sds ele);
+int zbtGetElementByRank(zbtree *t, unsigned long rank, zbtCursor *c);
+int zbtFirst(zbtree *t, zbtCursor *c);
+int zbtLast(zbtree *t, zbtCursor *c);
+int zbtSeekScoreGte(zbtree *t, double score, int ex, zbtCursor *c);
+int zbtSeekScoreLte(zbtree *t, double score, int ex, zbtCursor *c);
+int zbtSeekFirst(zbtree *t, zbtPredicate *pred, void *privdata, zbtCursor *c);
+int zbtSeekLast(zbtree *t, zbtPredicate *pred, void *privdata, zbtCursor *c);
+void zbtReplaceEle(zbtree *t, double score, sds oldele, sds newele);
+long zbtDefragNodes(zbtree *t, void *(*defragalloc)(void *ptr));
+size_t zbtAllocSize(const zbtree *t);
+
+static inline double zbtCursorScore(const zbtCursor *c) {
+    return c->leaf->scores[c->pos];
+}
+
+static inline sds zbtCursorEle(const zbtCursor *c) {
+    return c->leaf->eles[c->pos];
+}
+
+/* Move to the next / previous element, returning 0 (and leaving a NULL
+ * leaf) at the end. */
+static inline int zbtNext(zbtCursor *c) {
+    if (++c->pos < (int)c->leaf->hdr.count) return 1;
+    c->leaf = c->leaf->next;
+    c->pos = 0;
+    return c->leaf != NULL;
+}
+
+static inline int zbtPrev(zbtCursor *c) {
+    if (--c->pos >= 0) return 1;
+    c->leaf = c->leaf->prev;
+    c->pos = c->leaf ? (int)c->leaf->hdr.count-1 : 0;
+    return c->leaf != NULL;
+}
+
+#ifdef REDIS_TEST
+int zbtreeTest(int argc, char *argv[], int accurate);
+#endif
+
+#endif
@@ -1146,6 +1146,79 @@ unsigned char *ziplistPush(unsigned char *zl, unsigned char *s, unsigned int sle
     return __ziplistInsert(zl,p,s,slen);
 }
 
+/* Append 'count' entries at the tail of 'zl', in array order, resizing the
+ * ziplist only once. When 'zl' is NULL a new ziplist holding just these
+ * entries is created with a single allocation. */
+unsigned char *ziplistAppendBulk(unsigned char *zl, unsigned char **vals,
+                                 unsigned int *lens, unsigned long count) {
+    size_t curlen, reqlen = 0, prevlen = 0, tailprevlen;
+    unsigned char *p, encoding;
+    long long value;
+    unsigned long j, len;
+
+    if (zl) {
+        curlen = intrev32ifbe(ZIPLIST_BYTES(zl));
+        p = ZIPLIST_ENTRY_TAIL(zl);
+        if (p[0] != ZIP_END) prevlen = zipRawEntryLengthSafe(zl, curlen, p);
+    } else {
+        curlen = ZIPLIST_HEADER_SIZE+ZIPLIST_END_SIZE;
+    }
+
+    /* Every entry stores the length of the one before it, so the first pass
+     * sizes the entries in order. */
+    tailprevlen = prevlen;
+    for (j = 0; j < count; j++) {
+        size_t entrylen;
+        encoding = 0;
+        if (zipTryEncoding(vals[j],lens[j],&value,&encoding))
+            entrylen = zipIntSize(encoding);
+        else
+            entrylen = lens[j];
+        entrylen += zipStorePrevEntryLength(NULL,prevlen);
+        entrylen += zipStoreEntryEncoding(NULL,encoding,lens[j]);
+        reqlen += entrylen;
+        prevlen = entrylen;
+    }
+
+    if (zl) {
+        zl = ziplistResize(zl,curlen+reqlen);
+    } else {
+        zl = zmalloc(curlen+reqlen);
+        ZIPLIST_BYTES(zl) = intrev32ifbe(curlen+reqlen);
+        ZIPLIST_TAIL_OFFSET(zl) = intrev32ifbe(ZIPLIST_HEADER_SIZE);
+        ZIPLIST_LENGTH(zl) = 0;
+        zl[curlen+reqlen-1] = ZIP_END;
+    }
+
+    /* Write the entries where the old ZIP_END was. */
+    p = zl+curlen-ZIPLIST_END_SIZE;
+    prevlen = tailprevlen;
+    for (j = 0; j < count; j++) {
+        unsigned char *entry = p;
+        encoding = 0;
+        int isint = zipTryEncoding(vals[j],lens[j],&value,&encoding);
+        p += zipStorePrevEntryLength(p,prevlen);
+        p += zipStoreEntryEncoding(p,encoding,lens[j]);
+        if (isint) {
+            zipSaveInteger(p,value,encoding);
+            p += zipIntSize(encoding);
+        } else {
+            memcpy(p,vals[j],lens[j]);
+            p += lens[j];
+        }
+        prevlen = p-entry;
+        if (j == count-1) ZIPLIST_TAIL_OFFSET(zl) = intrev32ifbe(entry-zl);
+    }
+
+    /* Like ZIPLIST_INCR_LENGTH, but the count may reach UINT16_MAX here. */
+    len = intrev16ifbe(ZIPLIST_LENGTH(zl));
+    if (len < UINT16_MAX) {
+        len += count;
+        ZIPLIST_LENGTH(zl) = intrev16ifbe(len < UINT16_MAX ? len : UINT16_MAX);
+    }
+    return zl;
+}
+
 /* Returns an offset to use for iterating with ziplistNext. When the given
  * index is negative, the list is traversed back to front. When the list
  * doesn't contain an element at the provided index, NULL is returned. */
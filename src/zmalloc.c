@@ -73,6 +73,11 @@ static struct {
 /* 线程局部存储：当前线程绑定的NUMA节点 */
 static __thread int tls_current_node = -1;
 
+/* 线程局部存储：分配节点覆盖（-1 = 使用本地优先策略） */
+static __thread int tls_alloc_node = -1;
+
+static void numa_detect_node_capacity(void);
+
 /* 初始化NUMA支持：初始化内存池、Slab分配器并按距离排序节点 */
 void numa_init(void)
 {
@@ -95,6 +100,7 @@ void numa_init(void)
 
     numa_ctx.num_nodes = numa_pool_num_nodes();
     numa_ctx.current_node = numa_pool_get_node();
+    numa_detect_node_capacity();
     tls_current_node = numa_ctx.current_node;
     /* 改为交错分配策略，实现跨节点负载均衡 */
     numa_ctx.allocation_strategy = NUMA_STRATEGY_INTERLEAVE;
@@ -186,6 +192,14 @@ static redisAtomic size_t numa_alloc_slab_count   = 0;
 static redisAtomic size_t numa_alloc_pool_count   = 0;
 static redisAtomic size_t numa_alloc_direct_count = 0;
 
+/* 每节点记账：已用字节数（含 PREFIX）随分配/释放原子更新；
+ * 容量在 numa_init() 时探测一次，配置可覆盖 */
+static redisAtomic size_t numa_node_used_bytes[NUMA_ACCT_MAX_NODES];
+static size_t numa_node_detected_capacity[NUMA_ACCT_MAX_NODES];
+static size_t numa_node_capacity[NUMA_ACCT_MAX_NODES];
+
+#define numa_node_acct_valid(n) ((unsigned)(n) < NUMA_ACCT_MAX_NODES)
+
 #else
 /* Standard allocator can use HAVE_MALLOC_SIZE if available */
 #ifdef HAVE_MALLOC_SIZE
@@ -272,7 +286,9 @@ static void *numa_alloc_with_size(size_t size)
     
     /* 本地优先：Node 0 压力超过 95% 时溢出到 Node 1 */
     int target_node;
-    if (numa_ctx.num_nodes == 1) {
+    if (tls_alloc_node >= 0) {
+        target_node = tls_alloc_node;
+    } else if (numa_ctx.num_nodes == 1) {
         target_node = 0;
     } else {
         static __thread int alloc_count = 0;
@@ -321,6 +337,8 @@ static void *numa_alloc_with_size(size_t size)
 
     numa_init_prefix(raw_ptr, size, from_pool, target_node);  /* P2修复：传入node_id写入PREFIX */
     update_zmalloc_stat_alloc(total_size);
+    if (numa_node_acct_valid(target_node))
+        atomicIncr(numa_node_used_bytes[target_node], total_size);
     return numa_to_user_ptr(raw_ptr);
 }
 
@@ -336,6 +354,8 @@ static void numa_free_with_size(void *user_ptr)
     int node_id = (int)prefix->node_id;  /* P2修复：从PREFIX读取正确的分配节点ID */
 
     update_zmalloc_stat_free(total_size);
+    if (numa_node_acct_valid(node_id))
+        atomicDecr(numa_node_used_bytes[node_id], total_size);
 
     void *raw_ptr = (char *)user_ptr - PREFIX_SIZE;
 
@@ -437,6 +457,14 @@ int numa_get_current_node(void)
     return numa_pool_get_node();
 }
 
+/* 设置本线程的分配节点覆盖，返回旧值 */
+int numa_set_thread_alloc_node(int node)
+{
+    int prev = tls_alloc_node;
+    tls_alloc_node = (node >= 0 && node < numa_ctx.num_nodes) ? node : -1;
+    return prev;
+}
+
 /* 在指定NUMA节点上分配内存（用于Key迁移，绕过Pool/Slab直接分配） */
 static void *numa_alloc_on_specific_node(size_t size, int node)
 {
@@ -451,6 +479,8 @@ static void *numa_alloc_on_specific_node(size_t size, int node)
 
     numa_init_prefix(raw_ptr, size, 0, node);  /* 标记为直接分配并记录节点ID */
     update_zmalloc_stat_alloc(total_size);
+    if (numa_node_acct_valid(node))
+        atomicIncr(numa_node_used_bytes[node], total_size);
     return numa_to_user_ptr(raw_ptr);
 }
 
@@ -542,11 +572,20 @@ int numa_get_node_id(void *ptr)
     return (int)prefix->node_id;
 }
 
-/* 设置分配内存的NUMA节点ID（用于迁移后更新标记） */
+/* 设置分配内存的NUMA节点ID（用于迁移后更新标记），记账随之转移，
+ * 保证释放时按新节点扣减 */
 void numa_set_node_id(void *ptr, int node_id)
 {
     if (!ptr) return;
     numa_alloc_prefix_t *prefix = numa_get_prefix(ptr);
+    int old_node = (int)prefix->node_id;
+    if (old_node == node_id) return;
+
+    size_t total_size = prefix->size + PREFIX_SIZE;
+    if (numa_node_acct_valid(old_node))
+        atomicDecr(numa_node_used_bytes[old_node], total_size);
+    if (numa_node_acct_valid(node_id))
+        atomicIncr(numa_node_used_bytes[node_id], total_size);
     prefix->node_id = (char)node_id;
 }
 
@@ -564,6 +603,47 @@ void numa_get_alloc_stats(size_t *slab_bytes, size_t *pool_bytes,
     atomicGet(numa_alloc_direct_count, *direct_count);
 }
 
+/* 探测各节点物理容量（仅在初始化时读取一次 sysfs）。
+ * 容器内 sysfs 不可见时 numa_node_size64() 返回 -1，容量记为未知(0) */
+static void numa_detect_node_capacity(void)
+{
+    for (int i = 0; i < numa_ctx.num_nodes && i < NUMA_ACCT_MAX_NODES; i++) {
+        long long size = numa_node_size64(i, NULL);
+        numa_node_detected_capacity[i] = (size > 0) ? (size_t)size : 0;
+        numa_node_capacity[i] = numa_node_detected_capacity[i];
+    }
+}
+
+/* 读取节点上由本进程分配的字节数（含 PREFIX） */
+size_t numa_get_node_used_memory(int node)
+{
+    size_t used = 0;
+    if (!numa_node_acct_valid(node)) return 0;
+    atomicGet(numa_node_used_bytes[node], used);
+    return used;
+}
+
+/* 读取节点容量（字节），0 表示未知 */
+size_t numa_get_node_capacity(int node)
+{
+    if (!numa_node_acct_valid(node)) return 0;
+    return numa_node_capacity[node];
+}
+
+/* 读取初始化时探测到的节点物理容量，0 表示未知 */
+size_t numa_get_node_detected_capacity(int node)
+{
+    if (!numa_node_acct_valid(node)) return 0;
+    return numa_node_detected_capacity[node];
+}
+
+/* 设置节点容量；bytes 为 0 时恢复为探测值 */
+void numa_set_node_capacity(int node, size_t bytes)
+{
+    if (!numa_node_acct_valid(node)) return;
+    numa_node_capacity[node] = bytes ? bytes : numa_node_detected_capacity[node];
+}
+
 #endif /* HAVE_NUMA */
 
 /* 尝试分配内存，失败返回NULL。若usable非空，写入实际可用大小。 */
@@ -102,6 +102,9 @@
 void *zmalloc(size_t size);
 void *zcalloc(size_t size);
 
+/* 每节点记账/预算数组的上限（server.maxmemory_node 等在非 NUMA 构建中也存在） */
+#define NUMA_ACCT_MAX_NODES 64
+
 /* NUMA support */
 #ifdef HAVE_NUMA
 #include <numa.h>
@@ -132,6 +135,10 @@ void numa_zfree(void *ptr);
 void *numa_zmalloc_onnode(size_t size, int node);
 void *numa_zcalloc_onnode(size_t size, int node);
 
+/* 线程级分配节点覆盖：>=0 时本线程后续 zmalloc 固定分配在该节点，
+ * -1 恢复本地优先策略。返回旧值，便于调用方成对恢复。 */
+int numa_set_thread_alloc_node(int node);
+
 /* NUMA heat tracking API - stored in PREFIX */
 #define NUMA_HOTNESS_MAX     7
 #define NUMA_HOTNESS_MIN     0
@@ -153,6 +160,14 @@ void numa_get_alloc_stats(size_t *slab_bytes, size_t *pool_bytes,
                           size_t *slab_count, size_t *pool_count,
                           size_t *direct_count);
 
+/* 每节点内存记账：分配器按 PREFIX 中的 node_id 维护已用字节数，
+ * 容量默认取 numa_node_size64()（初始化时读取一次），可由配置覆盖；
+ * 容量为 0 表示未知。NUMA_ACCT_MAX_NODES 定义在下方，非 NUMA 构建也可见。 */
+size_t numa_get_node_used_memory(int node);
+size_t numa_get_node_capacity(int node);
+size_t numa_get_node_detected_capacity(int node);
+void numa_set_node_capacity(int node, size_t bytes);
+
 #endif /* HAVE_NUMA */
 void *zrealloc(void *ptr, size_t size);
 void *ztrymalloc(size_t size);
@@ -23,6 +23,14 @@ start_server [list overrides [list "dir" $server_path "dbfilename" "encodings.rd
 "0","zset","zset","a","1","b","2","c","3","aa","10","bb","20","cc","30","aaa","100","bbb","200","ccc","300","aaaa","1000","cccc","123456789","bbbb","5000000000",
 "0","zset_zipped","zset","a","1","b","2","c","3",
 }
+
+  test "RDB encoding loading test with loader threads" {
+    set dump [csvdump r]
+    r config set numa-rdb-load-threads 2
+    r debug reload nosave
+    r config set numa-rdb-load-threads 0
+    assert_equal $dump [csvdump r]
+  }
 }
 
 set server_path [tmpdir "server.rdb-startup-test"]
@@ -202,6 +210,93 @@ test {client freed during loading} {
     }
 }
 
+set server_path [tmpdir "server.rdb-numa-placement-test"]
+
+start_server [list overrides [list "dir" $server_path "numa-rdb-placement" yes] keep_persistence true] {
+    # Only NUMA builds save the placement.
+    if {[string match {*numa_nodes:*} [r info numa]]} {
+        test {Test RDB NUMA placement is restored on restart} {
+            for {set j 0} {$j < 100} {incr j} {
+                r set string:$j [string repeat x 100]
+                r hset hash:$j field $j
+            }
+            set digest [r debug digest]
+            r save
+            set fp [open [file join $server_path dump.rdb] r]
+            fconfigure $fp -translation binary
+            set content [read $fp]
+            close $fp
+            assert_match {*numa-placement*} $content
+
+            restart_server 0 true false
+            assert_equal $digest [r debug digest]
+            wait_for_log_messages 0 {"*NUMA placement restored for 200 keys*"} 0 10 100
+        }
+
+        test {Test RDB NUMA placement passes redis-check-rdb} {
+            catch {
+                exec src/redis-check-rdb [file join $server_path dump.rdb]
+            } result
+            assert_match {*RDB looks OK!*} $result
+            assert_no_match {*AUX FIELD numa-placement*} $result
+        }
+    }
+}
+
+set server_path [tmpdir "server.rdb-numa-save-test"]
+
+start_server [list overrides [list "dir" $server_path "numa-bgsave-per-node" yes] keep_persistence true] {
+    # Return the offset of 'key' in the RDB file of the server.
+    proc rdb_key_offset {path key} {
+        set fp [open [file join $path dump.rdb] r]
+        fconfigure $fp -translation binary
+        set content [read $fp]
+        close $fp
+        string first $key $content
+    }
+
+    if {[string match {*numa_nodes:*} [r info numa]]} {
+        test {Test BGSAVE with numa-bgsave-per-node} {
+            r debug populate 10000
+            for {set j 0} {$j < 100} {incr j} {
+                r hset hash:$j field $j
+                r rpush list:$j a b c
+                r set volatile:$j $j ex 1000
+            }
+            # Written by the child's main thread instead of a node thread.
+            r setrange bigstring 2000000 x
+            set digest [r debug digest]
+            r bgsave
+            waitForBgsave r
+            verify_log_message 0 "*saving with * per-node thread(s)*" 0
+
+            restart_server 0 true false
+            assert_equal $digest [r debug digest]
+            assert_morethan [r ttl volatile:0] 0
+        }
+
+        test {Test RDB numa-rdb-hot-first saves hot keys first} {
+            r flushall
+            for {set j 0} {$j < 1000} {incr j} {
+                r set key:$j [string repeat x 100]
+            }
+            for {set j 0} {$j < 20} {incr j} {
+                r get key:999
+            }
+            set digest [r debug digest]
+            r config set numa-rdb-hot-first yes
+            r bgsave
+            waitForBgsave r
+            r config set numa-rdb-hot-first no
+            assert_lessthan [rdb_key_offset $server_path key:999] \
+                [rdb_key_offset $server_path key:0]
+
+            restart_server 0 true false
+            assert_equal $digest [r debug digest]
+        }
+    }
+}
+
 # Our COW metrics (Private_Dirty) work only on Linux
 set system_name [string tolower [exec uname -s]]
 if {$system_name eq {linux}} {
@@ -154,3 +154,84 @@ start_server {tags {"repl"}} {
         }
     }
 }
+
+start_server {tags {"repl"} overrides {repl-backlog-shared-output yes repl-backlog-size 100kb}} {
+    start_server {} {
+        start_server {} {
+            set master [srv -2 client]
+            set master_host [srv -2 host]
+            set master_port [srv -2 port]
+            set replica1 [srv -1 client]
+            set replica1_pid [srv -1 pid]
+            set replica2 [srv 0 client]
+
+            $replica1 replicaof $master_host $master_port
+            $replica2 replicaof $master_host $master_port
+            wait_for_condition 50 100 {
+                [status $replica1 master_link_status] eq {up} &&
+                [status $replica2 master_link_status] eq {up}
+            } else {
+                fail "Replicas didn't connect"
+            }
+
+            test {repl-backlog-shared-output: replicas send from the backlog} {
+                for {set j 0} {$j < 1000} {incr j} {
+                    $master set key:$j [string repeat x 100]
+                }
+                wait_for_condition 50 100 {
+                    [status $master repl_backlog_shared_replicas] == 2
+                } else {
+                    fail "Replicas don't send from the backlog"
+                }
+                wait_for_ofs_sync $master $replica1
+                wait_for_ofs_sync $master $replica2
+                assert_equal [$master debug digest] [$replica1 debug digest]
+                assert_equal [$master debug digest] [$replica2 debug digest]
+            }
+
+            test {repl-backlog-shared-output: a lagging replica gets its own copy} {
+                set full_syncs [status $master sync_full]
+                exec kill -SIGSTOP $replica1_pid
+                # Write more than the backlog and the socket buffers hold
+                # while the replica is stopped: its unsent data must be
+                # copied before it is overwritten.
+                for {set j 0} {$j < 500} {incr j} {
+                    $master set big:$j [string repeat y 100000]
+                }
+                wait_for_condition 50 100 {
+                    [status $master repl_backlog_shared_replicas] == 1
+                } else {
+                    fail "The lagging replica still sends from the backlog"
+                }
+                exec kill -SIGCONT $replica1_pid
+                wait_for_ofs_sync $master $replica1
+                wait_for_ofs_sync $master $replica2
+                assert_equal [$master debug digest] [$replica1 debug digest]
+                assert_equal [$master debug digest] [$replica2 debug digest]
+
+                # Once caught up, it sends from the backlog again.
+                $master set foo bar
+                wait_for_condition 50 100 {
+                    [status $master repl_backlog_shared_replicas] == 2
+                } else {
+                    fail "The replica didn't switch back to the backlog"
+                }
+                assert_equal $full_syncs [status $master sync_full]
+            }
+
+            test {repl-backlog-shared-output: can be disabled at runtime} {
+                $master config set repl-backlog-shared-output no
+                $master set foo baz
+                wait_for_condition 50 100 {
+                    [status $master repl_backlog_shared_replicas] == 0
+                } else {
+                    fail "Replicas still send from the backlog"
+                }
+                wait_for_ofs_sync $master $replica1
+                wait_for_ofs_sync $master $replica2
+                assert_equal baz [$replica1 get foo]
+                assert_equal baz [$replica2 get foo]
+            }
+        }
+    }
+}
@@ -78,6 +78,7 @@ set ::all_tests {
     unit/shutdown
     unit/networking
     unit/cluster
+    unit/numa
 }
 # Index to the next test to run in the ::all_tests list.
 set ::next_test 0
@@ -249,6 +249,40 @@ start_server {tags {"hll"}} {
         assert {$err < (double($card)/100)*5}
     }
 
+    test {PFCOUNT / PFMERGE of many dense HLLs: SIMD and scalar code agree} {
+        set keys {}
+        for {set j 0} {$j < 100} {incr j} {
+            set elements {}
+            for {set x 0} {$x < 2000} {incr x} {
+                lappend elements [randomInt 1000000]
+            }
+            r del hll$j
+            r pfadd hll$j {*}$elements
+            r pfdebug todense hll$j
+            lappend keys hll$j
+        }
+        foreach simd {no yes} {
+            r pfdebug simd $simd
+            set start [clock microseconds]
+            for {set i 0} {$i < 20} {incr i} {
+                set union($simd) [r pfcount {*}$keys]
+            }
+            set count_us [expr {[clock microseconds]-$start}]
+            r del merged-$simd
+            r pfadd merged-$simd
+            r pfdebug todense merged-$simd
+            set start [clock microseconds]
+            r pfmerge merged-$simd {*}$keys
+            set merge_us [expr {[clock microseconds]-$start}]
+            if {$::verbose} {
+                puts "SIMD $simd: PFCOUNT of 100 keys [expr {$count_us/20}] us, PFMERGE of 100 keys $merge_us us"
+            }
+        }
+        assert_equal $union(no) $union(yes)
+        assert_equal [r pfdebug getreg merged-no] [r pfdebug getreg merged-yes]
+        assert_equal $union(yes) [r pfcount merged-yes]
+    }
+
     test {PFDEBUG GETREG returns the HyperLogLog raw registers} {
         r del hll
         r pfadd hll 1 2 3
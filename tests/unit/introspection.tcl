@@ -199,6 +199,12 @@ start_server {tags {"introspection"}} {
             bgsave_cpulist
             set-proc-title
             lua-enable-deprecated-api
+            numa-latency-probe-buffer
+            numa-io-threads
+            numa-lazyfree-workers
+            keyspace-bucketed-dict
+            numa-keyspace-shards
+            keyspace-embedded-key-max-len
         }
 
         if {!$::tls} {
@@ -272,10 +272,10 @@ start_server {tags {"keyspace"}} {
         assert_equal $digest [r debug digest-value newset2]
     }
 
-    test {COPY basic usage for ziplist sorted set} {
+    test {COPY basic usage for listpack sorted set} {
         r del zset1 newzset1
         r zadd zset1 123 foobar
-        assert_encoding ziplist zset1
+        assert_encoding listpack zset1
         r copy zset1 newzset1
         set digest [r debug digest-value zset1]
         assert_equal $digest [r debug digest-value newzset1]
@@ -287,8 +287,8 @@ start_server {tags {"keyspace"}} {
 
      test {COPY basic usage for skiplist sorted set} {
         r del zset2 newzset2
-        set original_max [lindex [r config get zset-max-ziplist-entries] 1]
-        r config set zset-max-ziplist-entries 0
+        set original_max [lindex [r config get zset-max-listpack-entries] 1]
+        r config set zset-max-listpack-entries 0
         for {set j 0} {$j < 130} {incr j} {
             r zadd zset2 [randomInt 50] ele-[randomInt 10]
         }
@@ -300,13 +300,13 @@ start_server {tags {"keyspace"}} {
         assert_equal 1 [r object refcount newzset2]
         r del zset2
         assert_equal $digest [r debug digest-value newzset2]
-        r config set zset-max-ziplist-entries $original_max
+        r config set zset-max-listpack-entries $original_max
     }
 
-    test {COPY basic usage for ziplist hash} {
+    test {COPY basic usage for listpack hash} {
         r del hash1 newhash1
         r hset hash1 tmp 17179869184
-        assert_encoding ziplist hash1
+        assert_encoding listpack hash1
         r copy hash1 newhash1
         set digest [r debug digest-value hash1]
         assert_equal $digest [r debug digest-value newhash1]
@@ -318,8 +318,8 @@ start_server {tags {"keyspace"}} {
 
     test {COPY basic usage for hashtable hash} {
         r del hash2 newhash2
-        set original_max [lindex [r config get hash-max-ziplist-entries] 1]
-        r config set hash-max-ziplist-entries 0
+        set original_max [lindex [r config get hash-max-listpack-entries] 1]
+        r config set hash-max-listpack-entries 0
         for {set i 0} {$i < 64} {incr i} {
             r hset hash2 [randomValue] [randomValue]
         }
@@ -331,7 +331,7 @@ start_server {tags {"keyspace"}} {
         assert_equal 1 [r object refcount newhash2]
         r del hash2
         assert_equal $digest [r debug digest-value newhash2]
-        r config set hash-max-ziplist-entries $original_max
+        r config set hash-max-listpack-entries $original_max
     }
 
     test {COPY basic usage for stream} {
@@ -492,3 +492,201 @@ start_server {tags {"keyspace"}} {
         r KEYS [string repeat "*?" 50000]
     } {}
 }
+
+# Keyspace operations that depend on how the keyspace dicts store their
+# entries, run against a server started with 'overrides'.
+proc test_keyspace_layout {name overrides} {
+    start_server [list tags {"keyspace"} overrides $overrides] {
+        test "$name: add, find and delete keys across rehashing" {
+            r flushall
+            for {set j 0} {$j < 10000} {incr j} {
+                r set key:$j $j
+            }
+            assert_equal 10000 [r dbsize]
+            for {set j 0} {$j < 10000} {incr j 7} {
+                assert_equal $j [r get key:$j]
+            }
+            assert_equal {} [r get nokey]
+            # Shrink the table by deleting most keys.
+            for {set j 0} {$j < 10000} {incr j} {
+                if {$j % 100} {r del key:$j}
+            }
+            assert_equal 100 [r dbsize]
+            for {set j 0} {$j < 10000} {incr j 100} {
+                assert_equal $j [r get key:$j]
+            }
+            assert_equal 100 [llength [r keys key:*]]
+            assert_match {key:*} [r randomkey]
+        }
+
+        test "$name: SCAN returns every key while the table changes" {
+            r flushall
+            for {set j 0} {$j < 5000} {incr j} {
+                r set key:$j $j
+            }
+            set cursor 0
+            set keys {}
+            set added 0
+            while 1 {
+                set res [r scan $cursor count 100]
+                set cursor [lindex $res 0]
+                lappend keys {*}[lindex $res 1]
+                # Grow the table during the scan.
+                if {$added < 10000} {
+                    for {set j 0} {$j < 1000} {incr j} {
+                        r set new:[incr added] x
+                    }
+                }
+                if {$cursor == 0} break
+            }
+            set seen [lsort -unique [lsearch -all -inline $keys key:*]]
+            assert_equal 5000 [llength $seen]
+        }
+
+        test "$name: active expire and lazy expire" {
+            r flushall
+            for {set j 0} {$j < 1000} {incr j} {
+                r psetex volatile:$j 10 x
+                r set persistent:$j x
+            }
+            r psetex lazy 10 x
+            after 20
+            assert_equal {} [r get lazy]
+            wait_for_condition 50 100 {
+                [r dbsize] == 1000
+            } else {
+                fail "Keys didn't expire"
+            }
+            assert_equal 0 [llength [r keys volatile:*]]
+        }
+
+        test "$name: DEBUG RELOAD, SWAPDB and FLUSHALL ASYNC" {
+            r flushall
+            r debug populate 10000
+            r hset myhash f v
+            r expire key:1 1000
+            set digest [r debug digest]
+            r debug reload
+            assert_equal $digest [r debug digest]
+            assert_morethan [r ttl key:1] 0
+
+            r select 10
+            r set other x
+            r swapdb 9 10
+            assert_equal 10001 [r dbsize]
+            assert_equal v [r hget myhash f]
+            r select 9
+            assert_equal x [r get other]
+            r swapdb 9 10
+            r select 10
+            r del other
+            r select 9
+            assert_equal $digest [r debug digest]
+
+            r flushall async
+            assert_equal 0 [r dbsize]
+            r set foo bar
+            assert_equal bar [r get foo]
+        }
+    }
+}
+
+test_keyspace_layout "bucketed dict" {keyspace-bucketed-dict yes}
+
+start_server {tags {"keyspace"} overrides {keyspace-bucketed-dict yes}} {
+    test {DEBUG HTSTATS reports the bucketed layout} {
+        r debug populate 1000
+        set stats [r debug htstats 9]
+        assert_match {*entries per bucket: *} $stats
+        assert_match {*overflow buckets: *} $stats
+    }
+}
+
+test_keyspace_layout "sharded dict" {numa-keyspace-shards 2}
+test_keyspace_layout "bucketed sharded dict" {numa-keyspace-shards 2 keyspace-bucketed-dict yes}
+
+start_server {tags {"keyspace"} overrides {numa-keyspace-shards 2}} {
+    test {DEBUG HTSTATS reports every shard} {
+        r debug populate 1000
+        set stats [r debug htstats 9]
+        assert_match {*Shard 0 (node *):*Shard 1 (node *):*} $stats
+        # Both shards hold a fair part of the keys. A shard still rehashing
+        # reports them split over its two tables.
+        set total 0
+        set main [string range $stats 0 [string first {[Expires HT]} $stats]]
+        foreach shard [lrange [split [string map {Shard \x00} $main] \x00] 1 end] {
+            set n 0
+            foreach {_ c} [regexp -all -inline {number of elements: (\d+)} $shard] {
+                incr n $c
+            }
+            assert_morethan $n 300
+            incr total $n
+        }
+        assert_equal 1000 $total
+    }
+}
+
+start_server {tags {"keyspace"} overrides {numa-keyspace-shards 1}} {
+    test {DEBUG HTSTATS with a single shard keeps the unsharded format} {
+        r debug populate 1000
+        set stats [r debug htstats 9]
+        assert_no_match {*Shard*} $stats
+        assert_match {*number of elements: 1000*} $stats
+    }
+}
+
+test_keyspace_layout "background resize" {dict-background-resize-threshold 1}
+
+test_keyspace_layout "embedded keys" {keyspace-embedded-key-max-len 16}
+
+start_server {tags {"keyspace"} overrides {keyspace-embedded-key-max-len 16}} {
+    test {Embedded and regular key names side by side} {
+        r flushall
+        set long [string repeat x 40]
+        r set short v1
+        r set $long v2
+        r expire short 100
+        r expire $long 100
+        assert_equal v1 [r get short]
+        assert_equal v2 [r get $long]
+        assert_range [r ttl short] 1 100
+        assert_equal [lsort [list short $long]] [lsort [r keys *]]
+
+        # Rename across the limit in both directions, the TTL follows.
+        r rename short [string repeat y 20]
+        r rename $long tiny
+        assert_equal v1 [r get [string repeat y 20]]
+        assert_equal v2 [r get tiny]
+        assert_range [r ttl tiny] 1 100
+        r persist tiny
+        assert_equal -1 [r ttl tiny]
+        r del tiny [string repeat y 20]
+        assert_equal 0 [r dbsize]
+    }
+
+    test {Embedded keys survive MOVE, SWAPDB and DEBUG RELOAD} {
+        r flushall
+        for {set j 0} {$j < 1000} {incr j} {
+            r set k$j $j
+            if {$j % 2} {r pexpire k$j 100000}
+        }
+        set digest [r debug digest]
+        r move k0 10
+        r select 10
+        assert_equal 0 [r get k0]
+        r move k0 9
+        r select 9
+        r swapdb 9 10
+        r swapdb 9 10
+        r debug reload
+        assert_equal $digest [r debug digest]
+        assert_equal 500 [scan [regexp -inline {expires=(\d+)} [r info keyspace]] expires=%d]
+    }
+
+    test {MEMORY USAGE and DEBUG SDSLEN of an embedded key} {
+        r flushall
+        r set short v
+        assert_morethan [r memory usage short] 0
+        assert_match {*key_sds_len:5,*} [r debug sdslen short]
+    }
+}
@@ -37,3 +37,40 @@ start_server {tags {"lazyfree"}} {
         }
     }
 }
+
+start_server {tags {"lazyfree"} overrides {numa-lazyfree-workers yes}} {
+    # Return 'field' of the lazyfree_node0 line of INFO memory.
+    proc lazyfree_node0 {field} {
+        if {[regexp "lazyfree_node0:\[^\r\n\]*$field=(\[0-9.\]+)" [r info memory] -> value]} {
+            return $value
+        }
+        return {}
+    }
+
+    if {[lazyfree_node0 freed] eq {}} {
+        # Not a NUMA build: there are no per node workers.
+        return
+    }
+
+    test "UNLINK is freed by the per node lazyfree worker" {
+        set orig_mem [s used_memory]
+        set freed [lazyfree_node0 freed]
+        set args {}
+        for {set i 0} {$i < 100000} {incr i} {
+            lappend args $i
+        }
+        r sadd myset {*}$args
+        set peak_mem [s used_memory]
+        assert {[r unlink myset] == 1}
+        wait_for_condition 50 100 {
+            [lazyfree_node0 freed] == $freed + 1 &&
+            [lazyfree_node0 pending] == 0
+        } else {
+            fail "The node 0 worker didn't free the set"
+        }
+        assert {[s used_memory] < $peak_mem}
+        assert {[s used_memory] < $orig_mem*2}
+        assert {[lazyfree_node0 busy_usec] > 0}
+        assert {[lazyfree_node0 freed_per_busy_sec] > 0}
+    }
+}
@@ -0,0 +1,389 @@
+# Return the value of 'field' in the "name:k=v,k=v" line of INFO numa, or
+# an empty string if the line or the field are missing.
+proc numa_info_field {r name field} {
+    if {[regexp "\r\n$name:(\[^\r\n\]*)" [$r info numa] -> line]} {
+        foreach kv [split $line ,] {
+            lassign [split $kv =] k v
+            if {$k eq $field} {return $v}
+        }
+    }
+    return {}
+}
+
+start_server {tags {"numa"}} {
+    if {![string match {*numa_nodes:*} [r info numa]]} {
+        # Not a NUMA build: the section and its configs don't exist.
+        return
+    }
+
+    test {Latency probe measures the local node} {
+        r config set numa-latency-probe-interval 20
+        wait_for_condition 100 50 {
+            [numa_info_field r numa_latency_cpu0_mem0 samples] > 0
+        } else {
+            fail "No latency samples for node 0"
+        }
+        assert_equal running [s numa_latency_probe]
+        assert_equal 1.00 [numa_info_field r numa_latency_cpu0_mem0 relative]
+        assert_morethan [numa_info_field r numa_latency_cpu0_mem0 ewma_ns] 0
+
+        r config set numa-latency-probe-interval 0
+        wait_for_condition 50 100 {
+            [s numa_latency_probe] eq {stopped}
+        } else {
+            fail "Latency probe didn't stop"
+        }
+        r config set numa-latency-probe-interval 1000
+        assert_equal running [s numa_latency_probe]
+    }
+
+    test {Bandwidth sampler fills the usage windows} {
+        assert_error {*must be 0 or between 10 and 100*} {
+            r config set numa-bw-sample-interval 5
+        }
+        r config set numa-bw-sample-interval 10
+        assert_equal running [s numa_bw_sampler]
+        set samples [numa_info_field r numa_bw_node0_1s samples]
+        wait_for_condition 100 50 {
+            [numa_info_field r numa_bw_node0_1s samples] > $samples
+        } else {
+            fail "The sampler didn't add samples"
+        }
+        foreach window {1s 10s 60s} {
+            set line numa_bw_node0_$window
+            assert_lessthan_equal [numa_info_field r $line p50] [numa_info_field r $line p99]
+            assert_lessthan_equal [numa_info_field r $line p99] [numa_info_field r $line max]
+        }
+
+        r config set numa-bw-sample-interval 0
+        wait_for_condition 50 100 {
+            [s numa_bw_sampler] eq {stopped}
+        } else {
+            fail "Bandwidth sampler didn't stop"
+        }
+        r config set numa-bw-sample-interval 100
+        assert_equal running [s numa_bw_sampler]
+    }
+
+    test {Per-node accounting follows allocations and frees} {
+        r del bigval
+        set before [numa_info_field r numa_mem_node0 used]
+        r setrange bigval 10000000 x
+        set after [numa_info_field r numa_mem_node0 used]
+        assert_range [expr {$after - $before}] 10000000 11000000
+        r del bigval
+        assert_lessthan [numa_info_field r numa_mem_node0 used] [expr {$before + 1000000}]
+    }
+
+    test {numa-node-capacity overrides the node capacity} {
+        set detected [numa_info_field r numa_mem_node0 capacity]
+        r config set numa-node-capacity "0:1gb"
+        assert_equal {0:1gb} [lindex [r config get numa-node-capacity] 1]
+        assert_equal 1073741824 [numa_info_field r numa_mem_node0 capacity]
+        set expected [expr {[numa_info_field r numa_mem_node0 used] / 1073741824.0}]
+        assert_range [numa_info_field r numa_mem_node0 pressure] \
+            [expr {$expected - 0.001}] [expr {$expected + 0.001}]
+
+        assert_error {*expects '<node>:<bytes>' pairs*} {
+            r config set numa-node-capacity "0:1gb 1"
+        }
+        assert_equal 1073741824 [numa_info_field r numa_mem_node0 capacity]
+        r config set numa-node-capacity ""
+        assert_equal $detected [numa_info_field r numa_mem_node0 capacity]
+    }
+
+    test {CONFIG SET/GET maxmemory-node} {
+        r config set maxmemory-node "0 100mb"
+        assert_equal {0 104857600} [lindex [r config get maxmemory-node] 1]
+        foreach bad {{ 0 1mb} {0  1mb} {0 1mb } {x 1mb} {0} {0 -1} {64 1mb} {0 1mb 1}} {
+            assert_error {*Invalid argument*} [list r config set maxmemory-node $bad]
+            assert_equal {0 104857600} [lindex [r config get maxmemory-node] 1]
+        }
+        r config set maxmemory-node ""
+        assert_equal {} [lindex [r config get maxmemory-node] 1]
+    }
+
+    test {maxmemory-node evicts keys from the node over budget} {
+        r flushall
+        r config set maxmemory-policy allkeys-random
+        set base [numa_info_field r numa_mem_node0 used]
+        for {set j 0} {$j < 200} {incr j} {
+            r setrange key:$j 100000 x
+        }
+        set budget [expr {$base + 5000000}]
+        set evicted [s evicted_keys]
+        r config set maxmemory-node "0 $budget"
+        # Eviction runs in time slices, continued by a timer.
+        wait_for_condition 100 50 {
+            [numa_info_field r numa_mem_node0 used] <= $budget
+        } else {
+            fail "Node 0 still over its budget"
+        }
+        assert_morethan [s evicted_keys] $evicted
+        assert_lessthan [r dbsize] 200
+
+        # Writes keep the node within its budget.
+        for {set j 200} {$j < 300} {incr j} {
+            r setrange key:$j 100000 x
+        }
+        wait_for_condition 100 50 {
+            [numa_info_field r numa_mem_node0 used] <= $budget
+        } else {
+            fail "Node 0 went over its budget"
+        }
+        r config set maxmemory-node ""
+        r config set maxmemory-policy noeviction
+        r flushall
+    }
+
+    test {maxmemory-node never evicts with noeviction} {
+        r config set maxmemory-policy noeviction
+        set base [numa_info_field r numa_mem_node0 used]
+        for {set j 0} {$j < 50} {incr j} {
+            r setrange key:$j 100000 x
+        }
+        set evicted [s evicted_keys]
+        r config set maxmemory-node "0 $base"
+        # The node stays over its budget, so writes are refused.
+        assert_error {*OOM*} {r set foo bar}
+        assert_equal 50 [r dbsize]
+        assert_equal $evicted [s evicted_keys]
+        r config set maxmemory-node ""
+        r set foo bar
+        r flushall
+    }
+
+    test {maxmemory-node counts memory still being freed by lazyfree} {
+        r flushall
+        r config set maxmemory-policy allkeys-random
+        r config set lazyfree-lazy-eviction yes
+        set base [numa_info_field r numa_mem_node0 used]
+        for {set j 0} {$j < 200} {incr j} {
+            r setrange key:$j 100000 x
+        }
+        # Room for about half of the keys.
+        set budget [expr {$base + 10000000}]
+        r config set maxmemory-node "0 $budget"
+        wait_for_condition 100 50 {
+            [numa_info_field r numa_mem_node0 used] <= $budget
+        } else {
+            fail "Node 0 still over its budget"
+        }
+        wait_for_condition 100 50 {
+            [s lazyfree_pending_objects] == 0
+        } else {
+            fail "lazyfree didn't finish"
+        }
+        assert_morethan [r dbsize] 60
+        assert_lessthan [r dbsize] 110
+        r config set maxmemory-node ""
+        r config set lazyfree-lazy-eviction no
+        r config set maxmemory-policy noeviction
+        r flushall
+    }
+
+    test {Cold tier compresses a value and promotes it on access} {
+        r config set numa-cold-compress yes
+        set val [string repeat "cold value " 1000]
+        r set coldkey $val
+        set digest [r debug digest-value coldkey]
+        set compressions [s numa_cold_compressions]
+        set promotions [s numa_cold_promotions]
+
+        assert_equal OK [r numa migrate key coldkey 0 compress]
+        assert_equal 1 [s numa_cold_keys]
+        assert_equal [expr {$compressions + 1}] [s numa_cold_compressions]
+        assert_equal [string length $val] [s numa_cold_raw_bytes]
+        assert_lessthan [s numa_cold_compressed_bytes] [s numa_cold_raw_bytes]
+        assert_match {*encoding:numa-cold*cold_blob_size:*} [r debug object coldkey]
+        assert_equal $digest [r debug digest-value coldkey]
+
+        # Reading the key decompresses it back into a plain string.
+        assert_equal $val [r get coldkey]
+        assert_equal 0 [s numa_cold_keys]
+        assert_equal 0 [s numa_cold_raw_bytes]
+        assert_equal [expr {$promotions + 1}] [s numa_cold_promotions]
+        assert_morethan_equal [s numa_cold_decompress_max_us] 0
+        assert_match {*encoding:raw*} [r debug object coldkey]
+        r del coldkey
+    }
+
+    test {Cold tier rejects small, integer and incompressible values} {
+        r set small [string repeat x 10]
+        assert_error {*not eligible*} {r numa migrate key small 0 compress}
+        r set num 12345
+        assert_error {*not eligible*} {r numa migrate key num 0 compress}
+        assert_error {*not found*} {r numa migrate key nokey 0 compress}
+
+        set skipped [s numa_cold_compress_skipped]
+        set random {}
+        for {set j 0} {$j < 1024} {incr j} {
+            append random [format %c [expr {int(rand() * 256)}]]
+        }
+        r set random $random
+        assert_error {*not compressible*} {r numa migrate key random 0 compress}
+        assert_equal [expr {$skipped + 1}] [s numa_cold_compress_skipped]
+        assert_equal $random [r get random]
+        assert_equal 0 [s numa_cold_keys]
+        r del small num random
+    }
+
+    test {Cold tier compresses listpack hashes and sorted sets} {
+        r config set numa-cold-compress-min-size 64
+        for {set j 0} {$j < 50} {incr j} {
+            r hset coldhash field:$j [string repeat v 20]
+            r zadd coldzset $j member:$j
+        }
+        set hdigest [r debug digest-value coldhash]
+        set zdigest [r debug digest-value coldzset]
+        assert_equal OK [r numa migrate key coldhash 0 compress]
+        assert_equal OK [r numa migrate key coldzset 0 compress]
+        assert_equal 2 [s numa_cold_keys]
+        assert_equal [string repeat v 20] [r hget coldhash field:7]
+        assert_equal {member:3 member:4} [r zrangebyscore coldzset 3 4]
+        assert_equal 0 [s numa_cold_keys]
+        assert_equal $hdigest [r debug digest-value coldhash]
+        assert_equal $zdigest [r debug digest-value coldzset]
+        assert_encoding listpack coldhash
+        assert_encoding listpack coldzset
+        r config set numa-cold-compress-min-size 512
+        r del coldhash coldzset
+    }
+
+    test {Cold values survive a DEBUG RELOAD} {
+        set val [string repeat "reload me " 500]
+        r set coldkey $val
+        assert_equal OK [r numa migrate key coldkey 0 compress]
+        set digest [r debug digest]
+        r debug reload
+        assert_equal $digest [r debug digest]
+        assert_equal $val [r get coldkey]
+        r del coldkey
+    }
+
+    # Demotion needs a second node to move values to.
+    if {[s numa_nodes] > 1} {
+        test {Node budget eviction demotes values into the cold tier} {
+            r flushall
+            r config set maxmemory-policy allkeys-random
+            set base [numa_info_field r numa_mem_node0 used]
+            for {set j 0} {$j < 100} {incr j} {
+                r set key:$j [string repeat "demote me " 10000]
+            }
+            set compressions [s numa_cold_compressions]
+            r config set maxmemory-node "0 [expr {$base + 2000000}]"
+            wait_for_condition 100 50 {
+                [s numa_cold_keys] > 0
+            } else {
+                fail "No values were demoted into the cold tier"
+            }
+            assert_morethan [s numa_cold_compressions] $compressions
+            r config set maxmemory-node ""
+            foreach key [r keys key:*] {
+                assert_equal [string repeat "demote me " 10000] [r get $key]
+            }
+            r config set maxmemory-policy noeviction
+            r flushall
+        }
+    }
+    r config set numa-cold-compress no
+
+    test {numa-reply-pool-blocks recycles reply blocks} {
+        r config set numa-reply-pool-blocks 16
+        set field numa_reply_pool_node0
+        for {set j 0} {$j < 100} {incr j} {
+            r rpush biglist {*}[lrepeat 100 [string repeat x 100]]
+        }
+        set misses [numa_info_field r $field misses]
+        set recycled [numa_info_field r $field recycled]
+        # A 1MB reply is built from many fixed size reply blocks.
+        assert_equal 10000 [llength [r lrange biglist 0 -1]]
+        assert_morethan [numa_info_field r $field misses] $misses
+        assert_morethan [numa_info_field r $field recycled] $recycled
+        assert_lessthan_equal [numa_info_field r $field blocks] 16
+
+        set hits [numa_info_field r $field hits]
+        assert_equal 10000 [llength [r lrange biglist 0 -1]]
+        assert_morethan [numa_info_field r $field hits] $hits
+        assert_morethan_equal [numa_info_field r $field bytes] \
+            [expr {[numa_info_field r $field blocks] * 16384}]
+
+        r config set numa-reply-pool-blocks 0
+        assert_equal 0 [numa_info_field r $field blocks]
+        r del biglist
+    }
+}
+
+# Sum 'field' over the numa_io_nodeN lines of INFO numa.
+proc numa_io_total {r field} {
+    set total 0
+    foreach {- value} [regexp -all -inline "numa_io_node\\d+:\[^\r\n\]*$field=(\\d+)" [$r info numa]] {
+        incr total $value
+    }
+    return $total
+}
+
+start_server {tags {"numa"} overrides {numa-io-threads yes io-threads 2 io-threads-do-reads yes}} {
+    if {![string match {*numa_nodes:*} [r info numa]]} {
+        return
+    }
+
+    test {numa-io-threads groups io threads by node} {
+        assert_equal enabled [s numa_io_threads]
+        assert_equal 2 [numa_io_total r threads]
+    }
+
+    test {numa-io-threads counts clients and traffic per node} {
+        set clients [numa_io_total r clients]
+        set rd_bytes [numa_io_total r read_bytes]
+        set wr_bytes [numa_io_total r write_bytes]
+        set rds {}
+        for {set j 0} {$j < 5} {incr j} {
+            set rd [redis_client]
+            $rd set key:$j [string repeat x 1000]
+            lappend rds $rd
+        }
+        assert_equal [expr {$clients + 5}] [numa_io_total r clients]
+        assert_morethan [numa_io_total r read_bytes] [expr {$rd_bytes + 5000}]
+        assert_morethan [numa_io_total r write_bytes] $wr_bytes
+        foreach rd $rds {$rd close}
+        wait_for_condition 50 100 {
+            [numa_io_total r clients] == $clients
+        } else {
+            fail "Closed clients are still counted"
+        }
+        r flushall
+    }
+
+    test {numa-io-threads keeps counting a resurrected cached master} {
+        start_server {overrides {numa-io-threads yes io-threads 2}} {
+            set replica [srv 0 client]
+            $replica replicaof [srv -1 host] [srv -1 port]
+            wait_for_condition 50 100 {
+                [s 0 master_link_status] eq {up}
+            } else {
+                fail "Replica didn't connect"
+            }
+            set clients [numa_io_total $replica clients]
+            set syncs [s -1 sync_partial_ok]
+
+            # The master client is cached on disconnection, then resurrected
+            # by a partial resync on a new connection.
+            $replica client kill type master
+            wait_for_condition 50 100 {
+                [s -1 sync_partial_ok] > $syncs &&
+                [s 0 master_link_status] eq {up}
+            } else {
+                fail "Replica didn't partially resync"
+            }
+            assert_equal $clients [numa_io_total $replica clients]
+
+            $replica replicaof no one
+            wait_for_condition 50 100 {
+                [numa_io_total $replica clients] == $clients - 1
+            } else {
+                fail "The master client is still counted"
+            }
+        }
+    }
+}
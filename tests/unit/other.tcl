@@ -325,6 +325,34 @@ start_server {tags {"other"}} {
     }
 }
 
+start_server {tags {"other"} overrides {dict-background-resize-threshold 1}} {
+    test {Don't start rehashing to a background table if redis has child process} {
+        r config set save ""
+        r config set rdb-key-save-delay 1000000
+
+        # Fill the table to its 1:1 ratio: the next insertion asks the
+        # lazyfree thread for the 8192 buckets table.
+        populate 4096 "" 1
+        r set k0 v0
+        after 200
+        r bgsave
+        wait_for_condition 10 100 {
+            [s rdb_bgsave_in_progress] eq 1
+        } else {
+            fail "bgsave did not start in time"
+        }
+
+        # The table is ready, but the child must not see rehashing start.
+        r mset k1 v1 k2 v2
+        assert_no_match "*table size: 8192*" [r debug HTSTATS 9]
+        exec kill -9 [get_child_pid 0]
+        after 200
+
+        r set k3 v3
+        assert_match "*table size: 8192*" [r debug HTSTATS 9]
+    }
+}
+
 proc read_proc_title {pid} {
     set fd [open "/proc/$pid/cmdline" "r"]
     set cmdline [read $fd 1024]
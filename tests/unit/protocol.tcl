@@ -207,3 +207,117 @@ start_server {tags {"regression"}} {
         $rd read
     }
 }
+
+start_server {tags {"protocol"} overrides {client-argv-cache yes}} {
+    test "client-argv-cache: retained arguments are not reused" {
+        # Values stored in the keyspace keep the argument objects.
+        for {set j 0} {$j < 100} {incr j} {
+            r set key:$j [string repeat v [expr {$j % 40}]]
+        }
+        for {set j 0} {$j < 100} {incr j} {
+            assert_equal [string repeat v [expr {$j % 40}]] [r get key:$j]
+        }
+        r flushall
+    }
+
+    test "client-argv-cache: pipelined commands of different sizes" {
+        set fd [r channel]
+        set proto {}
+        for {set j 0} {$j < 50} {incr j} {
+            set args [list MSET]
+            for {set k 0} {$k < $j} {incr k} {lappend args k:$j:$k v:$j:$k}
+            if {$j == 0} {set args [list PING]}
+            append proto [formatCommand {*}$args]
+            append proto [formatCommand GET k:$j:0]
+        }
+        puts -nonewline $fd $proto
+        flush $fd
+        assert_equal PONG [r read]
+        assert_equal {} [r read]
+        for {set j 1} {$j < 50} {incr j} {
+            assert_equal OK [r read]
+            assert_equal v:$j:0 [r read]
+        }
+        assert_equal v:49:48 [r get k:49:48]
+        r flushall
+    }
+
+    test "client-argv-cache: MULTI and blocked commands keep their arguments" {
+        r multi
+        r set foo bar
+        r append foo baz
+        r incrby counter 10
+        assert_equal {OK 6 10} [r exec]
+        assert_equal barbaz [r get foo]
+
+        set rd [redis_deferring_client]
+        $rd blpop mylist 0
+        wait_for_blocked_clients_count 1
+        for {set j 0} {$j < 10} {incr j} {r set tmp:$j x}
+        r rpush mylist element
+        assert_equal {mylist element} [$rd read]
+        $rd close
+        r flushall
+    }
+
+    test "client-argv-cache: can be disabled at runtime" {
+        r set foo bar
+        r config set client-argv-cache no
+        assert_equal bar [r get foo]
+        r set foo baz
+        r config set client-argv-cache yes
+        assert_equal baz [r get foo]
+    }
+}
+
+start_server {tags {"protocol"} overrides {pipeline-prefetch-batch 16}} {
+    test "pipeline-prefetch-batch: pipelined commands keep their results" {
+        for {set j 0} {$j < 1000} {incr j} {r set key:$j val:$j}
+        set fd [r channel]
+        set proto {}
+        for {set j 0} {$j < 1000} {incr j} {
+            append proto [formatCommand GET key:$j]
+            append proto [formatCommand INCR counter]
+            if {$j % 100 == 0} {append proto [formatCommand PING]}
+        }
+        append proto [formatCommand SELECT 10]
+        append proto [formatCommand GET key:0]
+        append proto [formatCommand SELECT 9]
+        puts -nonewline $fd $proto
+        flush $fd
+        for {set j 0} {$j < 1000} {incr j} {
+            assert_equal val:$j [r read]
+            assert_equal [expr {$j + 1}] [r read]
+            if {$j % 100 == 0} {assert_equal PONG [r read]}
+        }
+        assert_equal OK [r read]
+        assert_equal {} [r read]
+        assert_equal OK [r read]
+    }
+
+    test "pipeline-prefetch-batch: commands split across reads" {
+        set fd [r channel]
+        set proto {}
+        for {set j 0} {$j < 20} {incr j} {append proto [formatCommand GET key:$j]}
+        set half [expr {[string length $proto] / 2 + 3}]
+        puts -nonewline $fd [string range $proto 0 $half-1]
+        flush $fd
+        after 100
+        puts -nonewline $fd [string range $proto $half end]
+        flush $fd
+        for {set j 0} {$j < 20} {incr j} {assert_equal val:$j [r read]}
+    }
+
+    test "pipeline-prefetch-batch: malformed commands in the batch" {
+        reconnect
+        set fd [r channel]
+        puts -nonewline $fd "[formatCommand GET key:1]*2\r\n\$3\r\nGET\r\n\$x\r\n"
+        flush $fd
+        assert_equal val:1 [r read]
+        assert_error {*invalid bulk length*} {r read}
+        reconnect
+        r config set pipeline-prefetch-batch 0
+        assert_equal val:2 [r get key:2]
+        r flushall
+    }
+}
@@ -263,6 +263,44 @@ start_server {
         r lrange testb 0 -1
     } {5 3 4}
 
+    test "SORT with parallel-ops-threads returns the serial result" {
+        r del tosort
+        for {set i 0} {$i < 5000} {incr i} {
+            r rpush tosort [expr {[randomInt 2000] - 1000}].[randomInt 10]
+            # Distinct weights: elements comparing equal may be reordered.
+            r set weight_$i [expr {($i * 7) % 5003}]
+        }
+        r rpush tosort 5000
+        r set weight_5000 5003
+
+        set cmds {
+            {sort tosort}
+            {sort tosort desc limit 10 100}
+            {sort tosort alpha}
+            {sort tosort by weight_*}
+            {sort tosort by weight_* limit 100 50 desc}
+            {sort tosort alpha store sorted}
+        }
+        set serial {}
+        foreach cmd $cmds {lappend serial [r {*}$cmd]}
+        lappend serial [r lrange sorted 0 -1]
+
+        r config set parallel-ops-threads 4
+        r config set parallel-sort-min-elements 2
+        set before [s parallel_sort_ops]
+        set parallel {}
+        foreach cmd $cmds {lappend parallel [r {*}$cmd]}
+        lappend parallel [r lrange sorted 0 -1]
+        assert_equal $serial $parallel
+        assert_equal [expr {$before + [llength $cmds]}] [s parallel_sort_ops]
+
+        r rpush tosort notanumber
+        assert_error "*can't be converted*" {r sort tosort}
+
+        r config set parallel-ops-threads 1
+        r config set parallel-sort-min-elements 100000
+    }
+
     tags {"slow"} {
         set num 100
         set res [create_random_dataset $num lpush]
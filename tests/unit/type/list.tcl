@@ -181,6 +181,55 @@ start_server {
         assert_equal {d c b a 0 1 2 3} [r lrange mylist 0 -1]
     }
 
+    foreach {type large} [array get largevalue] {
+        test "Variadic RPUSH/LPUSH spanning many nodes - $type" {
+            r del mylist reflist
+            set elements {}
+            for {set i 0} {$i < 100} {incr i} {
+                lappend elements [expr {$i % 3 ? "v$i" : $i * 1000}]
+            }
+            lset elements 50 $large
+            r rpush mylist x y
+            r rpush reflist x y
+            assert_equal 102 [r lpush mylist {*}$elements]
+            assert_equal 202 [r rpush mylist {*}$elements]
+            foreach e $elements {r lpush reflist $e}
+            foreach e $elements {r rpush reflist $e}
+            assert_equal [r lrange reflist 0 -1] [r lrange mylist 0 -1]
+            assert_equal [lreverse $elements] [r lrange mylist 0 99]
+            assert_equal $elements [r lrange mylist 102 -1]
+            assert_encoding quicklist mylist
+        }
+    }
+
+    proc quicklist_pool_stat {field} {
+        if {[regexp "numa_quicklist_pool_node0:\[^\r\n\]*$field=(\\d+)" [r info numa] -> value]} {
+            return $value
+        }
+        return {}
+    }
+
+    test {Quicklist node pool recycles nodes of emptied lists} {
+        r del mylist
+        r config set numa-quicklist-pool-nodes 1000
+        set recycled [quicklist_pool_stat recycled]
+        set hits [quicklist_pool_stat hits]
+        # 100 elements in nodes of 5 entries.
+        r rpush mylist {*}[lrepeat 100 a]
+        r del mylist
+        r rpush mylist {*}[lrepeat 100 a]
+        assert_equal 100 [r llen mylist]
+        if {$recycled ne {}} {
+            assert_equal [expr {$recycled + 20}] [quicklist_pool_stat recycled]
+            assert_equal [expr {$hits + 20}] [quicklist_pool_stat hits]
+        }
+        r config set numa-quicklist-pool-nodes 0
+        if {$recycled ne {}} {
+            assert_equal 0 [quicklist_pool_stat nodes]
+        }
+        r del mylist
+    }
+
     test {DEL a list} {
         assert_equal 1 [r del mylist2]
         assert_equal 0 [r exists mylist2]
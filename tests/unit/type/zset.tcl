@@ -7,14 +7,14 @@ start_server {tags {"zset"}} {
     }
 
     proc basics {encoding} {
-        set original_max_entries [lindex [r config get zset-max-ziplist-entries] 1]
-        set original_max_value [lindex [r config get zset-max-ziplist-value] 1]
-        if {$encoding == "ziplist"} {
-            r config set zset-max-ziplist-entries 128
-            r config set zset-max-ziplist-value 64
+        set original_max_entries [lindex [r config get zset-max-listpack-entries] 1]
+        set original_max_value [lindex [r config get zset-max-listpack-value] 1]
+        if {$encoding == "listpack"} {
+            r config set zset-max-listpack-entries 128
+            r config set zset-max-listpack-value 64
         } elseif {$encoding == "skiplist"} {
-            r config set zset-max-ziplist-entries 0
-            r config set zset-max-ziplist-value 0
+            r config set zset-max-listpack-entries 0
+            r config set zset-max-listpack-value 0
         } else {
             puts "Unknown sorted set encoding"
             exit
@@ -993,13 +993,19 @@ start_server {tags {"zset"}} {
             r hello 2
         }
 
-        r config set zset-max-ziplist-entries $original_max_entries
-        r config set zset-max-ziplist-value $original_max_value
+        r config set zset-max-listpack-entries $original_max_entries
+        r config set zset-max-listpack-value $original_max_value
     }
 
-    basics ziplist
+    basics listpack
     basics skiplist
 
+    # Run the skiplist tests again with every sorted set indexed by the B+tree.
+    set original_btree_min [lindex [r config get zset-btree-min-entries] 1]
+    r config set zset-btree-min-entries 1
+    basics skiplist
+    r config set zset-btree-min-entries $original_btree_min
+
     test {ZINTERSTORE regression with two sets, intset+hashtable} {
         r del seta setb setc
         r sadd set1 a
@@ -1013,7 +1019,7 @@ start_server {tags {"zset"}} {
         r zrange out 0 -1 withscores
     } {neginf 0}
 
-    test {ZINTERSTORE #516 regression, mixed sets and ziplist zsets} {
+    test {ZINTERSTORE #516 regression, mixed sets and listpack zsets} {
         r sadd one 100 101 102 103
         r sadd two 100 200 201 202
         r zadd three 1 500 1 501 1 502 1 503 1 100
@@ -1092,16 +1098,16 @@ start_server {tags {"zset"}} {
     }
 
     proc stressers {encoding} {
-        set original_max_entries [lindex [r config get zset-max-ziplist-entries] 1]
-        set original_max_value [lindex [r config get zset-max-ziplist-value] 1]
-        if {$encoding == "ziplist"} {
+        set original_max_entries [lindex [r config get zset-max-listpack-entries] 1]
+        set original_max_value [lindex [r config get zset-max-listpack-value] 1]
+        if {$encoding == "listpack"} {
             # Little extra to allow proper fuzzing in the sorting stresser
-            r config set zset-max-ziplist-entries 256
-            r config set zset-max-ziplist-value 64
+            r config set zset-max-listpack-entries 256
+            r config set zset-max-listpack-value 64
             set elements 128
         } elseif {$encoding == "skiplist"} {
-            r config set zset-max-ziplist-entries 0
-            r config set zset-max-ziplist-value 0
+            r config set zset-max-listpack-entries 0
+            r config set zset-max-listpack-value 0
             if {$::accurate} {set elements 1000} else {set elements 100}
         } else {
             puts "Unknown sorted set encoding"
@@ -1518,18 +1524,23 @@ start_server {tags {"zset"}} {
             r zadd zset 0 foo
             assert_equal {zset foo 0} [$rd read]
         }
-        r config set zset-max-ziplist-entries $original_max_entries
-        r config set zset-max-ziplist-value $original_max_value
+        r config set zset-max-listpack-entries $original_max_entries
+        r config set zset-max-listpack-value $original_max_value
     }
 
     tags {"slow"} {
-        stressers ziplist
+        stressers listpack
         stressers skiplist
+
+        set original_btree_min [lindex [r config get zset-btree-min-entries] 1]
+        r config set zset-btree-min-entries 1
+        stressers skiplist
+        r config set zset-btree-min-entries $original_btree_min
     }
 
     test {ZSET skiplist order consistency when elements are moved} {
-        set original_max [lindex [r config get zset-max-ziplist-entries] 1]
-        r config set zset-max-ziplist-entries 0
+        set original_max [lindex [r config get zset-max-listpack-entries] 1]
+        r config set zset-max-listpack-entries 0
         for {set times 0} {$times < 10} {incr times} {
             r del zset
             for {set j 0} {$j < 1000} {incr j} {
@@ -1550,7 +1561,96 @@ start_server {tags {"zset"}} {
                 set prev_score $score
             }
         }
-        r config set zset-max-ziplist-entries $original_max
+        r config set zset-max-listpack-entries $original_max
+    }
+
+    test {ZSET skiplist converted to B+tree index keeps order and ranks} {
+        set original_max [lindex [r config get zset-max-listpack-entries] 1]
+        set original_btree_min [lindex [r config get zset-btree-min-entries] 1]
+        r config set zset-max-listpack-entries 0
+        r config set zset-btree-min-entries 100
+        r del zset
+        set expected {}
+        for {set j 0} {$j < 1000} {incr j} {
+            set score [randomInt 200]
+            r zadd zset $score ele-$j
+            lappend expected [list $score ele-$j]
+        }
+        set expected [lsort -command {apply {{a b} {
+            set d [expr {[lindex $a 0] - [lindex $b 0]}]
+            if {$d != 0} {return $d}
+            string compare [lindex $a 1] [lindex $b 1]
+        }}} $expected]
+        set elements {}
+        foreach item $expected {lappend elements [lindex $item 1]}
+        assert_equal $elements [r zrange zset 0 -1]
+        assert_equal [lreverse $elements] [r zrevrange zset 0 -1]
+        foreach rank {0 1 99 500 998 999} {
+            assert_equal $rank [r zrank zset [lindex $elements $rank]]
+        }
+
+        # Cross-check range removals and a reload against a skiplist copy.
+        r zremrangebyscore zset 50 (60
+        r zremrangebyrank zset 10 20
+        r config set zset-btree-min-entries 0
+        r zunionstore zcopy 1 zset
+        r config set zset-btree-min-entries 100
+        assert_equal [r zrange zcopy 0 -1 withscores] [r zrange zset 0 -1 withscores]
+        r debug reload
+        assert_equal [r zrange zcopy 0 -1 withscores] [r zrange zset 0 -1 withscores]
+        assert_equal [r zrangebyscore zcopy 10 (150 limit 5 40] [r zrangebyscore zset 10 (150 limit 5 40]
+        assert_equal [r debug digest-value zcopy] [r debug digest-value zset]
+
+        r config set zset-max-listpack-entries $original_max
+        r config set zset-btree-min-entries $original_btree_min
+    } {OK} {needs:debug}
+
+    test {ZUNIONSTORE / ZINTERSTORE with parallel-ops-threads return the serial result} {
+        r del z1 z2 s1 s2
+        for {set j 0} {$j < 2000} {incr j} {
+            r zadd z1 [expr {[randomInt 1000] / 10.0}] [randomInt 3000]
+        }
+        for {set j 0} {$j < 100} {incr j} {
+            r zadd z2 [randomInt 50] [randomInt 3000]
+        }
+        for {set j 0} {$j < 300} {incr j} {
+            r sadd s1 [randomInt 3000]
+        }
+        for {set j 0} {$j < 1000} {incr j} {
+            r sadd s2 [randomInt 3000] e[randomInt 100]
+        }
+        assert_encoding skiplist z1
+        assert_encoding listpack z2
+        assert_encoding intset s1
+        assert_encoding hashtable s2
+
+        set cmds {
+            {zunionstore dst 4 z1 z2 s1 s2 weights 1 2 3 4}
+            {zunionstore dst 3 z1 z2 s2 aggregate min}
+            {zunionstore dst 2 z1 z1 aggregate max}
+            {zinterstore dst 2 z1 s2}
+            {zinterstore dst 3 z1 z2 s1 weights 2 1 -1 aggregate max}
+            {zinterstore dst 2 s2 s2}
+        }
+        set serial {}
+        foreach cmd $cmds {
+            lappend serial [r {*}$cmd] [r zrange dst 0 -1 withscores]
+        }
+        lappend serial [r zunion 3 z1 s1 s2 withscores] [r zinter 2 z1 z1 withscores]
+
+        r config set parallel-ops-threads 4
+        r config set parallel-zset-min-elements 1
+        set before [s parallel_zset_ops]
+        set parallel {}
+        foreach cmd $cmds {
+            lappend parallel [r {*}$cmd] [r zrange dst 0 -1 withscores]
+        }
+        lappend parallel [r zunion 3 z1 s1 s2 withscores] [r zinter 2 z1 z1 withscores]
+        assert_equal $serial $parallel
+        assert_equal [expr {$before + [llength $cmds] + 2}] [s parallel_zset_ops]
+
+        r config set parallel-ops-threads 1
+        r config set parallel-zset-min-elements 100000
     }
 
     test {ZRANGESTORE basic} {
@@ -1643,25 +1743,25 @@ start_server {tags {"zset"}} {
         assert_match "*syntax*" $err
     }
 
-    test {ZRANGESTORE with zset-max-ziplist-entries 0 #10767 case} {
-        set original_max [lindex [r config get zset-max-ziplist-entries] 1]
-        r config set zset-max-ziplist-entries 0
+    test {ZRANGESTORE with zset-max-listpack-entries 0 #10767 case} {
+        set original_max [lindex [r config get zset-max-listpack-entries] 1]
+        r config set zset-max-listpack-entries 0
         r del z1{t} z2{t}
         r zadd z1{t} 1 a
         assert_equal 1 [r zrangestore z2{t} z1{t} 0 -1]
-        r config set zset-max-ziplist-entries $original_max
+        r config set zset-max-listpack-entries $original_max
     }
 
-    test {ZRANGESTORE with zset-max-ziplist-entries 1 dst key should use skiplist encoding} {
-        set original_max [lindex [r config get zset-max-ziplist-entries] 1]
-        r config set zset-max-ziplist-entries 1
+    test {ZRANGESTORE with zset-max-listpack-entries 1 dst key should use skiplist encoding} {
+        set original_max [lindex [r config get zset-max-listpack-entries] 1]
+        r config set zset-max-listpack-entries 1
         r del z1{t} z2{t} z3{t}
         r zadd z1{t} 1 a 2 b
         assert_equal 1 [r zrangestore z2{t} z1{t} 0 0]
-        assert_encoding ziplist z2{t}
+        assert_encoding listpack z2{t}
         assert_equal 2 [r zrangestore z3{t} z1{t} 0 1]
         assert_encoding skiplist z3{t}
-        r config set zset-max-ziplist-entries $original_max
+        r config set zset-max-listpack-entries $original_max
     }
 
     test {ZRANGE invalid syntax} {
@@ -1697,9 +1797,9 @@ start_server {tags {"zset"}} {
         }
     }
 
-    foreach {type contents} "ziplist {1 a 2 b 3 c} skiplist {1 a 2 b 3 [randstring 70 90 alpha]}" {
-        set original_max_value [lindex [r config get zset-max-ziplist-value] 1]
-        r config set zset-max-ziplist-value 10
+    foreach {type contents} "listpack {1 a 2 b 3 c} skiplist {1 a 2 b 3 [randstring 70 90 alpha]}" {
+        set original_max_value [lindex [r config get zset-max-listpack-value] 1]
+        r config set zset-max-listpack-value 10
         create_zset myzset $contents
         assert_encoding $type myzset
 
@@ -1712,7 +1812,7 @@ start_server {tags {"zset"}} {
             }
             assert_equal [lsort [get_keys $contents]] [lsort [array names myzset]]
         }
-        r config set zset-max-ziplist-value $original_max_value
+        r config set zset-max-listpack-value $original_max_value
     }
 
     test "ZRANDMEMBER with RESP3" {
@@ -1757,10 +1857,10 @@ start_server {tags {"zset"}} {
 
     foreach {type contents} "
         skiplist {1 a 2 b 3 c 4 d 5 e 6 f 7 g 7 h 9 i 10 [randstring 70 90 alpha]}
-        ziplist {1 a 2 b 3 c 4 d 5 e 6 f 7 g 7 h 9 i 10 j} " {
+        listpack {1 a 2 b 3 c 4 d 5 e 6 f 7 g 7 h 9 i 10 j} " {
         test "ZRANDMEMBER with <count> - $type" {
-            set original_max_value [lindex [r config get zset-max-ziplist-value] 1]
-            r config set zset-max-ziplist-value 10
+            set original_max_value [lindex [r config get zset-max-listpack-value] 1]
+            r config set zset-max-listpack-value 10
             create_zset myzset $contents
             assert_encoding $type myzset
 
@@ -1892,7 +1992,7 @@ start_server {tags {"zset"}} {
                 assert_lessthan [chi_square_value $allkey] 40
             }
         }
-        r config set zset-max-ziplist-value $original_max_value
+        r config set zset-max-listpack-value $original_max_value
     }
 
 }
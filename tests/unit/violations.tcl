@@ -80,7 +80,7 @@ start_server [list overrides [list save ""] ] {
 # This reproduces the overflow in the call to ziplistResize
 # Object will be converted to hashtable encoding
 start_server [list overrides [list save ""] ] {
-    r config set hash-max-ziplist-value 1000000000 ;#1gb
+    r config set hash-max-listpack-value 1000000000 ;#1gb
     test {hash with many big fields} {
         for {set j 0} {$j<10} {incr j} {
             r hset h $j $::str500
@@ -93,7 +93,7 @@ start_server [list overrides [list save ""] ] {
 # Object will be converted to hashtable encoding
 start_server [list overrides [list save ""] ] {
     test {hash with one huge field} {
-        catch {r config set hash-max-ziplist-value 10000000000} ;#10gb
+        catch {r config set hash-max-listpack-value 10000000000} ;#10gb
         r config set proto-max-bulk-len 10000000000 ;#10gb
         r config set client-query-buffer-limit 10000000000 ;#10gb
         r write "*4\r\n\$4\r\nHSET\r\n\$2\r\nH1\r\n"
@@ -0,0 +1,64 @@
+#!/usr/bin/env tclsh8.5
+# Throughput of a list used as a queue (variadic LPUSH batches consumed with
+# RPOP <count>) with the quicklist node pool disabled and enabled. Run it from
+# the utils directory against a running server (the keys used are deleted at
+# the end):
+#
+#   ./list-queue-bench.tcl [host] [port] [batch] [elements] [pool-nodes]
+#
+# Released under the BSD license like Redis itself
+
+source ../tests/support/redis.tcl
+
+set host [expr {$argc > 0 ? [lindex $argv 0] : "127.0.0.1"}]
+set port [expr {$argc > 1 ? [lindex $argv 1] : 6379}]
+set batch [expr {$argc > 2 ? [lindex $argv 2] : 100}]
+set elements [expr {$argc > 3 ? [lindex $argv 3] : 1000000}]
+set poolnodes [expr {$argc > 4 ? [lindex $argv 4] : 10000}]
+
+# Sum a field of the numa_quicklist_pool_nodeN lines of INFO numa.
+proc pool_stat {r field} {
+    set total 0
+    foreach {- value} [regexp -all -inline "numa_quicklist_pool_node\\d+:\[^\r\n\]*$field=(\\d+)" [$r info numa]] {
+        incr total $value
+    }
+    return $total
+}
+
+# Push 'elements' values in LPUSH batches of 'batch' to 'depth' queues,
+# popping each batch back once every queue got one, so the queues keep
+# creating and emptying nodes. Returns the elements per second.
+proc run {r batch elements depth} {
+    set values {}
+    for {set i 0} {$i < $batch} {incr i} {lappend values "job:$i:[string repeat x 32]"}
+    set start [clock microseconds]
+    for {set done 0} {$done < $elements} {incr done [expr {$batch * $depth}]} {
+        for {set q 0} {$q < $depth} {incr q} {$r lpush qb:$q {*}$values}
+        for {set q 0} {$q < $depth} {incr q} {$r rpop qb:$q $batch}
+    }
+    set elapsed [expr {([clock microseconds] - $start) / 1000000.0}]
+    expr {$elements / $elapsed}
+}
+
+set r [redis $host $port]
+# Send each batch with one write: split writes wait for the delayed ACK.
+fconfigure [$r channel] -buffersize 1048576
+set saved [lindex [$r config get numa-quicklist-pool-nodes] 1]
+set queues {}
+for {set q 0} {$q < 16} {incr q} {lappend queues qb:$q}
+
+puts [format "%-18s %16s %16s %12s" "" "pool off (el/s)" "pool on (el/s)" "pool hits"]
+foreach depth {1 16} {
+    $r del {*}$queues
+    $r config set numa-quicklist-pool-nodes 0
+    set off [run $r $batch $elements $depth]
+    $r config set numa-quicklist-pool-nodes $poolnodes
+    set hits [pool_stat $r hits]
+    set on [run $r $batch $elements $depth]
+    puts [format "%-18s %16.0f %16.0f %12d" "$depth queue(s)" $off $on \
+        [expr {[pool_stat $r hits] - $hits}]]
+}
+
+$r config set numa-quicklist-pool-nodes $saved
+$r del {*}$queues
+$r close
@@ -0,0 +1,84 @@
+#!/usr/bin/env tclsh8.5
+# Latency of big SORT / ZUNIONSTORE / ZINTERSTORE commands with the parallel
+# ops threads disabled and enabled. Run it from the utils directory against
+# a running server (the keys used are deleted at the end):
+#
+#   ./parallel-ops-bench.tcl [host] [port] [elements] [threads] [runs]
+#
+# Released under the BSD license like Redis itself
+
+source ../tests/support/redis.tcl
+
+set host [expr {$argc > 0 ? [lindex $argv 0] : "127.0.0.1"}]
+set port [expr {$argc > 1 ? [lindex $argv 1] : 6379}]
+set elements [expr {$argc > 2 ? [lindex $argv 2] : 1000000}]
+set threads [expr {$argc > 3 ? [lindex $argv 3] : 4}]
+set runs [expr {$argc > 4 ? [lindex $argv 4] : 5}]
+
+set ::benchmarks {
+    "SORT LIMIT 0 10"       {sort pb:list limit 0 10}
+    "SORT DESC LIMIT 0 10"  {sort pb:list desc limit 0 10}
+    "SORT ALPHA LIMIT 0 10" {sort pb:list alpha limit 0 10}
+    "ZUNIONSTORE 2 keys"    {zunionstore pb:dst 2 pb:z1 pb:z2}
+    "ZUNIONSTORE WEIGHTS"   {zunionstore pb:dst 2 pb:z1 pb:z2 weights 1 2 aggregate max}
+    "ZINTERSTORE 2 keys"    {zinterstore pb:dst 2 pb:z1 pb:z2}
+}
+
+# Create the inputs server side: a list of random integers, and two sorted
+# sets sharing half of their elements.
+proc fill {r n} {
+    set chunk 50000
+    for {set i 0} {$i < $n} {incr i $chunk} {
+        $r eval {
+            for i = tonumber(ARGV[1]), tonumber(ARGV[2]) - 1 do
+                redis.call('rpush', 'pb:list', math.random(1000000000))
+                redis.call('zadd', 'pb:z1', math.random(), 'e' .. i)
+                if i % 2 == 0 then
+                    redis.call('zadd', 'pb:z2', math.random(), 'e' .. i)
+                else
+                    redis.call('zadd', 'pb:z2', math.random(), 'f' .. i)
+                end
+            end
+        } 0 $i [expr {min($i + $chunk, $n)}]
+    }
+}
+
+# Return the min and average milliseconds of 'runs' executions of cmd.
+proc measure {r cmd runs} {
+    set min {}
+    set total 0
+    for {set j 0} {$j < $runs} {incr j} {
+        set start [clock microseconds]
+        $r {*}$cmd
+        set elapsed [expr {([clock microseconds] - $start) / 1000.0}]
+        if {$min eq {} || $elapsed < $min} {set min $elapsed}
+        set total [expr {$total + $elapsed}]
+    }
+    list $min [expr {$total / $runs}]
+}
+
+set r [redis $host $port]
+set saved {}
+foreach param {parallel-ops-threads parallel-sort-min-elements parallel-zset-min-elements} {
+    lappend saved $param [lindex [$r config get $param] 1]
+}
+
+puts "Creating inputs of $elements elements..."
+$r del pb:list pb:z1 pb:z2 pb:dst
+fill $r $elements
+$r config set parallel-sort-min-elements 2
+$r config set parallel-zset-min-elements 1
+
+puts [format "%-24s %20s %20s %8s" "" "1 thread (min/avg)" "$threads threads (min/avg)" "speedup"]
+foreach {name cmd} $::benchmarks {
+    $r config set parallel-ops-threads 1
+    lassign [measure $r $cmd $runs] smin savg
+    $r config set parallel-ops-threads $threads
+    lassign [measure $r $cmd $runs] pmin pavg
+    puts [format "%-24s %9.1f/%8.1f ms %9.1f/%8.1f ms %7.2fx" \
+        $name $smin $savg $pmin $pavg [expr {$smin / $pmin}]]
+}
+
+foreach {param value} $saved {$r config set $param $value}
+$r del pb:list pb:z1 pb:z2 pb:dst
+$r close